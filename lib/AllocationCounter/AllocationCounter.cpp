@@ -0,0 +1,137 @@
+#include "AllocationCounter.h"
+#include <stdlib.h>
+
+#ifdef ESP32
+#include <Arduino.h>
+
+static volatile TaskHandle_t trackedTask = nullptr;
+static volatile uint32_t allocations = 0;
+static volatile uint32_t frees = 0;
+
+static inline void noteAllocation()
+{
+    if (trackedTask && xTaskGetCurrentTaskHandle() == trackedTask)
+    {
+        allocations++; // Only the tracked task writes
+    }
+}
+
+static inline void noteFree(void *pointer)
+{
+    if (pointer && trackedTask && xTaskGetCurrentTaskHandle() == trackedTask)
+    {
+        frees++;
+    }
+}
+
+extern "C"
+{
+    void *__real_malloc(size_t size);
+    void *__real_calloc(size_t count, size_t size);
+    void *__real_realloc(void *pointer, size_t size);
+    void __real_free(void *pointer);
+
+    void *__wrap_malloc(size_t size)
+    {
+        noteAllocation();
+        return __real_malloc(size);
+    }
+
+    void *__wrap_calloc(size_t count, size_t size)
+    {
+        noteAllocation();
+        return __real_calloc(count, size);
+    }
+
+    void *__wrap_realloc(void *pointer, size_t size)
+    {
+        noteAllocation(); // String growth and shrink both count
+        return __real_realloc(pointer, size);
+    }
+
+    void __wrap_free(void *pointer)
+    {
+        noteFree(pointer);
+        __real_free(pointer);
+    }
+}
+
+void AllocationCounter::track()
+{
+    allocations = 0;
+    frees = 0;
+    trackedTask = xTaskGetCurrentTaskHandle();
+}
+
+#else
+#include <atomic>
+#include <new>
+#include <thread>
+
+static std::atomic<bool> tracking(false);
+static std::thread::id trackedThread;
+static std::atomic<uint32_t> allocations(0);
+static std::atomic<uint32_t> frees(0);
+
+static inline bool isTracked()
+{
+    return tracking.load(std::memory_order_acquire) && std::this_thread::get_id() == trackedThread;
+}
+
+static inline void noteAllocation()
+{
+    if (isTracked())
+    {
+        allocations++;
+    }
+}
+
+void *operator new(size_t size)
+{
+    noteAllocation();
+    void *pointer = malloc(size ? size : 1);
+    if (!pointer)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    if (pointer && isTracked())
+    {
+        frees++;
+    }
+    free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    operator delete(pointer);
+}
+
+void AllocationCounter::track()
+{
+    allocations = 0;
+    frees = 0;
+    trackedThread = std::this_thread::get_id();
+    tracking.store(true, std::memory_order_release);
+}
+
+#endif
+
+uint32_t AllocationCounter::getCount()
+{
+    return allocations;
+}
+
+uint32_t AllocationCounter::getFrees()
+{
+    return frees;
+}
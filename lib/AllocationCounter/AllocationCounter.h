@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+// Counts heap allocations and frees made by one task, to prove a code path is
+// heap-free and to show allocation churn.
+//
+// On the ESP32 the linker routes malloc, calloc, realloc and free through this
+// library (-Wl,--wrap in platformio.ini), which catches Arduino String and
+// operator new as well. On the host global operator new and delete are
+// replaced, which is what std::string and the host String use. Allocations by
+// other tasks, such as HomeSpan or the WiFi stack, are not counted.
+class AllocationCounter
+{
+public:
+    static void track();        // Count allocations by the calling task from now on
+    static uint32_t getCount(); // Since track()
+    static uint32_t getFrees(); // Since track()
+};
@@ -0,0 +1,95 @@
+#include "BootProfiler.h"
+#include <stdio.h>
+#include <string.h>
+
+bool BootProfiler::mark(const char *phase, uint32_t nowMicros)
+{
+    if (phaseCount >= MAX_PHASES)
+    {
+        return false;
+    }
+    phases[phaseCount].name = phase;
+    phases[phaseCount].endMicros = nowMicros;
+    phaseCount++;
+    return true;
+}
+
+uint32_t BootProfiler::getPhaseDuration(uint8_t index) const
+{
+    if (index >= phaseCount)
+    {
+        return 0;
+    }
+    uint32_t start = index == 0 ? 0 : phases[index - 1].endMicros;
+    return phases[index].endMicros - start;
+}
+
+int BootProfiler::findPhase(const char *name) const
+{
+    for (uint8_t i = 0; i < phaseCount; i++)
+    {
+        if (strcmp(phases[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+uint8_t BootProfiler::countOverBudget(const BootPhaseBudget *budgets, uint8_t budgetCount) const
+{
+    uint8_t over = 0;
+    for (uint8_t i = 0; i < phaseCount; i++)
+    {
+        const BootPhaseBudget *budget = findBudget(phases[i].name, budgets, budgetCount);
+        if (budget && getPhaseDuration(i) > budget->budgetMs * 1000)
+        {
+            over++;
+        }
+    }
+    return over;
+}
+
+size_t BootProfiler::format(char *buffer, size_t size, const BootPhaseBudget *budgets, uint8_t budgetCount) const
+{
+    size_t length = 0;
+    if (size > 0)
+    {
+        buffer[0] = '\0';
+    }
+    for (uint8_t i = 0; i < phaseCount && length < size; i++)
+    {
+        uint32_t duration = getPhaseDuration(i);
+        const BootPhaseBudget *budget = findBudget(phases[i].name, budgets, budgetCount);
+        int written;
+        if (budget)
+        {
+            written = snprintf(buffer + length, size - length, "%-12s %7.1f ms  @%7.1f ms  budget %u ms%s\n",
+                               phases[i].name, duration / 1000.0, phases[i].endMicros / 1000.0,
+                               (unsigned)budget->budgetMs, duration > budget->budgetMs * 1000 ? "  OVER" : "");
+        }
+        else
+        {
+            written = snprintf(buffer + length, size - length, "%-12s %7.1f ms  @%7.1f ms\n",
+                               phases[i].name, duration / 1000.0, phases[i].endMicros / 1000.0);
+        }
+        if (written < 0)
+        {
+            break;
+        }
+        length += (size_t)written;
+    }
+    return length < size ? length : size - 1;
+}
+
+const BootPhaseBudget *BootProfiler::findBudget(const char *name, const BootPhaseBudget *budgets, uint8_t budgetCount)
+{
+    for (uint8_t i = 0; budgets && i < budgetCount; i++)
+    {
+        if (strcmp(budgets[i].name, name) == 0)
+        {
+            return &budgets[i];
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct BootPhaseBudget
+{
+    const char *name;
+    uint32_t budgetMs;
+};
+
+// Time-to-first-dashboard target and the per-phase budgets that make it up.
+// Only checked at runtime: the boot report flags phases over budget and a
+// first frame over the target. No recorded device profile is tested.
+static const uint32_t BOOT_TARGET_FIRST_FRAME_MS = 1500;
+static const BootPhaseBudget BOOT_PHASE_BUDGETS[] = {
+    {"serial", 20},
+    {"oled", 150},
+    {"gpio", 10},
+    {"restore", 200},
+    {"sensors", 60},
+    {"homespan", 900},
+    {"first_frame", 160}};
+static const uint8_t BOOT_PHASE_BUDGET_COUNT = sizeof(BOOT_PHASE_BUDGETS) / sizeof(BOOT_PHASE_BUDGETS[0]);
+
+// Records when each boot phase ends. A phase runs from the previous mark
+// (or from boot) to its own mark. Times are microseconds since boot, as
+// from esp_timer_get_time(). Phase names must be string literals.
+class BootProfiler
+{
+public:
+    static const uint8_t MAX_PHASES = 12;
+
+    BootProfiler() : phaseCount(0) {}
+
+    // False once MAX_PHASES are recorded
+    bool mark(const char *phase, uint32_t nowMicros);
+
+    uint8_t getPhaseCount() const { return phaseCount; }
+    const char *getPhaseName(uint8_t index) const { return index < phaseCount ? phases[index].name : ""; }
+    uint32_t getPhaseEnd(uint8_t index) const { return index < phaseCount ? phases[index].endMicros : 0; }
+    uint32_t getPhaseDuration(uint8_t index) const;
+    int findPhase(const char *name) const;
+
+    // Time from boot to the end of the last phase
+    uint32_t getTotalMicros() const { return phaseCount ? phases[phaseCount - 1].endMicros : 0; }
+
+    // Number of recorded phases over their budget; unbudgeted phases never count
+    uint8_t countOverBudget(const BootPhaseBudget *budgets, uint8_t budgetCount) const;
+
+    // One line per phase: "name  duration  end  [budget]"; returns length written
+    size_t format(char *buffer, size_t size, const BootPhaseBudget *budgets = nullptr, uint8_t budgetCount = 0) const;
+
+private:
+    struct Phase
+    {
+        const char *name;
+        uint32_t endMicros;
+    };
+
+    Phase phases[MAX_PHASES];
+    uint8_t phaseCount;
+
+    static const BootPhaseBudget *findBudget(const char *name, const BootPhaseBudget *budgets, uint8_t budgetCount);
+};
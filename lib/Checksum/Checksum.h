@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3, reflected, as used by zlib) for persisted records.
+// Uses a 16-entry nibble table so it costs 64 bytes of flash instead of 1 KB.
+uint32_t crc32Update(uint32_t crc, const void *data, size_t length);
+
+inline uint32_t crc32(const void *data, size_t length)
+{
+    return crc32Update(0, data, length);
+}
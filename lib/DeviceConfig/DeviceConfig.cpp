@@ -0,0 +1,250 @@
+#include "DeviceConfig.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Checksum.h"
+
+static const uint32_t CONFIG_MAGIC = 0x47464344; // "DCFG"
+static const size_t CONFIG_HEADER_SIZE = 16;
+static const char *const CONFIG_KEY = "config";
+static const char *const DEFAULT_SETUP_CODE = "46637726"; // HomeSpan default
+
+static void copyString(char *destination, size_t size, const char *source)
+{
+    snprintf(destination, size, "%s", source);
+}
+
+// Whole-hour UTC offset as a POSIX TZ string; POSIX signs are inverted
+static void formatTimezone(char *timezone, size_t size, int hours)
+{
+    if (hours == 0)
+    {
+        copyString(timezone, size, "UTC0");
+    }
+    else
+    {
+        snprintf(timezone, size, "<%+03d>%d", hours, -hours);
+    }
+}
+
+void setDeviceConfigDefaults(DeviceConfig &config)
+{
+    memset(&config, 0, sizeof(config));
+    copyString(config.deviceName, sizeof(config.deviceName), "RO Monitor");
+    copyString(config.setupCode, sizeof(config.setupCode), DEFAULT_SETUP_CODE);
+    copyString(config.ntpServer, sizeof(config.ntpServer), "pool.ntp.org");
+    copyString(config.timezone, sizeof(config.timezone), "UTC0");
+
+    config.i2cSdaPin = 21;
+    config.i2cSclPin = 22;
+    config.buttonLeftPin = 4;
+    config.buttonRightPin = 5;
+    config.flowPins[0] = 26;
+    config.flowPins[1] = 27;
+    config.flowPins[2] = 25;
+    config.powerFailPin = PIN_NOT_FITTED; // GPIO 34 on boards with a comparator; it has no pull-up
+    config.tdsInletAdcChannel = 4;  // GPIO 32
+    config.tdsOutletAdcChannel = 5; // GPIO 33
+
+    // YF-S201: F = 7.5 * Q (L/min) = 450 pulses per liter
+    config.flowPulsesPerLiter[0] = 450;
+    config.flowPulsesPerLiter[1] = 450;
+    config.flowPulsesPerLiter[2] = 450;
+    config.leakSampleMs = 200;
+    config.tdsOutputIntervalMs = 1000;
+    config.screenIntervalMs = 8000;
+    config.statusIntervalMs = 60000;
+    config.rollupCheckpointMs = 3600000;
+
+    config.leakMaxContinuousFlowMin = 10;
+    config.leakMaxRateMlPerMin = 4000;
+    config.quietStartHour = 1;
+    config.quietEndHour = 5;
+
+    // A HAP pair-verify or a new session needs a few contiguous KB
+    config.heapSampleMs = 5000;
+    config.heapWarnLargestBlock = 16384;
+    config.heapWarnFragmentationPercent = 60;
+
+    // Mains dips recover within seconds; longer means a stuck or floating input
+    config.powerFailMaxPauseMs = 10000;
+}
+
+// Repair anything a damaged or hand-edited record could break
+static void sanitize(DeviceConfig &config)
+{
+    DeviceConfig defaults;
+    setDeviceConfigDefaults(defaults);
+
+    config.deviceName[sizeof(config.deviceName) - 1] = '\0';
+    config.ntpServer[sizeof(config.ntpServer) - 1] = '\0';
+    config.timezone[sizeof(config.timezone) - 1] = '\0';
+    config.setupCode[sizeof(config.setupCode) - 1] = '\0';
+    bool digits = strlen(config.setupCode) == 8;
+    for (int i = 0; digits && i < 8; i++)
+    {
+        digits = config.setupCode[i] >= '0' && config.setupCode[i] <= '9';
+    }
+    if (!digits)
+    {
+        copyString(config.setupCode, sizeof(config.setupCode), DEFAULT_SETUP_CODE);
+    }
+
+    if (config.leakSampleMs == 0)
+        config.leakSampleMs = defaults.leakSampleMs;
+    if (config.tdsOutputIntervalMs == 0)
+        config.tdsOutputIntervalMs = defaults.tdsOutputIntervalMs;
+    if (config.screenIntervalMs == 0)
+        config.screenIntervalMs = defaults.screenIntervalMs;
+    if (config.statusIntervalMs == 0)
+        config.statusIntervalMs = defaults.statusIntervalMs;
+    if (config.rollupCheckpointMs == 0)
+        config.rollupCheckpointMs = defaults.rollupCheckpointMs;
+    if (config.heapSampleMs == 0)
+        config.heapSampleMs = defaults.heapSampleMs;
+    if (config.heapWarnFragmentationPercent > 100)
+        config.heapWarnFragmentationPercent = defaults.heapWarnFragmentationPercent;
+    if (config.powerFailPin > 39)
+        config.powerFailPin = PIN_NOT_FITTED;
+    if (config.powerFailMaxPauseMs == 0)
+        config.powerFailMaxPauseMs = defaults.powerFailMaxPauseMs;
+}
+
+static void migrateV1(const DeviceConfigV1 &old, DeviceConfig &config)
+{
+    setDeviceConfigDefaults(config);
+    copyString(config.deviceName, sizeof(config.deviceName), old.deviceName);
+    copyString(config.setupCode, sizeof(config.setupCode), old.setupCode);
+    copyString(config.ntpServer, sizeof(config.ntpServer), old.ntpServer);
+    formatTimezone(config.timezone, sizeof(config.timezone), old.timezoneHours);
+    for (int i = 0; i < 3; i++)
+    {
+        config.flowPulsesPerLiter[i] = old.flowPulsesPerLiter;
+    }
+    config.screenIntervalMs = old.screenIntervalMs;
+}
+
+size_t encodeConfigRecord(uint16_t version, uint16_t compatVersion, const void *body, uint16_t bodyLength,
+                          uint8_t *buffer, size_t bufferSize)
+{
+    if (bufferSize < CONFIG_HEADER_SIZE + bodyLength)
+    {
+        return 0;
+    }
+    uint16_t reserved = 0;
+    memcpy(buffer, &CONFIG_MAGIC, 4);
+    memcpy(buffer + 4, &version, 2);
+    memcpy(buffer + 6, &compatVersion, 2);
+    memcpy(buffer + 8, &bodyLength, 2);
+    memcpy(buffer + 10, &reserved, 2);
+    memcpy(buffer + CONFIG_HEADER_SIZE, body, bodyLength);
+    uint32_t crc = crc32Update(crc32(buffer, 12), body, bodyLength);
+    memcpy(buffer + 12, &crc, 4);
+    return CONFIG_HEADER_SIZE + bodyLength;
+}
+
+ConfigLoadResult decodeDeviceConfig(const uint8_t *record, size_t length, DeviceConfig &config)
+{
+    setDeviceConfigDefaults(config);
+    if (length < CONFIG_HEADER_SIZE)
+    {
+        return length == 0 ? CONFIG_MISSING : CONFIG_INVALID;
+    }
+
+    uint32_t magic;
+    uint16_t version;
+    uint16_t compatVersion;
+    uint16_t bodyLength;
+    uint32_t crc;
+    memcpy(&magic, record, 4);
+    memcpy(&version, record + 4, 2);
+    memcpy(&compatVersion, record + 6, 2);
+    memcpy(&bodyLength, record + 8, 2);
+    memcpy(&crc, record + 12, 4);
+    if (magic != CONFIG_MAGIC || CONFIG_HEADER_SIZE + bodyLength > length ||
+        crc != crc32Update(crc32(record, 12), record + CONFIG_HEADER_SIZE, bodyLength))
+    {
+        return CONFIG_INVALID;
+    }
+
+    const uint8_t *body = record + CONFIG_HEADER_SIZE;
+    ConfigLoadResult result;
+    if (version == DEVICE_CONFIG_VERSION && bodyLength == sizeof(DeviceConfig))
+    {
+        memcpy(&config, body, sizeof(DeviceConfig));
+        result = CONFIG_LOADED;
+    }
+    else if (version == 1 && bodyLength == sizeof(DeviceConfigV1))
+    {
+        DeviceConfigV1 old;
+        memcpy(&old, body, sizeof(old));
+        migrateV1(old, config);
+        result = CONFIG_MIGRATED;
+    }
+    else if (version > DEVICE_CONFIG_VERSION && compatVersion <= DEVICE_CONFIG_VERSION &&
+             bodyLength >= sizeof(DeviceConfig))
+    {
+        memcpy(&config, body, sizeof(DeviceConfig));
+        result = CONFIG_NEWER;
+    }
+    else
+    {
+        return CONFIG_INVALID;
+    }
+
+    sanitize(config);
+    return result;
+}
+
+ConfigLoadResult loadDeviceConfig(KeyValueStore &store, DeviceConfig &config)
+{
+    uint8_t record[DEVICE_CONFIG_MAX_RECORD];
+    size_t length = store.read(CONFIG_KEY, record, sizeof(record));
+    return decodeDeviceConfig(record, length, config);
+}
+
+bool saveDeviceConfig(KeyValueStore &store, const DeviceConfig &config)
+{
+    uint8_t record[CONFIG_HEADER_SIZE + sizeof(DeviceConfig)];
+    size_t length = encodeConfigRecord(DEVICE_CONFIG_VERSION, DEVICE_CONFIG_VERSION, &config, sizeof(DeviceConfig),
+                                       record, sizeof(record));
+    return length > 0 && store.write(CONFIG_KEY, record, length);
+}
+
+void applyLegacySettings(DeviceConfig &config, const char *deviceName, const char *ntpServer,
+                         const char *timezoneHours)
+{
+    if (deviceName && deviceName[0])
+    {
+        copyString(config.deviceName, sizeof(config.deviceName), deviceName);
+    }
+    if (ntpServer && ntpServer[0])
+    {
+        copyString(config.ntpServer, sizeof(config.ntpServer), ntpServer);
+    }
+    if (timezoneHours && timezoneHours[0])
+    {
+        long hours = strtol(timezoneHours, nullptr, 10);
+        if (hours >= -12 && hours <= 14)
+        {
+            formatTimezone(config.timezone, sizeof(config.timezone), (int)hours);
+        }
+    }
+}
+
+const char *configLoadResultName(ConfigLoadResult result)
+{
+    switch (result)
+    {
+    case CONFIG_LOADED:
+        return "loaded";
+    case CONFIG_MIGRATED:
+        return "migrated";
+    case CONFIG_NEWER:
+        return "newer version";
+    case CONFIG_MISSING:
+        return "defaults";
+    default:
+        return "invalid, defaults";
+    }
+}
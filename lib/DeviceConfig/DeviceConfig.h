@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "KeyValueStore.h"
+
+// Versions 2 and 3 were development layouts that never shipped; version 4
+// holds all of their fields, and only version 1 is migrated.
+static const uint16_t DEVICE_CONFIG_VERSION = 4;
+static const uint8_t PIN_NOT_FITTED = 0xFF; // Optional input with nothing connected
+static const size_t DEVICE_CONFIG_MAX_RECORD = 512; // Room for newer firmware's records
+
+#pragma pack(push, 1)
+
+// Version 1 layout, only read to migrate it
+struct DeviceConfigV1
+{
+    char deviceName[24];
+    char setupCode[9];
+    char ntpServer[40];
+    int8_t timezoneHours;
+    uint16_t flowPulsesPerLiter; // One calibration for every channel
+    uint32_t screenIntervalMs;
+};
+
+// Current layout. Fields are only ever appended, so a newer record whose
+// compatVersion allows it can be read by taking the prefix this firmware knows.
+struct DeviceConfig
+{
+    // Identity and network
+    char deviceName[24];
+    char setupCode[9]; // HomeKit pairing code, 8 digits
+    char ntpServer[40];
+    char timezone[40]; // POSIX TZ, e.g. "CET-1CEST,M3.5.0,M10.5.0/3"
+
+    // Pins (GPIO numbers) and ADC1 channels
+    uint8_t i2cSdaPin;
+    uint8_t i2cSclPin;
+    uint8_t buttonLeftPin;
+    uint8_t buttonRightPin;
+    uint8_t flowPins[3]; // Inlet, permeate, brine
+    uint8_t powerFailPin; // Supply comparator output, PIN_NOT_FITTED = none
+    uint8_t tdsInletAdcChannel;
+    uint8_t tdsOutletAdcChannel;
+
+    // Calibration and timing
+    uint16_t flowPulsesPerLiter[3]; // 0 = sensor not fitted
+    uint16_t leakSampleMs;
+    uint16_t tdsOutputIntervalMs;
+    uint32_t screenIntervalMs;
+    uint32_t statusIntervalMs;
+    uint32_t rollupCheckpointMs;
+
+    // Leak thresholds
+    uint16_t leakMaxContinuousFlowMin;
+    uint16_t leakMaxRateMlPerMin;
+    int8_t quietStartHour;
+    int8_t quietEndHour;
+
+    // Heap health: a diagnostic dump when either limit is crossed, 0 = off
+    uint16_t heapSampleMs;
+    uint32_t heapWarnLargestBlock;        // Bytes
+    uint8_t heapWarnFragmentationPercent; // 100 - largest block / free
+
+    // Power fail: longest a low supply pauses routine flash writes
+    uint32_t powerFailMaxPauseMs;
+};
+
+#pragma pack(pop)
+
+enum ConfigLoadResult
+{
+    CONFIG_LOADED,   // Current version
+    CONFIG_MIGRATED, // Older version, upgraded - caller should save it back
+    CONFIG_NEWER,    // Newer but compatible version, known prefix used
+    CONFIG_MISSING,  // Nothing stored, defaults
+    CONFIG_INVALID   // Damaged or incompatible, defaults
+};
+
+void setDeviceConfigDefaults(DeviceConfig &config);
+
+// One read of the "config" key; always leaves a usable config
+ConfigLoadResult loadDeviceConfig(KeyValueStore &store, DeviceConfig &config);
+bool saveDeviceConfig(KeyValueStore &store, const DeviceConfig &config);
+
+// Record framing: magic(4) version(2) compatVersion(2) bodyLength(2) reserved(2) crc(4), body.
+// compatVersion is the oldest firmware version able to read the body's prefix.
+size_t encodeConfigRecord(uint16_t version, uint16_t compatVersion, const void *body, uint16_t bodyLength,
+                          uint8_t *buffer, size_t bufferSize);
+ConfigLoadResult decodeDeviceConfig(const uint8_t *record, size_t length, DeviceConfig &config);
+
+// Import the settings WiFiController used to keep as separate NVS strings
+void applyLegacySettings(DeviceConfig &config, const char *deviceName, const char *ntpServer,
+                         const char *timezoneHours);
+
+const char *configLoadResultName(ConfigLoadResult result);
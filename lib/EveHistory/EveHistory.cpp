@@ -0,0 +1,358 @@
+#include "EveHistory.h"
+#include <string.h>
+
+static const uint32_t CHECKPOINT_MAGIC = 0x54534948; // "HIST"
+static const uint16_t CHECKPOINT_VERSION = 1;
+
+// Checkpoint layout: magic(4) version(2) head(2) nextIndex(4) firstTimestamp(4)
+// lastTimestamp(4), then the first index of every block, then the blocks
+static const size_t CHECKPOINT_HEADER_SIZE = 20;
+
+// Packed codec value: usage in the high bits, filter percent in the low 7
+static const uint32_t FILTER_BITS = 128;
+static const uint32_t MAX_USAGE = 0x7FFFFFFF / FILTER_BITS;
+
+static void writeLE16(uint8_t *out, uint16_t value)
+{
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static void writeLE32(uint8_t *out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t readLE32(const uint8_t *in)
+{
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+HistoryRing::HistoryRing() : encoder(blocks[0], BLOCK_SIZE)
+{
+    clear();
+}
+
+void HistoryRing::clear()
+{
+    memset(blockFirstIndex, 0, sizeof(blockFirstIndex));
+    nextIndex = 1;
+    firstTimestamp = 0;
+    lastTimestamp = 0;
+    startBlock(0);
+}
+
+void HistoryRing::startBlock(int slot)
+{
+    head = slot;
+    blockFirstIndex[slot] = 0; // Drops the oldest block once the ring has wrapped
+    encoder = TimeSeriesEncoder(blocks[slot], BLOCK_SIZE);
+}
+
+bool HistoryRing::append(const HistoryEntry &entry)
+{
+    if (nextIndex > 1 && entry.timestamp < lastTimestamp)
+    {
+        return false;
+    }
+
+    uint32_t usage = entry.usageDeciliters < MAX_USAGE ? entry.usageDeciliters : MAX_USAGE;
+    uint32_t filter = entry.filterPercent < FILTER_BITS ? entry.filterPercent : FILTER_BITS - 1;
+    int32_t value = (int32_t)(usage * FILTER_BITS + filter);
+
+    if (!encoder.append(entry.timestamp, value))
+    {
+        startBlock((head + 1) % BLOCK_COUNT);
+        if (!encoder.append(entry.timestamp, value))
+        {
+            return false;
+        }
+    }
+    if (blockFirstIndex[head] == 0)
+    {
+        blockFirstIndex[head] = nextIndex;
+    }
+    encoder.finish(); // Keep the block decodable after every sample
+
+    if (nextIndex == 1)
+    {
+        firstTimestamp = entry.timestamp;
+    }
+    lastTimestamp = entry.timestamp;
+    nextIndex++;
+    return true;
+}
+
+uint32_t HistoryRing::getFirstIndex() const
+{
+    uint32_t first = 0;
+    for (int i = 0; i < BLOCK_COUNT; i++)
+    {
+        if (blockFirstIndex[i] != 0 && (first == 0 || blockFirstIndex[i] < first))
+        {
+            first = blockFirstIndex[i];
+        }
+    }
+    return first;
+}
+
+int HistoryRing::read(uint32_t index, HistoryEntry *out, int maxEntries) const
+{
+    int copied = 0;
+    while (copied < maxEntries && index < nextIndex)
+    {
+        // Find the block holding this entry
+        int slot = -1;
+        for (int i = 0; i < BLOCK_COUNT; i++)
+        {
+            if (blockFirstIndex[i] != 0 && blockFirstIndex[i] <= index &&
+                (slot < 0 || blockFirstIndex[i] > blockFirstIndex[slot]))
+            {
+                slot = i;
+            }
+        }
+        if (slot < 0)
+        {
+            break; // Older than anything kept
+        }
+
+        TimeSeriesDecoder decoder(blocks[slot], BLOCK_SIZE);
+        uint32_t position = blockFirstIndex[slot];
+        uint32_t timestamp;
+        int32_t value;
+        bool progressed = false;
+        while (copied < maxEntries && decoder.next(timestamp, value))
+        {
+            if (position++ < index)
+            {
+                continue;
+            }
+            out[copied].timestamp = timestamp;
+            out[copied].usageDeciliters = (uint32_t)value / FILTER_BITS;
+            out[copied].filterPercent = (uint8_t)((uint32_t)value % FILTER_BITS);
+            copied++;
+            index++;
+            progressed = true;
+        }
+        if (!progressed)
+        {
+            break; // Corrupt or short block
+        }
+    }
+    return copied;
+}
+
+size_t HistoryRing::getCheckpointSize()
+{
+    return CHECKPOINT_HEADER_SIZE + BLOCK_COUNT * sizeof(uint32_t) + BLOCK_COUNT * BLOCK_SIZE;
+}
+
+size_t HistoryRing::saveCheckpoint(uint8_t *buffer, size_t bufferSize) const
+{
+    if (bufferSize < getCheckpointSize())
+    {
+        return 0;
+    }
+
+    uint16_t headSlot = (uint16_t)head;
+    memcpy(buffer, &CHECKPOINT_MAGIC, 4);
+    memcpy(buffer + 4, &CHECKPOINT_VERSION, 2);
+    memcpy(buffer + 6, &headSlot, 2);
+    memcpy(buffer + 8, &nextIndex, 4);
+    memcpy(buffer + 12, &firstTimestamp, 4);
+    memcpy(buffer + 16, &lastTimestamp, 4);
+    uint8_t *p = buffer + CHECKPOINT_HEADER_SIZE;
+    memcpy(p, blockFirstIndex, sizeof(blockFirstIndex));
+    p += sizeof(blockFirstIndex);
+    memcpy(p, blocks, sizeof(blocks));
+    return getCheckpointSize();
+}
+
+bool HistoryRing::restoreCheckpoint(const uint8_t *buffer, size_t length)
+{
+    if (length != getCheckpointSize())
+    {
+        return false;
+    }
+
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headSlot;
+    memcpy(&magic, buffer, 4);
+    memcpy(&version, buffer + 4, 2);
+    memcpy(&headSlot, buffer + 6, 2);
+    if (magic != CHECKPOINT_MAGIC || version != CHECKPOINT_VERSION || headSlot >= BLOCK_COUNT)
+    {
+        return false;
+    }
+
+    memcpy(&nextIndex, buffer + 8, 4);
+    memcpy(&firstTimestamp, buffer + 12, 4);
+    memcpy(&lastTimestamp, buffer + 16, 4);
+    const uint8_t *p = buffer + CHECKPOINT_HEADER_SIZE;
+    memcpy(blockFirstIndex, p, sizeof(blockFirstIndex));
+    p += sizeof(blockFirstIndex);
+    memcpy(blocks, p, sizeof(blocks));
+
+    // Blocks that fail their CRC are dropped rather than served
+    for (int i = 0; i < BLOCK_COUNT; i++)
+    {
+        if (blockFirstIndex[i] != 0 && !TimeSeriesDecoder(blocks[i], BLOCK_SIZE).isValid())
+        {
+            blockFirstIndex[i] = 0;
+        }
+    }
+
+    // Re-encode the open block so appends continue where it left off
+    uint8_t open[BLOCK_SIZE];
+    memcpy(open, blocks[headSlot], BLOCK_SIZE);
+    uint32_t headFirst = blockFirstIndex[headSlot];
+    startBlock(headSlot);
+    TimeSeriesDecoder decoder(open, BLOCK_SIZE);
+    uint32_t timestamp;
+    int32_t value;
+    while (headFirst != 0 && decoder.next(timestamp, value))
+    {
+        encoder.append(timestamp, value);
+    }
+    if (encoder.getRecordCount() > 0)
+    {
+        blockFirstIndex[headSlot] = headFirst;
+        nextIndex = headFirst + encoder.getRecordCount();
+        encoder.finish();
+    }
+    return true;
+}
+
+EveHistoryServer::EveHistoryServer(const HistoryRing &ring)
+    : ring(ring), cursor(0), sendReference(false), transferring(false)
+{
+}
+
+uint32_t EveHistoryServer::referenceTime() const
+{
+    uint32_t first = ring.getFirstTimestamp();
+    return first > EVE_EPOCH_OFFSET ? first - EVE_EPOCH_OFFSET : 0;
+}
+
+size_t EveHistoryServer::buildStatus(uint8_t *out, size_t capacity) const
+{
+    if (capacity < STATUS_SIZE)
+    {
+        return 0;
+    }
+
+    uint32_t reference = referenceTime();
+    uint32_t last = ring.getLastTimestamp();
+    uint32_t sinceReference = ring.getCount() > 0 && last > EVE_EPOCH_OFFSET ? last - EVE_EPOCH_OFFSET - reference : 0;
+    uint32_t capacityEntries = HistoryRing::BLOCK_COUNT * (HistoryRing::BLOCK_SIZE - TIMESERIES_HEADER_SIZE) / 3;
+
+    size_t n = 0;
+    writeLE32(out + n, sinceReference);
+    n += 4;
+    writeLE32(out + n, 0); // Negative offset, unused
+    n += 4;
+    writeLE32(out + n, reference);
+    n += 4;
+
+    // Signature: field count, then type and size of each field
+    out[n++] = 2;
+    out[n++] = FIELD_USAGE;
+    out[n++] = 2;
+    out[n++] = FIELD_FILTER;
+    out[n++] = 1;
+
+    writeLE16(out + n, (uint16_t)ring.getLastIndex());
+    n += 2;
+    writeLE16(out + n, (uint16_t)capacityEntries);
+    n += 2;
+    writeLE32(out + n, ring.getFirstIndex());
+    n += 4;
+    static const uint8_t TRAILER[6] = {0, 0, 0, 0, 1, 1};
+    memcpy(out + n, TRAILER, sizeof(TRAILER));
+    n += sizeof(TRAILER);
+    return n;
+}
+
+bool EveHistoryServer::request(const uint8_t *data, size_t length)
+{
+    if (length < 6)
+    {
+        return false;
+    }
+
+    uint32_t address = readLE32(data + 2);
+    uint32_t first = ring.getFirstIndex();
+    if (first == 0)
+    {
+        cursor = ring.getLastIndex() + 1;
+        sendReference = false;
+    }
+    else if (address <= first)
+    {
+        cursor = first;
+        sendReference = true; // Client starts over; give it the time base first
+    }
+    else
+    {
+        cursor = address;
+        sendReference = false;
+    }
+    transferring = true;
+    return true;
+}
+
+size_t EveHistoryServer::nextBatch(uint8_t *out, size_t capacity)
+{
+    if (capacity < 1)
+    {
+        return 0;
+    }
+
+    size_t n = 0;
+    if (sendReference && capacity >= REFERENCE_SIZE)
+    {
+        out[n++] = REFERENCE_SIZE;
+        writeLE32(out + n, cursor - 1);
+        n += 4;
+        writeLE32(out + n, 1);
+        n += 4;
+        out[n++] = 0x81; // Reference time entry
+        writeLE32(out + n, referenceTime());
+        n += 4;
+        memset(out + n, 0, 7);
+        n += 7;
+        sendReference = false;
+    }
+
+    HistoryEntry entries[BATCH_ENTRIES];
+    int room = (int)((capacity - n) / ENTRY_SIZE);
+    int count = ring.read(cursor, entries, room < BATCH_ENTRIES ? room : BATCH_ENTRIES);
+    uint32_t reference = referenceTime();
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t eveTime = entries[i].timestamp > EVE_EPOCH_OFFSET ? entries[i].timestamp - EVE_EPOCH_OFFSET : 0;
+        uint32_t usage = entries[i].usageDeciliters < 0xFFFF ? entries[i].usageDeciliters : 0xFFFF;
+
+        out[n++] = ENTRY_SIZE;
+        writeLE32(out + n, cursor + i);
+        n += 4;
+        writeLE32(out + n, eveTime > reference ? eveTime - reference : 0);
+        n += 4;
+        out[n++] = 0x03; // Both fields present
+        writeLE16(out + n, (uint16_t)usage);
+        n += 2;
+        out[n++] = entries[i].filterPercent;
+    }
+    cursor += count;
+
+    if (n == 0)
+    {
+        out[n++] = 0; // Nothing left
+        transferring = false;
+    }
+    return n;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "TimeSeriesCodec.h"
+
+// One history sample, taken at the end of each interval
+struct HistoryEntry
+{
+    uint32_t timestamp;       // Unix seconds
+    uint32_t usageDeciliters; // Water drawn during the interval
+    uint8_t filterPercent;    // Lowest filter life at the end of the interval
+};
+
+// Bounded ring of TimeSeriesCodec blocks holding the history samples.
+//
+// Each record is one codec value, usageDeciliters * 128 + filterPercent, so a
+// regular 10 minute sample costs a byte for the timestamp and two or three for
+// the value. Entries are numbered from 1, as the Eve app addresses them; when
+// the ring is full the oldest block is dropped as a whole and the numbers of
+// the remaining entries stay the same.
+//
+// RAM budget: 16 blocks * 256 bytes = 4 KB, roughly 75 samples per block or
+// eight to nine days at 10 minute intervals.
+class HistoryRing
+{
+public:
+    static const int BLOCK_COUNT = 16;
+    static const size_t BLOCK_SIZE = 256;
+
+    HistoryRing();
+
+    // False if the timestamp goes backwards
+    bool append(const HistoryEntry &entry);
+    void clear();
+
+    uint32_t getFirstIndex() const; // 0 when empty
+    uint32_t getLastIndex() const { return nextIndex - 1; }
+    uint32_t getCount() const { return getFirstIndex() ? nextIndex - getFirstIndex() : 0; }
+    uint32_t getFirstTimestamp() const { return firstTimestamp; } // Of entry 1, kept when it is dropped
+    uint32_t getLastTimestamp() const { return lastTimestamp; }
+
+    // Copies up to maxEntries starting at index; returns the number copied.
+    // Cost is bounded by one block's worth of decoding plus the copy.
+    int read(uint32_t index, HistoryEntry *out, int maxEntries) const;
+
+    // Flash checkpoint support - fixed-size binary image; blocks keep their own CRC
+    static size_t getCheckpointSize();
+    size_t saveCheckpoint(uint8_t *buffer, size_t bufferSize) const;
+    bool restoreCheckpoint(const uint8_t *buffer, size_t length);
+
+private:
+    uint8_t blocks[BLOCK_COUNT][BLOCK_SIZE];
+    uint32_t blockFirstIndex[BLOCK_COUNT]; // 0 = slot empty
+    int head;                              // Slot being written
+    uint32_t nextIndex;
+    uint32_t firstTimestamp;
+    uint32_t lastTimestamp;
+    TimeSeriesEncoder encoder;
+
+    void startBlock(int slot);
+};
+
+// Eve history protocol served from a HistoryRing.
+//
+// The Eve app reads the status (which entries exist and the reference time),
+// writes the number of the first entry it still needs, then reads batches of
+// entries. Times on the wire are seconds since the reference time, which is
+// the first entry's time in Eve's 2001-01-01 epoch. A batch is built straight
+// from the ring into a caller buffer, so a long history never needs more RAM
+// than one batch.
+class EveHistoryServer
+{
+public:
+    static const uint32_t EVE_EPOCH_OFFSET = 978307200; // 2001-01-01 in Unix seconds
+    static const int BATCH_ENTRIES = 16;
+    static const size_t ENTRY_SIZE = 13;
+    static const size_t REFERENCE_SIZE = 21;
+    static const size_t MAX_BATCH_SIZE = REFERENCE_SIZE + BATCH_ENTRIES * ENTRY_SIZE;
+    static const size_t STATUS_SIZE = 31;
+
+    // Field types in the status signature and the per-entry bitmask order
+    static const uint8_t FIELD_USAGE = 0x07;  // Deciliters, 2 bytes
+    static const uint8_t FIELD_FILTER = 0x0F; // Percent, 1 byte
+
+    explicit EveHistoryServer(const HistoryRing &ring);
+
+    // History status characteristic value; returns its length
+    size_t buildStatus(uint8_t *out, size_t capacity) const;
+
+    // History request write: the first entry the client wants
+    bool request(const uint8_t *data, size_t length);
+
+    // Next batch for the history entries characteristic, advancing the cursor.
+    // A single zero byte means the transfer is complete.
+    size_t nextBatch(uint8_t *out, size_t capacity);
+
+    bool isTransferring() const { return transferring; }
+    uint32_t getCursor() const { return cursor; }
+
+private:
+    const HistoryRing &ring;
+    uint32_t cursor;
+    bool sendReference;
+    bool transferring;
+
+    uint32_t referenceTime() const;
+};
@@ -0,0 +1,296 @@
+#include "EventJournal.h"
+#include <stdio.h>
+#include <string.h>
+#include "Checksum.h"
+
+static_assert(sizeof(JournalState) == 72, "JournalState layout is part of the on-flash format");
+
+static const size_t SCAN_CHUNK = 512;
+static_assert(4 + sizeof(JournalState) <= EventJournal::MAX_PAYLOAD, "Checkpoint must fit in one record");
+
+EventJournal::EventJournal(JournalStorage &journalStorage, const char *pathPrefix)
+    : storage(journalStorage), prefix(pathPrefix), sequence(0), segmentBytes(0),
+      recordsSinceCheckpoint(0), replayedRecords(0), scannedBytes(0), tornTail(false)
+{
+    memset(&state, 0, sizeof(state));
+}
+
+bool EventJournal::begin()
+{
+    memset(&state, 0, sizeof(state));
+    sequence = 0;
+    segmentBytes = 0;
+    recordsSinceCheckpoint = 0;
+    replayedRecords = 0;
+    scannedBytes = 0;
+    tornTail = false;
+
+    // Only each segment's leading checkpoint is read to find the newest one
+    for (uint8_t slot = 0; slot < SEGMENT_COUNT; slot++)
+    {
+        uint32_t segmentSequence;
+        if (readSegmentSequence(slot, segmentSequence) && segmentSequence > sequence)
+        {
+            sequence = segmentSequence;
+        }
+    }
+    if (sequence == 0)
+    {
+        return false;
+    }
+
+    replaySegment();
+    return true;
+}
+
+bool EventJournal::resume(const JournalState &savedState, uint32_t segmentSequence, uint32_t segmentLength)
+{
+    if (segmentSequence == 0)
+    {
+        return false;
+    }
+    char path[32];
+    segmentPath(segmentSequence, path);
+    if (storage.size(path) != segmentLength)
+    {
+        return false;
+    }
+
+    state = savedState;
+    sequence = segmentSequence;
+    segmentBytes = segmentLength;
+    // Checkpoint on the next append so a later replay stays within one interval
+    recordsSinceCheckpoint = CHECKPOINT_INTERVAL;
+    replayedRecords = 0;
+    scannedBytes = 0;
+    tornTail = false;
+    return true;
+}
+
+bool EventJournal::logFilterReplaced(uint32_t timestamp, uint8_t filterIndex)
+{
+    return append(EVENT_FILTER_REPLACED, timestamp, &filterIndex, 1);
+}
+
+bool EventJournal::logDraw(uint32_t timestamp, uint32_t milliliters, uint32_t durationMs)
+{
+    uint32_t payload[2] = {milliliters, durationMs};
+    return append(EVENT_DRAW, timestamp, payload, sizeof(payload));
+}
+
+bool EventJournal::logLeakAlert(uint32_t timestamp, uint8_t alerts)
+{
+    return append(EVENT_LEAK_ALERT, timestamp, &alerts, 1);
+}
+
+bool EventJournal::append(JournalEventType type, uint32_t timestamp, const void *payload, uint8_t length)
+{
+    if (length > MAX_PAYLOAD || type == EVENT_CHECKPOINT)
+    {
+        return false;
+    }
+
+    apply(type, timestamp, (const uint8_t *)payload, length);
+
+    uint32_t recordSize = HEADER_SIZE + length + 4;
+    if (sequence == 0 || segmentBytes + recordSize > SEGMENT_SIZE)
+    {
+        // The new segment's checkpoint already includes this event
+        return startSegment(timestamp);
+    }
+    if (recordsSinceCheckpoint >= CHECKPOINT_INTERVAL)
+    {
+        return writeCheckpoint(timestamp);
+    }
+    return writeRecord(type, timestamp, payload, length);
+}
+
+void EventJournal::segmentPath(uint32_t segmentSequence, char *path) const
+{
+    snprintf(path, 32, "%s%u.log", prefix, (unsigned)(segmentSequence % SEGMENT_COUNT));
+}
+
+bool EventJournal::readSegmentSequence(uint8_t slot, uint32_t &segmentSequence)
+{
+    char path[32];
+    segmentPath(slot, path);
+
+    uint8_t record[HEADER_SIZE + 4 + sizeof(JournalState) + 4];
+    if (storage.read(path, 0, record, sizeof(record)) != sizeof(record))
+    {
+        return false;
+    }
+    uint32_t crc;
+    memcpy(&crc, record + sizeof(record) - 4, 4);
+    if (record[0] != RECORD_MAGIC || record[1] != EVENT_CHECKPOINT ||
+        record[2] != sizeof(record) - HEADER_SIZE - 4 || crc != crc32(record, sizeof(record) - 4))
+    {
+        return false;
+    }
+    memcpy(&segmentSequence, record + HEADER_SIZE, 4);
+    return segmentSequence % SEGMENT_COUNT == slot;
+}
+
+// Read the current segment in chunks, restore its last checkpoint and apply
+// the records after it. Stops at the first damaged record.
+void EventJournal::replaySegment()
+{
+    char path[32];
+    segmentPath(sequence, path);
+
+    uint8_t chunk[SCAN_CHUNK];
+    uint32_t offset = 0;
+    while (true)
+    {
+        size_t count = storage.read(path, offset, chunk, sizeof(chunk));
+        scannedBytes += count;
+
+        size_t position = 0;
+        while (position + HEADER_SIZE <= count)
+        {
+            const uint8_t *record = chunk + position;
+            uint8_t length = record[2];
+            size_t total = HEADER_SIZE + length + 4;
+            if (record[0] != RECORD_MAGIC || length > MAX_PAYLOAD)
+            {
+                break;
+            }
+            if (position + total > count)
+            {
+                break;
+            }
+
+            uint32_t crc;
+            memcpy(&crc, record + HEADER_SIZE + length, 4);
+            if (crc != crc32(record, HEADER_SIZE + length))
+            {
+                break;
+            }
+
+            uint32_t timestamp;
+            memcpy(&timestamp, record + 4, 4);
+            const uint8_t *payload = record + HEADER_SIZE;
+            if (record[1] == EVENT_CHECKPOINT && length == 4 + sizeof(JournalState))
+            {
+                memcpy(&state, payload + 4, sizeof(JournalState));
+                recordsSinceCheckpoint = 0;
+                replayedRecords = 0;
+            }
+            else
+            {
+                apply((JournalEventType)record[1], timestamp, payload, length);
+                recordsSinceCheckpoint++;
+                replayedRecords++;
+            }
+            position += total;
+        }
+
+        offset += position;
+        // A full chunk that ended mid-record is re-read from the record start
+        if (count < sizeof(chunk) || position == 0)
+        {
+            break;
+        }
+    }
+
+    segmentBytes = offset;
+    if (offset < storage.size(path))
+    {
+        // Appending after a torn record would hide everything behind it
+        tornTail = true;
+        segmentBytes = SEGMENT_SIZE;
+    }
+}
+
+bool EventJournal::startSegment(uint32_t timestamp)
+{
+    sequence++;
+    char path[32];
+    segmentPath(sequence, path);
+    storage.remove(path);
+    segmentBytes = 0;
+    return writeCheckpoint(timestamp);
+}
+
+bool EventJournal::writeRecord(JournalEventType type, uint32_t timestamp, const void *payload, uint8_t length)
+{
+    uint8_t record[HEADER_SIZE + MAX_PAYLOAD + 4];
+    record[0] = RECORD_MAGIC;
+    record[1] = type;
+    record[2] = length;
+    record[3] = 0;
+    memcpy(record + 4, &timestamp, 4);
+    if (length > 0)
+    {
+        memcpy(record + HEADER_SIZE, payload, length);
+    }
+    uint32_t crc = crc32(record, HEADER_SIZE + length);
+    memcpy(record + HEADER_SIZE + length, &crc, 4);
+
+    char path[32];
+    segmentPath(sequence, path);
+    size_t total = HEADER_SIZE + length + 4;
+    if (!storage.append(path, record, total))
+    {
+        return false;
+    }
+    segmentBytes += total;
+    recordsSinceCheckpoint = type == EVENT_CHECKPOINT ? 0 : recordsSinceCheckpoint + 1;
+    return true;
+}
+
+bool EventJournal::writeCheckpoint(uint32_t timestamp)
+{
+    uint8_t payload[4 + sizeof(JournalState)];
+    memcpy(payload, &sequence, 4);
+    memcpy(payload + 4, &state, sizeof(JournalState));
+    return writeRecord(EVENT_CHECKPOINT, timestamp, payload, sizeof(payload));
+}
+
+void EventJournal::apply(JournalEventType type, uint32_t timestamp, const uint8_t *payload, uint8_t length)
+{
+    switch (type)
+    {
+    case EVENT_BOOT:
+        state.bootCount++;
+        break;
+    case EVENT_COUNTER_RESET:
+        state.drawnMl = 0;
+        state.drawCount = 0;
+        state.resetCount++;
+        state.lastResetTime = timestamp;
+        for (int i = 0; i < 8; i++)
+        {
+            state.filterReplacedTime[i] = timestamp;
+        }
+        break;
+    case EVENT_FILTER_REPLACED:
+        if (length >= 1 && payload[0] < 8)
+        {
+            state.filterReplacedTime[payload[0]] = timestamp;
+        }
+        break;
+    case EVENT_DRAW:
+        if (length >= 4)
+        {
+            uint32_t milliliters;
+            memcpy(&milliliters, payload, 4);
+            state.drawnMl += milliliters;
+            state.drawCount++;
+        }
+        break;
+    case EVENT_LEAK_ALERT:
+        if (length >= 1)
+        {
+            state.lastAlerts = payload[0];
+            if (payload[0] != 0)
+            {
+                state.alertCount++;
+                state.lastAlertTime = timestamp;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
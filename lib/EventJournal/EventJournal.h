@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include "JournalStorage.h"
+
+enum JournalEventType : uint8_t
+{
+    EVENT_CHECKPOINT = 1,      // Full state snapshot
+    EVENT_BOOT = 2,
+    EVENT_COUNTER_RESET = 3,   // All counters and filters reset by the user
+    EVENT_FILTER_REPLACED = 4, // payload: filter index
+    EVENT_DRAW = 5,            // payload: milliliters, duration ms
+    EVENT_LEAK_ALERT = 6       // payload: LeakAlert bits
+};
+
+// State rebuilt by replaying the journal. Fixed-width fields with the 64-bit
+// one first so the layout is identical on the host and the ESP32.
+struct JournalState
+{
+    uint64_t drawnMl;     // Since the last counter reset
+    uint32_t drawCount;   // Since the last counter reset
+    uint32_t bootCount;
+    uint32_t resetCount;
+    uint32_t lastResetTime;
+    uint32_t alertCount;
+    uint32_t lastAlertTime;
+    uint32_t filterReplacedTime[8];
+    uint8_t lastAlerts;
+    uint8_t reserved[7];
+};
+
+// Append-only event log in fixed-size segment files used as a ring.
+//
+// Record: magic(1) type(1) length(1) reserved(1) timestamp(4) payload crc32(4).
+// Every segment opens with a checkpoint and another follows every
+// CHECKPOINT_INTERVAL records, so begin() only has to read the newest segment
+// and applies just the events after its last checkpoint. Boot cost is bounded
+// by SEGMENT_SIZE no matter how much history the ring holds.
+class EventJournal
+{
+public:
+    static const uint8_t SEGMENT_COUNT = 16;
+    static const uint32_t SEGMENT_SIZE = 16384;
+    static const uint16_t CHECKPOINT_INTERVAL = 64;
+    static const uint8_t MAX_PAYLOAD = 96;
+
+    // pathPrefix + slot + ".log" names each segment, e.g. "/journal3.log"
+    EventJournal(JournalStorage &storage, const char *pathPrefix = "/journal");
+
+    // Find the newest segment and rebuild state. False if the journal was empty.
+    bool begin();
+
+    // Continue from state kept across a warm reset instead of replaying.
+    // Refused if the segment on flash is not exactly where the state left it.
+    bool resume(const JournalState &savedState, uint32_t segmentSequence, uint32_t segmentLength);
+
+    bool append(JournalEventType type, uint32_t timestamp, const void *payload = nullptr, uint8_t length = 0);
+    bool logBoot(uint32_t timestamp) { return append(EVENT_BOOT, timestamp); }
+    bool logCounterReset(uint32_t timestamp) { return append(EVENT_COUNTER_RESET, timestamp); }
+    bool logFilterReplaced(uint32_t timestamp, uint8_t filterIndex);
+    bool logDraw(uint32_t timestamp, uint32_t milliliters, uint32_t durationMs);
+    bool logLeakAlert(uint32_t timestamp, uint8_t alerts);
+
+    const JournalState &getState() const { return state; }
+    uint32_t getSegmentSequence() const { return sequence; }
+    uint32_t getSegmentBytes() const { return segmentBytes; }
+
+    // Replay statistics from the last begin()
+    uint32_t getReplayedRecords() const { return replayedRecords; }
+    uint32_t getScannedBytes() const { return scannedBytes; }
+    bool hadTornTail() const { return tornTail; }
+
+private:
+    static const uint8_t RECORD_MAGIC = 0xE7;
+    static const uint8_t HEADER_SIZE = 8;
+
+    JournalStorage &storage;
+    const char *prefix;
+    JournalState state;
+    uint32_t sequence;    // Segment sequence number; slot = sequence % SEGMENT_COUNT
+    uint32_t segmentBytes;
+    uint16_t recordsSinceCheckpoint;
+    uint32_t replayedRecords;
+    uint32_t scannedBytes;
+    bool tornTail;
+
+    void segmentPath(uint32_t segmentSequence, char *path) const;
+    bool readSegmentSequence(uint8_t slot, uint32_t &segmentSequence);
+    void replaySegment();
+    bool startSegment(uint32_t timestamp);
+    bool writeRecord(JournalEventType type, uint32_t timestamp, const void *payload, uint8_t length);
+    bool writeCheckpoint(uint32_t timestamp);
+    void apply(JournalEventType type, uint32_t timestamp, const uint8_t *payload, uint8_t length);
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stddef.h>
+
+// File operations the journal and the Eve history checkpoint need, so they
+// run against a host stand-in. On the device it is backed by LittleFS on the
+// spiffs partition.
+class JournalStorage
+{
+public:
+    virtual ~JournalStorage() {}
+
+    virtual bool append(const char *path, const void *data, size_t length) = 0;
+    // Returns the number of bytes read; 0 past the end or if the file is missing
+    virtual size_t read(const char *path, size_t offset, void *data, size_t length) = 0;
+    virtual size_t size(const char *path) = 0;
+    virtual bool remove(const char *path) = 0;
+    // Replaces to if it exists; LittleFS renames atomically
+    virtual bool rename(const char *from, const char *to) = 0;
+};
+
+#ifdef ARDUINO
+#include <LittleFS.h>
+
+class LittleFSJournalStorage : public JournalStorage
+{
+public:
+    bool append(const char *path, const void *data, size_t length) override
+    {
+        File file = LittleFS.open(path, FILE_APPEND);
+        if (!file)
+        {
+            return false;
+        }
+        size_t written = file.write((const uint8_t *)data, length);
+        file.close();
+        return written == length;
+    }
+
+    size_t read(const char *path, size_t offset, void *data, size_t length) override
+    {
+        if (!LittleFS.exists(path))
+        {
+            return 0;
+        }
+        File file = LittleFS.open(path, FILE_READ);
+        if (!file || !file.seek(offset))
+        {
+            return 0;
+        }
+        size_t count = file.read((uint8_t *)data, length);
+        file.close();
+        return count;
+    }
+
+    size_t size(const char *path) override
+    {
+        if (!LittleFS.exists(path))
+        {
+            return 0;
+        }
+        File file = LittleFS.open(path, FILE_READ);
+        size_t length = file ? file.size() : 0;
+        file.close();
+        return length;
+    }
+
+    bool remove(const char *path) override
+    {
+        return !LittleFS.exists(path) || LittleFS.remove(path);
+    }
+
+    bool rename(const char *from, const char *to) override
+    {
+        return LittleFS.rename(from, to);
+    }
+};
+#endif
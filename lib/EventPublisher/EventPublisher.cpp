@@ -0,0 +1,122 @@
+#include "EventPublisher.h"
+
+EventPublisher::EventPublisher(uint32_t windowMs)
+    : entryCount(0), pendingCount(0), windowMs(windowMs), windowStart(0), urgentPending(false), coalesced(0),
+      batches(0)
+{
+}
+
+int EventPublisher::add(CharacteristicSink &sink, float initialValue, const PublishPolicy &policy)
+{
+    if (entryCount >= MAX_CHARACTERISTICS)
+    {
+        return -1;
+    }
+    Entry &entry = entries[entryCount];
+    entry.sink = &sink;
+    entry.published = PublishedValue(policy.hysteresis);
+    entry.published.record(initialValue);
+    entry.policy = policy;
+    entry.pendingValue = initialValue;
+    entry.pending = false;
+    entry.notified = false;
+    entry.expedited = false;
+    entry.lastNotifyMs = 0;
+    return entryCount++;
+}
+
+void EventPublisher::set(int handle, float value, uint32_t nowMs)
+{
+    if (handle < 0 || handle >= entryCount)
+    {
+        return;
+    }
+    Entry &entry = entries[handle];
+
+    if (!entry.published.isChange(value))
+    {
+        // Back within the step of what controllers already show
+        if (entry.pending)
+        {
+            entry.pending = false;
+            entry.expedited = false;
+            pendingCount--;
+            coalesced++;
+        }
+        stats.suppressed++;
+        return;
+    }
+
+    if (entry.pending)
+    {
+        if (entry.pendingValue != value)
+        {
+            coalesced++;
+        }
+        entry.pendingValue = value;
+        return;
+    }
+
+    if (pendingCount == 0)
+    {
+        windowStart = nowMs;
+    }
+    entry.pending = true;
+    entry.pendingValue = value;
+    pendingCount++;
+    if (entry.policy.urgent)
+    {
+        urgentPending = true;
+    }
+}
+
+void EventPublisher::expedite(int handle)
+{
+    if (handle < 0 || handle >= entryCount || !entries[handle].pending)
+    {
+        return;
+    }
+    entries[handle].expedited = true;
+    urgentPending = true;
+}
+
+int EventPublisher::flush(uint32_t nowMs)
+{
+    if (pendingCount == 0 || (!urgentPending && nowMs - windowStart < windowMs))
+    {
+        return 0;
+    }
+
+    int sent = 0;
+    for (int i = 0; i < entryCount; i++)
+    {
+        Entry &entry = entries[i];
+        if (!entry.pending)
+        {
+            continue;
+        }
+        if (entry.notified && entry.policy.minIntervalMs > 0 && !entry.policy.urgent && !entry.expedited &&
+            nowMs - entry.lastNotifyMs < entry.policy.minIntervalMs)
+        {
+            continue; // Rate limited; stays pending with its latest value
+        }
+
+        entry.sink->publish(entry.pendingValue);
+        entry.published.record(entry.pendingValue);
+        entry.pending = false;
+        entry.expedited = false;
+        entry.notified = true;
+        entry.lastNotifyMs = nowMs;
+        pendingCount--;
+        sent++;
+    }
+
+    urgentPending = false;
+    windowStart = nowMs; // Anything left waits for a fresh window
+    stats.sent += sent;
+    if (sent > 0)
+    {
+        batches++;
+    }
+    return sent;
+}
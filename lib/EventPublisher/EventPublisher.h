@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include "PublishedValue.h"
+
+// The one thing the publisher needs from a characteristic: set it. On the
+// device this wraps a SpanCharacteristic; tests count the calls.
+class CharacteristicSink
+{
+public:
+    virtual ~CharacteristicSink() {}
+    virtual void publish(float value) = 0;
+};
+
+// How one characteristic is published
+struct PublishPolicy
+{
+    float hysteresis = 0;       // Smallest change worth an event (0 = any change)
+    uint32_t minIntervalMs = 0; // At most one event per this long (0 = no limit)
+    bool urgent = false;        // Flush straight away instead of waiting for the window
+};
+
+// Batches characteristic changes into as few HomeKit notifications as possible.
+//
+// set() only records the latest value. The first change opens a coalescing
+// window; flush() publishes every pending change together once the window has
+// passed, so a burst (all five filters reset at once) goes out in one HomeSpan
+// poll cycle, which HomeSpan sends as a single event message per controller.
+// A value that changes again inside the window is sent once, with its latest
+// value. A characteristic still inside its minimum interval stays pending and
+// goes out with a later flush unless it is expedited. Urgent entries (the leak
+// sensor) close the window at once and take everything pending with them.
+class EventPublisher
+{
+public:
+    static const int MAX_CHARACTERISTICS = 24;
+
+    explicit EventPublisher(uint32_t windowMs = 250);
+
+    // initialValue is what the characteristic was created with; returns a handle, -1 if full
+    int add(CharacteristicSink &sink, float initialValue, const PublishPolicy &policy = PublishPolicy());
+    void set(int handle, float value, uint32_t nowMs);
+
+    // Send the handle's pending value with the next flush, even inside its
+    // minimum interval (the final total when a draw stops)
+    void expedite(int handle);
+
+    // Call every loop, right before homeSpan.poll(); returns the events sent
+    int flush(uint32_t nowMs);
+
+    bool hasPending() const { return pendingCount > 0; }
+    const UpdateStats &getStats() const { return stats; }
+    uint32_t getCoalesced() const { return coalesced; } // Superseded while pending
+    uint32_t getBatches() const { return batches; }     // Flushes that sent anything
+
+private:
+    struct Entry
+    {
+        CharacteristicSink *sink;
+        PublishedValue published;
+        PublishPolicy policy;
+        float pendingValue;
+        bool pending;
+        bool notified;
+        bool expedited;
+        uint32_t lastNotifyMs;
+    };
+
+    Entry entries[MAX_CHARACTERISTICS];
+    int entryCount;
+    int pendingCount;
+    uint32_t windowMs;
+    uint32_t windowStart;
+    bool urgentPending;
+    UpdateStats stats;
+    uint32_t coalesced;
+    uint32_t batches;
+};
@@ -0,0 +1,20 @@
+#include "FilterStages.h"
+
+FilterStatus filterStatusFor(uint8_t percent)
+{
+    if (percent < 10)
+    {
+        return STATUS_REPLACE;
+    }
+    if (percent < 20)
+    {
+        return STATUS_WARNING;
+    }
+    return STATUS_OK;
+}
+
+const char *filterStatusLabel(FilterStatus status)
+{
+    static const char *const LABELS[] = {"OK", "LOW", "REPLACE"};
+    return status <= STATUS_REPLACE ? LABELS[status] : "?";
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+
+// RO systems this firmware supports, from a three-stage under-sink unit to
+// an eight-stage system with remineralization and UV
+#define FILTER_STAGE_MIN 3
+#define FILTER_STAGE_MAX 8
+
+enum FilterStatus : uint8_t
+{
+    STATUS_OK,      // >20%
+    STATUS_WARNING, // 10-20%
+    STATUS_REPLACE  // <10%
+};
+
+// Fixed description of one stage. Tables of these are const, so on the ESP32
+// they stay in flash and cost no RAM.
+struct FilterStageInfo
+{
+    const char *name;        // Filter screen title, up to 10 characters
+    const char *shortName;   // Dashboard card label, three characters
+    const char *homeKitName; // Service name in the Home app
+};
+
+// Thresholds shared by the display and HomeKit
+FilterStatus filterStatusFor(uint8_t percent);
+const char *filterStatusLabel(FilterStatus status); // "OK", "LOW" or "REPLACE"
+
+// Remaining life of each stage of an N-stage system. The stage count is a
+// template parameter, so the arrays are sized at compile time and a table
+// of the wrong length does not build.
+template <int N>
+class FilterStageModel
+{
+    static_assert(N >= FILTER_STAGE_MIN && N <= FILTER_STAGE_MAX, "RO systems have 3 to 8 filter stages");
+
+public:
+    static const int COUNT = N;
+
+    explicit FilterStageModel(const FilterStageInfo (&stages)[N]) : info(stages)
+    {
+        replaceAll();
+    }
+
+    const FilterStageInfo &getInfo(int stage) const { return info[stage]; }
+    const FilterStageInfo *getInfoTable() const { return info; }
+    uint8_t getPercent(int stage) const { return percent[stage]; }
+    FilterStatus getStatus(int stage) const { return status[stage]; }
+
+    // Status follows the level; levels above 100 are clamped
+    void setPercent(int stage, uint8_t level)
+    {
+        percent[stage] = level > 100 ? 100 : level;
+        status[stage] = filterStatusFor(percent[stage]);
+    }
+
+    void replace(int stage) { setPercent(stage, 100); }
+
+    void replaceAll()
+    {
+        for (int i = 0; i < N; i++)
+        {
+            replace(i);
+        }
+    }
+
+    // The stage that runs out first decides when the unit needs service
+    uint8_t getLowestPercent() const
+    {
+        uint8_t lowest = 100;
+        for (int i = 0; i < N; i++)
+        {
+            if (percent[i] < lowest)
+            {
+                lowest = percent[i];
+            }
+        }
+        return lowest;
+    }
+
+private:
+    const FilterStageInfo *info;
+    uint8_t percent[N];
+    FilterStatus status[N];
+};
@@ -0,0 +1,109 @@
+#include "FlowMeter.h"
+
+static const char *const CHANNEL_NAMES[FLOW_CHANNEL_COUNT] = {"INLET", "PERMEATE", "BRINE"};
+
+FlowMeter::FlowMeter()
+{
+    for (int i = 0; i < FLOW_CHANNEL_COUNT; i++)
+    {
+        channels[i].pulsesPerLiter = 0;
+        channels[i].pulsesSeen = 0;
+        channels[i].remainder = 0;
+        channels[i].lastMilliliters = 0;
+    }
+}
+
+void FlowMeter::configure(FlowChannelId channel, uint16_t pulsesPerLiter)
+{
+    channels[channel].pulsesPerLiter = pulsesPerLiter;
+    channels[channel].remainder = 0;
+}
+
+void FlowMeter::update(const uint32_t pulseTotals[FLOW_CHANNEL_COUNT], uint32_t timestamp)
+{
+    for (int i = 0; i < FLOW_CHANNEL_COUNT; i++)
+    {
+        Channel &channel = channels[i];
+        uint32_t pulses = pulseTotals[i] - channel.pulsesSeen;
+        channel.pulsesSeen = pulseTotals[i];
+        channel.lastMilliliters = 0;
+
+        if (pulses == 0 || channel.pulsesPerLiter == 0)
+        {
+            continue;
+        }
+
+        // Carry the sub-milliliter remainder so no volume is lost to rounding
+        uint32_t scaled = pulses * 1000 + channel.remainder;
+        channel.lastMilliliters = scaled / channel.pulsesPerLiter;
+        channel.remainder = scaled % channel.pulsesPerLiter;
+        channel.rollup.addUsage(channel.lastMilliliters, timestamp);
+    }
+}
+
+float FlowMeter::recoveryFrom(uint64_t inlet, uint64_t permeate, uint64_t brine) const
+{
+    uint64_t feed;
+    if (isFitted(FLOW_INLET))
+    {
+        feed = inlet;
+    }
+    else if (isFitted(FLOW_BRINE))
+    {
+        feed = permeate + brine;
+    }
+    else
+    {
+        return -1.0f;
+    }
+
+    if (feed == 0)
+    {
+        return -1.0f;
+    }
+
+    float ratio = 100.0f * (float)permeate / (float)feed;
+    return ratio > 100.0f ? 100.0f : ratio;
+}
+
+float FlowMeter::getRecoveryRatio() const
+{
+    return recoveryFrom(channels[FLOW_INLET].rollup.getLifetimeMilliliters(),
+                        channels[FLOW_PERMEATE].rollup.getLifetimeMilliliters(),
+                        channels[FLOW_BRINE].rollup.getLifetimeMilliliters());
+}
+
+float FlowMeter::getRecoveryRatio(uint32_t timestamp) const
+{
+    const uint16_t lastHour = UsageRollup::MINUTE_BUCKETS;
+    return recoveryFrom(channels[FLOW_INLET].rollup.getRange(RollupTier::MINUTE, lastHour, timestamp),
+                        channels[FLOW_PERMEATE].rollup.getRange(RollupTier::MINUTE, lastHour, timestamp),
+                        channels[FLOW_BRINE].rollup.getRange(RollupTier::MINUTE, lastHour, timestamp));
+}
+
+uint64_t FlowMeter::getRejectMilliliters() const
+{
+    if (isFitted(FLOW_BRINE))
+    {
+        return channels[FLOW_BRINE].rollup.getLifetimeMilliliters();
+    }
+
+    uint64_t inlet = channels[FLOW_INLET].rollup.getLifetimeMilliliters();
+    uint64_t permeate = channels[FLOW_PERMEATE].rollup.getLifetimeMilliliters();
+    return inlet > permeate ? inlet - permeate : 0;
+}
+
+void FlowMeter::clear()
+{
+    for (int i = 0; i < FLOW_CHANNEL_COUNT; i++)
+    {
+        channels[i].rollup.clear();
+        channels[i].remainder = 0;
+        channels[i].lastMilliliters = 0;
+    }
+}
+
+const char *FlowMeter::channelName(FlowChannelId channel)
+{
+    return channel < FLOW_CHANNEL_COUNT ? CHANNEL_NAMES[channel] : "?";
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include "UsageRollup.h"
+
+// Flow channels of an RO unit. Add a channel by adding an entry before
+// FLOW_CHANNEL_COUNT - storage is sized from it at compile time.
+enum FlowChannelId : uint8_t
+{
+    FLOW_INLET,    // Feed water into the unit
+    FLOW_PERMEATE, // Filtered water to the faucet
+    FLOW_BRINE,    // Reject water to the drain
+    FLOW_CHANNEL_COUNT
+};
+
+// Meters N pulse-output flow sensors, each with its own calibration and
+// usage rollup, and derives recovery ratio and reject volume from them.
+//
+// Channels live in fixed arrays and each update is a constant amount of work
+// per channel - no allocation, no history scans. RAM is dominated by the
+// rollups: FLOW_CHANNEL_COUNT * sizeof(UsageRollup) (~2.8 KB for 3 channels).
+class FlowMeter
+{
+public:
+    FlowMeter();
+
+    // Set pulses per liter for a channel; 0 marks the sensor as not fitted
+    void configure(FlowChannelId channel, uint16_t pulsesPerLiter);
+    bool isFitted(FlowChannelId channel) const { return channels[channel].pulsesPerLiter > 0; }
+
+    // Consume monotonic pulse totals (one per channel, as counted by the
+    // interrupt handlers) and add the new volume to each channel's rollup
+    void update(const uint32_t pulseTotals[FLOW_CHANNEL_COUNT], uint32_t timestamp);
+
+    // Volume added by the last update() in milliliters
+    uint32_t getLastMilliliters(FlowChannelId channel) const { return channels[channel].lastMilliliters; }
+    const UsageRollup &getRollup(FlowChannelId channel) const { return channels[channel].rollup; }
+    UsageRollup &getRollup(FlowChannelId channel) { return channels[channel].rollup; }
+
+    // Permeate share of feed water in percent over the lifetime totals, or
+    // over the last hour when a timestamp is given. Negative when unknown
+    // (no feed-side sensor fitted, or no flow yet).
+    float getRecoveryRatio() const;
+    float getRecoveryRatio(uint32_t timestamp) const;
+
+    // Reject water in milliliters - measured on the brine channel when fitted,
+    // otherwise inlet minus permeate
+    uint64_t getRejectMilliliters() const;
+
+    void clear();
+
+    static const char *channelName(FlowChannelId channel);
+
+private:
+    struct Channel
+    {
+        uint16_t pulsesPerLiter;
+        uint32_t pulsesSeen;
+        uint32_t remainder; // Sub-milliliter carry, in pulses * 1000
+        uint32_t lastMilliliters;
+        UsageRollup rollup;
+    };
+
+    Channel channels[FLOW_CHANNEL_COUNT];
+
+    float recoveryFrom(uint64_t inlet, uint64_t permeate, uint64_t brine) const;
+};
@@ -0,0 +1,92 @@
+#include "HeapMonitor.h"
+#include <string.h>
+
+HeapMonitor::HeapMonitor()
+    : head(0), count(0), started(false), lastSampleMs(0), allocations(0), frees(0), passes(0),
+      maxPassAllocations(0), warning(false), warnings(0), lowestLargestBlock(UINT32_MAX)
+{
+    memset(samples, 0, sizeof(samples));
+}
+
+void HeapMonitor::addPass(uint32_t passAllocations, uint32_t passFrees)
+{
+    allocations += passAllocations;
+    frees += passFrees;
+    if (passes < UINT16_MAX)
+    {
+        passes++;
+    }
+    if (passAllocations > maxPassAllocations)
+    {
+        maxPassAllocations = passAllocations > UINT16_MAX ? UINT16_MAX : passAllocations;
+    }
+}
+
+bool HeapMonitor::isDue(uint32_t nowMs) const
+{
+    return !started || nowMs - lastSampleMs >= config.sampleIntervalMs;
+}
+
+uint8_t HeapMonitor::fragmentation(uint32_t freeBytes, uint32_t largestFreeBlock)
+{
+    if (freeBytes == 0 || largestFreeBlock >= freeBytes)
+    {
+        return 0;
+    }
+    return (uint8_t)(100 - (uint64_t)largestFreeBlock * 100 / freeBytes);
+}
+
+bool HeapMonitor::sample(uint32_t nowMs, const HeapStats &stats)
+{
+    HeapSample &entry = samples[head];
+    entry.timestampMs = nowMs;
+    entry.freeBytes = stats.freeBytes;
+    entry.largestFreeBlock = stats.largestFreeBlock;
+    entry.minimumFreeBytes = stats.minimumFreeBytes;
+    entry.allocations = allocations;
+    entry.frees = frees;
+    entry.passes = passes;
+    entry.maxPassAllocations = maxPassAllocations;
+    entry.fragmentationPercent = fragmentation(stats.freeBytes, stats.largestFreeBlock);
+
+    bool unhealthy = stats.largestFreeBlock < config.warnLargestBlock;
+    if (config.warnFragmentationPercent > 0 && entry.fragmentationPercent >= config.warnFragmentationPercent)
+    {
+        unhealthy = true;
+    }
+    entry.warning = unhealthy;
+
+    head = (head + 1) % SAMPLE_COUNT;
+    if (count < SAMPLE_COUNT)
+    {
+        count++;
+    }
+    if (stats.largestFreeBlock < lowestLargestBlock)
+    {
+        lowestLargestBlock = stats.largestFreeBlock;
+    }
+
+    started = true;
+    lastSampleMs = nowMs;
+    allocations = 0;
+    frees = 0;
+    passes = 0;
+    maxPassAllocations = 0;
+
+    bool entered = unhealthy && !warning;
+    warning = unhealthy;
+    if (entered)
+    {
+        warnings++;
+    }
+    return entered;
+}
+
+const HeapSample &HeapMonitor::getSample(int age) const
+{
+    if (age < 0 || age >= count)
+    {
+        age = 0;
+    }
+    return samples[(head - 1 - age + SAMPLE_COUNT) % SAMPLE_COUNT];
+}
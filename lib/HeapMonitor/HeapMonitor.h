@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+
+// Heap figures read from the allocator (heap_caps_* on the ESP32)
+struct HeapStats
+{
+    uint32_t freeBytes;
+    uint32_t largestFreeBlock;
+    uint32_t minimumFreeBytes; // Low-water mark since boot
+};
+
+// One entry of the heap history
+struct HeapSample
+{
+    uint32_t timestampMs;
+    uint32_t freeBytes;
+    uint32_t largestFreeBlock;
+    uint32_t minimumFreeBytes;
+    uint32_t allocations;        // Loop-task allocations during the interval
+    uint32_t frees;              // Loop-task frees during the interval
+    uint16_t passes;             // Loop passes during the interval
+    uint16_t maxPassAllocations; // Worst single pass
+    uint8_t fragmentationPercent;
+    bool warning;
+};
+
+struct HeapMonitorConfig
+{
+    uint32_t sampleIntervalMs = 5000;
+    uint32_t warnLargestBlock = 16384;      // TLS and pairing need one large contiguous block
+    uint8_t warnFragmentationPercent = 60;  // 0 = check disabled
+};
+
+// Tracks heap health over time. Each loop pass adds its allocation and free
+// counts; every sample interval the caller reads the allocator and closes the
+// interval into a ring of the last SAMPLE_COUNT samples.
+//
+// Fragmentation is the share of free memory that is not in the largest
+// block. A heap can keep plenty of free bytes and still fail the 16 KB
+// allocation a TLS session needs, so the warning looks at the largest block
+// as well as the ratio. sample() reports the warning once when it starts and
+// re-arms only after a sample is healthy again, so the caller can dump
+// diagnostics without repeating them every interval.
+class HeapMonitor
+{
+public:
+    static const int SAMPLE_COUNT = 64;
+
+    HeapMonitor();
+
+    void setConfig(const HeapMonitorConfig &newConfig) { config = newConfig; }
+    const HeapMonitorConfig &getConfig() const { return config; }
+
+    void addPass(uint32_t allocations, uint32_t frees);
+
+    bool isDue(uint32_t nowMs) const;
+
+    // Closes the interval; true when this sample starts a warning
+    bool sample(uint32_t nowMs, const HeapStats &stats);
+
+    static uint8_t fragmentation(uint32_t freeBytes, uint32_t largestFreeBlock);
+
+    int getCount() const { return count; }
+    const HeapSample &getSample(int age) const; // 0 = newest
+    bool isWarning() const { return warning; }
+    uint32_t getWarningCount() const { return warnings; }
+    uint32_t getLowestLargestBlock() const { return lowestLargestBlock; } // Since boot
+
+private:
+    HeapMonitorConfig config;
+    HeapSample samples[SAMPLE_COUNT];
+    int head; // Next slot
+    int count;
+    bool started;
+    uint32_t lastSampleMs;
+
+    // Open interval
+    uint32_t allocations;
+    uint32_t frees;
+    uint16_t passes;
+    uint16_t maxPassAllocations;
+
+    bool warning;
+    uint32_t warnings;
+    uint32_t lowestLargestBlock;
+};
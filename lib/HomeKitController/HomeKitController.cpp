@@ -1,78 +1,75 @@
 #include "HomeKitController.h"
 
+// Reject water volume in liters (custom characteristic, visible in apps such as Eve)
+CUSTOM_CHAR(RejectWaterVolume, 8C3A1E01-6F2B-4D8E-9B1A-52D0C0A1B001, PR + EV, UINT32, 0, 0, 4000000000, true);
+
+// Lifetime permeate volume in liters and current flow in liters per minute
+CUSTOM_CHAR(TotalWaterVolume, 8C3A1E01-6F2B-4D8E-9B1A-52D0C0A1B002, PR + EV, UINT32, 0, 0, 4000000000, true);
+CUSTOM_CHAR(WaterFlowRate, 8C3A1E01-6F2B-4D8E-9B1A-52D0C0A1B003, PR + EV, FLOAT, 0, 0, 60, false);
+
+// Eve history service characteristics
+CUSTOM_CHAR_DATA(EveHistoryStatus, E863F116-079E-48FF-8F27-9C2605A29F52, PR + EV + HD);
+CUSTOM_CHAR_DATA(EveHistoryEntries, E863F117-079E-48FF-8F27-9C2605A29F52, PR + EV + HD);
+CUSTOM_CHAR_DATA(EveHistoryRequest, E863F11C-079E-48FF-8F27-9C2605A29F52, PW + HD);
+CUSTOM_CHAR_DATA(EveSetTime, E863F121-079E-48FF-8F27-9C2605A29F52, PW + HD);
+
+// Flash checkpoint of the history ring, written from the HomeKit task to
+// the filesystem; NVS is too small to rewrite a 4 KB blob next to pairing data
+static const char *HISTORY_PATH = "/history.bin";
+static const char *HISTORY_TEMP_PATH = "/history.tmp";
+static const char *HISTORY_LEGACY_KEY = "history"; // NVS, before the filesystem
+static const uint8_t HISTORY_SAVE_EVERY = 36; // Samples, six hours at 10 minutes
+
+// Pair-setup's SRP math takes several seconds on the ESP32, inside poll()
+const StallPhase HOMEKIT_STALL_PHASES[HOMEKIT_PHASE_COUNT] = {
+    {"hk_apply", 1000},
+    {"hk_history", 2000},
+    {"hk_commands", 3000},
+    {"hk_flush", 1000},
+    {"hk_poll", 20000},
+    {"hk_idle", 1000},
+    {"hk_setup", 0}}; // No limit: setup blocks until the user finishes it
+static uint8_t historyImage[sizeof(HistoryRing) + 64];
+
 // Global pointer to the HomeKit controller for callback access
 static HomeKitController *globalHomeKitController = nullptr;
 
-// HomeKit pairing callback function
-void homeKitPairingCallback(bool isPaired)
+void SpanCharacteristicSink::publish(float value)
 {
-    Serial.printf("HomeKit: Pairing callback - isPaired: %s\n", isPaired ? "true" : "false");
-    if (globalHomeKitController)
+    if (wholeNumber)
+    {
+        characteristic->setVal((int)(value + 0.5f));
+    }
+    else
     {
-        globalHomeKitController->onPairingComplete(isPaired);
+        characteristic->setVal(value);
     }
 }
 
-// Forward declaration for filter status enum
-enum FilterStatus
-{
-    STATUS_OK,      // >20%
-    STATUS_WARNING, // 10-20%
-    STATUS_REPLACE  // <10%
-};
-
-// Include the filter structure definition
-struct FilterInfo
-{
-    String name;
-    String shortName;
-    int percentage;
-    FilterStatus status;
-    String timeLeft;
-};
-
 // Filter maintenance implementation using proper HomeKit FilterMaintenance service
-DEV_FilterMaintenance::DEV_FilterMaintenance(FilterInfo *filter, int index) : Service::FilterMaintenance()
+DEV_FilterMaintenance::DEV_FilterMaintenance(const char *name, int index, const HomeKitState &state,
+                                             EventPublisher &publisher, HomeKitCommandQueue &resetRequests)
+    : Service::FilterMaintenance(), publisher(&publisher)
 {
-    filterRef = filter;
+    filterName = name;
     filterIndex = index;
+    this->resetRequests = &resetRequests;
 
     // Initialize FilterMaintenance characteristics
-    filterChangeIndication = new Characteristic::FilterChangeIndication(
-        (filter->status == STATUS_REPLACE) ? 1 : 0 // 1=CHANGE_NEEDED, 0=NO_CHANGE_NEEDED
-    );
-
-    filterLifeLevel = new Characteristic::FilterLifeLevel(filter->percentage); // 0-100% remaining
+    int changeNeeded = state.filterChangeNeeded[index]; // 1=CHANGE_NEEDED, 0=NO_CHANGE_NEEDED
+    int percentage = state.filterPercent[index];
+    filterChangeIndication = new Characteristic::FilterChangeIndication(changeNeeded);
+    filterLifeLevel = new Characteristic::FilterLifeLevel(percentage); // 0-100% remaining
     resetFilterIndication = new Characteristic::ResetFilterIndication();       // Write-only for reset
 
-    // Only log filter creation during initial setup, not for every filter
-    if (index == 0)
-    {
-        Serial.println("HomeKit: Creating 5 filter maintenance services...");
-    }
-    if (index == 4)
-    {
-        Serial.println("HomeKit: All filter maintenance services created successfully");
-    }
-}
-
-void DEV_FilterMaintenance::loop()
-{
-    // Update filter status every 10 seconds
-    if (filterLifeLevel->timeVal() > 10000)
-    {
-        updateFromFilter();
-
-        // Log significant changes
-        static int lastReportedPercentage[5] = {-1, -1, -1, -1, -1};
-        if (abs(filterRef->percentage - lastReportedPercentage[filterIndex]) >= 5)
-        {
-            Serial.printf("HomeKit: Filter %d (%s) updated to %d%% - %s\n",
-                          filterIndex + 1, filterRef->name.c_str(), filterRef->percentage,
-                          (filterRef->status == STATUS_REPLACE) ? "CHANGE NEEDED" : "OK");
-            lastReportedPercentage[filterIndex] = filterRef->percentage;
-        }
-    }
+    // Life changes slowly; one event per 10 s is plenty
+    PublishPolicy lifePolicy;
+    lifePolicy.minIntervalMs = 10000;
+    lifeSink.characteristic = filterLifeLevel;
+    changeSink.characteristic = filterChangeIndication;
+    lifeHandle = publisher.add(lifeSink, percentage, lifePolicy);
+    changeHandle = publisher.add(changeSink, changeNeeded);
+    lastReportedPercentage = -1;
 }
 
 boolean DEV_FilterMaintenance::update()
@@ -82,18 +79,14 @@ boolean DEV_FilterMaintenance::update()
     {
         if (resetFilterIndication->getNewVal() == 1)
         {
-            // Reset filter to 100%
-            filterRef->percentage = 100;
-            filterRef->status = STATUS_OK;
-            filterRef->timeLeft = "6 months";
-
-            // Update characteristics immediately
-            filterLifeLevel->setVal(100);
-            filterChangeIndication->setVal(0); // NO_CHANGE_NEEDED
-
-            Serial.printf("HomeKit: Filter %d (%s) reset to 100%% via HomeKit\n",
-                          filterIndex + 1, filterRef->name.c_str());
+            // The UI task owns the filter data; the new level comes back with its next state
+            HomeKitCommand command = {HomeKitCommandType::FILTER_RESET, (uint8_t)filterIndex, ""};
+            if (!resetRequests->push(command))
+            {
+                return false; // Queue full, let the Home app retry
+            }
 
+            Serial.printf("HomeKit: Filter %d (%s) reset requested via HomeKit\n", filterIndex + 1, filterName);
             return true; // Signal successful handling
         }
     }
@@ -101,79 +94,232 @@ boolean DEV_FilterMaintenance::update()
     return true; // Always return true for proper operation
 }
 
-void DEV_FilterMaintenance::updateFromFilter()
+void DEV_FilterMaintenance::updateFromState(const HomeKitState &state)
 {
-    if (filterRef)
+    int percentage = state.filterPercent[filterIndex];
+    int changeNeeded = state.filterChangeNeeded[filterIndex];
+    unsigned long now = millis();
+    publisher->set(lifeHandle, percentage, now);
+    publisher->set(changeHandle, changeNeeded, now);
+
+    // Log significant changes
+    if (abs(percentage - lastReportedPercentage) >= 5)
     {
-        // Update filter life level
-        filterLifeLevel->setVal(filterRef->percentage);
-
-        // Update change indication based on filter status
-        int changeNeeded = (filterRef->status == STATUS_REPLACE) ? 1 : 0;
-        filterChangeIndication->setVal(changeNeeded);
+        Serial.printf("HomeKit: Filter %d (%s) updated to %d%% - %s\n", filterIndex + 1, filterName, percentage,
+                      changeNeeded ? "CHANGE NEEDED" : "OK");
+        lastReportedPercentage = percentage;
     }
 }
 
-// Water usage sensor implementation - uses temperature sensor to report water usage
-DEV_WaterUsageSensor::DEV_WaterUsageSensor(unsigned int *waterUsage) : Service::TemperatureSensor()
+// Water usage implementation - a faucet valve that reports draws rather than controls them
+DEV_WaterUsage::DEV_WaterUsage(const HomeKitState &state, EventPublisher &publisher)
+    : Service::Valve(), publisher(&publisher), drawing(state.waterInUse)
+{
+    active = new Characteristic::Active(state.waterInUse);
+    inUse = new Characteristic::InUse(state.waterInUse);
+    valveType = new Characteristic::ValveType(3); // Water faucet
+    totalVolume = new Characteristic::TotalWaterVolume(state.waterUsageLiters);
+    flowRate = new Characteristic::WaterFlowRate(state.flowLitersPerMinute);
+
+    // Draw start and stop go out on the next poll so automations react at once
+    PublishPolicy drawPolicy;
+    drawPolicy.urgent = true;
+    activeSink.characteristic = active;
+    inUseSink.characteristic = inUse;
+    activeHandle = publisher.add(activeSink, state.waterInUse, drawPolicy);
+    inUseHandle = publisher.add(inUseSink, state.waterInUse, drawPolicy);
+
+    // While water runs: whole liters at most every 30 s, the rate every 5 s
+    PublishPolicy totalPolicy;
+    totalPolicy.minIntervalMs = 30000;
+    totalSink.characteristic = totalVolume;
+    totalSink.wholeNumber = true;
+    totalHandle = publisher.add(totalSink, state.waterUsageLiters, totalPolicy);
+
+    PublishPolicy ratePolicy;
+    ratePolicy.hysteresis = 0.2f;
+    ratePolicy.minIntervalMs = 5000;
+    rateSink.characteristic = flowRate;
+    rateHandle = publisher.add(rateSink, state.flowLitersPerMinute, ratePolicy);
+
+    Serial.println("HomeKit: Water usage valve created");
+}
+
+boolean DEV_WaterUsage::update()
+{
+    // Nothing to open or close; refusing the write snaps the Home app switch back
+    return false;
+}
+
+void DEV_WaterUsage::updateFromState(const HomeKitState &state)
 {
-    waterUsageRef = waterUsage;
+    unsigned long now = millis();
+    publisher->set(totalHandle, state.waterUsageLiters, now);
+    publisher->set(rateHandle, state.flowLitersPerMinute, now);
+    publisher->set(activeHandle, state.waterInUse, now);
+    publisher->set(inUseHandle, state.waterInUse, now);
+
+    // When a draw stops, the final volume and zero rate go out with it
+    if (drawing && !state.waterInUse)
+    {
+        publisher->expedite(totalHandle);
+        publisher->expedite(rateHandle);
+    }
+    drawing = state.waterInUse;
 
-    // Use temperature to represent water usage (scaled down by 10 to fit in reasonable temperature range)
-    // 1000 liters = 100°C, 500 liters = 50°C etc.
-    float scaledUsage = (*waterUsage) / 10.0f;
-    temperature = new Characteristic::CurrentTemperature(scaledUsage);
-    temperature->setRange(0, 500); // 0-5000 liters range
+    // Log significant changes
+    static unsigned int lastReportedUsage = 0;
+    if (abs((int)state.waterUsageLiters - (int)lastReportedUsage) >= 50)
+    {
+        Serial.printf("HomeKit: Water usage updated to %u liters\n", (unsigned)state.waterUsageLiters);
+        lastReportedUsage = state.waterUsageLiters;
+    }
+}
 
-    Serial.println("HomeKit: Water usage sensor created");
+// Eve history implementation - batches are built from the ring on request
+DEV_EveHistory::DEV_EveHistory(const HistoryRing &ring)
+    : SpanService("E863F007-079E-48FF-8F27-9C2605A29F52", "EveHistory", true), server(ring)
+{
+    status = new Characteristic::EveHistoryStatus();
+    entries = new Characteristic::EveHistoryEntries();
+    request = new Characteristic::EveHistoryRequest();
+    setTime = new Characteristic::EveSetTime();
+    refreshStatus();
+    Serial.println("HomeKit: Eve history service created");
 }
 
-void DEV_WaterUsageSensor::loop()
+boolean DEV_EveHistory::update()
 {
-    // Update water usage every 30 seconds
-    if (temperature->timeVal() > 30000)
+    if (!request->updated())
     {
-        float scaledUsage = (*waterUsageRef) / 10.0f;
-        temperature->setVal(scaledUsage);
+        return true; // Set time: accepted, the clock comes from NTP
+    }
 
-        // Log significant changes
-        static unsigned int lastReportedUsage = 0;
-        if (abs((int)(*waterUsageRef) - (int)lastReportedUsage) >= 50)
-        {
-            Serial.printf("HomeKit: Water usage updated to %d liters\n", *waterUsageRef);
-            lastReportedUsage = *waterUsageRef;
-        }
+    uint8_t data[16];
+    size_t length = request->getNewData(nullptr, 0);
+    if (length > sizeof(data))
+    {
+        return false;
+    }
+    request->getNewData(data, sizeof(data));
+    if (!server.request(data, length))
+    {
+        return false;
     }
+
+    // Bounded work on the HomeKit task: at most one batch of entries
+    uint8_t batch[EveHistoryServer::MAX_BATCH_SIZE];
+    size_t batchLength = server.nextBatch(batch, sizeof(batch));
+    entries->setData(batch, batchLength);
+    return true;
+}
+
+void DEV_EveHistory::refreshStatus()
+{
+    uint8_t data[EveHistoryServer::STATUS_SIZE];
+    size_t length = server.buildStatus(data, sizeof(data));
+    status->setData(data, length);
+}
+
+// Leak sensor implementation - state is pushed by the controller on alert changes
+DEV_LeakSensor::DEV_LeakSensor(EventPublisher &publisher) : Service::LeakSensor(), publisher(&publisher)
+{
+    leakDetected = new Characteristic::LeakDetected(0);
+
+    // Alerts skip the coalescing window and are never rate limited
+    PublishPolicy policy;
+    policy.urgent = true;
+    leakSink.characteristic = leakDetected;
+    leakHandle = publisher.add(leakSink, 0, policy);
+    Serial.println("HomeKit: Leak sensor created");
 }
 
-void DEV_WaterUsageSensor::updateFromUsage()
+void DEV_LeakSensor::setLeak(bool detected)
 {
-    if (waterUsageRef)
+    publisher->set(leakHandle, detected ? 1 : 0, millis());
+}
+
+// Recovery sensor implementation - reports the RO recovery ratio as humidity
+DEV_RecoverySensor::DEV_RecoverySensor(EventPublisher &publisher) : Service::HumiditySensor(), publisher(&publisher)
+{
+    recovery = new Characteristic::CurrentRelativeHumidity(0);
+    rejectVolume = new Characteristic::RejectWaterVolume(0);
+
+    // Whole percent steps are plenty for a ratio that drifts over days
+    PublishPolicy policy;
+    policy.minIntervalMs = 60000;
+    rejectSink.characteristic = rejectVolume;
+    rejectHandle = publisher.add(rejectSink, 0, policy);
+    policy.hysteresis = 1.0f;
+    recoverySink.characteristic = recovery;
+    recoverySink.wholeNumber = true;
+    recoveryHandle = publisher.add(recoverySink, 0, policy);
+    Serial.println("HomeKit: Recovery ratio sensor created");
+}
+
+void DEV_RecoverySensor::setRecovery(float recoveryPercent, uint32_t rejectLiters)
+{
+    unsigned long now = millis();
+    if (recoveryPercent >= 0)
     {
-        float scaledUsage = (*waterUsageRef) / 10.0f;
-        temperature->setVal(scaledUsage);
+        publisher->set(recoveryHandle, recoveryPercent, now);
     }
+    publisher->set(rejectHandle, rejectLiters, now);
+}
+
+void HomeKitController::setSetupCode(const char *code)
+{
+    strncpy(pairingCode, code, sizeof(pairingCode) - 1);
+    pairingCode[sizeof(pairingCode) - 1] = '\0';
+    snprintf(setupCode, sizeof(setupCode), "%.3s-%.2s-%.3s", pairingCode, pairingCode + 3, pairingCode + 5);
 }
 
 HomeKitController::HomeKitController()
 {
     status = HOMEKIT_NOT_INITIALIZED;
     initialized = false;
-    setupCode = "466-37-726"; // Default setup code
-    lastUpdate = 0;
+    paired = false;
+    wifiConnected = false;
+    hapConnections = 0;
+    wifiConnects = 0;
+    linkChanges = 0;
+    serialHandedOver = false;
+    appliedSequence = 0;
+    setSetupCode("46637726"); // Default HomeSpan setup code
 
     // Initialize service pointers
-    for (int i = 0; i < 5; i++)
+    filterStages = nullptr;
+    filterCount = 0;
+    for (int i = 0; i < FILTER_STAGE_MAX; i++)
     {
         filterMaintenanceServices[i] = nullptr;
     }
-    waterUsageSensor = nullptr;
+    waterUsage = nullptr;
+    leakSensor = nullptr;
+    recoverySensor = nullptr;
+    historyService = nullptr;
+    historyUnsaved = 0;
+    historyStorage = nullptr;
+    eveHistoryService = false;
+    trail = nullptr;
+    timingRequests = false;
+    for (int i = 0; i < MAX_TIMED_SESSIONS; i++)
+    {
+        requestWaiting[i] = false;
+        requestSeen[i] = 0;
+    }
 
     // Set global pointer for callback access
     globalHomeKitController = this;
 }
 
-void HomeKitController::begin(FilterInfo filters[5], unsigned int *waterUsage)
+void HomeKitController::setFilterStages(const FilterStageInfo *stages, uint8_t count)
+{
+    filterStages = stages;
+    filterCount = count < FILTER_STAGE_MAX ? count : FILTER_STAGE_MAX;
+}
+
+void HomeKitController::begin(const HomeKitState &initialState)
 {
     if (initialized)
     {
@@ -190,6 +336,32 @@ void HomeKitController::begin(FilterInfo filters[5], unsigned int *waterUsage)
     // Set WiFi hostname before HomeSpan initialization (no spaces, DNS-friendly)
     WiFi.setHostname("RO-Monitor-Bridge");
 
+    // Deriving the pairing verifier is slow, so only when the code changed
+    char appliedCode[sizeof(pairingCode)] = "";
+    prefs.getString("setup_code", appliedCode, sizeof(appliedCode));
+    if (strcmp(appliedCode, pairingCode) != 0)
+    {
+        homeSpan.setPairingCode(pairingCode);
+        prefs.putString("setup_code", pairingCode);
+    }
+
+    // Pairing and WiFi changes arrive from HomeSpan as they happen, on the HomeKit task
+    homeSpan.setPairCallback(onPairCallback);
+    homeSpan.setStatusCallback(onStatusCallback);
+    homeSpan.setConnectionCallback(onConnectionCallback);
+
+    // The UI task owns the UART; HomeSpan commands come through toHomeKit
+    homeSpan.setSerialInputDisable(true);
+
+    // Request timing reads HomeSpan's session table; a longer one than the
+    // timing slots turns it off rather than timing some sessions only
+    timingRequests = homeSpan.maxConnections <= MAX_TIMED_SESSIONS;
+    if (!timingRequests)
+    {
+        Serial.printf("HomeKit: %d sessions allowed, request timing covers %d - timing off\n",
+                      homeSpan.maxConnections, MAX_TIMED_SESSIONS);
+    }
+
     try
     {
         // Simple HomeSpan initialization - HomeSpan will manage WiFi
@@ -211,11 +383,9 @@ void HomeKitController::begin(FilterInfo filters[5], unsigned int *waterUsage)
     Serial.println("HomeKit: Setting log level to minimal (0) to reduce output...");
     homeSpan.setLogLevel(0);
 
-    // Use the default setup code
-    setupCode = "466-37-726"; // Default HomeSpan setup code
-    Serial.printf("HomeKit: Setup code: %s\n", setupCode.c_str());
+    Serial.printf("HomeKit: Setup code: %s\n", setupCode);
     Serial.println("HomeKit: WiFi Configuration:");
-    Serial.println("HomeKit: - Type 'W' in serial monitor for manual WiFi setup");
+    Serial.println("HomeKit: - Type '!W' in serial monitor for manual WiFi setup");
     Serial.println("HomeKit: - Or connect to HomeSpan's default AP for web setup");
 
     // Create bridge accessory (required for multiple accessories)
@@ -227,27 +397,27 @@ void HomeKitController::begin(FilterInfo filters[5], unsigned int *waterUsage)
     new Characteristic::Model("ESP32-RO-v1");
     new Characteristic::FirmwareRevision("1.0.0");
 
-    // Create filter maintenance accessories
-    const char *filterNames[] = {"PP1 Filter", "PP2 Filter", "Carbon Filter", "RO Membrane", "Mineralizer"};
-
-    for (int i = 0; i < 5; i++)
+    // Create filter maintenance accessories, one per stage
+    Serial.printf("HomeKit: Creating %u filter maintenance services...\n", filterCount);
+    for (int i = 0; i < filterCount; i++)
     {
         // Create a new accessory for each filter
         new SpanAccessory();
         new Service::AccessoryInformation();
         new Characteristic::Identify();
         new Characteristic::Manufacturer("DIY Electronics");
-        new Characteristic::SerialNumber(("FILTER" + String(i + 1)).c_str());
+        char serialNumber[12];
+        snprintf(serialNumber, sizeof(serialNumber), "FILTER%d", i + 1);
+        new Characteristic::SerialNumber(serialNumber);
         new Characteristic::Model("RO Filter");
-        new Characteristic::Name(filterNames[i]);
+        new Characteristic::Name(filterStages[i].homeKitName);
         new Characteristic::FirmwareRevision("1.0.0");
 
         // Add FilterMaintenance service with proper HomeKit characteristics
-        filterMaintenanceServices[i] = new DEV_FilterMaintenance(&filters[i], i);
-
-        // Small delay to ensure proper initialization
-        delay(10);
+        filterMaintenanceServices[i] =
+            new DEV_FilterMaintenance(filterStages[i].homeKitName, i, initialState, publisher, toUi);
     }
+    Serial.println("HomeKit: All filter maintenance services created successfully");
 
     // Create water usage sensor accessory
     new SpanAccessory();
@@ -255,94 +425,290 @@ void HomeKitController::begin(FilterInfo filters[5], unsigned int *waterUsage)
     new Characteristic::Identify();
     new Characteristic::Manufacturer("DIY Electronics");
     new Characteristic::SerialNumber("USAGE001");
-    new Characteristic::Model("Water Usage Sensor");
+    new Characteristic::Model("Water Usage Meter");
     new Characteristic::Name("Water Usage");
     new Characteristic::FirmwareRevision("1.0.0");
 
-    // Add water usage sensor service (using temperature to represent usage)
-    waterUsageSensor = new DEV_WaterUsageSensor(waterUsage);
+    // Faucet valve: draws, lifetime volume and flow rate
+    waterUsage = new DEV_WaterUsage(initialState, publisher);
+
+    // Usage and filter life history, restored from flash. The Eve service
+    // that serves it is only registered when asked for; see DEV_EveHistory.
+    restoreHistory();
+    if (eveHistoryService)
+    {
+        historyService = new DEV_EveHistory(history);
+    }
+
+    // Create leak sensor accessory
+    new SpanAccessory();
+    new Service::AccessoryInformation();
+    new Characteristic::Identify();
+    new Characteristic::Manufacturer("DIY Electronics");
+    new Characteristic::SerialNumber("LEAK001");
+    new Characteristic::Model("Flow Leak Detector");
+    new Characteristic::Name("Water Leak");
+    new Characteristic::FirmwareRevision("1.0.0");
+
+    leakSensor = new DEV_LeakSensor(publisher);
+
+    // Create recovery ratio accessory
+    new SpanAccessory();
+    new Service::AccessoryInformation();
+    new Characteristic::Identify();
+    new Characteristic::Manufacturer("DIY Electronics");
+    new Characteristic::SerialNumber("RECOVERY001");
+    new Characteristic::Model("RO Recovery Monitor");
+    new Characteristic::Name("RO Recovery");
+    new Characteristic::FirmwareRevision("1.0.0");
+
+    recoverySensor = new DEV_RecoverySensor(publisher);
 
     // Final initialization
     initialized = true;
-    status = HOMEKIT_WAITING_FOR_PAIRING;
+    linkChanged();
 
     Serial.println("HomeKit: ========== READY FOR PAIRING ==========");
-    Serial.printf("HomeKit: Setup code: %s | Device: RO Monitor Bridge\n", setupCode.c_str());
-    Serial.printf("HomeKit: Services: 6 total (5 filter maintenance + 1 water usage sensor)\n");
+    Serial.printf("HomeKit: Setup code: %s | Device: RO Monitor Bridge\n", setupCode);
+    Serial.printf("HomeKit: Services: %u total (%u filter maintenance + water usage + leak + recovery)\n",
+                  filterCount + 3, filterCount);
     Serial.println("HomeKit: Look for 'RO Monitor Bridge' in iOS Home app");
     Serial.println("HomeKit: Filter status shown as FilterChangeIndication & FilterLifeLevel");
-    Serial.println("HomeKit: Water usage shown as temperature, filters support reset via HomeKit");
+    Serial.println("HomeKit: Water usage shown as a faucet with volume and flow rate, filters support reset via HomeKit");
     Serial.println("HomeKit: ============================================");
-    ;
+
+    // HomeSpan gets its own task on the WiFi core; the UI loop keeps core 1
+    sharedState.write(initialState);
+    xTaskCreatePinnedToCore(taskEntry, "homekit", 8192, this, 1, nullptr, 0);
+}
+
+void HomeKitController::taskEntry(void *arg)
+{
+    HomeKitController *controller = static_cast<HomeKitController *>(arg);
+    for (;;)
+    {
+        controller->poll();
+        controller->mark(HOMEKIT_PHASE_IDLE);
+        vTaskDelay(1); // Let the idle task run and feed the watchdog
+    }
+}
+
+void HomeKitController::applyState(const HomeKitState &state)
+{
+    // The publisher keeps the last value per characteristic; only real changes reach setVal()
+    for (int i = 0; i < filterCount; i++)
+    {
+        filterMaintenanceServices[i]->updateFromState(state);
+    }
+    waterUsage->updateFromState(state);
+    leakSensor->setLeak(state.leakDetected);
+    recoverySensor->setRecovery(state.recoveryPercent, state.rejectLiters);
 }
 
-void HomeKitController::update()
+void HomeKitController::poll()
 {
     if (!initialized)
     {
         return;
     }
 
-    // Update HomeSpan - this is critical and should be called frequently
-    homeSpan.poll();
+    // Take the UI's latest state only when it has changed
+    mark(HOMEKIT_PHASE_APPLY);
+    if (sharedState.getSequence() != appliedSequence)
+    {
+        HomeKitState state;
+        appliedSequence = sharedState.read(state);
+        applyState(state);
+    }
 
-    // Check pairing status using HomeSpan's pairing callbacks and status
-    static bool wasPaired = false;
-    static unsigned long lastStatusCheck = 0;
-    static unsigned long lastConnectionLog = 0;
+    mark(HOMEKIT_PHASE_HISTORY);
+    appendHistory();
 
-    // Check pairing status every 30 seconds (reduced from 2 seconds)
-    if (millis() - lastStatusCheck > 30000)
+    mark(HOMEKIT_PHASE_COMMANDS);
+    HomeKitCommand command;
+    while (toHomeKit.pop(command))
     {
-        // For HomeSpan 1.9.1, we need to monitor the serial output or use callbacks
-        // For now, we'll use a simpler status tracking approach
-
-        if (status == HOMEKIT_NOT_INITIALIZED)
+        if (command.type == HomeKitCommandType::RESET_PAIRING)
         {
-            status = HOMEKIT_WAITING_FOR_PAIRING;
+            // HomeSpan's unpair command erases the controllers and reports
+            // the change through onPairCallback, like an unpair from the Home app
+            Serial.println("HomeKit: Removing all paired controllers...");
+            homeSpan.processSerialCommand("U");
+        }
+        else if (command.type == HomeKitCommandType::SERIAL_COMMAND)
+        {
+            mark(HOMEKIT_PHASE_SETUP);
+            homeSpan.processSerialCommand(command.text); // May prompt and read the UART
+            if (command.text[0] == 'S')
+            {
+                // The code comes from the device config; put it back so the
+                // one on the display is the one HomeKit accepts
+                Serial.printf("HomeKit: Setup code is set in the device config, keeping %s\n", setupCode);
+                homeSpan.setPairingCode(pairingCode);
+            }
+            else if (command.text[0] == 'E' || command.text[0] == 'F')
+            {
+                prefs.remove("setup_code"); // Code erased with the rest; apply it on the next boot
+            }
+            serialHandedOver = false;
+            mark(HOMEKIT_PHASE_COMMANDS);
         }
-
-        lastStatusCheck = millis();
     }
 
-    // Log connection status every 5 minutes (reduced from 15 seconds)
-    if (millis() - lastConnectionLog > 300000)
-    {
-        Serial.printf("HomeKit: Status: %s, Setup Code: %s\n",
-                      getStatusString().c_str(),
-                      setupCode.c_str());
+    // Pending characteristic changes go out together in this poll cycle
+    mark(HOMEKIT_PHASE_FLUSH);
+    publisher.flush(millis());
+
+    // Update HomeSpan - this is critical and should be called frequently.
+    // Pairing and WiFi callbacks run from inside this call.
+    mark(HOMEKIT_PHASE_POLL);
+    stampRequests();
+    homeSpan.poll();
+    timeRequests();
+
+    countConnections();
+}
 
-        if (WiFi.status() == WL_CONNECTED)
+// Device-side latency: from the first pass that sees a request's bytes to
+// the end of the poll that answers it. Time the frames spent buffered at the
+// access point while the radio slept happens before and is not visible here.
+void HomeKitController::stampRequests()
+{
+    if (!timingRequests)
+    {
+        return;
+    }
+    unsigned long now = millis();
+    for (int i = 0; i < homeSpan.maxConnections; i++)
+    {
+        if (!requestWaiting[i] && homeSpan.hap[i]->client && homeSpan.hap[i]->client.available() > 0)
         {
-            Serial.printf("HomeKit: WiFi IP: %s, mDNS: %s.local\n",
-                          WiFi.localIP().toString().c_str(),
-                          WiFi.getHostname());
+            requestWaiting[i] = true;
+            requestSeen[i] = now;
         }
-        else
+    }
+}
+
+void HomeKitController::timeRequests()
+{
+    if (!timingRequests)
+    {
+        return;
+    }
+    unsigned long now = millis();
+    for (int i = 0; i < homeSpan.maxConnections; i++)
+    {
+        if (requestWaiting[i] && !(homeSpan.hap[i]->client && homeSpan.hap[i]->client.available() > 0))
         {
-            Serial.println("HomeKit: WARNING - WiFi disconnected!");
+            requestWaiting[i] = false;
+            unsigned long latency = now - requestSeen[i];
+            latencies.push(latency > 0xFFFF ? 0xFFFF : (uint16_t)latency); // Dropped if the UI is behind
         }
+    }
+}
 
-        lastConnectionLog = millis();
+// HomeSpan has no public session count, and its connection callback counts
+// WiFi connects, so open sessions are counted from HomeSpan 1.9.1's client
+// table (platformio.ini pins that release): a few pointer tests per pass,
+// and only a change is acted on
+void HomeKitController::countConnections()
+{
+    uint8_t open = 0;
+    for (int i = 0; i < homeSpan.maxConnections; i++)
+    {
+        if (homeSpan.hap[i]->client)
+        {
+            open++;
+        }
     }
+    if (open != hapConnections)
+    {
+        Serial.printf("HomeKit: %u controller connection%s open\n", open, open == 1 ? "" : "s");
+        hapConnections = open;
+        linkChanged();
+    }
+}
 
-    // Periodically update services (the services handle their own timing in their loop() methods)
-    // This is just for fallback manual updates if needed
-    if (millis() - lastUpdate > updateInterval)
+void HomeKitController::linkChanged()
+{
+    if (status != HOMEKIT_ERROR)
     {
-        for (int i = 0; i < 5; i++)
+        if (!paired)
         {
-            if (filterMaintenanceServices[i])
-            {
-                filterMaintenanceServices[i]->updateFromFilter();
-            }
+            status = HOMEKIT_WAITING_FOR_PAIRING;
         }
-        if (waterUsageSensor)
+        else
         {
-            waterUsageSensor->updateFromUsage();
+            status = hapConnections > 0 ? HOMEKIT_RUNNING : HOMEKIT_PAIRED;
         }
-        lastUpdate = millis();
     }
+    linkChanges++;
+}
+
+void HomeKitController::onPairCallback(boolean isPaired)
+{
+    HomeKitController *controller = globalHomeKitController;
+    if (!controller)
+    {
+        return;
+    }
+    Serial.println(isPaired ? "HomeKit: PAIRING SUCCESSFUL! Device is now connected to HomeKit"
+                            : "HomeKit: Pairing removed - back to waiting state");
+    controller->paired = isPaired;
+    controller->linkChanged();
+}
+
+void HomeKitController::onStatusCallback(HS_STATUS spanStatus)
+{
+    HomeKitController *controller = globalHomeKitController;
+    if (!controller)
+    {
+        return;
+    }
+    Serial.printf("HomeKit: %s\n", homeSpan.statusString(spanStatus));
+
+    switch (spanStatus)
+    {
+    case HS_WIFI_NEEDED:
+    case HS_WIFI_CONNECTING:
+        controller->wifiConnected = false;
+        break;
+    case HS_PAIRING_NEEDED: // Sent once WiFi is up, and again after every pairing change
+        controller->wifiConnected = true;
+        controller->paired = false;
+        break;
+    case HS_PAIRED:
+        controller->wifiConnected = true;
+        controller->paired = true;
+        break;
+    case HS_WIFI_SCANNING:
+    case HS_ENTERING_CONFIG_MODE:
+    case HS_AP_STARTED:
+    case HS_AP_CONNECTED:
+        // poll() now waits on the user for minutes; keep the watchdog off it
+        controller->mark(HOMEKIT_PHASE_SETUP);
+        return;
+    case HS_CONFIG_MODE_EXIT:
+    case HS_AP_TERMINATED:
+        controller->mark(HOMEKIT_PHASE_POLL);
+        return;
+    default:
+        return; // Setup modes and OTA leave the link as it is
+    }
+    controller->linkChanged();
+}
+
+void HomeKitController::onConnectionCallback(int count)
+{
+    HomeKitController *controller = globalHomeKitController;
+    if (!controller)
+    {
+        return;
+    }
+    Serial.printf("HomeKit: WiFi connected (%d time%s since boot)\n", count, count == 1 ? "" : "s");
+    controller->wifiConnected = true;
+    controller->wifiConnects = (uint16_t)count;
+    controller->linkChanged();
 }
 
 HomeKitStatus HomeKitController::getStatus()
@@ -350,47 +716,110 @@ HomeKitStatus HomeKitController::getStatus()
     return status;
 }
 
-String HomeKitController::getSetupCode()
+const char *HomeKitController::getSetupCode() const
 {
     return setupCode;
 }
 
 bool HomeKitController::isPaired()
 {
-    if (!initialized)
+    return initialized && paired;
+}
+
+void HomeKitController::publishState(const HomeKitState &state)
+{
+    sharedState.write(state);
+}
+
+bool HomeKitController::nextCommand(HomeKitCommand &command)
+{
+    return toUi.pop(command);
+}
+
+bool HomeKitController::addHistory(const HistoryEntry &entry)
+{
+    return historyQueue.push(entry);
+}
+
+bool HomeKitController::nextLatency(uint16_t &latencyMs)
+{
+    return latencies.pop(latencyMs);
+}
+
+// The ring belongs to the HomeKit task; samples from the UI arrive by queue
+void HomeKitController::appendHistory()
+{
+    HistoryEntry entry;
+    bool appended = false;
+    while (historyQueue.pop(entry))
     {
-        return false;
+        if (history.append(entry))
+        {
+            appended = true;
+            historyUnsaved++;
+        }
+    }
+    if (!appended)
+    {
+        return;
+    }
+    if (historyService)
+    {
+        historyService->refreshStatus();
     }
 
-    // In HomeSpan 1.9.1, we don't have direct access to controller count
-    // We'll use a simple status-based approach
-    return (status == HOMEKIT_PAIRED || status == HOMEKIT_RUNNING);
+    if (historyUnsaved >= HISTORY_SAVE_EVERY)
+    {
+        saveHistory();
+        historyUnsaved = 0;
+    }
 }
 
-void HomeKitController::updateSensors(FilterInfo filters[5], unsigned int waterUsage)
+void HomeKitController::restoreHistory()
 {
-    if (!initialized)
+    size_t length = 0;
+    if (historyStorage)
     {
-        return;
+        length = historyStorage->read(HISTORY_PATH, 0, historyImage, sizeof(historyImage));
     }
 
-    // Update filter maintenance services
-    for (int i = 0; i < 5; i++)
+    // A checkpoint from before the filesystem moves out of NVS once
+    bool legacy = false;
+    if (length == 0)
     {
-        if (filterMaintenanceServices[i])
-        {
-            filterMaintenanceServices[i]->updateFromFilter();
-        }
+        length = prefs.getBytes(HISTORY_LEGACY_KEY, historyImage, sizeof(historyImage));
+        legacy = length > 0;
+    }
+    if (length > 0 && !history.restoreCheckpoint(historyImage, length))
+    {
+        Serial.println("HomeKit: Stored history rejected, starting empty");
+        history.clear();
     }
+    if (legacy && historyStorage)
+    {
+        saveHistory();
+        prefs.remove(HISTORY_LEGACY_KEY);
+    }
+}
 
-    // Update water usage sensor
-    if (waterUsageSensor)
+// Written beside the old copy and renamed over it, so a reset mid-write
+// leaves the previous checkpoint
+void HomeKitController::saveHistory()
+{
+    if (!historyStorage)
+    {
+        return;
+    }
+    size_t length = history.saveCheckpoint(historyImage, sizeof(historyImage));
+    historyStorage->remove(HISTORY_TEMP_PATH);
+    if (!historyStorage->append(HISTORY_TEMP_PATH, historyImage, length) ||
+        !historyStorage->rename(HISTORY_TEMP_PATH, HISTORY_PATH))
     {
-        waterUsageSensor->updateFromUsage();
+        Serial.println("HomeKit: History checkpoint failed");
     }
 }
 
-String HomeKitController::getStatusString()
+const char *HomeKitController::getStatusString() const
 {
     switch (status)
     {
@@ -417,21 +846,40 @@ void HomeKitController::resetPairing()
         return;
     }
 
-    Serial.println("HomeKit: Resetting pairing data...");
-    homeSpan.deleteStoredValues();
-    status = HOMEKIT_WAITING_FOR_PAIRING;
-    Serial.println("HomeKit: Pairing reset complete - restart device to take effect");
+    HomeKitCommand command = {HomeKitCommandType::RESET_PAIRING, 0, ""};
+    toHomeKit.push(command);
+}
+
+bool HomeKitController::sendSerialCommand(const char *line)
+{
+    if (!initialized || serialHandedOver)
+    {
+        return false;
+    }
+    HomeKitCommand command = {HomeKitCommandType::SERIAL_COMMAND, 0, ""};
+    strncpy(command.text, line, sizeof(command.text) - 1);
+    command.text[sizeof(command.text) - 1] = '\0';
+    serialHandedOver = true; // Before the push: the HomeKit task may run it at once
+    if (!toHomeKit.push(command))
+    {
+        serialHandedOver = false;
+        return false;
+    }
+    return true;
 }
 
 void HomeKitController::printDiagnostics()
 {
     Serial.println("HomeKit: ========== DIAGNOSTIC INFO ==========");
     Serial.printf("HomeKit: Initialized: %s\n", initialized ? "Yes" : "No");
-    Serial.printf("HomeKit: Status: %s\n", getStatusString().c_str());
-    Serial.printf("HomeKit: Setup Code: %s\n", setupCode.c_str());
+    Serial.printf("HomeKit: Status: %s\n", getStatusString());
+    Serial.printf("HomeKit: Setup Code: %s\n", setupCode);
+    const UpdateStats &stats = publisher.getStats();
+    Serial.printf("HomeKit: Characteristic updates: %u sent in %u batches, %u suppressed, %u coalesced\n",
+                  stats.sent, publisher.getBatches(), stats.suppressed, publisher.getCoalesced());
 
-    // Note: HomeSpan 1.9.1 doesn't provide getControllerCount()
-    Serial.println("HomeKit: Pairing Status: Check serial output for pairing messages");
+    Serial.printf("HomeKit: Paired: %s | Open connections: %u | WiFi connects: %u | Link changes: %u\n",
+                  paired ? "Yes" : "No", hapConnections, wifiConnects, linkChanges);
 
     Serial.printf("HomeKit: WiFi Status: %s\n", WiFi.status() == WL_CONNECTED ? "Connected" : "Disconnected");
     if (WiFi.status() == WL_CONNECTED)
@@ -445,31 +893,3 @@ void HomeKitController::printDiagnostics()
     Serial.printf("HomeKit: Uptime: %lu ms\n", millis());
     Serial.println("HomeKit: ======================================");
 }
-
-void HomeKitController::setPairingStatus(bool paired)
-{
-    if (paired)
-    {
-        status = HOMEKIT_PAIRED;
-        Serial.println("HomeKit: Status manually set to PAIRED");
-    }
-    else
-    {
-        status = HOMEKIT_WAITING_FOR_PAIRING;
-        Serial.println("HomeKit: Status manually set to WAITING_FOR_PAIRING");
-    }
-}
-
-void HomeKitController::onPairingComplete(bool paired)
-{
-    if (paired)
-    {
-        status = HOMEKIT_RUNNING;
-        Serial.println("HomeKit: PAIRING SUCCESSFUL! Device is now connected to HomeKit");
-    }
-    else
-    {
-        status = HOMEKIT_WAITING_FOR_PAIRING;
-        Serial.println("HomeKit: Pairing removed or failed - back to waiting state");
-    }
-}
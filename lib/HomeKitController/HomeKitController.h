@@ -3,9 +3,12 @@
 
 #include "HomeSpan.h"
 #include <Preferences.h>
-
-// Forward declaration
-struct FilterInfo;
+#include "EventPublisher.h"
+#include "EveHistory.h"
+#include "FilterStages.h"
+#include "JournalStorage.h"
+#include "SharedState.h"
+#include "StallWatchdog.h"
 
 enum HomeKitStatus
 {
@@ -16,8 +19,61 @@ enum HomeKitStatus
     HOMEKIT_ERROR
 };
 
-// Custom pairing callback to track HomeKit pairing status
-extern void homeKitPairingCallback(bool isPaired);
+// Device state the UI task publishes for HomeKit. Plain data, handed over
+// through a seqlock so the HomeKit task never sees a half-updated copy.
+struct HomeKitState
+{
+    uint8_t filterPercent[FILTER_STAGE_MAX];      // First setFilterStages() entries used
+    uint8_t filterChangeNeeded[FILTER_STAGE_MAX];
+    uint32_t waterUsageLiters;
+    float flowLitersPerMinute;
+    uint8_t waterInUse; // A draw is in progress
+    float recoveryPercent; // Negative = unknown
+    uint32_t rejectLiters;
+    uint8_t leakDetected;
+};
+
+// Phases of a HomeKit task pass, for the stall watchdog's breadcrumbs
+enum HomeKitPhase : uint8_t
+{
+    HOMEKIT_PHASE_APPLY,    // Applying the UI's state to the services
+    HOMEKIT_PHASE_HISTORY,  // Appending and checkpointing Eve history
+    HOMEKIT_PHASE_COMMANDS, // UI requests; a pairing reset erases NVS
+    HOMEKIT_PHASE_FLUSH,    // Sending coalesced characteristic changes
+    HOMEKIT_PHASE_POLL,     // homeSpan.poll(); pair-setup math runs here
+    HOMEKIT_PHASE_IDLE,     // Yielding between passes
+    HOMEKIT_PHASE_SETUP,    // HomeSpan's WiFi, access point or config mode; waits on the user
+    HOMEKIT_PHASE_COUNT
+};
+extern const StallPhase HOMEKIT_STALL_PHASES[HOMEKIT_PHASE_COUNT];
+
+// Requests passed between the UI and HomeKit tasks
+enum class HomeKitCommandType : uint8_t
+{
+    FILTER_RESET,  // HomeKit -> UI: index = filter reset from the Home app
+    RESET_PAIRING, // UI -> HomeKit
+    SERIAL_COMMAND // UI -> HomeKit: text is a HomeSpan CLI command, e.g. "W"
+};
+
+struct HomeKitCommand
+{
+    HomeKitCommandType type;
+    uint8_t index;
+    char text[24];
+};
+
+typedef SpscQueue<HomeKitCommand, 8> HomeKitCommandQueue;
+typedef SpscQueue<HistoryEntry, 4> HistoryQueue;
+typedef SpscQueue<uint16_t, 16> LatencyQueue;
+
+// Sets a HomeSpan characteristic on behalf of the EventPublisher
+struct SpanCharacteristicSink : CharacteristicSink
+{
+    SpanCharacteristic *characteristic = nullptr;
+    bool wholeNumber = false; // Round before setting
+
+    void publish(float value) override;
+};
 
 // Filter maintenance service using proper HomeKit FilterMaintenance service
 struct DEV_FilterMaintenance : Service::FilterMaintenance
@@ -25,51 +81,197 @@ struct DEV_FilterMaintenance : Service::FilterMaintenance
     SpanCharacteristic *filterChangeIndication; // 0=NO_CHANGE_NEEDED, 1=CHANGE_NEEDED
     SpanCharacteristic *filterLifeLevel;        // Filter life remaining as percentage (0-100)
     SpanCharacteristic *resetFilterIndication;  // Write-only characteristic for filter reset
-    FilterInfo *filterRef;
+    const char *filterName;
     int filterIndex;
+    HomeKitCommandQueue *resetRequests;
+    EventPublisher *publisher;
+    SpanCharacteristicSink lifeSink;
+    SpanCharacteristicSink changeSink;
+    int lifeHandle;
+    int changeHandle;
+    int lastReportedPercentage; // For the change log
 
-    DEV_FilterMaintenance(FilterInfo *filter, int index);
-    void loop() override;
+    DEV_FilterMaintenance(const char *name, int index, const HomeKitState &state, EventPublisher &publisher,
+                          HomeKitCommandQueue &resetRequests);
     boolean update() override;
-    void updateFromFilter();
+    void updateFromState(const HomeKitState &state);
 };
 
-// Water usage sensor that reports total water usage
-struct DEV_WaterUsageSensor : Service::TemperatureSensor
+// Water drawn at the faucet. A Valve whose InUse follows draws, so Home app
+// automations can trigger on it, with the lifetime volume and flow rate in
+// custom characteristics for apps such as Eve.
+struct DEV_WaterUsage : Service::Valve
 {
-    SpanCharacteristic *temperature; // We'll use temperature to represent water usage (in hundreds of liters)
-    unsigned int *waterUsageRef;
+    SpanCharacteristic *active;      // Mirrors inUse; there is no valve to drive
+    SpanCharacteristic *inUse;       // 1 while water is drawn
+    SpanCharacteristic *valveType;   // Water faucet
+    SpanCharacteristic *totalVolume; // Lifetime permeate in liters
+    SpanCharacteristic *flowRate;    // Liters per minute
+    EventPublisher *publisher;
+    SpanCharacteristicSink activeSink;
+    SpanCharacteristicSink inUseSink;
+    SpanCharacteristicSink totalSink;
+    SpanCharacteristicSink rateSink;
+    int activeHandle;
+    int inUseHandle;
+    int totalHandle;
+    int rateHandle;
+    bool drawing; // As last published
 
-    DEV_WaterUsageSensor(unsigned int *waterUsage);
-    void loop() override;
-    void updateFromUsage();
+    DEV_WaterUsage(const HomeKitState &state, EventPublisher &publisher);
+    boolean update() override;
+    void updateFromState(const HomeKitState &state);
 };
 
+// Leak sensor raised by the flow leak detector
+struct DEV_LeakSensor : Service::LeakSensor
+{
+    SpanCharacteristic *leakDetected; // 0=LEAK_NOT_DETECTED, 1=LEAK_DETECTED
+    EventPublisher *publisher;
+    SpanCharacteristicSink leakSink;
+    int leakHandle;
+
+    DEV_LeakSensor(EventPublisher &publisher);
+    void setLeak(bool detected);
+};
+
+// Eve history service on the water usage accessory. HomeSpan has no read
+// callback, so every request the Eve app writes is answered with one batch
+// from its offset onwards; the ring itself is never copied. Eve reads the
+// entries again after one request and expects the next batch, which this
+// cannot tell apart, so a sync would stop after the first 16 entries. The
+// controller therefore leaves it unregistered unless asked for it.
+struct DEV_EveHistory : SpanService
+{
+    SpanCharacteristic *status;  // Entry range and reference time
+    SpanCharacteristic *entries; // The current batch
+    SpanCharacteristic *request; // First entry the client wants
+    SpanCharacteristic *setTime; // Written by Eve; the clock comes from NTP
+    EveHistoryServer server;
+
+    DEV_EveHistory(const HistoryRing &ring);
+    boolean update() override;
+    void refreshStatus();
+};
+
+// RO recovery ratio reported as relative humidity (0-100%), with the reject
+// water volume in a custom characteristic for apps that show custom values
+struct DEV_RecoverySensor : Service::HumiditySensor
+{
+    SpanCharacteristic *recovery;     // Permeate share of feed water in percent
+    SpanCharacteristic *rejectVolume; // Lifetime reject water in liters
+    EventPublisher *publisher;
+    SpanCharacteristicSink recoverySink;
+    SpanCharacteristicSink rejectSink;
+    int recoveryHandle;
+    int rejectHandle;
+
+    DEV_RecoverySensor(EventPublisher &publisher);
+    void setRecovery(float recoveryPercent, uint32_t rejectLiters);
+};
+
+// Runs HomeSpan on its own task. The UI task hands state over with
+// publishState() and collects Home app requests with nextCommand(); nothing
+// else is shared, so neither task ever waits for the other.
 class HomeKitController
 {
 private:
     Preferences prefs;
-    HomeKitStatus status;
+    volatile HomeKitStatus status;
     bool initialized;
-    String setupCode;
-    DEV_FilterMaintenance *filterMaintenanceServices[5];
-    DEV_WaterUsageSensor *waterUsageSensor;
-    unsigned long lastUpdate;
-    const unsigned long updateInterval = 10000; // Update every 10 seconds
+
+    // Link state, written by HomeSpan callbacks on the HomeKit task
+    volatile bool paired;
+    volatile bool wifiConnected;
+    volatile uint8_t hapConnections; // Open controller sessions
+    volatile uint16_t wifiConnects;  // Including reconnects
+    volatile uint32_t linkChanges;
+    volatile bool serialHandedOver; // A HomeSpan command owns the UART until it returns
+    char setupCode[11];  // As shown to the user, 123-45-678
+    char pairingCode[9]; // Eight digits, as HomeSpan takes it
+    const FilterStageInfo *filterStages;
+    uint8_t filterCount;
+    DEV_FilterMaintenance *filterMaintenanceServices[FILTER_STAGE_MAX];
+    DEV_WaterUsage *waterUsage;
+    DEV_LeakSensor *leakSensor;
+    DEV_RecoverySensor *recoverySensor;
+    DEV_EveHistory *historyService;
+    HistoryRing history;
+    HistoryQueue historyQueue;
+    JournalStorage *historyStorage; // Optional; checkpoints are kept in RAM only without it
+    bool eveHistoryService;
+    uint8_t historyUnsaved; // Samples since the last checkpoint
+    EventPublisher publisher; // All sensor characteristic changes go through here
+    Seqlock<HomeKitState> sharedState;
+    BreadcrumbTrail *trail; // Optional
+    uint32_t appliedSequence;
+    HomeKitCommandQueue toUi;
+    HomeKitCommandQueue toHomeKit;
+
+    // Request timing: a session with bytes waiting before homeSpan.poll() has
+    // a request in; it is answered once the poll leaves nothing waiting
+    static const int MAX_TIMED_SESSIONS = 16;
+#ifdef CONFIG_LWIP_MAX_SOCKETS
+    static_assert(MAX_TIMED_SESSIONS >= CONFIG_LWIP_MAX_SOCKETS, "HomeSpan can hold a session per lwIP socket");
+#endif
+    bool timingRequests; // Off when HomeSpan allows more sessions than are timed
+    bool requestWaiting[MAX_TIMED_SESSIONS];
+    unsigned long requestSeen[MAX_TIMED_SESSIONS];
+    LatencyQueue latencies; // To the UI task, in ms
+
+    static void taskEntry(void *arg);
+    static void onPairCallback(boolean isPaired);
+    static void onStatusCallback(HS_STATUS spanStatus);
+    static void onConnectionCallback(int count);
+    void applyState(const HomeKitState &state);
+    void appendHistory();
+    void restoreHistory();
+    void saveHistory();
+    void countConnections();
+    void stampRequests();
+    void timeRequests();
+    void linkChanged(); // Re-derive status after a link event
+    void mark(HomeKitPhase phase)
+    {
+        if (trail)
+        {
+            markPhase(*trail, phase, ESP.getCycleCount());
+        }
+    }
 
 public:
     HomeKitController();
-    void begin(FilterInfo filters[5], unsigned int *waterUsage);
-    void update();
+    void setSetupCode(const char *code); // Before begin(); eight digits
+    void setFilterStages(const FilterStageInfo *stages, uint8_t count); // Before begin(); kept, not copied
+    void setTrail(BreadcrumbTrail *breadcrumbs) { trail = breadcrumbs; } // Before begin(); HomeKit task marks it
+    void setHistoryStorage(JournalStorage *storage) { historyStorage = storage; } // Before begin(); LittleFS
+    // Before begin(). Off by default: Eve would only ever get the first batch.
+    // History is recorded and checkpointed either way.
+    void setEveHistoryService(bool enabled) { eveHistoryService = enabled; }
+    void begin(const HomeKitState &initialState); // Starts the HomeKit task
+    void poll();                                   // One HomeKit task pass
+
+    // UI task side
+    void publishState(const HomeKitState &state);
+    bool nextCommand(HomeKitCommand &command);
+    bool addHistory(const HistoryEntry &entry); // False if the HomeKit task is behind
+    bool nextLatency(uint16_t &latencyMs);       // Request-to-response times, oldest first
     HomeKitStatus getStatus();
-    String getSetupCode();
+    const char *getSetupCode() const;
     bool isPaired();
-    void updateSensors(FilterInfo filters[5], unsigned int waterUsage);
-    String getStatusString();
-    void resetPairing();
+    bool isWifiConnected() const { return wifiConnected; }
+    uint8_t getConnectionCount() const { return hapConnections; }
+    uint32_t getLinkChanges() const { return linkChanges; } // Bumped on every link event
+    const UpdateStats &getUpdateStats() const { return publisher.getStats(); }
+    const char *getStatusString() const;
+    void resetPairing(); // Carried out on the HomeKit task
+
+    // HomeSpan does not read the UART itself; the UI's parser forwards its
+    // commands. Some, like "W", prompt and read their answers, so the UI
+    // must leave the UART alone while isSerialHandedOver().
+    bool sendSerialCommand(const char *line);
+    bool isSerialHandedOver() const { return serialHandedOver; }
     void printDiagnostics();             // New diagnostic method
-    void setPairingStatus(bool paired);  // Manual pairing status update
-    void onPairingComplete(bool paired); // Callback for pairing status
 };
 
 #endif
@@ -0,0 +1,67 @@
+#pragma once
+
+// Host stand-in for the parts of the Arduino-ESP32 core that the HomeKit
+// code uses. Native builds only; the esp32dev env ignores this library.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+typedef bool boolean;
+
+// Minimal String on std::string
+class String
+{
+public:
+    String() {}
+    String(const char *text) : text(text ? text : "") {}
+    String(const std::string &text) : text(text) {}
+    explicit String(int value) : text(std::to_string(value)) {}
+
+    const char *c_str() const { return text.c_str(); }
+    size_t length() const { return text.size(); }
+    bool operator==(const char *other) const { return text == other; }
+    String operator+(const String &other) const { return String(text + other.text); }
+    friend String operator+(const char *left, const String &right) { return String(std::string(left) + right.text); }
+
+private:
+    std::string text;
+};
+
+// Serial output is swallowed; tests check behaviour, not log text
+class HardwareSerial
+{
+public:
+    void begin(unsigned long) {}
+    int printf(const char *, ...) { return 0; }
+    size_t print(const char *) { return 0; }
+    size_t println(const char * = "") { return 0; }
+};
+extern HardwareSerial Serial;
+
+// Simulated clock, advanced by the tests
+unsigned long millis();
+void hostSetMillis(unsigned long now);
+void hostAdvanceMillis(unsigned long delta);
+
+class EspClass
+{
+public:
+    uint32_t getFreeHeap() { return 200000; }
+    uint32_t getCycleCount() { return (uint32_t)(millis() * 240000UL); } // 240 MHz on the simulated clock
+};
+extern EspClass ESP;
+
+// FreeRTOS: tasks are not started on the host; tests call the task body directly
+typedef void *TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+#define pdPASS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+BaseType_t xTaskCreatePinnedToCore(void (*task)(void *), const char *name, uint32_t stackDepth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+int hostTasksCreated();
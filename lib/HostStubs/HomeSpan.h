@@ -0,0 +1,234 @@
+#pragma once
+
+// Host stand-in for the HomeSpan API surface HomeKitController uses. Values
+// are kept as doubles; every setVal() is counted so tests can measure the
+// event traffic a real HomeSpan would send to paired controllers.
+
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "WiFi.h"
+
+enum class Category
+{
+    Bridges
+};
+
+enum HS_STATUS
+{
+    HS_WIFI_NEEDED,
+    HS_WIFI_CONNECTING,
+    HS_PAIRING_NEEDED,
+    HS_PAIRED,
+    HS_ENTERING_CONFIG_MODE,
+    HS_CONFIG_MODE_EXIT,
+    HS_AP_STARTED,
+    HS_AP_CONNECTED,
+    HS_AP_TERMINATED,
+    HS_WIFI_SCANNING
+};
+
+// One slot of HomeSpan's controller session table
+struct HAPClient
+{
+    // Stand-in for the session's WiFiClient
+    struct Client
+    {
+        bool open;
+        int pending; // Request bytes waiting; poll() answers them
+
+        explicit operator bool() const { return open; }
+        int available() const { return open ? pending : 0; }
+    } client;
+};
+
+struct SpanService;
+
+struct SpanCharacteristic
+{
+    double value;
+    double newValue;
+    std::vector<uint8_t> data; // DATA format characteristics
+    std::vector<uint8_t> newData;
+    bool isUpdated;
+    uint32_t setCount;
+    SpanService *service;
+
+    explicit SpanCharacteristic(double initial = 0);
+
+    template <typename T>
+    void setVal(T val, bool = true)
+    {
+        value = (double)val;
+        setCount++;
+    }
+    template <typename T = int>
+    T getVal()
+    {
+        return (T)value;
+    }
+    template <typename T = int>
+    T getNewVal()
+    {
+        return (T)newValue;
+    }
+    void setData(const uint8_t *bytes, size_t len, bool = true)
+    {
+        data.assign(bytes, bytes + len);
+        setCount++;
+    }
+    size_t getData(uint8_t *bytes, size_t len) { return copyData(data, bytes, len); }
+    size_t getNewData(uint8_t *bytes, size_t len) { return copyData(newData, bytes, len); }
+    bool updated() { return isUpdated; }
+    SpanCharacteristic *setRange(double, double, double = 0) { return this; }
+
+private:
+    // As HomeSpan: a null buffer asks for the size
+    static size_t copyData(const std::vector<uint8_t> &source, uint8_t *bytes, size_t len)
+    {
+        if (bytes && source.size() <= len)
+        {
+            memcpy(bytes, source.data(), source.size());
+        }
+        return source.size();
+    }
+};
+
+struct SpanService
+{
+    std::vector<SpanCharacteristic *> characteristics;
+
+    SpanService();
+    SpanService(const char *type, const char *hapName, bool isCustom = false);
+    virtual ~SpanService() {}
+    virtual boolean update() { return true; }
+    virtual void loop() {}
+};
+
+struct SpanAccessory
+{
+    uint32_t aid;
+    SpanAccessory(uint32_t aid = 0) : aid(aid) {}
+};
+
+#define HOST_SERVICE(NAME) \
+    struct NAME : SpanService \
+    { \
+    };
+namespace Service
+{
+    HOST_SERVICE(AccessoryInformation)
+    HOST_SERVICE(FilterMaintenance)
+    HOST_SERVICE(Valve)
+    HOST_SERVICE(LeakSensor)
+    HOST_SERVICE(HumiditySensor)
+}
+
+// Numeric characteristics start at their initial value; strings are not kept
+inline double hostInitialValue(double value)
+{
+    return value;
+}
+inline double hostInitialValue(const char *)
+{
+    return 0;
+}
+
+#define HOST_CHARACTERISTIC(NAME) \
+    struct NAME : SpanCharacteristic \
+    { \
+        NAME() : SpanCharacteristic(0) {} \
+        template <typename T> \
+        NAME(T initial) : SpanCharacteristic(hostInitialValue(initial)) {} \
+    };
+namespace Characteristic
+{
+    HOST_CHARACTERISTIC(Identify)
+    HOST_CHARACTERISTIC(Manufacturer)
+    HOST_CHARACTERISTIC(SerialNumber)
+    HOST_CHARACTERISTIC(Model)
+    HOST_CHARACTERISTIC(Name)
+    HOST_CHARACTERISTIC(FirmwareRevision)
+    HOST_CHARACTERISTIC(FilterChangeIndication)
+    HOST_CHARACTERISTIC(FilterLifeLevel)
+    HOST_CHARACTERISTIC(ResetFilterIndication)
+    HOST_CHARACTERISTIC(Active)
+    HOST_CHARACTERISTIC(InUse)
+    HOST_CHARACTERISTIC(ValveType)
+    HOST_CHARACTERISTIC(LeakDetected)
+    HOST_CHARACTERISTIC(CurrentRelativeHumidity)
+}
+
+#define CUSTOM_CHAR(NAME, UUID, PERMS, FORMAT, DEFVAL, MINVAL, MAXVAL, STATIC_RANGE) \
+    namespace Characteristic \
+    { \
+        HOST_CHARACTERISTIC(NAME) \
+    }
+#define CUSTOM_CHAR_DATA(NAME, UUID, PERMS) \
+    namespace Characteristic \
+    { \
+        HOST_CHARACTERISTIC(NAME) \
+    }
+
+struct Span
+{
+    static const int HOST_MAX_CONNECTIONS = 20; // Room to test a table longer than HomeSpan's default
+
+    std::vector<SpanService *> services;
+    int pollCount = 0;
+    int deleteCount = 0;
+    int pairingCodeCount = 0;
+    unsigned long pollMs = 0; // Simulated time one poll() takes
+    bool serialInputDisabled = false;
+    std::vector<std::string> serialCommands;
+    HAPClient clients[HOST_MAX_CONNECTIONS];
+    HAPClient *hap[HOST_MAX_CONNECTIONS];
+    int maxConnections = 8;
+    void (*pairCallback)(boolean) = nullptr;
+    void (*statusCallback)(HS_STATUS) = nullptr;
+    void (*connectionCallback)(int) = nullptr;
+    void (*pollHook)() = nullptr; // Runs inside poll(), as a blocking setup mode would
+
+    Span();
+    Span &begin(Category, const char * = "") { return *this; }
+    Span &enableAutoStartAP() { return *this; }
+    Span &setLogLevel(int) { return *this; }
+    Span &setPairingCode(const char *)
+    {
+        pairingCodeCount++;
+        return *this;
+    }
+    Span &setPairCallback(void (*callback)(boolean))
+    {
+        pairCallback = callback;
+        return *this;
+    }
+    Span &setStatusCallback(void (*callback)(HS_STATUS))
+    {
+        statusCallback = callback;
+        return *this;
+    }
+    Span &setConnectionCallback(void (*callback)(int))
+    {
+        connectionCallback = callback;
+        return *this;
+    }
+    const char *statusString(HS_STATUS) { return "status"; }
+    void deleteStoredValues() { deleteCount++; }
+    Span &setSerialInputDisable(bool disable)
+    {
+        serialInputDisabled = disable;
+        return *this;
+    }
+    void processSerialCommand(const char *command); // Recorded in serialCommands; "U" unpairs
+    void poll(); // Runs every service's loop(), like HomeSpan
+
+    // Test helpers: a controller writes a characteristic; uncounted setVal totals
+    void write(SpanCharacteristic *characteristic, double value);
+    void writeData(SpanCharacteristic *characteristic, const uint8_t *bytes, size_t len);
+    uint32_t totalSetCount() const;
+    void setOpenSessions(int count); // Sessions seen on the next poll
+    void sendRequest(int session);   // Bytes waiting until the next poll
+    void reset(); // Forget all services and callbacks, for a fresh controller
+};
+extern Span homeSpan;
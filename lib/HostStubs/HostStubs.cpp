@@ -0,0 +1,165 @@
+#include "Arduino.h"
+#include "HomeSpan.h"
+#include "WiFi.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+Span homeSpan;
+
+static unsigned long hostMillis = 0;
+static int tasksCreated = 0;
+
+unsigned long millis()
+{
+    return hostMillis;
+}
+
+void hostSetMillis(unsigned long now)
+{
+    hostMillis = now;
+}
+
+void hostAdvanceMillis(unsigned long delta)
+{
+    hostMillis += delta;
+}
+
+BaseType_t xTaskCreatePinnedToCore(void (*)(void *), const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *,
+                                   BaseType_t)
+{
+    tasksCreated++;
+    return pdPASS;
+}
+
+void vTaskDelay(TickType_t)
+{
+}
+
+int hostTasksCreated()
+{
+    return tasksCreated;
+}
+
+// Characteristics belong to the most recently created service, as in HomeSpan
+SpanCharacteristic::SpanCharacteristic(double initial)
+    : value(initial), newValue(initial), isUpdated(false), setCount(0), service(nullptr)
+{
+    if (!homeSpan.services.empty())
+    {
+        service = homeSpan.services.back();
+        service->characteristics.push_back(this);
+    }
+}
+
+SpanService::SpanService()
+{
+    homeSpan.services.push_back(this);
+}
+
+SpanService::SpanService(const char *, const char *, bool)
+{
+    homeSpan.services.push_back(this);
+}
+
+Span::Span()
+{
+    for (int i = 0; i < HOST_MAX_CONNECTIONS; i++)
+    {
+        hap[i] = &clients[i];
+    }
+    reset();
+}
+
+void Span::poll()
+{
+    pollCount++;
+    hostAdvanceMillis(pollMs);
+    if (pollHook)
+    {
+        pollHook();
+    }
+    for (size_t i = 0; i < services.size(); i++)
+    {
+        services[i]->loop();
+    }
+    for (int i = 0; i < HOST_MAX_CONNECTIONS; i++)
+    {
+        clients[i].client.pending = 0;
+    }
+}
+
+void Span::write(SpanCharacteristic *characteristic, double value)
+{
+    characteristic->newValue = value;
+    characteristic->isUpdated = true;
+    if (characteristic->service && characteristic->service->update())
+    {
+        characteristic->value = value;
+    }
+    characteristic->isUpdated = false;
+}
+
+void Span::writeData(SpanCharacteristic *characteristic, const uint8_t *bytes, size_t len)
+{
+    characteristic->newData.assign(bytes, bytes + len);
+    characteristic->isUpdated = true;
+    if (characteristic->service && characteristic->service->update())
+    {
+        characteristic->data = characteristic->newData;
+    }
+    characteristic->isUpdated = false;
+}
+
+uint32_t Span::totalSetCount() const
+{
+    uint32_t total = 0;
+    for (size_t i = 0; i < services.size(); i++)
+    {
+        for (size_t j = 0; j < services[i]->characteristics.size(); j++)
+        {
+            total += services[i]->characteristics[j]->setCount;
+        }
+    }
+    return total;
+}
+
+void Span::setOpenSessions(int count)
+{
+    for (int i = 0; i < HOST_MAX_CONNECTIONS; i++)
+    {
+        clients[i].client.open = i < count;
+        clients[i].client.pending = 0;
+    }
+}
+
+void Span::processSerialCommand(const char *command)
+{
+    serialCommands.push_back(command);
+    if (strcmp(command, "U") == 0 && pairCallback)
+    {
+        pairCallback(false); // HomeSpan erases the controllers and reports it
+    }
+}
+
+void Span::sendRequest(int session)
+{
+    clients[session].client.pending = 1;
+}
+
+void Span::reset()
+{
+    services.clear();
+    pollCount = 0;
+    deleteCount = 0;
+    pairingCodeCount = 0;
+    pollMs = 0;
+    maxConnections = 8;
+    serialInputDisabled = false;
+    serialCommands.clear();
+    setOpenSessions(0);
+    pairCallback = nullptr;
+    statusCallback = nullptr;
+    connectionCallback = nullptr;
+    pollHook = nullptr;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <map>
+#include "Arduino.h"
+
+// In-memory NVS namespace
+class Preferences
+{
+public:
+    bool begin(const char *, bool = false) { return true; }
+    void end() {}
+
+    size_t getString(const char *key, char *value, size_t maxLen)
+    {
+        std::map<std::string, std::string>::iterator it = values.find(key);
+        if (it == values.end() || it->second.size() + 1 > maxLen)
+        {
+            return 0;
+        }
+        memcpy(value, it->second.c_str(), it->second.size() + 1);
+        return it->second.size() + 1;
+    }
+
+    size_t putString(const char *key, const char *value)
+    {
+        values[key] = value;
+        return strlen(value);
+    }
+
+    size_t putBytes(const char *key, const void *value, size_t len)
+    {
+        values[key] = std::string((const char *)value, len);
+        return len;
+    }
+
+    size_t getBytes(const char *key, void *buffer, size_t maxLen)
+    {
+        std::map<std::string, std::string>::iterator it = values.find(key);
+        if (it == values.end() || it->second.size() > maxLen)
+        {
+            return 0;
+        }
+        memcpy(buffer, it->second.data(), it->second.size());
+        return it->second.size();
+    }
+
+    bool remove(const char *key) { return values.erase(key) > 0; }
+
+private:
+    std::map<std::string, std::string> values;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Arduino.h"
+
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+class IPAddress
+{
+public:
+    String toString() const { return "192.168.1.50"; }
+};
+
+class WiFiClass
+{
+public:
+    int status() { return connected ? WL_CONNECTED : WL_DISCONNECTED; }
+    IPAddress localIP() { return IPAddress(); }
+    String SSID() { return "host"; }
+    const char *getHostname() { return hostname.c_str(); }
+    bool setHostname(const char *name)
+    {
+        hostname = name;
+        return true;
+    }
+
+    bool connected = false;
+
+private:
+    std::string hostname;
+};
+extern WiFiClass WiFi;
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+
+// Minimal blob store interface so persistence logic runs on the host.
+// On the device it is backed by Preferences (NVS).
+class KeyValueStore
+{
+public:
+    virtual ~KeyValueStore() {}
+
+    // Returns the number of bytes read, 0 if the key does not exist
+    virtual size_t read(const char *key, void *data, size_t length) = 0;
+    virtual bool write(const char *key, const void *data, size_t length) = 0;
+};
+
+#ifdef ARDUINO
+#include <Preferences.h>
+
+class PreferencesStore : public KeyValueStore
+{
+private:
+    Preferences &prefs;
+
+public:
+    explicit PreferencesStore(Preferences &preferences) : prefs(preferences) {}
+
+    size_t read(const char *key, void *data, size_t length) override
+    {
+        if (!prefs.isKey(key))
+        {
+            return 0;
+        }
+        return prefs.getBytes(key, data, length);
+    }
+
+    bool write(const char *key, const void *data, size_t length) override
+    {
+        return prefs.putBytes(key, data, length) == length;
+    }
+};
+#endif
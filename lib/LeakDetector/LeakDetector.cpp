@@ -0,0 +1,152 @@
+#include "LeakDetector.h"
+
+// Shortest window the trickle average is judged over - a single drip
+// pulse looks like a fast flow when measured over one sample period
+static const unsigned long TRICKLE_MIN_WINDOW_MS = 60000;
+
+LeakDetector::LeakDetector()
+{
+    reset();
+}
+
+void LeakDetector::reset()
+{
+    flowing = false;
+    flowStartTime = 0;
+    lastFlowTime = 0;
+    rateMlPerMin = 0;
+    rateAbove = false;
+    rateAboveSince = 0;
+    trickling = false;
+    trickleStartTime = 0;
+    lastTrickleTime = 0;
+    trickleVolume = 0;
+    alerts = LEAK_NONE;
+}
+
+static bool isQuietHour(int hour, uint8_t start, uint8_t end)
+{
+    if (hour < 0)
+    {
+        return false;
+    }
+    if (start <= end)
+    {
+        return hour >= start && hour < end;
+    }
+    return hour >= start || hour < end; // Window wraps past midnight
+}
+
+uint8_t LeakDetector::update(uint32_t milliliters, unsigned long intervalMs, unsigned long currentTimeMs, int hourOfDay)
+{
+    if (intervalMs == 0)
+    {
+        return alerts;
+    }
+
+    // Smoothed rate: half the previous estimate plus half the new sample
+    uint32_t sampleRate = (uint32_t)((uint64_t)milliliters * 60000 / intervalMs);
+    rateMlPerMin = (rateMlPerMin + sampleRate) / 2;
+
+    // === CONTINUOUS FLOW ===
+    if (milliliters > 0)
+    {
+        if (!flowing)
+        {
+            flowing = true;
+            flowStartTime = currentTimeMs;
+        }
+        lastFlowTime = currentTimeMs;
+    }
+    else if (flowing && currentTimeMs - lastFlowTime >= config.flowStopGapMs)
+    {
+        flowing = false;
+        rateMlPerMin = 0;
+        alerts &= ~(LEAK_CONTINUOUS_FLOW | LEAK_RATE_CEILING);
+    }
+
+    if (flowing && currentTimeMs - flowStartTime >= config.maxContinuousFlowMs)
+    {
+        alerts |= LEAK_CONTINUOUS_FLOW;
+    }
+
+    // === RATE CEILING ===
+    if (rateMlPerMin > config.maxFlowRateMlPerMin)
+    {
+        if (!rateAbove)
+        {
+            rateAbove = true;
+            rateAboveSince = currentTimeMs;
+        }
+        if (currentTimeMs - rateAboveSince >= config.rateHoldMs)
+        {
+            alerts |= LEAK_RATE_CEILING;
+        }
+    }
+    else
+    {
+        rateAbove = false;
+    }
+
+    // === QUIET HOUR TRICKLE ===
+    // Drips arrive as isolated pulses, so judge the average rate over the
+    // whole trickle window rather than the jumpy per-sample rate
+    bool quiet = isQuietHour(hourOfDay, config.quietStartHour, config.quietEndHour);
+    if (!quiet || (trickling && currentTimeMs - lastTrickleTime >= config.trickleGapMs))
+    {
+        trickling = false;
+        alerts &= ~LEAK_QUIET_TRICKLE;
+    }
+
+    if (quiet && milliliters > 0)
+    {
+        if (!trickling)
+        {
+            trickling = true;
+            trickleStartTime = currentTimeMs;
+            trickleVolume = 0;
+        }
+        trickleVolume += milliliters;
+        lastTrickleTime = currentTimeMs;
+    }
+
+    if (trickling)
+    {
+        unsigned long elapsed = currentTimeMs - trickleStartTime + intervalMs;
+        uint64_t averageRate = (uint64_t)trickleVolume * 60000 / elapsed;
+        if (elapsed >= TRICKLE_MIN_WINDOW_MS && averageRate > config.trickleMaxRateMlPerMin)
+        {
+            // A real draw during quiet hours - restart the trickle window
+            trickling = false;
+            alerts &= ~LEAK_QUIET_TRICKLE;
+        }
+        else if (elapsed >= config.trickleDurationMs)
+        {
+            alerts |= LEAK_QUIET_TRICKLE;
+        }
+    }
+
+    return alerts;
+}
+
+unsigned long LeakDetector::getFlowDuration(unsigned long currentTimeMs) const
+{
+    return flowing ? currentTimeMs - flowStartTime : 0;
+}
+
+const char *LeakDetector::alertName(uint8_t alerts)
+{
+    if (alerts & LEAK_RATE_CEILING)
+    {
+        return "BURST";
+    }
+    if (alerts & LEAK_CONTINUOUS_FLOW)
+    {
+        return "NONSTOP FLOW";
+    }
+    if (alerts & LEAK_QUIET_TRICKLE)
+    {
+        return "NIGHT DRIP";
+    }
+    return "NONE";
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+// Alert bits reported by LeakDetector
+enum LeakAlert : uint8_t
+{
+    LEAK_NONE = 0,
+    LEAK_CONTINUOUS_FLOW = 1 << 0, // Flow lasted longer than the limit (stuck faucet)
+    LEAK_RATE_CEILING = 1 << 1,    // Flow rate above the ceiling (burst fitting)
+    LEAK_QUIET_TRICKLE = 1 << 2    // Slow flow during quiet hours (dripping fitting)
+};
+
+struct LeakDetectorConfig
+{
+    unsigned long maxContinuousFlowMs = 10UL * 60 * 1000; // 10 minutes
+    uint32_t maxFlowRateMlPerMin = 4000;                  // Above any normal faucet draw
+    unsigned long rateHoldMs = 400;                       // Rate must stay above ceiling this long
+    unsigned long flowStopGapMs = 3000;                   // No volume for this long = flow stopped
+    uint32_t trickleMaxRateMlPerMin = 300;                // Average below this counts as trickle
+    unsigned long trickleGapMs = 120000;                  // Drips may be minutes apart
+    unsigned long trickleDurationMs = 15UL * 60 * 1000;   // 15 minutes of trickle
+    uint8_t quietStartHour = 1;                           // Quiet hours [start, end) local time
+    uint8_t quietEndHour = 5;
+};
+
+// Flags stuck faucets, bursts and night-time trickles from the flow stream.
+// Feed it the volume measured in each sample period; all state is a handful of
+// scalars, so every update is O(1) regardless of how long the flow lasts.
+// Alerts latch until the flow stops.
+class LeakDetector
+{
+private:
+    LeakDetectorConfig config;
+
+    bool flowing;
+    unsigned long flowStartTime;
+    unsigned long lastFlowTime;
+
+    uint32_t rateMlPerMin; // Smoothed flow rate
+    bool rateAbove;
+    unsigned long rateAboveSince;
+
+    bool trickling;
+    unsigned long trickleStartTime;
+    unsigned long lastTrickleTime;
+    uint32_t trickleVolume;
+
+    uint8_t alerts;
+
+public:
+    LeakDetector();
+
+    // Process one sample: volume delivered over the last intervalMs.
+    // hourOfDay is local time 0-23, or -1 when the clock is not set (quiet
+    // hour detection is skipped). Returns the active alert bits.
+    uint8_t update(uint32_t milliliters, unsigned long intervalMs, unsigned long currentTimeMs, int hourOfDay);
+
+    uint8_t getAlerts() const { return alerts; }
+    bool isFlowing() const { return flowing; }
+    uint32_t getFlowRate() const { return rateMlPerMin; }
+    unsigned long getFlowDuration(unsigned long currentTimeMs) const;
+
+    void setConfig(const LeakDetectorConfig &newConfig) { config = newConfig; }
+    const LeakDetectorConfig &getConfig() const { return config; }
+    void reset();
+
+    static const char *alertName(uint8_t alerts);
+};
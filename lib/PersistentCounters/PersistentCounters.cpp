@@ -0,0 +1,190 @@
+#include "PersistentCounters.h"
+#include <stddef.h>
+#include <string.h>
+#include "Checksum.h"
+
+static const uint32_t COUNTERS_MAGIC = 0x31544E43; // "CNT1"
+static const uint32_t DAY_MS = 24UL * 60 * 60 * 1000;
+
+PersistentCounters::PersistentCounters(KeyValueStore &kvStore, const CounterWritePolicy &writePolicy)
+    : store(kvStore), policy(writePolicy), dirty(0), stamped(0), persistedWaterMl(0),
+      dirtySince(0), filtersChangedAt(0), dayStart(0), failedAt(0), writeFailed(false),
+      writesToday(0), budgetBlocked(false),
+      writeCount(0), budgetExhaustions(0)
+{
+    // Zero padding too, so the CRC over the raw record is deterministic
+    memset(&record, 0, sizeof(record));
+    record.magic = COUNTERS_MAGIC;
+}
+
+bool PersistentCounters::load()
+{
+    bool found = false;
+    char key[8];
+    Record candidate;
+    for (uint8_t slot = 0; slot < SLOT_COUNT; slot++)
+    {
+        slotKey(slot, key);
+        memset(&candidate, 0, sizeof(candidate));
+        if (store.read(key, &candidate, sizeof(candidate)) != sizeof(candidate))
+        {
+            continue;
+        }
+        if (candidate.magic != COUNTERS_MAGIC || candidate.crc != recordCrc(candidate))
+        {
+            continue;
+        }
+        // Sequence numbers only grow, so the newest slot wins
+        if (!found || candidate.sequence > record.sequence)
+        {
+            record = candidate;
+            found = true;
+        }
+    }
+
+    if (found)
+    {
+        persistedWaterMl = record.waterUsedMl;
+        dirty = 0;
+        stamped = 0;
+    }
+    return found;
+}
+
+void PersistentCounters::resume(uint32_t sequence, uint64_t persistedWater)
+{
+    record.sequence = sequence;
+    record.waterUsedMl = persistedWater;
+    persistedWaterMl = persistedWater;
+}
+
+void PersistentCounters::setWaterUsed(uint64_t milliliters)
+{
+    if (record.waterUsedMl != milliliters)
+    {
+        record.waterUsedMl = milliliters;
+        dirty |= DIRTY_WATER;
+    }
+}
+
+void PersistentCounters::setFilterPercent(uint8_t index, uint8_t percent)
+{
+    if (index < MAX_FILTERS && record.filterPercent[index] != percent)
+    {
+        record.filterPercent[index] = percent;
+        dirty |= DIRTY_FILTERS;
+        stamped &= ~DIRTY_FILTERS; // Settle delay restarts on every change
+    }
+}
+
+bool PersistentCounters::update(unsigned long currentTimeMs)
+{
+    uint32_t now = (uint32_t)currentTimeMs;
+    rollDay(now);
+    if (!dirty)
+    {
+        return false;
+    }
+
+    // After a failed write, wait a full interval before trying again
+    if (writeFailed && now - failedAt < policy.maxIntervalMs)
+    {
+        return false;
+    }
+
+    // Remember when each field first became dirty
+    if (!stamped)
+    {
+        dirtySince = now;
+    }
+    if ((dirty & DIRTY_FILTERS) && !(stamped & DIRTY_FILTERS))
+    {
+        filtersChangedAt = now;
+    }
+    stamped = dirty;
+
+    bool due = now - dirtySince >= policy.maxIntervalMs;
+    if ((dirty & DIRTY_WATER) && record.waterUsedMl - persistedWaterMl >= policy.volumeThresholdMl)
+    {
+        due = true;
+    }
+    if ((dirty & DIRTY_FILTERS) && now - filtersChangedAt >= policy.priorityDelayMs)
+    {
+        due = true;
+    }
+    if (!due)
+    {
+        return false;
+    }
+
+    if (writesToday >= policy.dailyWriteBudget)
+    {
+        if (!budgetBlocked)
+        {
+            budgetBlocked = true;
+            budgetExhaustions++;
+        }
+        return false;
+    }
+    return write(now);
+}
+
+bool PersistentCounters::flush(unsigned long currentTimeMs, bool ignoreBudget)
+{
+    uint32_t now = (uint32_t)currentTimeMs;
+    rollDay(now);
+    if (!dirty)
+    {
+        return false;
+    }
+    if (!ignoreBudget && writesToday >= policy.dailyWriteBudget)
+    {
+        return false;
+    }
+    return write(now);
+}
+
+bool PersistentCounters::write(uint32_t now)
+{
+    record.sequence++;
+    record.crc = recordCrc(record);
+
+    char key[8];
+    slotKey(record.sequence % SLOT_COUNT, key);
+    if (!store.write(key, &record, sizeof(record)))
+    {
+        writeFailed = true;
+        failedAt = now;
+        return false;
+    }
+
+    persistedWaterMl = record.waterUsedMl;
+    dirty = 0;
+    stamped = 0;
+    writeFailed = false;
+    writesToday++;
+    writeCount++;
+    return true;
+}
+
+void PersistentCounters::rollDay(uint32_t now)
+{
+    if (now - dayStart >= DAY_MS)
+    {
+        dayStart += (now - dayStart) / DAY_MS * DAY_MS;
+        writesToday = 0;
+        budgetBlocked = false;
+    }
+}
+
+void PersistentCounters::slotKey(uint8_t slot, char *key)
+{
+    memcpy(key, "ctr", 3);
+    key[3] = (char)('0' + slot);
+    key[4] = '\0';
+}
+
+uint32_t PersistentCounters::recordCrc(const Record &value)
+{
+    return crc32(&value, offsetof(Record, crc));
+}
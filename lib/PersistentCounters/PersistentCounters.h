@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include "KeyValueStore.h"
+
+struct CounterWritePolicy
+{
+    uint32_t volumeThresholdMl = 5000;          // Write after this much new usage
+    unsigned long maxIntervalMs = 15UL * 60000; // Or when dirty this long
+    unsigned long priorityDelayMs = 5000;       // Filter changes settle this long first
+    uint16_t dailyWriteBudget = 96;             // Hard cap per 24 h of uptime
+};
+
+// Water usage and filter life counters persisted with write coalescing.
+//
+// Setters only mark fields dirty; update() decides when a write is worth it
+// (volume or time threshold, or a short settle delay for filter changes) and
+// never exceeds the daily write budget. Each write goes to the next of
+// SLOT_COUNT keys with a sequence number and CRC, so wear is spread across
+// keys and a torn write always leaves the previous slot intact.
+class PersistentCounters
+{
+public:
+    static const uint8_t MAX_FILTERS = 8;
+    static const uint8_t SLOT_COUNT = 4;
+
+    PersistentCounters(KeyValueStore &store, const CounterWritePolicy &policy = CounterWritePolicy());
+
+    // Load the newest valid slot; false if nothing was stored yet
+    bool load();
+
+    // Continue the slot sequence after a warm reset without reading the slots.
+    // Values set afterwards are dirty and written under the normal policy.
+    void resume(uint32_t sequence, uint64_t persistedWaterMl);
+
+    void setWaterUsed(uint64_t milliliters);
+    void setFilterPercent(uint8_t index, uint8_t percent);
+    uint64_t getWaterUsed() const { return record.waterUsedMl; }
+    uint64_t getPersistedWaterUsed() const { return persistedWaterMl; }
+    uint8_t getFilterPercent(uint8_t index) const { return index < MAX_FILTERS ? record.filterPercent[index] : 0; }
+
+    // Call regularly; writes when the policy says so. Returns true if written.
+    bool update(unsigned long currentTimeMs);
+
+    // Write now if dirty, ignoring thresholds (not the budget unless told to)
+    bool flush(unsigned long currentTimeMs, bool ignoreBudget = false);
+
+    bool isDirty() const { return dirty != 0; }
+    uint32_t getWriteCount() const { return writeCount; }
+    uint16_t getWritesToday() const { return writesToday; }
+    uint32_t getBudgetExhaustions() const { return budgetExhaustions; } // Days the budget ran out
+    uint32_t getSequence() const { return record.sequence; }
+
+private:
+    struct Record
+    {
+        uint32_t magic;
+        uint32_t sequence;
+        uint64_t waterUsedMl;
+        uint8_t filterPercent[MAX_FILTERS];
+        uint32_t crc;
+    };
+
+    enum DirtyField : uint8_t
+    {
+        DIRTY_WATER = 1 << 0,
+        DIRTY_FILTERS = 1 << 1
+    };
+
+    KeyValueStore &store;
+    CounterWritePolicy policy;
+    Record record;
+    uint8_t dirty;
+    uint8_t stamped; // Dirty fields whose change time has been recorded
+    uint64_t persistedWaterMl;
+    // Times kept as 32-bit millis so arithmetic wraps the same on host and device
+    uint32_t dirtySince;
+    uint32_t filtersChangedAt;
+    uint32_t dayStart;
+    uint32_t failedAt;
+    bool writeFailed;
+    uint16_t writesToday;
+    bool budgetBlocked;
+    uint32_t writeCount;
+    uint32_t budgetExhaustions;
+
+    bool write(uint32_t now);
+    void rollDay(uint32_t now);
+    static void slotKey(uint8_t slot, char *key);
+    static uint32_t recordCrc(const Record &record);
+};
@@ -0,0 +1,84 @@
+#include "PowerFailRecord.h"
+#include <string.h>
+#include "Checksum.h"
+
+static const uint32_t POWER_FAIL_MAGIC = 0x31465750; // "PWF1"
+
+// Layout: magic(4) baseSequence(4) deltaMl(4) timestamp(4) filters(8) crc(4)
+static const size_t CRC_OFFSET = PowerFailRecord::RECORD_SIZE - 4;
+
+PowerFailRecord::PowerFailRecord() : published(0), pending(false), preparedSequence(0), preparedWaterMl(0)
+{
+    memset(images, 0, sizeof(images));
+    memset(preparedFilters, 0, sizeof(preparedFilters));
+}
+
+void PowerFailRecord::prepare(const PersistentCounters &counters, uint32_t timestamp)
+{
+    uint8_t filters[PersistentCounters::MAX_FILTERS];
+    for (uint8_t i = 0; i < PersistentCounters::MAX_FILTERS; i++)
+    {
+        filters[i] = counters.getFilterPercent(i);
+    }
+    if (pending == counters.isDirty() && preparedSequence == counters.getSequence() &&
+        preparedWaterMl == counters.getWaterUsed() && memcmp(preparedFilters, filters, sizeof(filters)) == 0)
+    {
+        return;
+    }
+
+    uint64_t delta = counters.getWaterUsed() - counters.getPersistedWaterUsed();
+    uint32_t baseSequence = counters.getSequence();
+    uint32_t deltaMl = (uint32_t)delta;
+    if (counters.getWaterUsed() < counters.getPersistedWaterUsed())
+    {
+        deltaMl = 0; // Counter reset pending - the filters still carry the news
+    }
+
+    uint8_t next = published ^ 1;
+    uint8_t *image = images[next];
+    memcpy(image, &POWER_FAIL_MAGIC, 4);
+    memcpy(image + 4, &baseSequence, 4);
+    memcpy(image + 8, &deltaMl, 4);
+    memcpy(image + 12, &timestamp, 4);
+    memcpy(image + 16, filters, sizeof(filters));
+    uint32_t crc = crc32(image, CRC_OFFSET);
+    memcpy(image + CRC_OFFSET, &crc, 4);
+    published = next;
+
+    pending = counters.isDirty();
+    preparedSequence = baseSequence;
+    preparedWaterMl = counters.getWaterUsed();
+    memcpy(preparedFilters, filters, sizeof(filters));
+}
+
+bool PowerFailRecord::merge(const uint8_t *record, size_t length, PersistentCounters &counters)
+{
+    if (length != RECORD_SIZE)
+    {
+        return false;
+    }
+    uint32_t magic;
+    uint32_t crc;
+    memcpy(&magic, record, 4);
+    memcpy(&crc, record + CRC_OFFSET, 4);
+    if (magic != POWER_FAIL_MAGIC || crc != crc32(record, CRC_OFFSET))
+    {
+        return false;
+    }
+
+    uint32_t baseSequence;
+    uint32_t deltaMl;
+    memcpy(&baseSequence, record + 4, 4);
+    memcpy(&deltaMl, record + 8, 4);
+    if (baseSequence != counters.getSequence())
+    {
+        return false;
+    }
+
+    counters.setWaterUsed(counters.getWaterUsed() + deltaMl);
+    for (uint8_t i = 0; i < PersistentCounters::MAX_FILTERS; i++)
+    {
+        counters.setFilterPercent(i, record[16 + i]);
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PersistentCounters.h"
+
+// Usage and filter changes not yet written by PersistentCounters, kept
+// serialized ahead of time so the power-fail path is one bounded write of
+// RECORD_SIZE bytes with no work left to do.
+//
+// Two images alternate: prepare() fills the idle one and then publishes it,
+// so a power-fail task preempting prepare() still sees a complete record.
+class PowerFailRecord
+{
+public:
+    static const size_t RECORD_SIZE = 28;
+
+    PowerFailRecord();
+
+    // Refresh from the current counters; cheap no-op when nothing changed
+    void prepare(const PersistentCounters &counters, uint32_t timestamp);
+
+    // The image to write on power failure
+    const uint8_t *data() const { return images[published]; }
+    bool hasPendingDelta() const { return pending; }
+
+    // Apply a record found at boot. Only a record prepared against the slot
+    // the counters just loaded is merged; anything else is stale or damaged.
+    static bool merge(const uint8_t *record, size_t length, PersistentCounters &counters);
+
+private:
+    uint8_t images[2][RECORD_SIZE];
+    volatile uint8_t published;
+    bool pending;
+    uint32_t preparedSequence;
+    uint64_t preparedWaterMl;
+    uint8_t preparedFilters[PersistentCounters::MAX_FILTERS];
+};
@@ -0,0 +1,139 @@
+#include "PowerPolicy.h"
+#include <string.h>
+
+const uint16_t LatencyStats::BUCKET_LIMITS_MS[BUCKET_COUNT - 1] = {10, 25, 50, 100, 250, 500, 1000};
+
+const char *radioPowerModeName(RadioPowerMode mode)
+{
+    static const char *const NAMES[RADIO_POWER_MODE_COUNT] = {"none", "min", "max"};
+    return (int)mode < RADIO_POWER_MODE_COUNT ? NAMES[(int)mode] : "?";
+}
+
+void LatencyStats::add(uint16_t latencyMs, uint16_t targetMs)
+{
+    int bucket = 0;
+    while (bucket < BUCKET_COUNT - 1 && latencyMs > BUCKET_LIMITS_MS[bucket])
+    {
+        bucket++;
+    }
+    buckets[bucket]++;
+    count++;
+    totalMs += latencyMs;
+    if (latencyMs > maxMs)
+    {
+        maxMs = latencyMs;
+    }
+    if (latencyMs > targetMs)
+    {
+        slow++;
+    }
+}
+
+uint16_t LatencyStats::getPercentile(uint8_t percent) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    uint32_t rank = ((uint64_t)count * percent + 99) / 100; // Nearest rank
+    uint32_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT - 1; i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            return BUCKET_LIMITS_MS[i] < maxMs ? BUCKET_LIMITS_MS[i] : maxMs;
+        }
+    }
+    return maxMs;
+}
+
+PowerPolicy::PowerPolicy()
+    : mode(RadioPowerMode::MIN_MODEM), // The ESP32 Arduino default, until the first update()
+      started(false),
+      lastUpdate(0),
+      buttonSeen(false),
+      lastButton(0),
+      requestSeen(false),
+      lastRequest(0),
+      drawSeen(false),
+      lastDraw(0),
+      modeChanges(0)
+{
+    memset(stats, 0, sizeof(stats));
+}
+
+void PowerPolicy::noteButton(unsigned long now)
+{
+    buttonSeen = true;
+    lastButton = now;
+}
+
+void PowerPolicy::noteRequest(unsigned long now, uint16_t latencyMs)
+{
+    requestSeen = true;
+    lastRequest = now;
+    stats[(int)mode].latency.add(latencyMs, config.latencyTargetMs);
+}
+
+bool PowerPolicy::update(unsigned long now, bool paired, uint8_t sessions, bool drawing)
+{
+    if (started)
+    {
+        stats[(int)mode].timeMs += now - lastUpdate;
+    }
+    lastUpdate = now;
+
+    if (drawing)
+    {
+        drawSeen = true;
+        lastDraw = now;
+    }
+
+    RadioPowerMode wanted;
+    if (within(buttonSeen, lastButton, now, config.buttonHoldMs) ||
+        within(requestSeen, lastRequest, now, config.requestHoldMs) ||
+        within(drawSeen, lastDraw, now, config.drawHoldMs))
+    {
+        wanted = RadioPowerMode::NO_SLEEP;
+    }
+    else if (paired || sessions > 0)
+    {
+        wanted = RadioPowerMode::MIN_MODEM;
+    }
+    else
+    {
+        wanted = RadioPowerMode::MAX_MODEM;
+    }
+
+    // The first call always applies, whatever the radio was left at
+    if (started && wanted == mode)
+    {
+        return false;
+    }
+    if (started)
+    {
+        modeChanges++;
+    }
+    started = true;
+    mode = wanted;
+    stats[(int)mode].entries++;
+    return true;
+}
+
+uint64_t PowerPolicy::getRadioOnMs(RadioPowerMode statsMode) const
+{
+    return stats[(int)statsMode].timeMs * config.radioOnPermille[(int)statsMode] / 1000;
+}
+
+uint16_t PowerPolicy::getRadioOnPermille() const
+{
+    uint64_t total = 0;
+    uint64_t radioOn = 0;
+    for (int i = 0; i < RADIO_POWER_MODE_COUNT; i++)
+    {
+        total += stats[i].timeMs;
+        radioOn += getRadioOnMs((RadioPowerMode)i);
+    }
+    return total ? (uint16_t)(radioOn * 1000 / total) : 1000;
+}
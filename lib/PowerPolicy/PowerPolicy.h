@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+
+// WiFi modem sleep levels, most awake first. On the ESP32 these are
+// WIFI_PS_NONE, WIFI_PS_MIN_MODEM and WIFI_PS_MAX_MODEM.
+enum class RadioPowerMode : uint8_t
+{
+    NO_SLEEP,  // Radio always on
+    MIN_MODEM, // Wakes for every DTIM beacon
+    MAX_MODEM  // Wakes every listen interval; frames wait longest at the AP
+};
+const int RADIO_POWER_MODE_COUNT = 3;
+
+const char *radioPowerModeName(RadioPowerMode mode); // "none", "min" or "max"
+
+// Request-to-response times of HomeKit requests, in fixed buckets
+struct LatencyStats
+{
+    static const int BUCKET_COUNT = 8;
+    static const uint16_t BUCKET_LIMITS_MS[BUCKET_COUNT - 1]; // Upper bounds; the last bucket is open
+
+    uint32_t count;
+    uint32_t slow; // Over the latency target
+    uint32_t totalMs;
+    uint16_t maxMs;
+    uint32_t buckets[BUCKET_COUNT];
+
+    void add(uint16_t latencyMs, uint16_t targetMs);
+    uint16_t getAverage() const { return count ? totalMs / count : 0; }
+    uint16_t getPercentile(uint8_t percent) const; // Upper bound of its bucket; maxMs for the open one
+};
+
+struct PowerModeStats
+{
+    uint64_t timeMs; // Spent in the mode
+    uint32_t entries;
+    LatencyStats latency;
+};
+
+struct PowerPolicyConfig
+{
+    uint32_t buttonHoldMs = 60000;  // Awake after a button press; the user is at the unit
+    uint32_t requestHoldMs = 10000; // Awake after a HomeKit request; the Home app reads in bursts
+    uint32_t drawHoldMs = 30000;    // Awake after a draw, while its final values go out
+    uint16_t latencyTargetMs = 100; // HomeKit requests slower than this count as slow
+    uint16_t radioOnPermille[RADIO_POWER_MODE_COUNT] = {1000, 40, 15}; // Estimated duty cycle per mode
+};
+
+// Picks the WiFi modem sleep level from what the device is doing:
+//
+//   button press, HomeKit request or draw within its hold  -> no sleep
+//   paired, or a HomeKit session open                      -> min modem
+//   nothing                                                -> max modem
+//
+// Home hubs keep a session open around the clock, so an open session alone
+// only earns min-modem sleep. Max modem skips the DTIM beacons after which
+// the access point sends multicast, so mDNS queries from controllers looking
+// for the accessory would be missed; it is kept for an unpaired device.
+//
+// Time per mode is accumulated on every update(), and radio-on time is
+// estimated from it with the configured duty cycles. Latencies are recorded
+// against the mode the request was served in.
+class PowerPolicy
+{
+public:
+    PowerPolicy();
+
+    void setConfig(const PowerPolicyConfig &newConfig) { config = newConfig; }
+    const PowerPolicyConfig &getConfig() const { return config; }
+
+    void noteButton(unsigned long now);
+    void noteRequest(unsigned long now, uint16_t latencyMs);
+
+    // Once per loop pass; true when the mode changed and should be applied
+    bool update(unsigned long now, bool paired, uint8_t sessions, bool drawing);
+
+    RadioPowerMode getMode() const { return mode; }
+    uint32_t getModeChanges() const { return modeChanges; }
+    const PowerModeStats &getStats(RadioPowerMode statsMode) const { return stats[(int)statsMode]; }
+    uint64_t getRadioOnMs(RadioPowerMode statsMode) const;
+    uint16_t getRadioOnPermille() const; // Over all modes since boot; 1000 = never slept
+
+private:
+    PowerPolicyConfig config;
+    RadioPowerMode mode;
+    PowerModeStats stats[RADIO_POWER_MODE_COUNT];
+    bool started;
+    unsigned long lastUpdate;
+    bool buttonSeen;
+    unsigned long lastButton;
+    bool requestSeen;
+    unsigned long lastRequest;
+    bool drawSeen;
+    unsigned long lastDraw;
+    uint32_t modeChanges;
+
+    static bool within(bool seen, unsigned long since, unsigned long now, uint32_t holdMs)
+    {
+        return seen && now - since < holdMs;
+    }
+};
@@ -0,0 +1,34 @@
+#include "PublishedValue.h"
+
+PublishedValue::PublishedValue(float hysteresis) : hysteresis(hysteresis), lastSent(0), published(false)
+{
+}
+
+bool PublishedValue::isChange(float value) const
+{
+    if (!published)
+    {
+        return true;
+    }
+    float change = value > lastSent ? value - lastSent : lastSent - value;
+    return change != 0 && change >= hysteresis;
+}
+
+void PublishedValue::record(float value)
+{
+    lastSent = value;
+    published = true;
+}
+
+bool PublishedValue::offer(float value, UpdateStats &stats)
+{
+    if (!isChange(value))
+    {
+        stats.suppressed++;
+        return false;
+    }
+
+    record(value);
+    stats.sent++;
+    return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+// Sent versus suppressed characteristic updates, shared by all cached values
+struct UpdateStats
+{
+    uint32_t sent = 0;
+    uint32_t suppressed = 0;
+};
+
+// Last value published for one HomeKit characteristic.
+//
+// Every setVal() on a HomeSpan characteristic becomes an event to each paired
+// controller, so callers offer() the current value and only set it when this
+// says so: on the first value, and afterwards when the value has moved at
+// least one hysteresis step from what was last sent. A step of 0 sends any
+// change. Measuring from the last sent value (not the last offered one) keeps
+// slow drift from being suppressed forever and stops noise at a rounding
+// boundary from flapping.
+class PublishedValue
+{
+public:
+    explicit PublishedValue(float hysteresis = 0);
+
+    bool offer(float value, UpdateStats &stats);
+    bool isChange(float value) const; // offer() without recording anything
+    void record(float value);         // The characteristic now shows value
+    void forget() { published = false; } // Next offer() always sends
+
+    bool hasPublished() const { return published; }
+    float getPublished() const { return lastSent; }
+
+private:
+    float hysteresis;
+    float lastSent;
+    bool published;
+};
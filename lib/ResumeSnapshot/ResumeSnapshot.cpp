@@ -0,0 +1,85 @@
+#include "ResumeSnapshot.h"
+#include <string.h>
+#include "Checksum.h"
+
+static const uint32_t SNAPSHOT_MAGIC = 0x314D5352; // "RSM1"
+
+// Header: magic(4) version(2) length(2) refreshCount(4) crc(4).
+// The CRC covers the first 12 header bytes and the payload.
+static uint32_t snapshotCrc(const uint8_t *region, uint16_t length)
+{
+    uint32_t crc = crc32Update(0, region, 12);
+    return crc32Update(crc, region + ResumeSnapshot::HEADER_SIZE, length);
+}
+
+ResumeSnapshot::ResumeSnapshot(uint8_t *snapshotRegion, size_t snapshotRegionSize, uint16_t layoutVersion)
+    : region(snapshotRegion), regionSize(snapshotRegionSize), version(layoutVersion)
+{
+}
+
+bool ResumeSnapshot::isValid() const
+{
+    uint32_t magic;
+    uint16_t storedVersion;
+    uint16_t length;
+    uint32_t crc;
+    memcpy(&magic, region, 4);
+    memcpy(&storedVersion, region + 4, 2);
+    memcpy(&length, region + 6, 2);
+    memcpy(&crc, region + 12, 4);
+
+    if (magic != SNAPSHOT_MAGIC || storedVersion != version || length > getCapacity())
+    {
+        return false;
+    }
+    return crc == snapshotCrc(region, length);
+}
+
+void ResumeSnapshot::invalidate()
+{
+    memset(region, 0, HEADER_SIZE);
+}
+
+bool ResumeSnapshot::commit(size_t payloadLength)
+{
+    if (payloadLength > getCapacity() || payloadLength > 0xFFFF)
+    {
+        return false;
+    }
+
+    // The payload was already rewritten, so only the header tells whether
+    // this continues an earlier snapshot
+    uint32_t magic;
+    uint16_t storedVersion;
+    memcpy(&magic, region, 4);
+    memcpy(&storedVersion, region + 4, 2);
+    uint32_t refreshCount = (magic == SNAPSHOT_MAGIC && storedVersion == version) ? getRefreshCount() + 1 : 1;
+    uint16_t length = (uint16_t)payloadLength;
+    memcpy(region, &SNAPSHOT_MAGIC, 4);
+    memcpy(region + 4, &version, 2);
+    memcpy(region + 6, &length, 2);
+    memcpy(region + 8, &refreshCount, 4);
+    uint32_t crc = snapshotCrc(region, length);
+    memcpy(region + 12, &crc, 4);
+    return true;
+}
+
+const uint8_t *ResumeSnapshot::getPayload(size_t &payloadLength) const
+{
+    if (!isValid())
+    {
+        payloadLength = 0;
+        return nullptr;
+    }
+    uint16_t length;
+    memcpy(&length, region + 6, 2);
+    payloadLength = length;
+    return region + HEADER_SIZE;
+}
+
+uint32_t ResumeSnapshot::getRefreshCount() const
+{
+    uint32_t refreshCount;
+    memcpy(&refreshCount, region + 8, 4);
+    return refreshCount;
+}
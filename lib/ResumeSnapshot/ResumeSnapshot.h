@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Versioned, checksummed state image in a caller-provided memory region.
+//
+// On the device the region is RTC_NOINIT memory, which keeps its contents
+// across software, watchdog and brownout resets but not power-on. A valid
+// snapshot lets setup() resume without reading flash; anything else (power-on
+// garbage, a firmware with a different layout, a torn refresh) fails the
+// magic, version, length or CRC check and the caller falls back to NVS.
+class ResumeSnapshot
+{
+public:
+    static const size_t HEADER_SIZE = 16;
+
+    // layoutVersion identifies the caller's payload layout; bump it when that changes
+    ResumeSnapshot(uint8_t *region, size_t regionSize, uint16_t layoutVersion);
+
+    bool isValid() const;
+    void invalidate();
+
+    // Payload area for the caller to fill, then commit() with the used length
+    uint8_t *payload() { return region + HEADER_SIZE; }
+    size_t getCapacity() const { return regionSize - HEADER_SIZE; }
+    bool commit(size_t payloadLength);
+
+    // Valid payload, or nullptr
+    const uint8_t *getPayload(size_t &payloadLength) const;
+    uint32_t getRefreshCount() const;
+
+private:
+    uint8_t *region;
+    size_t regionSize;
+    uint16_t version;
+};
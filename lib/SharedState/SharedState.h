@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+// Single-writer seqlock around a plain-data snapshot.
+//
+// The writer never waits and readers never block it: the sequence is odd
+// while a write is in progress, and a reader retries if the sequence was odd
+// or changed while it copied. With one writer updating every 100 ms and
+// copies of a few dozen bytes, a retry is rare and a torn value is never
+// returned. T must be trivially copyable. A reader spins while a write is in
+// progress, so it must not preempt the writer on the writer's own core.
+template <typename T>
+class Seqlock
+{
+public:
+    Seqlock() : sequence(0)
+    {
+        memset(&value, 0, sizeof(value));
+    }
+
+    // Writer side; only one task may write
+    void write(const T &newValue)
+    {
+        uint32_t start = sequence.load(std::memory_order_relaxed);
+        sequence.store(start + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        copy(&value, &newValue);
+        sequence.store(start + 2, std::memory_order_release);
+    }
+
+    // Reader side; any number of tasks. Returns the sequence of the copy.
+    uint32_t read(T &out) const
+    {
+        for (;;)
+        {
+            uint32_t before = sequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                continue; // Write in progress
+            }
+            copy(&out, &value);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before)
+            {
+                return before;
+            }
+        }
+    }
+
+    uint32_t getSequence() const { return sequence.load(std::memory_order_acquire); }
+
+private:
+    // Volatile byte copy so the compiler keeps it between the fences
+    static void copy(volatile void *destination, const volatile void *source)
+    {
+        volatile uint8_t *to = (volatile uint8_t *)destination;
+        const volatile uint8_t *from = (const volatile uint8_t *)source;
+        for (size_t i = 0; i < sizeof(T); i++)
+        {
+            to[i] = from[i];
+        }
+    }
+
+    std::atomic<uint32_t> sequence;
+    T value;
+};
+
+// Lock-free single-producer, single-consumer queue of plain-data items.
+// Holds Capacity - 1 items; push() fails rather than waits when full.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    // Producer side
+    bool push(const T &item)
+    {
+        size_t current = tail.load(std::memory_order_relaxed);
+        size_t next = (current + 1) % Capacity;
+        if (next == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        items[current] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T &item)
+    {
+        size_t current = head.load(std::memory_order_relaxed);
+        if (current == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = items[current];
+        head.store((current + 1) % Capacity, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    T items[Capacity];
+};
@@ -0,0 +1,163 @@
+#include "StallWatchdog.h"
+#include <stdio.h>
+#include <string.h>
+
+static const uint32_t TRAIL_MAGIC = 0x53544C31; // "STL1"
+
+void beginTrail(BreadcrumbTrail &trail)
+{
+    memset((void *)&trail, 0, sizeof(trail));
+    for (int i = 0; i < BREADCRUMB_COUNT; i++)
+    {
+        trail.crumbs[i].phase = STALL_NO_PHASE;
+    }
+    trail.phase = STALL_NO_PHASE;
+    trail.stalledPhase = STALL_NO_PHASE;
+    trail.magic = TRAIL_MAGIC;
+}
+
+bool isTrailValid(const BreadcrumbTrail &trail, uint8_t phaseCount)
+{
+    if (trail.magic != TRAIL_MAGIC || trail.sequence == 0 || trail.phase >= phaseCount)
+    {
+        return false;
+    }
+    return trail.stalledPhase == STALL_NO_PHASE || trail.stalledPhase < phaseCount;
+}
+
+size_t formatTrail(const BreadcrumbTrail &trail, const StallPhase *phases, uint8_t phaseCount, uint32_t stampsPerMs,
+                   char *buffer, size_t size)
+{
+    size_t length = 0;
+    if (size > 0)
+    {
+        buffer[0] = '\0';
+    }
+    uint32_t count = trail.sequence < BREADCRUMB_COUNT ? trail.sequence : BREADCRUMB_COUNT;
+    for (uint32_t i = 0; i < count && length < size; i++)
+    {
+        uint8_t slot = (uint8_t)(trail.head - count + i) & (BREADCRUMB_COUNT - 1);
+        const Breadcrumb &crumb = trail.crumbs[slot];
+        const char *name = crumb.phase < phaseCount ? phases[crumb.phase].name : "?";
+        int written;
+        if (i + 1 < count)
+        {
+            uint32_t next = trail.crumbs[(slot + 1) & (BREADCRUMB_COUNT - 1)].stamp;
+            uint32_t micros = stampsPerMs ? (uint32_t)((uint64_t)(next - crumb.stamp) * 1000 / stampsPerMs) : 0;
+            written = snprintf(buffer + length, size - length, "  %-12s %6lu.%03lu ms\n", name,
+                               (unsigned long)(micros / 1000), (unsigned long)(micros % 1000));
+        }
+        else
+        {
+            written = snprintf(buffer + length, size - length, "  %-12s %6lu ms, still running\n", name,
+                               (unsigned long)trail.phaseMs);
+        }
+        if (written < 0)
+        {
+            break;
+        }
+        length += (size_t)written;
+    }
+    return length < size ? length : (size ? size - 1 : 0);
+}
+
+StallWatchdog::StallWatchdog()
+    : trailCount(0), restartAfterMs(0), stallCount(0), lastStalledTrail(-1), lastStalledPhase(STALL_NO_PHASE),
+      lastStallMs(0)
+{
+}
+
+int StallWatchdog::watch(BreadcrumbTrail &trail, const char *taskName, const StallPhase *phases, uint8_t phaseCount,
+                         uint32_t nowMs)
+{
+    if (trailCount >= MAX_TRAILS || phaseCount > STALL_MAX_PHASES)
+    {
+        return -1;
+    }
+    Watched &entry = watched[trailCount];
+    entry.trail = &trail;
+    entry.taskName = taskName;
+    entry.phases = phases;
+    entry.phaseCount = phaseCount;
+    for (uint8_t i = 0; i < phaseCount; i++)
+    {
+        entry.limits[i] = phases[i].limitMs;
+    }
+    entry.lastSequence = trail.sequence;
+    entry.sequenceSeenMs = nowMs;
+    return trailCount++;
+}
+
+void StallWatchdog::setLimit(int trail, uint8_t phase, uint32_t limitMs)
+{
+    if (trail >= 0 && trail < trailCount && phase < watched[trail].phaseCount)
+    {
+        watched[trail].limits[phase] = limitMs;
+    }
+}
+
+uint32_t StallWatchdog::getLimit(int trail, uint8_t phase) const
+{
+    if (trail < 0 || trail >= trailCount || phase >= watched[trail].phaseCount)
+    {
+        return 0;
+    }
+    return watched[trail].limits[phase];
+}
+
+const char *StallWatchdog::getPhaseName(int trail, uint8_t phase) const
+{
+    if (trail < 0 || trail >= trailCount || phase >= watched[trail].phaseCount)
+    {
+        return "?";
+    }
+    return watched[trail].phases[phase].name;
+}
+
+StallAction StallWatchdog::check(uint32_t nowMs)
+{
+    StallAction action = STALL_NONE;
+    for (int i = 0; i < trailCount; i++)
+    {
+        Watched &entry = watched[i];
+        BreadcrumbTrail &trail = *entry.trail;
+        uint32_t sequence = trail.sequence;
+        uint8_t phase = trail.phase;
+        if (sequence != entry.lastSequence)
+        {
+            // Moved on since the last check; a flagged stall has cleared
+            entry.lastSequence = sequence;
+            entry.sequenceSeenMs = nowMs;
+            trail.stalledPhase = STALL_NO_PHASE;
+        }
+
+        uint32_t running = nowMs - entry.sequenceSeenMs;
+        trail.phaseMs = running;
+        trail.uptimeMs = nowMs;
+        if (phase >= entry.phaseCount || entry.limits[phase] == 0 || running <= entry.limits[phase])
+        {
+            continue;
+        }
+
+        if (trail.stalledPhase == STALL_NO_PHASE)
+        {
+            trail.stalledPhase = phase;
+            lastStalledTrail = i;
+            lastStalledPhase = phase;
+            stallCount++;
+            if (action < STALL_DETECTED)
+            {
+                action = STALL_DETECTED;
+            }
+        }
+        if (lastStalledTrail == i)
+        {
+            lastStallMs = running;
+        }
+        if (restartAfterMs > 0 && running > entry.limits[phase] + restartAfterMs)
+        {
+            action = STALL_RESTART;
+        }
+    }
+    return action;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BREADCRUMB_COUNT 16 // Power of two
+#define STALL_NO_PHASE 0xFF
+#define STALL_MAX_PHASES 16
+
+struct Breadcrumb
+{
+    uint32_t stamp; // Caller's clock; CPU cycles on the ESP32
+    uint8_t phase;
+};
+
+// What one task was doing, kept where a reset does not clear it (RTC_NOINIT_ATTR
+// on the ESP32, which survives every reset except power-on). The task writes
+// the phase and crumbs; the watchdog writes the timing fields.
+struct BreadcrumbTrail
+{
+    uint32_t magic;
+    volatile uint32_t sequence; // Bumped by every marker
+    volatile uint8_t phase;     // Executing now
+    uint8_t head;               // Next crumb; wraps with the ring
+    uint8_t stalledPhase;       // STALL_NO_PHASE unless the watchdog flagged the current phase
+    uint32_t phaseMs;           // How long the current phase had run at the last check
+    uint32_t uptimeMs;          // Time of the last check
+    Breadcrumb crumbs[BREADCRUMB_COUNT];
+};
+
+// Phase names and stall limits; the index is the phase number
+struct StallPhase
+{
+    const char *name;
+    uint32_t limitMs;
+};
+
+// Start a fresh trail for this boot. Read the previous one first.
+void beginTrail(BreadcrumbTrail &trail);
+
+// True if the trail was written by an earlier boot of this firmware
+bool isTrailValid(const BreadcrumbTrail &trail, uint8_t phaseCount);
+
+// Entering a phase: a store to the ring and three to the header, no calls.
+// Only the owning task marks its trail.
+inline void markPhase(BreadcrumbTrail &trail, uint8_t phase, uint32_t stamp)
+{
+    Breadcrumb &crumb = trail.crumbs[trail.head & (BREADCRUMB_COUNT - 1)];
+    crumb.stamp = stamp;
+    crumb.phase = phase;
+    trail.head++;
+    trail.phase = phase;
+    trail.sequence++;
+}
+
+// Crumbs oldest first, each with the time until the next one; returns length written
+size_t formatTrail(const BreadcrumbTrail &trail, const StallPhase *phases, uint8_t phaseCount, uint32_t stampsPerMs,
+                   char *buffer, size_t size);
+
+enum StallAction : uint8_t
+{
+    STALL_NONE,
+    STALL_DETECTED, // A phase passed its limit
+    STALL_RESTART   // A stalled phase passed the restart grace too
+};
+
+// Watches breadcrumb trails from another task or timer. A phase has stalled
+// when its trail's sequence has not moved for longer than the phase's limit.
+// The check only compares a sequence number and a timestamp per trail, so it
+// can run every 100 ms from a timer; it keeps the trail's timing fields up to
+// date, so a reset in the middle of a stall still leaves them in RTC memory.
+class StallWatchdog
+{
+public:
+    static const int MAX_TRAILS = 2;
+
+    StallWatchdog();
+
+    // Returns the trail number, or -1 if MAX_TRAILS are watched
+    int watch(BreadcrumbTrail &trail, const char *taskName, const StallPhase *phases, uint8_t phaseCount,
+              uint32_t nowMs);
+
+    void setLimit(int trail, uint8_t phase, uint32_t limitMs);
+    uint32_t getLimit(int trail, uint8_t phase) const;
+
+    // 0 = record stalls but never ask for a restart
+    void setRestartAfterMs(uint32_t ms) { restartAfterMs = ms; }
+
+    // The most severe action of any trail
+    StallAction check(uint32_t nowMs);
+
+    // The latest stall, kept after it clears so a stalled task can report it later
+    uint32_t getStallCount() const { return stallCount; } // Bumped on every new stall
+    int getLastStalledTrail() const { return lastStalledTrail; }
+    uint8_t getLastStalledPhase() const { return lastStalledPhase; }
+    uint32_t getLastStallMs() const { return lastStallMs; } // Grows while the stall lasts
+    const char *getTaskName(int trail) const { return watched[trail].taskName; }
+    const BreadcrumbTrail &getTrail(int trail) const { return *watched[trail].trail; }
+    const char *getPhaseName(int trail, uint8_t phase) const;
+
+private:
+    struct Watched
+    {
+        BreadcrumbTrail *trail;
+        const char *taskName;
+        const StallPhase *phases;
+        uint8_t phaseCount;
+        uint32_t limits[STALL_MAX_PHASES];
+        uint32_t lastSequence;
+        uint32_t sequenceSeenMs;
+    };
+
+    Watched watched[MAX_TRAILS];
+    int trailCount;
+    uint32_t restartAfterMs;
+    volatile uint32_t stallCount;
+    volatile int lastStalledTrail;
+    volatile uint8_t lastStalledPhase;
+    volatile uint32_t lastStallMs;
+};
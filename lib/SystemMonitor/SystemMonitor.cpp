@@ -0,0 +1,220 @@
+#include "SystemMonitor.h"
+#include <string.h>
+
+SystemMonitor::SystemMonitor()
+    : checkpointHead(0), sinceCheckpoint(0), lastClock(0), elapsedTicks(0), costTicks(0), started(false)
+{
+    memset(loads, 0, sizeof(loads));
+    memset(history, 0, sizeof(history));
+    memset(checkpointClock, 0, sizeof(checkpointClock));
+    for (int core = 0; core < CORE_COUNT; core++)
+    {
+        idleSlot[core] = -1;
+    }
+}
+
+uint16_t SystemMonitor::share(uint32_t busy, uint32_t elapsed)
+{
+    if (elapsed == 0)
+    {
+        return 0;
+    }
+    uint64_t permille = (uint64_t)busy * 1000 / elapsed;
+    return permille > 1000 ? 1000 : (uint16_t)permille;
+}
+
+int SystemMonitor::findSlot(uint32_t id) const
+{
+    for (int slot = 0; slot < MAX_TASKS; slot++)
+    {
+        if (loads[slot].present && loads[slot].id == id)
+        {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+int SystemMonitor::claimSlot(const TaskSnapshot &task)
+{
+    int slot = 0;
+    while (slot < MAX_TASKS && loads[slot].present)
+    {
+        slot++;
+    }
+    if (slot == MAX_TASKS)
+    {
+        return -1; // More tasks than slots; the extra ones go unreported
+    }
+
+    for (int core = 0; core < CORE_COUNT; core++)
+    {
+        if (idleSlot[core] == slot)
+        {
+            idleSlot[core] = -1;
+        }
+    }
+
+    TaskLoad &load = loads[slot];
+    memset(&load, 0, sizeof(load));
+    strncpy(load.name, task.name ? task.name : "?", sizeof(load.name) - 1);
+    load.id = task.id;
+    load.core = task.core;
+    load.stackFree = task.stackFree;
+    load.present = true;
+
+    // A new task's share starts from its first sample
+    history[slot].lastRunTime = task.runTime;
+    for (int i = 0; i < WINDOW_CHECKPOINTS; i++)
+    {
+        history[slot].checkpoints[i] = task.runTime;
+    }
+
+    if (strncmp(load.name, "IDLE", 4) == 0 && task.core >= 0 && task.core < CORE_COUNT)
+    {
+        idleSlot[task.core] = slot;
+    }
+    return slot;
+}
+
+void SystemMonitor::update(uint32_t clockNow, const TaskSnapshot *tasks, int count)
+{
+    if (!started)
+    {
+        // First sample only sets the baseline
+        for (int i = 0; i < count; i++)
+        {
+            claimSlot(tasks[i]);
+        }
+        for (int i = 0; i < WINDOW_CHECKPOINTS; i++)
+        {
+            checkpointClock[i] = clockNow;
+        }
+        lastClock = clockNow;
+        started = true;
+        return;
+    }
+
+    uint32_t elapsed = clockNow - lastClock;
+    uint32_t windowClock = clockNow - checkpointClock[checkpointHead];
+    lastClock = clockNow;
+    elapsedTicks += elapsed;
+
+    // Match the tasks already tracked first, so a deleted task's slot is
+    // only handed out once every surviving task has kept its own
+    bool seen[MAX_TASKS] = {};
+    int unmatched[MAX_TASKS];
+    int unmatchedCount = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int slot = findSlot(tasks[i].id);
+        if (slot < 0)
+        {
+            if (unmatchedCount < MAX_TASKS)
+            {
+                unmatched[unmatchedCount++] = i;
+            }
+            continue;
+        }
+
+        TaskLoad &load = loads[slot];
+        TaskHistory &past = history[slot];
+        seen[slot] = true;
+        if (tasks[i].stackFree < load.stackFree)
+        {
+            load.stackFree = tasks[i].stackFree;
+        }
+        load.recentPermille = share(tasks[i].runTime - past.lastRunTime, elapsed);
+        load.windowPermille = share(tasks[i].runTime - past.checkpoints[checkpointHead], windowClock);
+        past.lastRunTime = tasks[i].runTime;
+    }
+
+    for (int slot = 0; slot < MAX_TASKS; slot++)
+    {
+        loads[slot].present = seen[slot];
+    }
+    for (int i = 0; i < unmatchedCount; i++)
+    {
+        claimSlot(tasks[unmatched[i]]);
+    }
+
+    if (++sinceCheckpoint >= CHECKPOINT_SAMPLES)
+    {
+        sinceCheckpoint = 0;
+        for (int slot = 0; slot < MAX_TASKS; slot++)
+        {
+            history[slot].checkpoints[checkpointHead] = history[slot].lastRunTime;
+        }
+        checkpointClock[checkpointHead] = clockNow;
+        checkpointHead = (checkpointHead + 1) % WINDOW_CHECKPOINTS;
+    }
+}
+
+uint16_t SystemMonitor::getCoreLoad(int core, bool window) const
+{
+    if (core < 0 || core >= CORE_COUNT || idleSlot[core] < 0 || !hasCpuData())
+    {
+        return UNKNOWN;
+    }
+    const TaskLoad &idle = loads[idleSlot[core]];
+    if (!idle.present)
+    {
+        return UNKNOWN;
+    }
+    return 1000 - (window ? idle.windowPermille : idle.recentPermille);
+}
+
+uint32_t SystemMonitor::getOverheadPpm() const
+{
+    return elapsedTicks ? (uint32_t)(costTicks * 1000000 / elapsedTicks) : 0;
+}
+
+int SystemMonitor::getTaskCount() const
+{
+    int count = 0;
+    for (int slot = 0; slot < MAX_TASKS; slot++)
+    {
+        if (loads[slot].present)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+int SystemMonitor::findLowestStack() const
+{
+    uint8_t slot;
+    return sortByStack(&slot, 1) ? slot : -1;
+}
+
+int SystemMonitor::sortByStack(uint8_t *slots, int maxSlots) const
+{
+    int count = 0;
+    for (int slot = 0; slot < MAX_TASKS; slot++)
+    {
+        if (!loads[slot].present)
+        {
+            continue;
+        }
+        // Insertion into the first maxSlots places
+        int position = count < maxSlots ? count : maxSlots;
+        while (position > 0 && loads[slots[position - 1]].stackFree > loads[slot].stackFree)
+        {
+            if (position < maxSlots)
+            {
+                slots[position] = slots[position - 1];
+            }
+            position--;
+        }
+        if (position < maxSlots)
+        {
+            slots[position] = (uint8_t)slot;
+            if (count < maxSlots)
+            {
+                count++;
+            }
+        }
+    }
+    return count;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+
+// What the scheduler reports for one task at a sample
+struct TaskSnapshot
+{
+    uint32_t id;          // FreeRTOS task number, unique for the task's lifetime
+    const char *name;
+    int8_t core;          // -1 = not pinned
+    uint32_t runTime;     // Run-time counter, same clock as the sample time
+    uint32_t stackFree;   // High-water mark: bytes never used
+};
+
+// One tracked task as the monitor reports it
+struct TaskLoad
+{
+    char name[16];
+    uint32_t id;
+    int8_t core;
+    uint32_t stackFree;      // Lowest high-water mark seen
+    uint16_t recentPermille; // CPU share over the last sample interval
+    uint16_t windowPermille; // CPU share over the rolling window
+    bool present;
+};
+
+// Per-task stack headroom and CPU shares from run-time counter snapshots.
+//
+// Every sample the caller passes the run-time counter of each task and the
+// counter clock (uxTaskGetSystemState() on the ESP32). A task's CPU share is
+// its counter delta over the clock delta. Core load is the complement of the
+// core's idle task ("IDLE0", "IDLE1"), so time spent in interrupts counts as
+// busy. Two windows are kept: the last sample interval, and a rolling window
+// of WINDOW_CHECKPOINTS checkpoints taken every CHECKPOINT_SAMPLES samples
+// (about a minute at one sample per second). Memory is fixed: MAX_TASKS slots,
+// each with its own checkpoint ring; slots of deleted tasks are reused.
+class SystemMonitor
+{
+public:
+    static const int MAX_TASKS = 16;
+    static const int CORE_COUNT = 2;
+    static const int WINDOW_CHECKPOINTS = 6;
+    static const int CHECKPOINT_SAMPLES = 10;
+    static const uint16_t UNKNOWN = 0xFFFF; // Load of a core without an idle task
+
+    SystemMonitor();
+
+    void update(uint32_t clockNow, const TaskSnapshot *tasks, int count);
+
+    // Cost of taking a sample, to report the monitor's own overhead
+    void addSampleCost(uint32_t clockTicks) { costTicks += clockTicks; }
+
+    bool hasCpuData() const { return elapsedTicks > 0; }
+    uint16_t getCoreLoad(int core, bool window) const; // Permille, or UNKNOWN
+    uint32_t getOverheadPpm() const;                   // Parts per million of one core
+
+    int getTaskSlots() const { return MAX_TASKS; }
+    const TaskLoad &getTask(int slot) const { return loads[slot]; }
+    int getTaskCount() const;
+
+    // Present task with the least stack headroom, or -1
+    int findLowestStack() const;
+
+    // Present tasks ordered by stack headroom, fewest free bytes first; returns count
+    int sortByStack(uint8_t *slots, int maxSlots) const;
+
+private:
+    struct TaskHistory
+    {
+        uint32_t lastRunTime;
+        uint32_t checkpoints[WINDOW_CHECKPOINTS];
+    };
+
+    TaskLoad loads[MAX_TASKS];
+    TaskHistory history[MAX_TASKS];
+    uint32_t checkpointClock[WINDOW_CHECKPOINTS];
+    int checkpointHead;  // Oldest checkpoint, overwritten next
+    int sinceCheckpoint; // Samples since the last checkpoint
+    uint32_t lastClock;
+    uint64_t elapsedTicks; // Total clock covered by samples
+    uint64_t costTicks;
+    bool started;
+    int idleSlot[CORE_COUNT];
+
+    int findSlot(uint32_t id) const;
+    int claimSlot(const TaskSnapshot &task);
+    static uint16_t share(uint32_t busy, uint32_t elapsed);
+};
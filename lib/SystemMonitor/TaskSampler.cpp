@@ -0,0 +1,38 @@
+#ifdef ESP32
+
+#include "TaskSampler.h"
+#include <Arduino.h>
+
+// Kept off the caller's stack; only the loop task samples
+static TaskStatus_t statuses[TASK_SAMPLER_CAPACITY];
+
+int sampleTasks(TaskSnapshot *out, int maxTasks, uint32_t &clockNow)
+{
+    clockNow = 0;
+#if configUSE_TRACE_FACILITY
+    uint32_t totalRunTime = 0;
+    int count = uxTaskGetSystemState(statuses, TASK_SAMPLER_CAPACITY, &totalRunTime);
+    if (count > maxTasks)
+    {
+        count = maxTasks;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        out[i].id = statuses[i].xTaskNumber;
+        out[i].name = statuses[i].pcTaskName;
+#if configTASKLIST_INCLUDE_COREID
+        out[i].core = statuses[i].xCoreID == tskNO_AFFINITY ? -1 : (int8_t)statuses[i].xCoreID;
+#else
+        out[i].core = -1;
+#endif
+        out[i].runTime = statuses[i].ulRunTimeCounter;
+        out[i].stackFree = statuses[i].usStackHighWaterMark; // Bytes: ESP-IDF stacks are counted in bytes
+    }
+    clockNow = totalRunTime;
+    return count;
+#else
+    return 0;
+#endif
+}
+
+#endif
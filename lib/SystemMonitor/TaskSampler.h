@@ -0,0 +1,13 @@
+#pragma once
+
+#include "SystemMonitor.h"
+
+// Snapshot of every FreeRTOS task for SystemMonitor, from one
+// uxTaskGetSystemState() call. clockNow is the run-time counter clock, which
+// the Arduino core drives from esp_timer, so it is in microseconds. Without
+// run-time stats in the FreeRTOS build the counters read 0 and only stack
+// headroom is reported. Returns the number of tasks written, or 0 if the
+// system has more tasks than TASK_SAMPLER_CAPACITY.
+#define TASK_SAMPLER_CAPACITY 24
+
+int sampleTasks(TaskSnapshot *out, int maxTasks, uint32_t &clockNow);
@@ -0,0 +1,161 @@
+#ifdef ESP32
+
+#include "TdsAcquisition.h"
+#include <Arduino.h>
+#include <driver/adc.h>
+
+// Bytes pulled from the DMA buffer per read (2 bytes per conversion)
+static const uint32_t READ_CHUNK_BYTES = 512;
+
+static portMUX_TYPE readingLock = portMUX_INITIALIZER_UNLOCKED;
+
+TdsAcquisition::TdsAcquisition() : inletFill(0),
+                                   outletFill(0),
+                                   temperature(25.0f),
+                                   running(false)
+{
+    reading = TdsReading();
+    reading.temperatureC = 25.0f;
+}
+
+bool TdsAcquisition::begin(const TdsAcquisitionConfig &newConfig)
+{
+    if (running)
+    {
+        return true;
+    }
+
+    config = newConfig;
+    if (config.blockSize == 0 || config.blockSize > TDS_MAX_BLOCK_SIZE)
+    {
+        config.blockSize = TDS_MAX_BLOCK_SIZE;
+    }
+
+    adc_digi_init_config_t initConfig = {};
+    initConfig.max_store_buf_size = 2048;
+    initConfig.conv_num_each_intr = READ_CHUNK_BYTES / 2;
+    initConfig.adc1_chan_mask = BIT(config.inletAdcChannel) | BIT(config.outletAdcChannel);
+    initConfig.adc2_chan_mask = 0;
+    if (adc_digi_initialize(&initConfig) != ESP_OK)
+    {
+        Serial.println("TDS: ERROR - continuous ADC init failed");
+        return false;
+    }
+
+    // Alternate between the two probes
+    adc_digi_pattern_config_t pattern[2] = {};
+    uint8_t channels[2] = {config.inletAdcChannel, config.outletAdcChannel};
+    for (int i = 0; i < 2; i++)
+    {
+        pattern[i].atten = ADC_ATTEN_DB_11;
+        pattern[i].channel = channels[i];
+        pattern[i].unit = 0; // ADC1
+        pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    }
+
+    adc_digi_configuration_t digiConfig = {};
+    digiConfig.conv_limit_en = 1; // Required on the original ESP32
+    digiConfig.conv_limit_num = 250;
+    digiConfig.pattern_num = 2;
+    digiConfig.adc_pattern = pattern;
+    digiConfig.sample_freq_hz = config.sampleRateHz;
+    digiConfig.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    digiConfig.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+    if (adc_digi_controller_configure(&digiConfig) != ESP_OK || adc_digi_start() != ESP_OK)
+    {
+        Serial.println("TDS: ERROR - continuous ADC start failed");
+        adc_digi_deinitialize();
+        return false;
+    }
+
+    running = true;
+    xTaskCreatePinnedToCore(taskEntry, "tds", 3072, this, 2, nullptr, 0);
+    Serial.printf("TDS: Sampling %lu Hz, %u-sample blocks, output every %lu ms\n",
+                  (unsigned long)config.sampleRateHz, config.blockSize, config.outputIntervalMs);
+    return true;
+}
+
+void TdsAcquisition::taskEntry(void *arg)
+{
+    static_cast<TdsAcquisition *>(arg)->run();
+}
+
+void TdsAcquisition::run()
+{
+    static uint8_t buffer[READ_CHUNK_BYTES];
+    unsigned long lastPublish = millis();
+
+    for (;;)
+    {
+        uint32_t length = 0;
+        esp_err_t result = adc_digi_read_bytes(buffer, sizeof(buffer), &length, 100);
+        if (result == ESP_OK || result == ESP_ERR_INVALID_STATE) // INVALID_STATE = overrun, data still usable
+        {
+            for (uint32_t i = 0; i + 1 < length; i += 2)
+            {
+                const adc_digi_output_data_t *sample = (const adc_digi_output_data_t *)&buffer[i];
+                addSample(sample->type1.channel, sample->type1.data);
+            }
+        }
+
+        unsigned long now = millis();
+        if (now - lastPublish >= config.outputIntervalMs)
+        {
+            publish(now);
+            lastPublish = now;
+        }
+    }
+}
+
+void TdsAcquisition::addSample(uint8_t channel, uint16_t value)
+{
+    if (channel == config.inletAdcChannel)
+    {
+        inletBlock[inletFill++] = value;
+        if (inletFill >= config.blockSize)
+        {
+            inletFilter.addBlock(inletBlock, inletFill);
+            inletFill = 0;
+        }
+    }
+    else if (channel == config.outletAdcChannel)
+    {
+        outletBlock[outletFill++] = value;
+        if (outletFill >= config.blockSize)
+        {
+            outletFilter.addBlock(outletBlock, outletFill);
+            outletFill = 0;
+        }
+    }
+}
+
+void TdsAcquisition::publish(unsigned long now)
+{
+    if (!inletFilter.hasReading() || !outletFilter.hasReading())
+    {
+        return;
+    }
+
+    float temperatureC = temperature;
+    TdsReading next;
+    next.inletPpm = inletFilter.getTdsPpm(temperatureC, config.inletCalibration);
+    next.outletPpm = outletFilter.getTdsPpm(temperatureC, config.outletCalibration);
+    next.temperatureC = temperatureC;
+    next.timestampMs = now;
+    next.valid = true;
+
+    portENTER_CRITICAL(&readingLock);
+    next.sequence = reading.sequence + 1;
+    reading = next;
+    portEXIT_CRITICAL(&readingLock);
+}
+
+TdsReading TdsAcquisition::getReading() const
+{
+    portENTER_CRITICAL(&readingLock);
+    TdsReading copy = reading;
+    portEXIT_CRITICAL(&readingLock);
+    return copy;
+}
+
+#endif
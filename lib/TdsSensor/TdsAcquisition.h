@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include "TdsFilter.h"
+
+// Largest block the acquisition task filters at once, per probe
+#define TDS_MAX_BLOCK_SIZE 128
+
+struct TdsAcquisitionConfig
+{
+    uint8_t inletAdcChannel = 4;       // ADC1 channel 4 = GPIO 32, feed water probe
+    uint8_t outletAdcChannel = 5;      // ADC1 channel 5 = GPIO 33, permeate probe
+    uint32_t sampleRateHz = 20000;     // Continuous conversion rate, shared by both probes
+    uint16_t blockSize = 64;           // Samples per probe per median block
+    unsigned long outputIntervalMs = 1000;
+    TdsCalibration inletCalibration;
+    TdsCalibration outletCalibration;
+};
+
+struct TdsReading
+{
+    float inletPpm;
+    float outletPpm;
+    float temperatureC;
+    uint32_t sequence; // Increments with every published reading
+    unsigned long timestampMs;
+    bool valid;
+};
+
+// Continuous (DMA) ADC sampling of both TDS probes on a background task.
+// The task drains the conversion buffer, filters each probe block-wise with
+// TdsChannelFilter and publishes a reading every outputIntervalMs, so the
+// main loop only ever copies the latest result.
+class TdsAcquisition
+{
+public:
+    TdsAcquisition();
+
+    bool begin(const TdsAcquisitionConfig &config);
+    bool isRunning() const { return running; }
+
+    // Water temperature for compensation, e.g. from a separate probe
+    void setTemperature(float temperatureC) { temperature = temperatureC; }
+
+    TdsReading getReading() const;
+
+private:
+    TdsAcquisitionConfig config;
+    TdsChannelFilter inletFilter;
+    TdsChannelFilter outletFilter;
+    uint16_t inletBlock[TDS_MAX_BLOCK_SIZE];
+    uint16_t outletBlock[TDS_MAX_BLOCK_SIZE];
+    uint16_t inletFill;
+    uint16_t outletFill;
+    volatile float temperature;
+    TdsReading reading;
+    bool running;
+
+    static void taskEntry(void *arg);
+    void run();
+    void addSample(uint8_t channel, uint16_t value);
+    void publish(unsigned long now);
+};
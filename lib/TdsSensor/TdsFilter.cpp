@@ -0,0 +1,124 @@
+#include "TdsFilter.h"
+
+static inline void swapSamples(uint16_t &a, uint16_t &b)
+{
+    uint16_t t = a;
+    a = b;
+    b = t;
+}
+
+uint16_t tdsBlockMedian(uint16_t *samples, size_t count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    // Hoare-style quickselect for the middle element
+    size_t k = count / 2;
+    size_t left = 0;
+    size_t right = count - 1;
+    while (left < right)
+    {
+        // Median-of-three pivot keeps sorted or constant blocks linear
+        size_t mid = left + (right - left) / 2;
+        if (samples[mid] < samples[left])
+            swapSamples(samples[mid], samples[left]);
+        if (samples[right] < samples[left])
+            swapSamples(samples[right], samples[left]);
+        if (samples[right] < samples[mid])
+            swapSamples(samples[right], samples[mid]);
+        uint16_t pivot = samples[mid];
+
+        size_t i = left;
+        size_t j = right;
+        while (i <= j)
+        {
+            while (samples[i] < pivot)
+                i++;
+            while (samples[j] > pivot)
+                j--;
+            if (i <= j)
+            {
+                swapSamples(samples[i], samples[j]);
+                i++;
+                if (j == 0)
+                    break;
+                j--;
+            }
+        }
+
+        if (k <= j)
+            right = j;
+        else if (k >= i)
+            left = i;
+        else
+            break;
+    }
+    return samples[k];
+}
+
+float tdsFromMillivolts(float millivolts, float temperatureC, const TdsCalibration &calibration)
+{
+    float volts = (millivolts - calibration.offsetMillivolts) / 1000.0f;
+    if (volts <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    // Normalize conductivity to 25 C, then apply the probe curve (cubic fit of
+    // the common analog TDS board) and halve EC to TDS
+    float compensation = 1.0f + calibration.temperatureCoefficient * (temperatureC - 25.0f);
+    float v = volts / compensation;
+    float ec = (133.42f * v * v * v - 255.86f * v * v + 857.39f * v) * calibration.kFactor;
+    return ec * 0.5f;
+}
+
+TdsChannelFilter::TdsChannelFilter()
+{
+    reset();
+}
+
+void TdsChannelFilter::reset()
+{
+    for (uint8_t i = 0; i < WINDOW; i++)
+    {
+        medians[i] = 0;
+    }
+    next = 0;
+    filled = 0;
+    sum = 0;
+}
+
+void TdsChannelFilter::addBlock(uint16_t *samples, size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    uint16_t median = tdsBlockMedian(samples, count);
+    sum -= medians[next];
+    medians[next] = median;
+    sum += median;
+    next = (next + 1) % WINDOW;
+    if (filled < WINDOW)
+    {
+        filled++;
+    }
+}
+
+float TdsChannelFilter::getAverageCounts() const
+{
+    return filled ? (float)sum / filled : 0.0f;
+}
+
+float TdsChannelFilter::getTdsPpm(float temperatureC, const TdsCalibration &calibration) const
+{
+    if (!filled)
+    {
+        return 0.0f;
+    }
+    float millivolts = getAverageCounts() * calibration.millivoltsPerCount;
+    return tdsFromMillivolts(millivolts, temperatureC, calibration);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Hardware-independent TDS signal chain:
+//   raw ADC block -> block median (rejects spikes) -> moving average of block
+//   medians (smooths noise) -> millivolts -> temperature compensation ->
+//   probe curve and calibration factor -> ppm
+
+struct TdsCalibration
+{
+    float millivoltsPerCount = 3300.0f / 4095.0f; // 12-bit ADC at 11 dB attenuation
+    float offsetMillivolts = 0.0f;                // ADC zero offset
+    float kFactor = 1.0f;                         // Probe cell constant from a reference solution
+    float temperatureCoefficient = 0.02f;         // Conductivity change per degree C
+};
+
+// Median of a block of samples. Reorders the block in place (quickselect),
+// O(n) on average with no extra memory.
+uint16_t tdsBlockMedian(uint16_t *samples, size_t count);
+
+// Convert a filtered probe voltage to ppm at 25 C
+float tdsFromMillivolts(float millivolts, float temperatureC, const TdsCalibration &calibration);
+
+// One probe channel: moving average over the last WINDOW block medians
+class TdsChannelFilter
+{
+public:
+    static const uint8_t WINDOW = 8;
+
+    TdsChannelFilter();
+
+    // Filter one acquisition block (reordered in place)
+    void addBlock(uint16_t *samples, size_t count);
+
+    bool hasReading() const { return filled > 0; }
+    float getAverageCounts() const;
+    float getTdsPpm(float temperatureC, const TdsCalibration &calibration) const;
+    void reset();
+
+private:
+    uint16_t medians[WINDOW];
+    uint8_t next;
+    uint8_t filled;
+    uint32_t sum; // Running sum of medians, so the average is O(1)
+};
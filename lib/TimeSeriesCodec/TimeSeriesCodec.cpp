@@ -0,0 +1,212 @@
+#include "TimeSeriesCodec.h"
+#include "Checksum.h"
+
+static const uint8_t MAGIC_0 = 'T';
+static const uint8_t MAGIC_1 = 'S';
+
+static inline uint64_t zigzagEncode(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t zigzagDecode(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static size_t writeVarint(uint8_t *out, uint64_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static bool readVarint(const uint8_t *data, size_t length, size_t &offset, uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (offset >= length)
+        {
+            return false;
+        }
+        uint8_t byte = data[offset++];
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void writeLE16(uint8_t *out, uint16_t value)
+{
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static void writeLE32(uint8_t *out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint16_t readLE16(const uint8_t *in)
+{
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static uint32_t readLE32(const uint8_t *in)
+{
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+TimeSeriesEncoder::TimeSeriesEncoder(uint8_t *buffer, size_t capacity) : buffer(buffer),
+                                                                         capacity(capacity)
+{
+    reset();
+}
+
+void TimeSeriesEncoder::reset()
+{
+    used = TIMESERIES_HEADER_SIZE;
+    count = 0;
+    baseTimestamp = 0;
+    lastTimestamp = 0;
+    lastDelta = 0;
+}
+
+bool TimeSeriesEncoder::append(uint32_t timestamp, int32_t value)
+{
+    if (capacity < TIMESERIES_HEADER_SIZE || count == UINT16_MAX)
+    {
+        return false;
+    }
+    if (count > 0 && timestamp < lastTimestamp)
+    {
+        return false;
+    }
+
+    // Encode into scratch first so a record never gets split across blocks
+    uint8_t scratch[TIMESERIES_MAX_RECORD_SIZE];
+    size_t n = 0;
+    int64_t delta = 0;
+    if (count > 0)
+    {
+        delta = (int64_t)timestamp - (int64_t)lastTimestamp;
+        n += writeVarint(scratch, zigzagEncode(delta - lastDelta));
+    }
+    n += writeVarint(scratch + n, zigzagEncode(value));
+
+    if (used + n > capacity || used + n - TIMESERIES_HEADER_SIZE > UINT16_MAX)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        buffer[used + i] = scratch[i];
+    }
+    used += n;
+
+    if (count == 0)
+    {
+        baseTimestamp = timestamp;
+    }
+    lastDelta = delta;
+    lastTimestamp = timestamp;
+    count++;
+    return true;
+}
+
+size_t TimeSeriesEncoder::finish()
+{
+    if (capacity < TIMESERIES_HEADER_SIZE)
+    {
+        return 0;
+    }
+
+    buffer[0] = MAGIC_0;
+    buffer[1] = MAGIC_1;
+    buffer[2] = TIMESERIES_VERSION;
+    buffer[3] = 0;
+    writeLE16(buffer + 4, count);
+    writeLE16(buffer + 6, (uint16_t)(used - TIMESERIES_HEADER_SIZE));
+    writeLE32(buffer + 8, baseTimestamp);
+
+    uint32_t crc = crc32Update(0, buffer, 12);
+    crc = crc32Update(crc, buffer + TIMESERIES_HEADER_SIZE, used - TIMESERIES_HEADER_SIZE);
+    writeLE32(buffer + 12, crc);
+    return used;
+}
+
+TimeSeriesDecoder::TimeSeriesDecoder(const uint8_t *block, size_t length) : block(block),
+                                                                           blockLength(0),
+                                                                           offset(TIMESERIES_HEADER_SIZE),
+                                                                           count(0),
+                                                                           decoded(0),
+                                                                           lastTimestamp(0),
+                                                                           lastDelta(0),
+                                                                           valid(false)
+{
+    if (length < TIMESERIES_HEADER_SIZE || block[0] != MAGIC_0 || block[1] != MAGIC_1 ||
+        block[2] != TIMESERIES_VERSION)
+    {
+        return;
+    }
+
+    uint16_t payloadLength = readLE16(block + 6);
+    if (TIMESERIES_HEADER_SIZE + payloadLength > length)
+    {
+        return;
+    }
+
+    uint32_t crc = crc32Update(0, block, 12);
+    crc = crc32Update(crc, block + TIMESERIES_HEADER_SIZE, payloadLength);
+    if (crc != readLE32(block + 12))
+    {
+        return;
+    }
+
+    count = readLE16(block + 4);
+    blockLength = TIMESERIES_HEADER_SIZE + payloadLength;
+    lastTimestamp = readLE32(block + 8);
+    valid = true;
+}
+
+bool TimeSeriesDecoder::next(uint32_t &timestamp, int32_t &value)
+{
+    if (!valid || decoded >= count)
+    {
+        return false;
+    }
+
+    uint64_t raw;
+    if (decoded > 0)
+    {
+        if (!readVarint(block, blockLength, offset, raw))
+        {
+            valid = false;
+            return false;
+        }
+        lastDelta += zigzagDecode(raw);
+        lastTimestamp = (uint32_t)((int64_t)lastTimestamp + lastDelta);
+    }
+    if (!readVarint(block, blockLength, offset, raw))
+    {
+        valid = false;
+        return false;
+    }
+    timestamp = lastTimestamp;
+    value = (int32_t)zigzagDecode(raw);
+    decoded++;
+    return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact block encoding for usage time series (timestamp, value) records.
+//
+// Block layout (all integers little-endian):
+//   0  'T' 'S'           magic
+//   2  version           TIMESERIES_VERSION
+//   3  flags             reserved, 0
+//   4  recordCount       uint16
+//   6  payloadLength     uint16, bytes following the header
+//   8  baseTimestamp     uint32, timestamp of the first record
+//   12 crc32             over bytes 0..11 and the payload
+//   16 payload
+//
+// Payload records are zig-zag varints: the first record stores only its value,
+// later records store the delta-of-delta of the timestamp followed by the value.
+// Regularly spaced records cost one byte for the timestamp, and idle periods
+// (value 0) one byte for the value. Values are not delta coded because usage is
+// bursty - a draw followed by idle would pay for two large deltas.
+
+static const uint8_t TIMESERIES_VERSION = 1;
+static const size_t TIMESERIES_HEADER_SIZE = 16;
+static const size_t TIMESERIES_MAX_RECORD_SIZE = 20; // Two 64-bit varints
+
+// Streams records into a caller-owned buffer; never allocates
+class TimeSeriesEncoder
+{
+private:
+    uint8_t *buffer;
+    size_t capacity;
+    size_t used;
+    uint16_t count;
+    uint32_t baseTimestamp;
+    uint32_t lastTimestamp;
+    int64_t lastDelta;
+
+public:
+    TimeSeriesEncoder(uint8_t *buffer, size_t capacity);
+
+    // Start a new block in the same buffer
+    void reset();
+
+    // Append a record; false if the block is full or timestamps go backwards
+    bool append(uint32_t timestamp, int32_t value);
+
+    // Write the header and CRC; returns the total block length in bytes
+    size_t finish();
+
+    uint16_t getRecordCount() const { return count; }
+    size_t getEncodedSize() const { return used; }
+};
+
+// Reads records back from one encoded block
+class TimeSeriesDecoder
+{
+private:
+    const uint8_t *block;
+    size_t blockLength;
+    size_t offset;
+    uint16_t count;
+    uint16_t decoded;
+    uint32_t lastTimestamp;
+    int64_t lastDelta;
+    bool valid;
+
+public:
+    TimeSeriesDecoder(const uint8_t *block, size_t length);
+
+    // True when magic, version, lengths and CRC all check out
+    bool isValid() const { return valid; }
+    uint16_t getRecordCount() const { return count; }
+
+    // Total length of the block, to step through concatenated blocks
+    size_t getBlockLength() const { return blockLength; }
+
+    // Decode the next record; false at the end of the block or on corrupt data
+    bool next(uint32_t &timestamp, int32_t &value);
+};
@@ -0,0 +1,264 @@
+#include "UsageRollup.h"
+#include <string.h>
+
+static const uint32_t CHECKPOINT_MAGIC = 0x4C4C4F52; // "ROLL"
+static const uint16_t CHECKPOINT_VERSION = 2;
+
+// Checkpoint layout: magic(4) version(2) reserved(2) lifetime(8) pending(4),
+// then per tier head(2) started(2) headPeriod(4), then all buckets.
+// Version 1 images have no pending field and are still read.
+static const size_t CHECKPOINT_HEADER_SIZE = 20;
+static const size_t CHECKPOINT_V1_HEADER_SIZE = 16;
+static const size_t CHECKPOINT_TIER_SIZE = 8;
+
+// Days since 1970-01-01 to a month index (year * 12 + month - 1).
+// Civil calendar conversion from Howard Hinnant's date algorithms.
+static uint32_t monthIndexFromDays(uint32_t days)
+{
+    uint32_t z = days + 719468;
+    uint32_t era = z / 146097;
+    uint32_t doe = z - era * 146097;
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t year = yoe + era * 400;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    uint32_t month = (mp < 10) ? mp + 3 : mp - 9;
+    if (month <= 2)
+    {
+        year++;
+    }
+    return year * 12 + (month - 1);
+}
+
+UsageRollup::UsageRollup()
+{
+    tiers[(int)RollupTier::MINUTE].buckets = minuteBuckets;
+    tiers[(int)RollupTier::MINUTE].size = MINUTE_BUCKETS;
+    tiers[(int)RollupTier::HOUR].buckets = hourBuckets;
+    tiers[(int)RollupTier::HOUR].size = HOUR_BUCKETS;
+    tiers[(int)RollupTier::DAY].buckets = dayBuckets;
+    tiers[(int)RollupTier::DAY].size = DAY_BUCKETS;
+    tiers[(int)RollupTier::MONTH].buckets = monthBuckets;
+    tiers[(int)RollupTier::MONTH].size = MONTH_BUCKETS;
+    clear();
+}
+
+void UsageRollup::clear()
+{
+    for (int i = 0; i < 4; i++)
+    {
+        memset(tiers[i].buckets, 0, tiers[i].size * sizeof(uint32_t));
+        tiers[i].head = 0;
+        tiers[i].headPeriod = 0;
+        tiers[i].started = false;
+    }
+    lifetimeMl = 0;
+    pendingMl = 0;
+}
+
+uint32_t UsageRollup::periodOf(RollupTier tier, uint32_t timestamp)
+{
+    switch (tier)
+    {
+    case RollupTier::MINUTE:
+        return timestamp / 60;
+    case RollupTier::HOUR:
+        return timestamp / 3600;
+    case RollupTier::DAY:
+        return timestamp / 86400;
+    case RollupTier::MONTH:
+    default:
+        return monthIndexFromDays(timestamp / 86400);
+    }
+}
+
+void UsageRollup::advance(Tier &tier, uint32_t period)
+{
+    if (!tier.started)
+    {
+        tier.headPeriod = period;
+        tier.started = true;
+        return;
+    }
+
+    // Clock stepped backwards (e.g. time sync) - keep accumulating in the head
+    if (period <= tier.headPeriod)
+    {
+        return;
+    }
+
+    uint32_t steps = period - tier.headPeriod;
+    if (steps >= tier.size)
+    {
+        memset(tier.buckets, 0, tier.size * sizeof(uint32_t));
+        tier.head = 0;
+    }
+    else
+    {
+        while (steps--)
+        {
+            tier.head = (tier.head + 1) % tier.size;
+            tier.buckets[tier.head] = 0;
+        }
+    }
+    tier.headPeriod = period;
+}
+
+void UsageRollup::addUsage(uint32_t milliliters, uint32_t timestamp)
+{
+    lifetimeMl += milliliters;
+    if (timestamp == UNKNOWN_TIME)
+    {
+        pendingMl += milliliters;
+        return;
+    }
+    milliliters += pendingMl;
+    pendingMl = 0;
+
+    uint32_t days = timestamp / 86400;
+    uint32_t periods[4] = {timestamp / 60, timestamp / 3600, days, monthIndexFromDays(days)};
+
+    for (int i = 0; i < 4; i++)
+    {
+        advance(tiers[i], periods[i]);
+        tiers[i].buckets[tiers[i].head] += milliliters;
+    }
+}
+
+uint32_t UsageRollup::getBucket(RollupTier tier, uint16_t periodsAgo, uint32_t timestamp) const
+{
+    const Tier &t = tierFor(tier);
+    if (!t.started)
+    {
+        return 0;
+    }
+
+    // Periods between the last write and now hold no usage
+    uint32_t now = periodOf(tier, timestamp);
+    uint32_t lag = (now > t.headPeriod) ? now - t.headPeriod : 0;
+    if (periodsAgo < lag)
+    {
+        return 0;
+    }
+
+    uint32_t age = periodsAgo - lag;
+    if (age >= t.size)
+    {
+        return 0;
+    }
+    return t.buckets[(t.head + t.size - age) % t.size];
+}
+
+uint32_t UsageRollup::getRange(RollupTier tier, uint16_t count, uint32_t timestamp) const
+{
+    const Tier &t = tierFor(tier);
+    if (count > t.size)
+    {
+        count = t.size;
+    }
+
+    uint32_t total = 0;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        total += getBucket(tier, i, timestamp);
+    }
+    return total;
+}
+
+uint16_t UsageRollup::getBucketCount(RollupTier tier) const
+{
+    return tierFor(tier).size;
+}
+
+size_t UsageRollup::getCheckpointSize()
+{
+    return CHECKPOINT_HEADER_SIZE + 4 * CHECKPOINT_TIER_SIZE +
+           (MINUTE_BUCKETS + HOUR_BUCKETS + DAY_BUCKETS + MONTH_BUCKETS) * sizeof(uint32_t);
+}
+
+size_t UsageRollup::saveCheckpoint(uint8_t *buffer, size_t bufferSize) const
+{
+    if (bufferSize < getCheckpointSize())
+    {
+        return 0;
+    }
+
+    uint8_t *p = buffer;
+    uint16_t reserved = 0;
+    memcpy(p, &CHECKPOINT_MAGIC, 4);
+    memcpy(p + 4, &CHECKPOINT_VERSION, 2);
+    memcpy(p + 6, &reserved, 2);
+    memcpy(p + 8, &lifetimeMl, 8);
+    memcpy(p + 16, &pendingMl, 4);
+    p += CHECKPOINT_HEADER_SIZE;
+
+    for (int i = 0; i < 4; i++)
+    {
+        uint16_t started = tiers[i].started ? 1 : 0;
+        memcpy(p, &tiers[i].head, 2);
+        memcpy(p + 2, &started, 2);
+        memcpy(p + 4, &tiers[i].headPeriod, 4);
+        p += CHECKPOINT_TIER_SIZE;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        size_t bytes = tiers[i].size * sizeof(uint32_t);
+        memcpy(p, tiers[i].buckets, bytes);
+        p += bytes;
+    }
+    return p - buffer;
+}
+
+bool UsageRollup::restoreCheckpoint(const uint8_t *buffer, size_t length)
+{
+    if (length < CHECKPOINT_V1_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    uint32_t magic;
+    uint16_t version;
+    memcpy(&magic, buffer, 4);
+    memcpy(&version, buffer + 4, 2);
+    size_t headerSize = version == 1 ? CHECKPOINT_V1_HEADER_SIZE : CHECKPOINT_HEADER_SIZE;
+    if (magic != CHECKPOINT_MAGIC || (version != 1 && version != CHECKPOINT_VERSION) ||
+        length != getCheckpointSize() - CHECKPOINT_HEADER_SIZE + headerSize)
+    {
+        return false;
+    }
+
+    // Validate tier heads before touching any state
+    const uint8_t *p = buffer + headerSize;
+    for (int i = 0; i < 4; i++)
+    {
+        uint16_t head;
+        memcpy(&head, p + i * CHECKPOINT_TIER_SIZE, 2);
+        if (head >= tiers[i].size)
+        {
+            return false;
+        }
+    }
+
+    memcpy(&lifetimeMl, buffer + 8, 8);
+    pendingMl = 0;
+    if (version >= 2)
+    {
+        memcpy(&pendingMl, buffer + 16, 4);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        uint16_t started;
+        memcpy(&tiers[i].head, p, 2);
+        memcpy(&started, p + 2, 2);
+        memcpy(&tiers[i].headPeriod, p + 4, 4);
+        tiers[i].started = started != 0;
+        p += CHECKPOINT_TIER_SIZE;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        size_t bytes = tiers[i].size * sizeof(uint32_t);
+        memcpy(tiers[i].buckets, p, bytes);
+        p += bytes;
+    }
+    return true;
+}
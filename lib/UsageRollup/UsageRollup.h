@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum class RollupTier
+{
+    MINUTE,
+    HOUR,
+    DAY,
+    MONTH
+};
+
+// Multi-resolution water usage history kept in fixed-size circular tiers.
+//
+// Every flow tick adds its volume to the current bucket of all four tiers, so
+// an update is O(1) (a tier that has to roll over clears at most one bucket per
+// elapsed period). Range queries sum already-aggregated buckets and never touch
+// raw samples. Volumes are in milliliters, so one bucket tops out at ~4294 L.
+//
+// Until the clock is set there is no period to file usage under, so it is
+// held in a pending total and filed into the first period with a real time.
+//
+// RAM budget: (60 + 48 + 90 + 24) buckets * 4 bytes = 888 bytes of buckets
+// plus 4 x 12 bytes of tier bookkeeping and the totals, < 1 KB total.
+class UsageRollup
+{
+public:
+    static const uint16_t MINUTE_BUCKETS = 60;
+    static const uint16_t HOUR_BUCKETS = 48;
+    static const uint16_t DAY_BUCKETS = 90;
+    static const uint16_t MONTH_BUCKETS = 24;
+
+    UsageRollup();
+
+    // Record usage at the given time (unix seconds). UNKNOWN_TIME holds it,
+    // counted in the lifetime total, until the first call with a real time.
+    static const uint32_t UNKNOWN_TIME = 0;
+    void addUsage(uint32_t milliliters, uint32_t timestamp);
+
+    // Sum of the newest `count` buckets of a tier, current period included.
+    // Periods that passed without usage count as zero.
+    uint32_t getRange(RollupTier tier, uint16_t count, uint32_t timestamp) const;
+
+    // Usage in a single bucket, `periodsAgo` = 0 is the current period
+    uint32_t getBucket(RollupTier tier, uint16_t periodsAgo, uint32_t timestamp) const;
+
+    uint16_t getBucketCount(RollupTier tier) const;
+    uint64_t getLifetimeMilliliters() const { return lifetimeMl; }
+    uint32_t getLifetimeLiters() const { return (uint32_t)(lifetimeMl / 1000); }
+    uint32_t getPendingMilliliters() const { return pendingMl; } // Not filed under a period yet
+
+    void clear();
+
+    // Flash checkpoint support - fixed-size binary image of the whole store
+    static size_t getCheckpointSize();
+    size_t saveCheckpoint(uint8_t *buffer, size_t bufferSize) const;
+    bool restoreCheckpoint(const uint8_t *buffer, size_t length);
+
+    // Period index helpers (months are calendar months of the timestamp)
+    static uint32_t periodOf(RollupTier tier, uint32_t timestamp);
+
+private:
+    struct Tier
+    {
+        uint32_t *buckets;
+        uint16_t size;
+        uint16_t head;       // Bucket holding the newest period
+        uint32_t headPeriod; // Period index stored in buckets[head]
+        bool started;
+    };
+
+    uint32_t minuteBuckets[MINUTE_BUCKETS];
+    uint32_t hourBuckets[HOUR_BUCKETS];
+    uint32_t dayBuckets[DAY_BUCKETS];
+    uint32_t monthBuckets[MONTH_BUCKETS];
+    Tier tiers[4];
+    uint64_t lifetimeMl;
+    uint32_t pendingMl;
+
+    // Copying would leave the tier pointers aimed at the source object
+    UsageRollup(const UsageRollup &);
+    UsageRollup &operator=(const UsageRollup &);
+
+    void advance(Tier &tier, uint32_t period);
+    const Tier &tierFor(RollupTier tier) const { return tiers[(int)tier]; }
+};
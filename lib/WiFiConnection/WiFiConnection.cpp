@@ -0,0 +1,210 @@
+#include "WiFiConnection.h"
+#include <string.h>
+
+WiFiConnection::WiFiConnection(WiFiDriver &wifiDriver, uint32_t seed)
+    : driver(wifiDriver),
+      state(WiFiConnectionState::NO_CREDENTIALS),
+      portalOpen(false),
+      portalOpened(0),
+      attemptStarted(0),
+      nextAttempt(0),
+      failures(0),
+      failuresSincePortal(0),
+      attempts(0),
+      connects(0),
+      stateChanges(0),
+      cachedChannel(0),
+      cacheFailed(false),
+      attemptUsedCache(false),
+      cacheChanges(0),
+      random(seed ? seed : 0x9E3779B9)
+{
+    memset(cachedBssid, 0, sizeof(cachedBssid));
+}
+
+void WiFiConnection::setCachedAccessPoint(const uint8_t *bssid, int32_t channel)
+{
+    if (bssid && channel > 0)
+    {
+        memcpy(cachedBssid, bssid, BSSID_LENGTH);
+        cachedChannel = channel;
+    }
+    else
+    {
+        memset(cachedBssid, 0, sizeof(cachedBssid));
+        cachedChannel = 0;
+    }
+    cacheFailed = false;
+}
+
+void WiFiConnection::begin(unsigned long now)
+{
+    failures = 0;
+    failuresSincePortal = 0;
+    if (driver.hasCredentials())
+    {
+        startAttempt(now);
+    }
+    else
+    {
+        setState(WiFiConnectionState::NO_CREDENTIALS);
+        openPortal(now);
+    }
+}
+
+void WiFiConnection::update(unsigned long now)
+{
+    if (portalOpen)
+    {
+        if (driver.processPortal())
+        {
+            // New network: the cached access point belongs to the old one
+            setCachedAccessPoint(nullptr, 0);
+            failures = 0;
+            startAttempt(now);
+        }
+        else if (state != WiFiConnectionState::NO_CREDENTIALS && now - portalOpened >= config.portalTimeoutMs)
+        {
+            closePortal();
+        }
+    }
+
+    WiFiLinkStatus link = driver.getLinkStatus();
+    switch (state)
+    {
+    case WiFiConnectionState::NO_CREDENTIALS:
+        if (driver.hasCredentials())
+        {
+            startAttempt(now);
+        }
+        break;
+    case WiFiConnectionState::CONNECTING:
+        if (link == WiFiLinkStatus::CONNECTED)
+        {
+            connected();
+        }
+        else if (link == WiFiLinkStatus::FAILED || now - attemptStarted >= config.attemptTimeoutMs)
+        {
+            attemptFailed(now);
+        }
+        break;
+    case WiFiConnectionState::CONNECTED:
+        if (link != WiFiLinkStatus::CONNECTED)
+        {
+            startAttempt(now); // Lost: straight back to the same access point
+        }
+        break;
+    case WiFiConnectionState::WAITING:
+        if (link == WiFiLinkStatus::CONNECTED)
+        {
+            connected(); // The portal or the driver got there first
+        }
+        else if ((long)(now - nextAttempt) >= 0)
+        {
+            startAttempt(now);
+        }
+        break;
+    }
+}
+
+void WiFiConnection::openPortal(unsigned long now)
+{
+    if (!portalOpen)
+    {
+        driver.startPortal();
+        portalOpen = true;
+    }
+    portalOpened = now;
+    failuresSincePortal = 0;
+}
+
+void WiFiConnection::closePortal()
+{
+    if (portalOpen)
+    {
+        driver.stopPortal();
+        portalOpen = false;
+    }
+    failuresSincePortal = 0;
+}
+
+void WiFiConnection::setState(WiFiConnectionState newState)
+{
+    if (newState != state)
+    {
+        state = newState;
+        stateChanges++;
+    }
+}
+
+void WiFiConnection::startAttempt(unsigned long now)
+{
+    attemptUsedCache = hasCachedAccessPoint() && !cacheFailed;
+    driver.connect(attemptUsedCache ? cachedBssid : nullptr, attemptUsedCache ? cachedChannel : 0);
+    attemptStarted = now;
+    attempts++;
+    setState(WiFiConnectionState::CONNECTING);
+}
+
+void WiFiConnection::attemptFailed(unsigned long now)
+{
+    driver.disconnect(); // Abandon the attempt before the next one
+    if (attemptUsedCache)
+    {
+        cacheFailed = true; // The access point may have moved channel or gone
+    }
+    if (failures < UINT16_MAX)
+    {
+        failures++;
+    }
+    failuresSincePortal++;
+    nextAttempt = now + backoffDelay();
+    setState(WiFiConnectionState::WAITING);
+
+    if (!portalOpen && failuresSincePortal >= config.portalAfterFailures)
+    {
+        openPortal(now);
+    }
+}
+
+void WiFiConnection::connected()
+{
+    failures = 0;
+    failuresSincePortal = 0;
+    connects++;
+    setState(WiFiConnectionState::CONNECTED);
+    closePortal();
+
+    uint8_t bssid[BSSID_LENGTH];
+    int32_t channel = 0;
+    if (driver.getAccessPoint(bssid, channel) && channel > 0 &&
+        (channel != cachedChannel || memcmp(bssid, cachedBssid, BSSID_LENGTH) != 0))
+    {
+        setCachedAccessPoint(bssid, channel);
+        cacheChanges++;
+    }
+    cacheFailed = false;
+}
+
+unsigned long WiFiConnection::backoffDelay()
+{
+    unsigned long delay = config.backoffBaseMs;
+    for (uint16_t i = 1; i < failures && delay < config.backoffMaxMs; i++)
+    {
+        delay *= 2;
+    }
+    if (delay > config.backoffMaxMs)
+    {
+        delay = config.backoffMaxMs;
+    }
+    unsigned long half = delay / 2;
+    return half + nextRandom() % (delay - half + 1);
+}
+
+uint32_t WiFiConnection::nextRandom()
+{
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return random;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+
+enum class WiFiLinkStatus : uint8_t
+{
+    DISCONNECTED, // Idle, or an attempt still in progress
+    CONNECTED,
+    FAILED // Attempt rejected: wrong password, network not found
+};
+
+// The radio and setup portal as WiFiConnection drives them. Every call must
+// return at once; on the ESP32 this is WiFi.begin() and WiFiManager in
+// non-blocking mode, in the native tests a mock.
+class WiFiDriver
+{
+public:
+    virtual ~WiFiDriver() {}
+
+    virtual bool hasCredentials() = 0;
+
+    // Starts an attempt with the saved credentials. A BSSID and channel skip
+    // the scan; null and 0 let the driver find the strongest access point.
+    virtual void connect(const uint8_t *bssid, int32_t channel) = 0;
+    virtual void disconnect() = 0;
+    virtual WiFiLinkStatus getLinkStatus() = 0;
+
+    // Access point of the current connection; false if unknown
+    virtual bool getAccessPoint(uint8_t *bssid, int32_t &channel) = 0;
+
+    // Setup portal: processPortal() serves it and returns true once new
+    // credentials have been saved
+    virtual void startPortal() = 0;
+    virtual bool processPortal() = 0;
+    virtual void stopPortal() = 0;
+};
+
+struct WiFiConnectionConfig
+{
+    unsigned long attemptTimeoutMs = 15000;
+    unsigned long backoffBaseMs = 1000; // First retry; doubles per failure
+    unsigned long backoffMaxMs = 300000;
+    uint8_t portalAfterFailures = 3;       // Consecutive failures before the portal opens
+    unsigned long portalTimeoutMs = 300000; // Only while credentials exist
+};
+
+enum class WiFiConnectionState : uint8_t
+{
+    NO_CREDENTIALS, // Portal open, nothing to connect to
+    CONNECTING,
+    CONNECTED,
+    WAITING // Backing off before the next attempt
+};
+
+// Non-blocking WiFi connection manager. update() reads the link once and
+// makes at most a couple of driver calls, so it can run every loop pass.
+//
+// A dropped connection is retried at once on the cached BSSID and channel,
+// which skips the scan. Failed attempts back off exponentially from
+// backoffBaseMs to backoffMaxMs with "equal jitter" (half the delay fixed,
+// half random), so devices that lost the same router do not retry in step.
+// A failed attempt on the cached access point falls back to a full scan.
+// After portalAfterFailures failures in a row the setup portal opens
+// alongside the retries, and closes again on connect or after
+// portalTimeoutMs. Without credentials the portal stays open.
+class WiFiConnection
+{
+public:
+    static const uint8_t BSSID_LENGTH = 6;
+
+    WiFiConnection(WiFiDriver &driver, uint32_t seed);
+
+    void setConfig(const WiFiConnectionConfig &newConfig) { config = newConfig; }
+    const WiFiConnectionConfig &getConfig() const { return config; }
+
+    void begin(unsigned long now); // Again after the credentials were erased
+    void update(unsigned long now);
+    void openPortal(unsigned long now); // Also on request, e.g. from a button
+
+    WiFiConnectionState getState() const { return state; }
+    bool isConnected() const { return state == WiFiConnectionState::CONNECTED; }
+    bool isPortalOpen() const { return portalOpen; }
+    uint16_t getFailures() const { return failures; } // Since the last connect
+    uint32_t getAttempts() const { return attempts; }
+    uint32_t getConnects() const { return connects; }
+    unsigned long getNextAttempt() const { return nextAttempt; } // While WAITING
+    uint32_t getStateChanges() const { return stateChanges; }   // Bumped on every transition
+
+    // Access point of the last good connection, for a fast first attempt
+    // after boot; getCacheChanges() tells the owner when to persist it
+    void setCachedAccessPoint(const uint8_t *bssid, int32_t channel);
+    bool hasCachedAccessPoint() const { return cachedChannel > 0; }
+    const uint8_t *getCachedBssid() const { return cachedBssid; }
+    int32_t getCachedChannel() const { return cachedChannel; }
+    uint32_t getCacheChanges() const { return cacheChanges; }
+
+private:
+    WiFiDriver &driver;
+    WiFiConnectionConfig config;
+    WiFiConnectionState state;
+    bool portalOpen;
+    unsigned long portalOpened;
+    unsigned long attemptStarted;
+    unsigned long nextAttempt;
+    uint16_t failures;
+    uint16_t failuresSincePortal;
+    uint32_t attempts;
+    uint32_t connects;
+    uint32_t stateChanges;
+    uint8_t cachedBssid[BSSID_LENGTH];
+    int32_t cachedChannel; // 0 = nothing cached
+    bool cacheFailed;      // The cached access point failed; scan until the next connect
+    bool attemptUsedCache;
+    uint32_t cacheChanges;
+    uint32_t random; // xorshift32 state, never 0
+
+    void setState(WiFiConnectionState newState);
+    void startAttempt(unsigned long now);
+    void attemptFailed(unsigned long now);
+    void connected();
+    void closePortal();
+    unsigned long backoffDelay();
+    uint32_t nextRandom();
+};
@@ -5,13 +5,14 @@
 const char *WiFiController::AP_NAME = "RO-Monitor-Setup";
 const char *WiFiController::AP_PASSWORD = "setup123";
 
-WiFiController::WiFiController() : currentStatus(WiFiStatus::DISCONNECTED),
-                                   lastConnectionAttempt(0),
-                                   lastStatusCheck(0),
-                                   connectionAttempts(0),
+WiFiController::WiFiController() : connection(*this, esp_random()),
+                                   lastState(WiFiConnectionState::NO_CREDENTIALS),
+                                   savedCacheChanges(0),
+                                   portalSaved(false),
                                    deviceNameParam(nullptr),
                                    ntpServerParam(nullptr),
-                                   timezoneParam(nullptr)
+                                   timezoneParam(nullptr),
+                                   configStore(configPrefs)
 {
 }
 
@@ -28,18 +29,7 @@ void WiFiController::begin()
 
     // Initialize preferences with a more specific namespace
     preferences.begin("wifi-settings", false);
-
-    // Clear any corrupted data on first boot (optional safety check)
-    size_t freeEntries = preferences.freeEntries();
-    Serial.printf("WiFiController: NVS free entries: %zu\n", freeEntries);
-
-    // Debug: Check if NVS is working
-    Serial.printf("WiFiController: NVS partition size: %zu bytes\n", preferences.getBytesLength("configured"));
-
-    // Test NVS write capability
-    preferences.putString("test", "hello");
-    String testRead = preferences.getString("test", "fail");
-    Serial.printf("WiFiController: NVS test write/read: %s\n", testRead.c_str());
+    Serial.printf("WiFiController: NVS free entries: %zu\n", preferences.freeEntries());
 
     // Load saved parameters
     loadSavedParameters();
@@ -47,99 +37,148 @@ void WiFiController::begin()
     // Set up custom parameters
     setupCustomParameters();
 
-    // Configure WiFiManager
+    // The portal runs from update(); a save only stores the credentials and
+    // WiFiConnection makes the attempt
     wifiManager.setDebugOutput(true);
     wifiManager.setSaveConfigCallback([this]()
                                       { this->saveCustomParameters(); });
     wifiManager.setAPCallback([this](WiFiManager *manager)
-                              { this->handleConfigModeCallback(manager); });
+                              { this->onConfigModeStarted(); });
+    wifiManager.setConfigPortalBlocking(false);
+    wifiManager.setSaveConnect(false);
+
+    // Retries are WiFiConnection's, with backoff
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);
+
+    loadCachedAccessPoint();
+    savedCacheChanges = connection.getCacheChanges();
+    connection.begin(millis());
+    lastState = connection.getState();
+    if (lastState == WiFiConnectionState::CONNECTING)
+    {
+        Serial.printf("WiFiController: Connecting%s...\n",
+                      connection.hasCachedAccessPoint() ? " to the last access point" : "");
+    }
+}
 
-    // Set timeouts
-    wifiManager.setConfigPortalTimeout(300); // 5 minutes
-    wifiManager.setConnectTimeout(30);       // 30 seconds
+void WiFiController::update()
+{
+    connection.update(millis());
 
-    // Try to connect with saved credentials
-    if (hasCredentials())
+    WiFiConnectionState state = connection.getState();
+    if (state != lastState)
     {
-        Serial.println("WiFiController: Attempting to connect with saved credentials...");
-        currentStatus = WiFiStatus::CONNECTING;
-
-        // Try auto-connect first
-        if (wifiManager.autoConnect(AP_NAME, AP_PASSWORD))
+        if (state == WiFiConnectionState::CONNECTED)
         {
-            Serial.println("WiFiController: Connected successfully!");
-            currentStatus = WiFiStatus::CONNECTED;
             onConnected();
         }
-        else
+        else if (lastState == WiFiConnectionState::CONNECTED)
         {
-            Serial.println("WiFiController: Auto-connect failed, starting config portal...");
-            currentStatus = WiFiStatus::CONFIG_MODE;
-            onConfigModeStarted();
+            onDisconnected();
         }
+        else if (state == WiFiConnectionState::WAITING)
+        {
+            Serial.printf("WiFiController: Attempt failed (%u in a row), next in %lu ms\n", connection.getFailures(),
+                          connection.getNextAttempt() - millis());
+        }
+        lastState = state;
     }
-    else
+
+    if (connection.getCacheChanges() != savedCacheChanges)
     {
-        Serial.println("WiFiController: No saved credentials, starting config portal...");
-        startConfigPortal();
+        saveCachedAccessPoint();
+        savedCacheChanges = connection.getCacheChanges();
     }
+}
 
-    lastStatusCheck = millis();
+WiFiStatus WiFiController::getStatus() const
+{
+    if (connection.isConnected())
+    {
+        return WiFiStatus::CONNECTED;
+    }
+    if (connection.isPortalOpen())
+    {
+        return WiFiStatus::CONFIG_MODE;
+    }
+    if (connection.getState() == WiFiConnectionState::CONNECTING)
+    {
+        return WiFiStatus::CONNECTING;
+    }
+    return WiFiStatus::DISCONNECTED;
 }
 
-void WiFiController::update()
+bool WiFiController::hasCredentials()
 {
-    unsigned long now = millis();
+    // Set when the portal saves; WiFiManager keeps the credentials themselves
+    return preferences.getBool("configured", false);
+}
 
-    // Check status periodically
-    if (now - lastStatusCheck >= STATUS_CHECK_INTERVAL)
+void WiFiController::connect(const uint8_t *bssid, int32_t channel)
+{
+    if (bssid)
     {
-        WiFiStatus previousStatus = currentStatus;
+        // Straight to the known access point, no scan
+        String ssid = wifiManager.getWiFiSSID(true);
+        String password = wifiManager.getWiFiPass(true);
+        WiFi.begin(ssid.c_str(), password.c_str(), channel, bssid);
+    }
+    else
+    {
+        WiFi.begin(); // Saved credentials, strongest access point
+    }
+}
 
-        if (WiFi.status() == WL_CONNECTED)
-        {
-            if (currentStatus != WiFiStatus::CONNECTED)
-            {
-                currentStatus = WiFiStatus::CONNECTED;
-                connectionAttempts = 0;
-                onConnected();
-            }
-        }
-        else
-        {
-            if (currentStatus == WiFiStatus::CONNECTED)
-            {
-                currentStatus = WiFiStatus::DISCONNECTED;
-                onDisconnected();
-
-                // Try to reconnect
-                Serial.println("WiFiController: Connection lost, attempting to reconnect...");
-                WiFi.reconnect();
-                lastConnectionAttempt = now;
-                connectionAttempts++;
-            }
-            else if (currentStatus == WiFiStatus::CONNECTING)
-            {
-                // Check if connection attempt timed out
-                if (now - lastConnectionAttempt >= CONNECTION_TIMEOUT)
-                {
-                    connectionAttempts++;
-                    if (connectionAttempts >= MAX_CONNECTION_ATTEMPTS)
-                    {
-                        Serial.println("WiFiController: Max connection attempts reached, starting config portal...");
-                        startConfigPortal();
-                    }
-                    else
-                    {
-                        Serial.printf("WiFiController: Connection attempt %d failed, retrying...\n", connectionAttempts);
-                        lastConnectionAttempt = now;
-                    }
-                }
-            }
-        }
+void WiFiController::disconnect()
+{
+    WiFi.disconnect(false, false); // Radio stays on, credentials stay saved
+}
 
-        lastStatusCheck = now;
+WiFiLinkStatus WiFiController::getLinkStatus()
+{
+    switch (WiFi.status())
+    {
+    case WL_CONNECTED:
+        return WiFiLinkStatus::CONNECTED;
+    case WL_CONNECT_FAILED:
+    case WL_NO_SSID_AVAIL:
+        return WiFiLinkStatus::FAILED;
+    default:
+        return WiFiLinkStatus::DISCONNECTED;
+    }
+}
+
+bool WiFiController::getAccessPoint(uint8_t *bssid, int32_t &channel)
+{
+    const uint8_t *current = WiFi.BSSID();
+    if (WiFi.status() != WL_CONNECTED || !current)
+    {
+        return false;
     }
+    memcpy(bssid, current, WiFiConnection::BSSID_LENGTH);
+    channel = WiFi.channel();
+    return true;
+}
+
+void WiFiController::startPortal()
+{
+    Serial.println("WiFiController: Starting config portal...");
+    wifiManager.startConfigPortal(AP_NAME, AP_PASSWORD); // Returns at once in non-blocking mode
+}
+
+bool WiFiController::processPortal()
+{
+    wifiManager.process();
+    bool saved = portalSaved;
+    portalSaved = false;
+    return saved;
+}
+
+void WiFiController::stopPortal()
+{
+    Serial.println("WiFiController: Closing config portal");
+    wifiManager.stopConfigPortal();
 }
 
 void WiFiController::setupCustomParameters()
@@ -148,25 +187,25 @@ void WiFiController::setupCustomParameters()
     deviceNameParam = new WiFiManagerParameter(
         "device_name",
         "Device Name",
-        deviceName.c_str(),
-        32,
+        config.deviceName,
+        sizeof(config.deviceName) - 1,
         "placeholder=\"RO Monitor\"");
 
     // NTP Server parameter
     ntpServerParam = new WiFiManagerParameter(
         "ntp_server",
         "NTP Server",
-        ntpServer.c_str(),
-        64,
+        config.ntpServer,
+        sizeof(config.ntpServer) - 1,
         "placeholder=\"pool.ntp.org\"");
 
     // Timezone parameter
     timezoneParam = new WiFiManagerParameter(
         "timezone",
-        "Timezone Offset (hours)",
-        timezone.c_str(),
-        8,
-        "placeholder=\"0\" type=\"number\" min=\"-12\" max=\"12\"");
+        "Timezone (POSIX TZ)",
+        config.timezone,
+        sizeof(config.timezone) - 1,
+        "placeholder=\"UTC0\"");
 
     // Add parameters to WiFiManager
     wifiManager.addParameter(deviceNameParam);
@@ -178,72 +217,54 @@ void WiFiController::saveCustomParameters()
 {
     Serial.println("WiFiController: Saving custom parameters...");
 
-    // Get values from parameters
-    deviceName = String(deviceNameParam->getValue());
-    ntpServer = String(ntpServerParam->getValue());
-    timezone = String(timezoneParam->getValue());
-
-    // Set defaults if empty
-    if (deviceName.length() == 0)
-        deviceName = "RO Monitor";
-    if (ntpServer.length() == 0)
-        ntpServer = "pool.ntp.org";
-    if (timezone.length() == 0)
-        timezone = "0";
-
-    // Save to preferences
-    preferences.putString("device_name", deviceName);
-    preferences.putString("ntp_server", ntpServer);
-    preferences.putString("timezone", timezone);
+    // Empty fields keep the current values
+    DeviceConfig defaults;
+    setDeviceConfigDefaults(defaults);
+    const char *name = deviceNameParam->getValue();
+    const char *ntp = ntpServerParam->getValue();
+    const char *tz = timezoneParam->getValue();
+    snprintf(config.deviceName, sizeof(config.deviceName), "%s", name[0] ? name : defaults.deviceName);
+    snprintf(config.ntpServer, sizeof(config.ntpServer), "%s", ntp[0] ? ntp : defaults.ntpServer);
+    snprintf(config.timezone, sizeof(config.timezone), "%s", tz[0] ? tz : defaults.timezone);
+
+    // Save as part of the single config record
+    saveDeviceConfig(configStore, config);
     preferences.putBool("configured", true);
+    portalSaved = true;
 
     Serial.printf("WiFiController: Saved - Device: %s, NTP: %s, TZ: %s\n",
-                  deviceName.c_str(), ntpServer.c_str(), timezone.c_str());
+                  config.deviceName, config.ntpServer, config.timezone);
 }
 
 void WiFiController::loadSavedParameters()
 {
-    deviceName = preferences.getString("device_name", "RO Monitor");
-    ntpServer = preferences.getString("ntp_server", "pool.ntp.org");
-    timezone = preferences.getString("timezone", "0");
+    configPrefs.begin("config", false);
+    ConfigLoadResult result = loadDeviceConfig(configStore, config);
 
-    Serial.printf("WiFiController: Loaded - Device: %s, NTP: %s, TZ: %s\n",
-                  deviceName.c_str(), ntpServer.c_str(), timezone.c_str());
+    Serial.printf("WiFiController: Loaded (%s) - Device: %s, NTP: %s, TZ: %s\n", configLoadResultName(result),
+                  config.deviceName, config.ntpServer, config.timezone);
 }
 
-bool WiFiController::shouldEnterConfigMode()
+void WiFiController::loadCachedAccessPoint()
 {
-    // Enter config mode if no credentials or unable to connect
-    return !hasCredentials() || (connectionAttempts >= MAX_CONNECTION_ATTEMPTS);
+    uint8_t bssid[WiFiConnection::BSSID_LENGTH];
+    int32_t channel = preferences.getInt("ap_channel", 0);
+    if (channel > 0 && preferences.getBytes("ap_bssid", bssid, sizeof(bssid)) == sizeof(bssid))
+    {
+        connection.setCachedAccessPoint(bssid, channel);
+    }
 }
 
-void WiFiController::handleConfigModeCallback(WiFiManager *myWiFiManager)
+// Only on a change of access point, so a stable network costs no flash writes
+void WiFiController::saveCachedAccessPoint()
 {
-    Serial.println("WiFiController: Entered config mode");
-    Serial.printf("WiFiController: Config AP: %s\n", AP_NAME);
-    Serial.printf("WiFiController: Config IP: %s\n", WiFi.softAPIP().toString().c_str());
-
-    currentStatus = WiFiStatus::CONFIG_MODE;
-    onConfigModeStarted();
+    preferences.putBytes("ap_bssid", connection.getCachedBssid(), WiFiConnection::BSSID_LENGTH);
+    preferences.putInt("ap_channel", connection.getCachedChannel());
 }
 
 void WiFiController::startConfigPortal()
 {
-    Serial.println("WiFiController: Starting config portal...");
-    currentStatus = WiFiStatus::CONFIG_MODE;
-
-    // Start the config portal
-    if (wifiManager.startConfigPortal(AP_NAME, AP_PASSWORD))
-    {
-        Serial.println("WiFiController: Config portal completed successfully");
-        currentStatus = WiFiStatus::CONNECTED;
-        onConnected();
-    }
-    else
-    {
-        Serial.println("WiFiController: Config portal failed or timed out");
-        currentStatus = WiFiStatus::ERROR;
-    }
+    connection.openPortal(millis());
 }
 
 void WiFiController::resetSettings()
@@ -252,15 +273,19 @@ void WiFiController::resetSettings()
     wifiManager.resetSettings();
     preferences.clear();
 
-    // Reset parameters to defaults
-    deviceName = "RO Monitor";
-    ntpServer = "pool.ntp.org";
-    timezone = "0";
-
-    currentStatus = WiFiStatus::DISCONNECTED;
-    connectionAttempts = 0;
+    // Reset network parameters to defaults
+    DeviceConfig defaults;
+    setDeviceConfigDefaults(defaults);
+    memcpy(config.deviceName, defaults.deviceName, sizeof(config.deviceName));
+    memcpy(config.ntpServer, defaults.ntpServer, sizeof(config.ntpServer));
+    memcpy(config.timezone, defaults.timezone, sizeof(config.timezone));
+    saveDeviceConfig(configStore, config);
+
+    // No credentials left: back to the setup portal
+    connection.setCachedAccessPoint(nullptr, 0);
+    connection.begin(millis());
+    lastState = connection.getState();
 }
-
 String WiFiController::getIPAddress() const
 {
     if (WiFi.status() == WL_CONNECTED)
@@ -272,7 +297,7 @@ String WiFiController::getIPAddress() const
 
 String WiFiController::getStatusString() const
 {
-    switch (currentStatus)
+    switch (getStatus())
     {
     case WiFiStatus::DISCONNECTED:
         return "Disconnected";
@@ -282,20 +307,11 @@ String WiFiController::getStatusString() const
         return "Connected";
     case WiFiStatus::CONFIG_MODE:
         return "Setup Mode";
-    case WiFiStatus::ERROR:
-        return "Error";
     default:
         return "Unknown";
     }
 }
 
-bool WiFiController::hasCredentials() const
-{
-    // Check if we have saved WiFi credentials in NVS
-    // WiFiManager will handle checking its own internal storage
-    return const_cast<Preferences &>(preferences).getBool("configured", false);
-}
-
 unsigned long WiFiController::getUptime() const
 {
     return millis();
@@ -3,30 +3,35 @@
 #include <WiFi.h>
 #include <WiFiManager.h>
 #include <Preferences.h>
+#include "DeviceConfig.h"
+#include "WiFiConnection.h"
 
 enum class WiFiStatus
 {
     DISCONNECTED,
     CONNECTING,
     CONNECTED,
-    CONFIG_MODE,
-    ERROR
+    CONFIG_MODE
 };
 
-class WiFiController
+// Station connection and setup portal on the ESP32. WiFiConnection decides
+// when to connect, back off and open the portal; this class is its driver,
+// on WiFi.begin() and WiFiManager's non-blocking portal, and keeps the last
+// access point in NVS so the first attempt after boot skips the scan.
+//
+// Unused: the firmware does not link this class. HomeSpan brings WiFi up
+// and owns the station and its access point, so none of this affects the
+// main loop today. It is kept for a build that takes WiFi back from HomeSpan.
+class WiFiController : private WiFiDriver
 {
 private:
     WiFiManager wifiManager;
     Preferences preferences;
-    WiFiStatus currentStatus;
-    unsigned long lastConnectionAttempt;
-    unsigned long lastStatusCheck;
-    int connectionAttempts;
+    WiFiConnection connection;
+    WiFiConnectionState lastState; // Last one logged
+    uint32_t savedCacheChanges;
+    bool portalSaved; // Set by WiFiManager's save callback
 
-    // Configuration constants
-    static const unsigned long CONNECTION_TIMEOUT = 30000;   // 30 seconds
-    static const unsigned long STATUS_CHECK_INTERVAL = 5000; // 5 seconds
-    static const int MAX_CONNECTION_ATTEMPTS = 3;
     static const char *AP_NAME;
     static const char *AP_PASSWORD;
 
@@ -35,31 +40,43 @@ private:
     WiFiManagerParameter *ntpServerParam;
     WiFiManagerParameter *timezoneParam;
 
-    // Device configuration
-    String deviceName;
-    String ntpServer;
-    String timezone;
+    // Device configuration, shared with the rest of the firmware
+    Preferences configPrefs;
+    PreferencesStore configStore;
+    DeviceConfig config;
 
     void setupCustomParameters();
     void saveCustomParameters();
     void loadSavedParameters();
-    bool shouldEnterConfigMode();
-    void handleConfigModeCallback(WiFiManager *myWiFiManager);
+    void loadCachedAccessPoint();
+    void saveCachedAccessPoint();
+
+    // WiFiDriver
+    bool hasCredentials() override;
+    void connect(const uint8_t *bssid, int32_t channel) override;
+    void disconnect() override;
+    WiFiLinkStatus getLinkStatus() override;
+    bool getAccessPoint(uint8_t *bssid, int32_t &channel) override;
+    void startPortal() override;
+    bool processPortal() override;
+    void stopPortal() override;
 
 public:
     WiFiController();
     ~WiFiController();
 
-    // Main control methods
+    // Neither call blocks: begin() starts the first attempt or the portal,
+    // update() runs the connection and portal and belongs in every loop pass
     void begin();
     void update();
-    bool isConnected() const { return WiFi.status() == WL_CONNECTED; }
-    WiFiStatus getStatus() const { return currentStatus; }
+    bool isConnected() const { return connection.isConnected(); }
+    WiFiStatus getStatus() const;
+    const WiFiConnection &getConnection() const { return connection; }
 
     // Configuration methods
-    void startConfigPortal();
+    void startConfigPortal(); // Opens alongside any retries
     void resetSettings();
-    String getDeviceName() const { return deviceName; }
+    const char *getDeviceName() const { return config.deviceName; }
     String getSSID() const { return WiFi.SSID(); }
     String getIPAddress() const;
     int getRSSI() const { return WiFi.RSSI(); }
@@ -69,7 +86,6 @@ public:
 
     // Status information
     String getStatusString() const;
-    bool hasCredentials() const;
     unsigned long getUptime() const;
 
     // Event callbacks
@@ -1,54 +1,82 @@
 #include <Wire.h>
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
+#include <Preferences.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <esp_heap_caps.h>
+#include <esp_wifi.h>
+#include <math.h>
+#include <time.h>
+#include <stdarg.h>
+#include "AllocationCounter.h"
 #include "ButtonLogic.h"
+#include "FilterStages.h"
 #include "HomeKitController.h"
+#include "UsageRollup.h"
+#include "FlowMeter.h"
+#include "TimeSeriesCodec.h"
+#include "LeakDetector.h"
+#include "TdsAcquisition.h"
+#include "PersistentCounters.h"
+#include "PowerFailRecord.h"
+#include "EventJournal.h"
+#include "ResumeSnapshot.h"
+#include "BootProfiler.h"
+#include "DeviceConfig.h"
+#include "HeapMonitor.h"
+#include "SystemMonitor.h"
+#include "TaskSampler.h"
+#include "StallWatchdog.h"
+#include "PowerPolicy.h"
 
 #define SCREEN_WIDTH 128
 #define SCREEN_HEIGHT 64
 #define OLED_RESET -1
-
-#define I2C_SDA 21
-#define I2C_SCL 22
+#define OLED_READY_TIMEOUT_MS 100 // SSD1306 start-up after power is applied
 
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
 
 // --- Screen and Filter Management ---
-#define BUTTON_LEFT_PIN 4  // Previous screen
-#define BUTTON_RIGHT_PIN 5 // Next screen (changed from 2 to 5)
-#define NUM_SCREENS 8      // Normal screens + HomeKit screen (removed WiFi status screen)
+#define NUM_SCREENS (SCREEN_DIAGNOSTICS + 1) // Screens in the rotation
+
+// Pins, calibration and intervals: one versioned record, read once at boot.
+// Flow pulses per liter of 0 = sensor not fitted. TDS probes must be on ADC1
+// (ADC2 is unavailable while WiFi runs). The power-fail pin is the supply
+// comparator output, low when the 12 V feed drops; the regulator's bulk
+// capacitance gives tens of ms of hold-up after the edge.
+Preferences configPrefs;
+PreferencesStore configStore(configPrefs);
+DeviceConfig deviceConfig;
+bool clockSyncStarted = false;
+
+#define POWER_FAIL_KEY "pwrfail"
+
+// Filter stages of this RO unit, in flow order. The table sets the stage
+// count, so another model only needs a different table.
+const FilterStageInfo filterStages[] = {
+    {"PP1 FILTER", "PP1", "PP1 Filter"},
+    {"PP2 FILTER", "PP2", "PP2 Filter"},
+    {"CARBON", "CAR", "Carbon Filter"},
+    {"MEMBRANE", "MEM", "RO Membrane"},
+    {"MINERALIZR", "MIN", "Mineralizer"}};
+typedef FilterStageModel<sizeof(filterStages) / sizeof(filterStages[0])> FilterModel;
+static_assert(FilterModel::COUNT <= PersistentCounters::MAX_FILTERS, "Persisted filter slots");
 
 enum ScreenType
 {
   SCREEN_DASHBOARD,
-  SCREEN_PP1,
-  SCREEN_PP2,
-  SCREEN_CARBON,
-  SCREEN_MEMBRANE,
-  SCREEN_MINERALIZER,
-  SCREEN_USAGE,
+  SCREEN_FIRST_FILTER, // One screen per stage
+  SCREEN_USAGE = SCREEN_FIRST_FILTER + FilterModel::COUNT,
+  SCREEN_RECOVERY,
+  SCREEN_WATER_QUALITY,
   SCREEN_HOMEKIT_STATUS, // HomeKit status screen
-  SCREEN_COUNTER_RESET
-};
-
-enum FilterStatus
-{
-  STATUS_OK,      // >20%
-  STATUS_WARNING, // 10-20%
-  STATUS_REPLACE  // <10%
-};
-
-struct FilterInfo
-{
-  String name;
-  String shortName;
-  int percentage;
-  FilterStatus status;
-  String timeLeft;
+  SCREEN_DIAGNOSTICS,    // Core load and task stack headroom
+  SCREEN_COUNTER_RESET,
+  SCREEN_LEAK_ALERT // Priority screen, pinned while a leak alert is new
 };
 
 unsigned long lastScreenChange = 0;
-const unsigned long screenInterval = 8000; // 8 seconds
 volatile int currentScreen = 0;
 
 // ButtonLogic instance for clean button handling
@@ -65,45 +93,155 @@ volatile bool rightButtonJustReleased = false;
 
 // Reduce frequent serial messages - only log status once per minute
 unsigned long lastStatusMessageTime = 0;
-const unsigned long statusMessageInterval = 60000; // 60 seconds
 
-// Filter data
-FilterInfo filters[5] = {
-    {"PP1 FILTER", "PP1", 80, STATUS_OK, "2 months"},
-    {"PP2 FILTER", "PP2", 75, STATUS_OK, "2 months"},
-    {"CARBON", "CAR", 50, STATUS_OK, "1 month"},
-    {"MEMBRANE", "MEM", 60, STATUS_OK, "3 months"},
-    {"MINERALIZR", "MIN", 15, STATUS_WARNING, "2 weeks"}};
+// Filter life; restored from the persistent counters at boot
+FilterModel filters(filterStages);
+
+// Flow metering - each channel's rollup is the single source of truth for its usage.
+// Drinking water usage is the permeate channel.
+FlowMeter flowMeter;
+UsageRollup &usageRollup = flowMeter.getRollup(FLOW_PERMEATE);
+Preferences usagePrefs;
+unsigned long lastRollupCheckpoint = 0;
+const char *const rollupKeys[FLOW_CHANNEL_COUNT] = {"rollup_in", "rollup", "rollup_br"};
+uint64_t checkpointedUsageMl = 0; // Total flow at the last rollup checkpoint
+
+// Usage total and filter life, written with coalescing and a daily write budget
+Preferences counterPrefs;
+PreferencesStore counterStore(counterPrefs);
+PersistentCounters persistentCounters(counterStore);
+
+// Pending counter deltas, pre-serialized for the power-fail task
+PowerFailRecord powerFailRecord;
+TaskHandle_t powerFailTaskHandle = nullptr;
+volatile bool powerFailing = false;   // Supply is low; no routine flash writes
+volatile uint32_t powerFailWriteMicros = 0; // Duration of the last emergency write
+
+// Event history (resets, filter changes, draws, alerts) on the spiffs partition
+LittleFSJournalStorage journalStorage;
+EventJournal eventJournal(journalStorage);
+bool drawInProgress = false;
+uint64_t drawStartMl = 0;
+unsigned long drawStartMs = 0;
+
+// Eve history sample period; Eve expects 10 minutes
+#define HISTORY_INTERVAL_S 600
+
+// Warm-reset snapshot in RTC slow memory: journal position, counter sequence,
+// filter life and every rollup. Bump RESUME_LAYOUT_VERSION when ResumeState
+// or the payload order changes.
+#define RESUME_LAYOUT_VERSION 3
+struct ResumeState
+{
+  JournalState journal;
+  uint32_t journalSequence;
+  uint32_t journalBytes;
+  uint32_t countersSequence;
+  uint8_t filterPercent[8];
+  uint64_t countersPersistedMl;
+};
+RTC_NOINIT_ATTR uint8_t resumeRegion[3072];
+ResumeSnapshot resumeSnapshot(resumeRegion, sizeof(resumeRegion), RESUME_LAYOUT_VERSION);
+bool resumeSnapshotCommitted = false;
+uint64_t resumeSnapshotFlowMl = 0;
 
-unsigned int totalWaterUsed = 1234; // Liters
+enum RestorePath
+{
+  RESTORE_DEFAULTS, // Nothing stored yet
+  RESTORE_FLASH,    // NVS counters/checkpoints and journal replay
+  RESTORE_RTC       // Warm reset, RTC snapshot
+};
+RestorePath restorePath = RESTORE_DEFAULTS;
+uint32_t restoreMicros = 0;
+
+// Boot phase timing, reported once the first frame is on screen
+BootProfiler bootProfiler;
+bool bootReported = false;
+
+// Flow pulses counted by interrupt, one total per channel. Totals only ever
+// increase; the flow meter and the leak detector each track what they consumed.
+volatile uint32_t flowPulseTotals[FLOW_CHANNEL_COUNT] = {0};
+
+// Leak detection runs on its own esp_timer, independent of the render loop
+LeakDetector leakDetector;
+esp_timer_handle_t leakTimer = nullptr;
+TaskHandle_t loopTaskHandle = nullptr;
+volatile uint8_t leakAlerts = LEAK_NONE; // Written by the leak timer
+uint8_t handledLeakAlerts = LEAK_NONE;   // Last alert state acted on by loop()
+
+unsigned int totalWaterUsed = 0; // Liters, mirrored from usageRollup for HomeKit
+uint32_t seenLinkChanges = 0;    // HomeKit link events already shown
+char wifiSsid[33] = "";          // Copied on link events, so frames and logs never build a String
+char wifiAddress[16] = "";
+
+// Heap allocations by the loop task; the steady state should make none
+uint32_t passAllocations = 0;     // During the last pass
+uint32_t passFrees = 0;
+uint32_t allocatingPasses = 0;    // Passes that allocated since the last status report
+
+// Free heap, largest block and fragmentation sampled into a ring; a warning
+// dumps the allocator state while there is still room for TLS and pairing
+HeapMonitor heapMonitor;
+
+// Task stacks and CPU shares, sampled once a second from the scheduler's
+// run-time counters; the sample itself must stay under 0.1% of a core
+#define SYSTEM_SAMPLE_MS 1000
+#define SYSTEM_OVERHEAD_BUDGET_PPM 1000
+SystemMonitor systemMonitor;
+TaskSnapshot taskSnapshots[TASK_SAMPLER_CAPACITY];
+unsigned long lastSystemSample = 0;
+
+// WiFi modem sleep follows activity: awake while the unit or the Home app is
+// in use, waking for beacons while a controller session is open, deepest
+// sleep otherwise. HomeKit request latencies are collected per mode.
+PowerPolicy powerPolicy;
+
+// Stall watchdog: loop() and the HomeKit task leave breadcrumbs in RTC
+// memory, and a 100 ms timer flags any phase that runs past its limit. The
+// task watchdog still backs up the loop task for hangs the timer cannot see.
+enum LoopPhase : uint8_t
+{
+  PHASE_SERIAL,   // Serial commands
+  PHASE_INPUT,    // Leak alerts, buttons, flow
+  PHASE_STORAGE,  // NVS checkpoints, journal, counters
+  PHASE_HOMEKIT,  // Clock sync, state exchange with the HomeKit task
+  PHASE_STATUS,   // Minute status report
+  PHASE_DISPLAY,  // Frame render and I2C transfer
+  PHASE_MONITORS, // Heap and task sampling
+  PHASE_WAIT,     // Frame delay
+  LOOP_PHASE_COUNT
+};
+const StallPhase loopPhases[LOOP_PHASE_COUNT] = {
+    {"serial", 2000}, // Commands print whole reports
+    {"input", 500},
+    {"storage", 3000}, // An NVS write can wait on a flash erase
+    {"homekit", 500},
+    {"status", 1000},
+    {"display", 500}, // A frame is about 25 ms at 400 kHz
+    {"monitors", 500},
+    {"wait", 1000}}; // Frame delay is 100 ms
+#define STALL_CHECK_MS 100
+#define STALL_RESTART_MS 30000 // Past a phase's limit; the breadcrumbs survive the restart
+RTC_NOINIT_ATTR BreadcrumbTrail loopTrail;
+RTC_NOINIT_ATTR BreadcrumbTrail homeKitTrail;
+StallWatchdog stallWatchdog;
+esp_timer_handle_t stallTimer = nullptr;
+uint32_t seenStalls = 0;
+char resetReport[1024]; // Previous boot's reset cause and breadcrumbs
+
+// TDS probes sampled continuously on a background task
+TdsAcquisition tdsSensor;
 
 // Function declarations
 void drawHomeKitStatusScreen();
 void drawCounterResetScreen();
 void drawUsageScreen();
+void drawRecoveryScreen();
+void drawWaterQualityScreen();
+void drawLeakAlertScreen();
 void drawFilterScreen(int filterIndex);
+void drawDiagnosticsScreen();
 void drawDashboard();
-void updateFilterStatus();
-
-// Update filter status based on percentage
-void updateFilterStatus()
-{
-  for (int i = 0; i < 5; i++)
-  {
-    if (filters[i].percentage < 10)
-    {
-      filters[i].status = STATUS_REPLACE;
-    }
-    else if (filters[i].percentage < 20)
-    {
-      filters[i].status = STATUS_WARNING;
-    }
-    else
-    {
-      filters[i].status = STATUS_OK;
-    }
-  }
-}
 
 // Graphics helper functions
 void drawProgressBar(int x, int y, int width, int height, int percentage)
@@ -120,7 +258,8 @@ void drawProgressBar(int x, int y, int width, int height, int percentage)
 
   // Draw percentage text in center of bar
   display.setTextSize(2);
-  String percentText = String(percentage) + "%";
+  char percentText[8];
+  snprintf(percentText, sizeof(percentText), "%d%%", percentage);
   int16_t x1, y1;
   uint16_t w, h;
   display.getTextBounds(percentText, 0, 0, &x1, &y1, &w, &h);
@@ -178,7 +317,7 @@ void drawLargeStatusIcon(int x, int y, FilterStatus status)
   }
 }
 
-void drawFilterCard(int x, int y, int width, int height, String name, FilterStatus status, int percentage)
+void drawFilterCard(int x, int y, int width, int height, const char *name, FilterStatus status, int percentage)
 {
   // Draw card border
   display.drawRect(x, y, width, height, WHITE);
@@ -197,14 +336,15 @@ void drawFilterCard(int x, int y, int width, int height, String name, FilterStat
 
   // Percentage at bottom
   display.setTextSize(1);
-  String percentText = String(percentage) + "%";
+  char percentText[8];
+  snprintf(percentText, sizeof(percentText), "%d%%", percentage);
   display.getTextBounds(percentText, 0, 0, &x1, &y1, &w, &h);
   textX = x + (width - w) / 2;
   display.setCursor(textX, y + height - 10);
   display.print(percentText);
 }
 
-void drawCenteredText(String text, int y, int textSize)
+void drawCenteredText(const char *text, int y, int textSize)
 {
   display.setTextSize(textSize);
   int16_t x1, y1;
@@ -215,17 +355,431 @@ void drawCenteredText(String text, int y, int textSize)
   display.print(text);
 }
 
+// Wall clock seconds, or UsageRollup::UNKNOWN_TIME until time is synced.
+// Usage recorded before then is held by the rollups, not filed under 1970.
+uint32_t usageTimestamp()
+{
+  time_t now = time(nullptr);
+  if (now > 1600000000)
+  {
+    return (uint32_t)now;
+  }
+  return UsageRollup::UNKNOWN_TIME;
+}
+
+// Seconds for events and queries - wall clock once time is synced, uptime before that
+uint32_t currentTimestamp()
+{
+  uint32_t now = usageTimestamp();
+  return now != UsageRollup::UNKNOWN_TIME ? now : millis() / 1000;
+}
+
+// Serial.printf() takes a heap buffer for lines over 64 characters; routine
+// logging from loop() formats on the stack instead
+void logPrintf(const char *format, ...)
+{
+  char line[160];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  Serial.print(line);
+}
+
+void IRAM_ATTR handleInletPulse()
+{
+  flowPulseTotals[FLOW_INLET]++;
+}
+
+void IRAM_ATTR handlePermeatePulse()
+{
+  flowPulseTotals[FLOW_PERMEATE]++;
+}
+
+void IRAM_ATTR handleBrinePulse()
+{
+  flowPulseTotals[FLOW_BRINE]++;
+}
+
+// Local hour for quiet-hour leak checks, -1 until the clock is synced
+int currentHourOfDay()
+{
+  time_t now = time(nullptr);
+  if (now <= 1600000000)
+  {
+    return -1;
+  }
+  struct tm local;
+  localtime_r(&now, &local);
+  return local.tm_hour;
+}
+
+// Leak sampling timer callback (esp_timer task). Wakes loop() straight away
+// when the alert state changes or a draw starts or stops, so neither the
+// alert path nor HomeKit automations wait for a frame.
+void sampleLeakDetector(void *arg)
+{
+  static uint32_t pulsesSeen = 0;
+  static uint32_t remainder = 0;
+  static bool wasFlowing = false;
+
+  // Watch the faucet side - that is where a stuck tap or burst line shows up
+  uint32_t pulsesPerLiter = deviceConfig.flowPulsesPerLiter[FLOW_PERMEATE];
+  if (pulsesPerLiter == 0)
+  {
+    return;
+  }
+  uint32_t total = flowPulseTotals[FLOW_PERMEATE];
+  uint32_t scaled = (total - pulsesSeen) * 1000 + remainder;
+  pulsesSeen = total;
+  remainder = scaled % pulsesPerLiter;
+
+  uint32_t milliliters = scaled / pulsesPerLiter;
+  uint8_t alerts = leakDetector.update(milliliters, deviceConfig.leakSampleMs, millis(), currentHourOfDay());
+  bool flowing = leakDetector.isFlowing();
+  if (alerts != leakAlerts || flowing != wasFlowing)
+  {
+    leakAlerts = alerts;
+    wasFlowing = flowing;
+    if (loopTaskHandle)
+    {
+      xTaskNotifyGive(loopTaskHandle);
+    }
+  }
+}
+
+// Move counted flow pulses into the per-channel usage history
+void processFlow()
+{
+  uint32_t totals[FLOW_CHANNEL_COUNT];
+  for (int i = 0; i < FLOW_CHANNEL_COUNT; i++)
+  {
+    totals[i] = flowPulseTotals[i];
+  }
+
+  flowMeter.update(totals, usageTimestamp());
+  totalWaterUsed = usageRollup.getLifetimeLiters();
+}
+
+// Combined flow over all channels, used to skip checkpoints when nothing moved
+uint64_t totalFlowMilliliters()
+{
+  uint64_t total = 0;
+  for (int i = 0; i < FLOW_CHANNEL_COUNT; i++)
+  {
+    total += flowMeter.getRollup((FlowChannelId)i).getLifetimeMilliliters();
+  }
+  return total;
+}
+
+void saveUsageCheckpoint()
+{
+  static uint8_t checkpoint[1024];
+  checkpointedUsageMl = totalFlowMilliliters();
+  for (int i = 0; i < FLOW_CHANNEL_COUNT; i++)
+  {
+    FlowChannelId channel = (FlowChannelId)i;
+    if (!flowMeter.isFitted(channel))
+    {
+      continue;
+    }
+    size_t length = flowMeter.getRollup(channel).saveCheckpoint(checkpoint, sizeof(checkpoint));
+    if (length > 0)
+    {
+      usagePrefs.putBytes(rollupKeys[i], checkpoint, length);
+    }
+  }
+}
+
+void loadUsageCheckpoint()
+{
+  static uint8_t checkpoint[1024];
+  for (int i = 0; i < FLOW_CHANNEL_COUNT; i++)
+  {
+    FlowChannelId channel = (FlowChannelId)i;
+    size_t length = usagePrefs.getBytes(rollupKeys[i], checkpoint, sizeof(checkpoint));
+    if (length > 0 && flowMeter.getRollup(channel).restoreCheckpoint(checkpoint, length))
+    {
+      Serial.printf("Usage history restored: %s %u L lifetime\n", FlowMeter::channelName(channel),
+                    flowMeter.getRollup(channel).getLifetimeLiters());
+    }
+  }
+  checkpointedUsageMl = totalFlowMilliliters();
+  totalWaterUsed = usageRollup.getLifetimeLiters();
+}
+
+// Restore filter life and the usage total. The counters are written more often
+// than the hourly rollup checkpoint, so usage newer than the checkpoint is
+// credited to the current period.
+bool loadPersistentCounters()
+{
+  if (!persistentCounters.load())
+  {
+    Serial.println("No stored counters, using defaults");
+    return false;
+  }
+
+  // Usage saved by the power-fail path goes in first, then straight to NVS
+  // so the record is never applied twice
+  uint8_t record[PowerFailRecord::RECORD_SIZE];
+  if (counterPrefs.isKey(POWER_FAIL_KEY) &&
+      counterPrefs.getBytes(POWER_FAIL_KEY, record, sizeof(record)) == sizeof(record))
+  {
+    uint64_t before = persistentCounters.getWaterUsed();
+    if (PowerFailRecord::merge(record, sizeof(record), persistentCounters))
+    {
+      persistentCounters.flush(millis(), true);
+      Serial.printf("Power-fail record merged: +%u mL\n", (unsigned)(persistentCounters.getWaterUsed() - before));
+    }
+    counterPrefs.remove(POWER_FAIL_KEY);
+  }
+
+  for (int i = 0; i < FilterModel::COUNT; i++)
+  {
+    filters.setPercent(i, persistentCounters.getFilterPercent(i));
+  }
+  uint64_t checkpointed = usageRollup.getLifetimeMilliliters();
+  if (persistentCounters.getWaterUsed() > checkpointed)
+  {
+    usageRollup.addUsage((uint32_t)(persistentCounters.getWaterUsed() - checkpointed), usageTimestamp());
+    totalWaterUsed = usageRollup.getLifetimeLiters();
+  }
+  Serial.printf("Counters restored (seq %u): %u L\n", persistentCounters.getSequence(), totalWaterUsed);
+  return true;
+}
+
+void fillResumeState(ResumeState &state)
+{
+  memset(&state, 0, sizeof(state)); // Padding too, so memcmp is meaningful
+  state.journal = eventJournal.getState();
+  state.journalSequence = eventJournal.getSegmentSequence();
+  state.journalBytes = eventJournal.getSegmentBytes();
+  state.countersSequence = persistentCounters.getSequence();
+  state.countersPersistedMl = persistentCounters.getPersistedWaterUsed();
+  for (int i = 0; i < FilterModel::COUNT; i++)
+  {
+    state.filterPercent[i] = filters.getPercent(i);
+  }
+}
+
+// Rewrite the RTC snapshot when anything it holds has changed
+void refreshResumeSnapshot()
+{
+  ResumeState state;
+  fillResumeState(state);
+  uint64_t flow = totalFlowMilliliters();
+  if (resumeSnapshotCommitted && flow == resumeSnapshotFlowMl &&
+      memcmp(&state, resumeSnapshot.payload(), sizeof(state)) == 0)
+  {
+    return;
+  }
+
+  uint8_t *payload = resumeSnapshot.payload();
+  size_t length = sizeof(state);
+  memcpy(payload, &state, sizeof(state));
+  for (int i = 0; i < FLOW_CHANNEL_COUNT; i++)
+  {
+    length += flowMeter.getRollup((FlowChannelId)i).saveCheckpoint(payload + length, resumeSnapshot.getCapacity() - length);
+  }
+  resumeSnapshotCommitted = resumeSnapshot.commit(length);
+  resumeSnapshotFlowMl = flow;
+}
+
+// Warm reset path: everything from RTC memory, no flash reads. The journal
+// position comes back in state; it is checked against the segment once the
+// filesystem is mounted.
+bool resumeFromSnapshot(ResumeState &state)
+{
+  size_t length;
+  const uint8_t *payload = resumeSnapshot.getPayload(length);
+  size_t rollupSize = UsageRollup::getCheckpointSize();
+  if (!payload || length != sizeof(ResumeState) + FLOW_CHANNEL_COUNT * rollupSize)
+  {
+    return false;
+  }
+
+  memcpy(&state, payload, sizeof(state));
+  for (int i = 0; i < FLOW_CHANNEL_COUNT; i++)
+  {
+    if (!flowMeter.getRollup((FlowChannelId)i).restoreCheckpoint(payload + sizeof(state) + i * rollupSize, rollupSize))
+    {
+      return false;
+    }
+  }
+
+  for (int i = 0; i < FilterModel::COUNT; i++)
+  {
+    filters.setPercent(i, state.filterPercent[i]);
+    persistentCounters.setFilterPercent(i, state.filterPercent[i]);
+  }
+  persistentCounters.resume(state.countersSequence, state.countersPersistedMl);
+  persistentCounters.setWaterUsed(usageRollup.getLifetimeMilliliters());
+  totalWaterUsed = usageRollup.getLifetimeLiters();
+  return true;
+}
+
+// Mirror live values into the persistent counters; they decide when to write
+void syncPersistentCounters()
+{
+  for (int i = 0; i < FilterModel::COUNT; i++)
+  {
+    // Filter life only goes up when a filter is replaced (panel or HomeKit)
+    if (filters.getPercent(i) > persistentCounters.getFilterPercent(i) && filters.getPercent(i) == 100)
+    {
+      eventJournal.logFilterReplaced(currentTimestamp(), i);
+    }
+    persistentCounters.setFilterPercent(i, filters.getPercent(i));
+  }
+  persistentCounters.setWaterUsed(usageRollup.getLifetimeMilliliters());
+  if (!powerFailing)
+  {
+    persistentCounters.update(millis());
+  }
+  powerFailRecord.prepare(persistentCounters, currentTimestamp());
+}
+
+// Supply comparator edge: hand over to the power-fail task immediately
+void IRAM_ATTR handlePowerFail()
+{
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(powerFailTaskHandle, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+// Highest-priority task: one bounded NVS write of the prepared record
+void powerFailTask(void *arg)
+{
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    powerFailing = true;
+    if (powerFailRecord.hasPendingDelta())
+    {
+      int64_t start = esp_timer_get_time();
+      counterPrefs.putBytes(POWER_FAIL_KEY, powerFailRecord.data(), PowerFailRecord::RECORD_SIZE);
+      powerFailWriteMicros = (uint32_t)(esp_timer_get_time() - start);
+    }
+
+    // Still running: it was a sag. Resume routine writes once the supply is
+    // good, or after the longest pause a real sag takes, so a stuck input
+    // cannot stop them for good.
+    uint32_t pauseStart = millis();
+    while (digitalRead(deviceConfig.powerFailPin) == LOW && millis() - pauseStart < deviceConfig.powerFailMaxPauseMs)
+    {
+      vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    powerFailing = false;
+    if (digitalRead(deviceConfig.powerFailPin) == LOW)
+    {
+      Serial.printf("Power-fail input still LOW after %u ms - resuming flash writes, check GPIO %u\n",
+                    deviceConfig.powerFailMaxPauseMs, deviceConfig.powerFailPin);
+    }
+    else
+    {
+      Serial.printf("Supply recovered (emergency write took %u us)\n", powerFailWriteMicros);
+    }
+  }
+}
+
+// Journal each draw once the leak detector sees the flow stop
+void journalDraws()
+{
+  bool flowing = leakDetector.isFlowing();
+  uint64_t lifetime = usageRollup.getLifetimeMilliliters();
+  if (flowing && !drawInProgress)
+  {
+    drawInProgress = true;
+    drawStartMl = lifetime;
+    drawStartMs = millis();
+  }
+  else if (!flowing && drawInProgress)
+  {
+    drawInProgress = false;
+    if (lifetime > drawStartMl)
+    {
+      eventJournal.logDraw(currentTimestamp(), (uint32_t)(lifetime - drawStartMl), millis() - drawStartMs);
+    }
+  }
+}
+
+// Hand HomeKit one history sample per interval once the clock is set
+void recordHistory()
+{
+  static uint32_t lastInterval = 0;
+  time_t now = time(nullptr);
+  if (now <= 1600000000)
+  {
+    return;
+  }
+  uint32_t interval = (uint32_t)now / HISTORY_INTERVAL_S;
+  if (interval == lastInterval)
+  {
+    return;
+  }
+  bool partial = lastInterval == 0; // Booted or synced part way through
+  lastInterval = interval;
+  if (partial)
+  {
+    return;
+  }
+
+  // The completed minutes of the interval that just ended
+  const uint16_t minutes = HISTORY_INTERVAL_S / 60;
+  uint32_t milliliters = usageRollup.getRange(RollupTier::MINUTE, minutes + 1, (uint32_t)now) -
+                         usageRollup.getBucket(RollupTier::MINUTE, 0, (uint32_t)now);
+
+  HistoryEntry entry;
+  entry.timestamp = interval * HISTORY_INTERVAL_S;
+  entry.usageDeciliters = milliliters / 100;
+  entry.filterPercent = filters.getLowestPercent();
+  if (!homeKitController.addHistory(entry))
+  {
+    Serial.println("History sample dropped: HomeKit task is behind");
+  }
+}
+
+// Print one rollup tier as a hex-encoded TimeSeriesCodec block, oldest bucket first
+void exportUsageTier(const char *label, RollupTier tier, uint32_t periodSeconds)
+{
+  static uint8_t block[512];
+  TimeSeriesEncoder encoder(block, sizeof(block));
+
+  uint32_t now = currentTimestamp();
+  uint32_t currentPeriod = UsageRollup::periodOf(tier, now);
+  uint16_t buckets = usageRollup.getBucketCount(tier);
+  for (int ago = buckets - 1; ago >= 0; ago--)
+  {
+    uint32_t periodStart = (currentPeriod - ago) * periodSeconds;
+    encoder.append(periodStart, usageRollup.getBucket(tier, ago, now));
+  }
+  size_t length = encoder.finish();
+
+  Serial.printf("EXPORT %s %u records %u bytes\n", label, encoder.getRecordCount(), (unsigned)length);
+  for (size_t i = 0; i < length; i++)
+  {
+    Serial.printf("%02X", block[i]);
+  }
+  Serial.println();
+}
+
+void exportUsageHistory()
+{
+  exportUsageTier("minutes", RollupTier::MINUTE, 60);
+  exportUsageTier("hours", RollupTier::HOUR, 3600);
+  exportUsageTier("days", RollupTier::DAY, 86400);
+}
+
 void IRAM_ATTR handleLeftButton()
 {
   // Detect press/release based on current pin state
-  bool currentState = digitalRead(BUTTON_LEFT_PIN) == LOW; // LOW = pressed (with pullup)
+  bool currentState = digitalRead(deviceConfig.buttonLeftPin) == LOW; // LOW = pressed (with pullup)
 
   if (currentState && !leftButtonCurrentlyPressed)
   {
     // Button just pressed
     leftButtonCurrentlyPressed = true;
     // Reduced logging - only show button activity every minute
-    if (millis() - lastStatusMessageTime > statusMessageInterval)
+    if (millis() - lastStatusMessageTime > deviceConfig.statusIntervalMs)
     {
       Serial.println("Left button pressed!");
     }
@@ -236,7 +790,7 @@ void IRAM_ATTR handleLeftButton()
     leftButtonCurrentlyPressed = false;
     leftButtonJustReleased = true;
     // Reduced logging - only show button activity every minute
-    if (millis() - lastStatusMessageTime > statusMessageInterval)
+    if (millis() - lastStatusMessageTime > deviceConfig.statusIntervalMs)
     {
       Serial.println("Left button released!");
     }
@@ -246,14 +800,14 @@ void IRAM_ATTR handleLeftButton()
 void IRAM_ATTR handleRightButton()
 {
   // Detect press/release based on current pin state
-  bool currentState = digitalRead(BUTTON_RIGHT_PIN) == LOW; // LOW = pressed (with pullup)
+  bool currentState = digitalRead(deviceConfig.buttonRightPin) == LOW; // LOW = pressed (with pullup)
 
   if (currentState && !rightButtonCurrentlyPressed)
   {
     // Button just pressed
     rightButtonCurrentlyPressed = true;
     // Reduced logging - only show button activity every minute
-    if (millis() - lastStatusMessageTime > statusMessageInterval)
+    if (millis() - lastStatusMessageTime > deviceConfig.statusIntervalMs)
     {
       Serial.println("Right button pressed!");
     }
@@ -264,43 +818,545 @@ void IRAM_ATTR handleRightButton()
     rightButtonCurrentlyPressed = false;
     rightButtonJustReleased = true;
     // Reduced logging - only show button activity every minute
-    if (millis() - lastStatusMessageTime > statusMessageInterval)
+    if (millis() - lastStatusMessageTime > deviceConfig.statusIntervalMs)
     {
       Serial.println("Right button released!");
     }
   }
 }
 
+// Snapshot of everything HomeKit shows, handed to the HomeKit task
+HomeKitState buildHomeKitState()
+{
+  HomeKitState state;
+  memset(&state, 0, sizeof(state));
+  for (int i = 0; i < FilterModel::COUNT; i++)
+  {
+    state.filterPercent[i] = filters.getPercent(i);
+    state.filterChangeNeeded[i] = filters.getStatus(i) == STATUS_REPLACE ? 1 : 0;
+  }
+  state.waterUsageLiters = totalWaterUsed;
+  state.flowLitersPerMinute = leakDetector.getFlowRate() / 1000.0f;
+  state.waterInUse = leakDetector.isFlowing() ? 1 : 0;
+  state.recoveryPercent = flowMeter.getRecoveryRatio(currentTimestamp());
+  state.rejectLiters = (uint32_t)(flowMeter.getRejectMilliliters() / 1000);
+  state.leakDetected = handledLeakAlerts != LEAK_NONE ? 1 : 0;
+  return state;
+}
+
+// One NVS read for the whole configuration. Older records are migrated and
+// written back; on first boot the old WiFiController settings are imported.
+void loadConfiguration()
+{
+  configPrefs.begin("config", false);
+  ConfigLoadResult result = loadDeviceConfig(configStore, deviceConfig);
+  if (result == CONFIG_MISSING)
+  {
+    Preferences legacy;
+    if (legacy.begin("wifi-settings", true))
+    {
+      char name[sizeof(deviceConfig.deviceName)] = "";
+      char ntp[sizeof(deviceConfig.ntpServer)] = "";
+      char timezone[8] = "";
+      legacy.getString("device_name", name, sizeof(name));
+      legacy.getString("ntp_server", ntp, sizeof(ntp));
+      legacy.getString("timezone", timezone, sizeof(timezone));
+      legacy.end();
+      applyLegacySettings(deviceConfig, name, ntp, timezone);
+    }
+  }
+  if (result == CONFIG_MIGRATED || result == CONFIG_MISSING)
+  {
+    saveDeviceConfig(configStore, deviceConfig);
+  }
+  Serial.printf("Config: %s (v%u) | %s\n", configLoadResultName(result), DEVICE_CONFIG_VERSION,
+                deviceConfig.deviceName);
+
+  HeapMonitorConfig heapConfig;
+  heapConfig.sampleIntervalMs = deviceConfig.heapSampleMs;
+  heapConfig.warnLargestBlock = deviceConfig.heapWarnLargestBlock;
+  heapConfig.warnFragmentationPercent = deviceConfig.heapWarnFragmentationPercent;
+  heapMonitor.setConfig(heapConfig);
+}
+
+HeapStats readHeapStats()
+{
+  HeapStats stats;
+  stats.freeBytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  stats.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  stats.minimumFreeBytes = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  return stats;
+}
+
+// Newest first; each line covers the interval that ended at its timestamp
+void reportHeapHistory(int maxSamples)
+{
+  Serial.println("========== HEAP HISTORY ==========");
+  logPrintf("Warn below %u byte block or at %u%% fragmentation | %u warnings | lowest block %u\n",
+            heapMonitor.getConfig().warnLargestBlock, heapMonitor.getConfig().warnFragmentationPercent,
+            heapMonitor.getWarningCount(), heapMonitor.getLowestLargestBlock());
+  Serial.println("   age s    free  largest  frag  min free  allocs  frees  worst pass");
+  uint32_t now = millis();
+  for (int i = 0; i < heapMonitor.getCount() && i < maxSamples; i++)
+  {
+    const HeapSample &sample = heapMonitor.getSample(i);
+    logPrintf("%8lu %7u %8u %4u%% %9u %7u %6u %11u%s\n", (unsigned long)((now - sample.timestampMs) / 1000),
+              sample.freeBytes, sample.largestFreeBlock, sample.fragmentationPercent, sample.minimumFreeBytes,
+              sample.allocations, sample.frees, sample.maxPassAllocations, sample.warning ? "  WARN" : "");
+  }
+  Serial.println("==================================");
+}
+
+// Called once when the heap turns unhealthy
+void dumpHeapDiagnostics()
+{
+  const HeapSample &sample = heapMonitor.getSample(0);
+  logPrintf("HEAP WARNING: largest block %u of %u free (%u%% fragmented), minimum ever %u\n",
+            sample.largestFreeBlock, sample.freeBytes, sample.fragmentationPercent, sample.minimumFreeBytes);
+  reportHeapHistory(8);
+  heap_caps_print_heap_info(MALLOC_CAP_8BIT);
+}
+
+void sampleHeap()
+{
+  heapMonitor.addPass(passAllocations, passFrees);
+  uint32_t now = millis();
+  if (heapMonitor.isDue(now) && heapMonitor.sample(now, readHeapStats()))
+  {
+    dumpHeapDiagnostics();
+  }
+}
+
+void sampleSystem()
+{
+  if (millis() - lastSystemSample < SYSTEM_SAMPLE_MS)
+  {
+    return;
+  }
+  lastSystemSample = millis();
+  uint32_t start = (uint32_t)esp_timer_get_time();
+  uint32_t clockNow;
+  int count = sampleTasks(taskSnapshots, TASK_SAMPLER_CAPACITY, clockNow);
+  systemMonitor.update(clockNow, taskSnapshots, count);
+  systemMonitor.addSampleCost((uint32_t)esp_timer_get_time() - start);
+}
+
+// Core load as "23%", or "--" without run-time stats
+// One decimal place in integers: newlib's float formatting can allocate
+void formatTenths(char *buffer, size_t size, float value)
+{
+  long tenths = lroundf(value * 10.0f);
+  snprintf(buffer, size, "%s%ld.%ld", tenths < 0 ? "-" : "", labs(tenths) / 10, labs(tenths) % 10);
+}
+
+void formatLoad(char *buffer, size_t size, uint16_t permille)
+{
+  if (permille == SystemMonitor::UNKNOWN)
+  {
+    snprintf(buffer, size, "--");
+  }
+  else
+  {
+    snprintf(buffer, size, "%u%%", (permille + 5) / 10);
+  }
+}
+
+void reportSystemMonitor()
+{
+  char now[8], window[8];
+  Serial.println("========== SYSTEM ==========");
+  for (int core = 0; core < SystemMonitor::CORE_COUNT; core++)
+  {
+    formatLoad(now, sizeof(now), systemMonitor.getCoreLoad(core, false));
+    formatLoad(window, sizeof(window), systemMonitor.getCoreLoad(core, true));
+    logPrintf("Core %d: %s now, %s over the last minute\n", core, now, window);
+  }
+  Serial.println("Task             core   now  minute  stack free");
+  uint8_t order[SystemMonitor::MAX_TASKS];
+  int count = systemMonitor.sortByStack(order, SystemMonitor::MAX_TASKS);
+  for (int i = 0; i < count; i++)
+  {
+    const TaskLoad &task = systemMonitor.getTask(order[i]);
+    formatLoad(now, sizeof(now), systemMonitor.hasCpuData() ? task.recentPermille : SystemMonitor::UNKNOWN);
+    formatLoad(window, sizeof(window), systemMonitor.hasCpuData() ? task.windowPermille : SystemMonitor::UNKNOWN);
+    char core[4] = "any";
+    if (task.core >= 0)
+    {
+      snprintf(core, sizeof(core), "%d", task.core);
+    }
+    logPrintf("%-16s %4s %5s %7s %11u\n", task.name, core, now, window, task.stackFree);
+  }
+  uint32_t overhead = systemMonitor.getOverheadPpm();
+  logPrintf("Monitor overhead: %u ppm of one core (budget %u)%s\n", overhead, SYSTEM_OVERHEAD_BUDGET_PPM,
+            overhead > SYSTEM_OVERHEAD_BUDGET_PPM ? " - OVER BUDGET" : "");
+  Serial.println("============================");
+}
+
+wifi_ps_type_t radioSleepType(RadioPowerMode mode)
+{
+  switch (mode)
+  {
+  case RadioPowerMode::NO_SLEEP:
+    return WIFI_PS_NONE;
+  case RadioPowerMode::MAX_MODEM:
+    return WIFI_PS_MAX_MODEM;
+  default:
+    return WIFI_PS_MIN_MODEM;
+  }
+}
+
+void updatePowerPolicy()
+{
+  uint16_t latency;
+  while (homeKitController.nextLatency(latency))
+  {
+    powerPolicy.noteRequest(millis(), latency);
+  }
+
+  // The WiFi library keeps the level and applies it again whenever the station restarts
+  if (powerPolicy.update(millis(), homeKitController.isPaired(), homeKitController.getConnectionCount(),
+                         leakDetector.isFlowing()))
+  {
+    WiFi.setSleep(radioSleepType(powerPolicy.getMode()));
+  }
+}
+
+void reportPowerPolicy()
+{
+  const PowerPolicyConfig &config = powerPolicy.getConfig();
+  Serial.println("========== WIFI POWER ==========");
+  logPrintf("Modem sleep: %s | %u changes | latency target %u ms\n", radioPowerModeName(powerPolicy.getMode()),
+            powerPolicy.getModeChanges(), config.latencyTargetMs);
+  Serial.println("Sleep  time (s)  radio on (s)  requests  avg  p50  p90   max  slow");
+  for (int i = 0; i < RADIO_POWER_MODE_COUNT; i++)
+  {
+    RadioPowerMode mode = (RadioPowerMode)i;
+    const PowerModeStats &stats = powerPolicy.getStats(mode);
+    logPrintf("%-5s %9lu %13lu %9u %4u %4u %4u %5u %5u\n", radioPowerModeName(mode),
+              (unsigned long)(stats.timeMs / 1000), (unsigned long)(powerPolicy.getRadioOnMs(mode) / 1000),
+              stats.latency.count, stats.latency.getAverage(), stats.latency.getPercentile(50),
+              stats.latency.getPercentile(90), stats.latency.maxMs, stats.latency.slow);
+  }
+  logPrintf("Radio on ~%u.%u%% of the time (estimated from duty cycles %u/%u/%u per mille)\n",
+            powerPolicy.getRadioOnPermille() / 10, powerPolicy.getRadioOnPermille() % 10,
+            config.radioOnPermille[0], config.radioOnPermille[1], config.radioOnPermille[2]);
+  Serial.println("================================");
+}
+
+inline void enterPhase(LoopPhase phase)
+{
+  markPhase(loopTrail, phase, ESP.getCycleCount());
+}
+
+const char *resetReasonName(esp_reset_reason_t reason)
+{
+  switch (reason)
+  {
+  case ESP_RST_POWERON:
+    return "power-on";
+  case ESP_RST_EXT:
+    return "external pin";
+  case ESP_RST_SW:
+    return "software restart";
+  case ESP_RST_PANIC:
+    return "panic";
+  case ESP_RST_INT_WDT:
+    return "interrupt watchdog";
+  case ESP_RST_TASK_WDT:
+    return "task watchdog";
+  case ESP_RST_WDT:
+    return "other watchdog";
+  case ESP_RST_DEEPSLEEP:
+    return "deep sleep wake";
+  case ESP_RST_BROWNOUT:
+    return "brownout";
+  default:
+    return "unknown";
+  }
+}
+
+// Appends one trail's last phase and breadcrumbs from the previous boot
+size_t describeTrail(char *buffer, size_t size, const char *task, const BreadcrumbTrail &trail,
+                     const StallPhase *phases, uint8_t phaseCount)
+{
+  if (!isTrailValid(trail, phaseCount))
+  {
+    return 0;
+  }
+  int written = snprintf(buffer, size, "%s task was in '%s' for %u ms at %u ms uptime%s\n", task,
+                         phases[trail.phase].name, trail.phaseMs, trail.uptimeMs,
+                         trail.stalledPhase != STALL_NO_PHASE ? " - STALLED" : "");
+  if (written < 0 || (size_t)written >= size)
+  {
+    return size ? size - 1 : 0;
+  }
+  return written + formatTrail(trail, phases, phaseCount, getCpuFrequencyMhz() * 1000, buffer + written,
+                               size - written);
+}
+
+// Reset cause plus what each task was doing when the previous boot ended.
+// Kept for the C command, since the boot log is easy to miss.
+void reportPreviousReset()
+{
+  esp_reset_reason_t reason = esp_reset_reason();
+  bool stallRestart = reason == ESP_RST_SW && ((isTrailValid(loopTrail, LOOP_PHASE_COUNT) &&
+                                                loopTrail.stalledPhase != STALL_NO_PHASE) ||
+                                               (isTrailValid(homeKitTrail, HOMEKIT_PHASE_COUNT) &&
+                                                homeKitTrail.stalledPhase != STALL_NO_PHASE));
+  size_t length = snprintf(resetReport, sizeof(resetReport), "Last reset: %s%s\n", resetReasonName(reason),
+                           stallRestart ? " by the stall watchdog" : "");
+  if (reason != ESP_RST_POWERON) // RTC memory is random after power-on
+  {
+    length += describeTrail(resetReport + length, sizeof(resetReport) - length, "Loop", loopTrail, loopPhases,
+                            LOOP_PHASE_COUNT);
+    length += describeTrail(resetReport + length, sizeof(resetReport) - length, "HomeKit", homeKitTrail,
+                            HOMEKIT_STALL_PHASES, HOMEKIT_PHASE_COUNT);
+  }
+  Serial.print(resetReport);
+  beginTrail(loopTrail);
+  beginTrail(homeKitTrail);
+}
+
+// Stall timer: a check is two loads and a compare per trail
+void checkStalls(void *arg)
+{
+  if (stallWatchdog.check(millis()) == STALL_RESTART)
+  {
+    esp_restart();
+  }
+}
+
+void startStallWatchdog()
+{
+  stallWatchdog.watch(loopTrail, "loop", loopPhases, LOOP_PHASE_COUNT, millis());
+  stallWatchdog.watch(homeKitTrail, "HomeKit", HOMEKIT_STALL_PHASES, HOMEKIT_PHASE_COUNT, millis());
+  stallWatchdog.setRestartAfterMs(STALL_RESTART_MS);
+  esp_timer_create_args_t stallTimerArgs = {};
+  stallTimerArgs.callback = checkStalls;
+  stallTimerArgs.name = "stall";
+  esp_timer_create(&stallTimerArgs, &stallTimer);
+  esp_timer_start_periodic(stallTimer, STALL_CHECK_MS * 1000ULL);
+  enableLoopWDT(); // Task watchdog for the loop task, fed after every pass
+}
+
+// A stall of the loop task itself shows up here once the loop is back
+void reportStalls()
+{
+  uint32_t stalls = stallWatchdog.getStallCount();
+  if (stalls == seenStalls)
+  {
+    return;
+  }
+  seenStalls = stalls;
+  int trail = stallWatchdog.getLastStalledTrail();
+  uint8_t phase = stallWatchdog.getLastStalledPhase();
+  logPrintf("STALL: %s task in '%s' for %u ms (limit %u ms)\n", stallWatchdog.getTaskName(trail),
+            stallWatchdog.getPhaseName(trail, phase), stallWatchdog.getLastStallMs(),
+            stallWatchdog.getLimit(trail, phase));
+}
+
+// Readiness check in place of a settle delay: the SSD1306 ignores its bus
+// for a while after power-up, so poll for an ACK until the deadline
+bool waitForI2cDevice(uint8_t address, uint32_t timeoutMs)
+{
+  uint32_t start = millis();
+  for (;;)
+  {
+    Wire.beginTransmission(address);
+    if (Wire.endTransmission() == 0)
+    {
+      return true;
+    }
+    if (millis() - start >= timeoutMs)
+    {
+      return false;
+    }
+    delay(1);
+  }
+}
+
+// A line starting with '!' is a HomeSpan command. It is collected across
+// passes and forwarded to the HomeKit task, which runs it; HomeSpan no longer
+// reads the UART itself. Returns true if the character was consumed.
+bool collectHomeSpanCommand(char c)
+{
+  static char line[24];
+  static int length = -1; // -1 = not collecting
+  if (length < 0)
+  {
+    if (c != '!')
+    {
+      return false;
+    }
+    length = 0;
+    return true;
+  }
+  if (c == '\r' || c == '\n')
+  {
+    line[length] = '\0';
+    if (length > 0 && !homeKitController.sendSerialCommand(line))
+    {
+      Serial.println("HomeSpan busy - command dropped");
+    }
+    length = -1;
+  }
+  else if (length < (int)sizeof(line) - 1)
+  {
+    line[length++] = c;
+  }
+  return true;
+}
+
+// Print the boot phase table and the time-to-first-dashboard verdict
+void reportBootProfile()
+{
+  static char report[512];
+  bootProfiler.format(report, sizeof(report), BOOT_PHASE_BUDGETS, BOOT_PHASE_BUDGET_COUNT);
+  uint32_t totalMs = bootProfiler.getTotalMicros() / 1000;
+  Serial.println("========== BOOT PROFILE ==========");
+  Serial.print(report);
+  Serial.printf("First dashboard after %u ms (target %u ms)%s\n", totalMs, BOOT_TARGET_FIRST_FRAME_MS,
+                totalMs > BOOT_TARGET_FIRST_FRAME_MS ? " - OVER TARGET" : "");
+  Serial.println("==================================");
+}
+
 void setup()
 {
+  // A TX buffer keeps boot logging from blocking on the UART
+  Serial.setTxBufferSize(1024);
   Serial.begin(115200);
   Serial.println("RO Monitor Starting...");
+  reportPreviousReset();
+  bootProfiler.mark("serial", (uint32_t)esp_timer_get_time());
 
-  Wire.begin(I2C_SDA, I2C_SCL);
-  display.begin(SSD1306_SWITCHCAPVCC, 0x3C);
+  loadConfiguration();
+  Wire.begin(deviceConfig.i2cSdaPin, deviceConfig.i2cSclPin);
+  if (!waitForI2cDevice(0x3C, OLED_READY_TIMEOUT_MS) || !display.begin(SSD1306_SWITCHCAPVCC, 0x3C))
+  {
+    Serial.println("OLED not responding on I2C 0x3C");
+  }
   display.setTextColor(WHITE);
+  bootProfiler.mark("oled", (uint32_t)esp_timer_get_time());
 
   // Setup both buttons
-  pinMode(BUTTON_LEFT_PIN, INPUT_PULLUP);
-  pinMode(BUTTON_RIGHT_PIN, INPUT_PULLUP);
-  attachInterrupt(digitalPinToInterrupt(BUTTON_LEFT_PIN), handleLeftButton, CHANGE);
-  attachInterrupt(digitalPinToInterrupt(BUTTON_RIGHT_PIN), handleRightButton, CHANGE);
-
-  Serial.println("Buttons configured:");
-  Serial.print("Left button (GPIO ");
-  Serial.print(BUTTON_LEFT_PIN);
-  Serial.println(")");
-  Serial.print("Right button (GPIO ");
-  Serial.print(BUTTON_RIGHT_PIN);
-  Serial.println(")");
-
-  // Test button states
-  Serial.print("Initial GPIO 4 state: ");
-  Serial.println(digitalRead(BUTTON_LEFT_PIN));
-  Serial.print("Initial GPIO 5 state: ");
-  Serial.println(digitalRead(BUTTON_RIGHT_PIN));
-
-  updateFilterStatus();
+  pinMode(deviceConfig.buttonLeftPin, INPUT_PULLUP);
+  pinMode(deviceConfig.buttonRightPin, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(deviceConfig.buttonLeftPin), handleLeftButton, CHANGE);
+  attachInterrupt(digitalPinToInterrupt(deviceConfig.buttonRightPin), handleRightButton, CHANGE);
+  Serial.printf("Buttons: left GPIO %d (%d), right GPIO %d (%d)\n", deviceConfig.buttonLeftPin,
+                digitalRead(deviceConfig.buttonLeftPin), deviceConfig.buttonRightPin,
+                digitalRead(deviceConfig.buttonRightPin));
+
+  // Flow sensors and usage history
+  void (*const pulseHandlers[FLOW_CHANNEL_COUNT])() = {handleInletPulse, handlePermeatePulse, handleBrinePulse};
+  for (int i = 0; i < FLOW_CHANNEL_COUNT; i++)
+  {
+    flowMeter.configure((FlowChannelId)i, deviceConfig.flowPulsesPerLiter[i]);
+    pinMode(deviceConfig.flowPins[i], INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(deviceConfig.flowPins[i]), pulseHandlers[i], FALLING);
+  }
+  bootProfiler.mark("gpio", (uint32_t)esp_timer_get_time());
+
+  usagePrefs.begin("usage", false);
+  counterPrefs.begin("counters", false);
+
+  // Restore state: RTC snapshot after a warm reset, otherwise NVS + journal
+  // (replays only the newest segment, so this stays fast)
+  esp_reset_reason_t resetReason = esp_reset_reason();
+  if (resetReason == ESP_RST_POWERON)
+  {
+    resumeSnapshot.invalidate(); // RTC memory is random after power-on
+  }
+  int64_t restoreStart = esp_timer_get_time();
+  ResumeState resumed;
+  if (resumeFromSnapshot(resumed))
+  {
+    restorePath = RESTORE_RTC;
+  }
+  else
+  {
+    flowMeter.clear(); // Drop anything a rejected snapshot partly restored
+    loadUsageCheckpoint();
+    restorePath = loadPersistentCounters() ? RESTORE_FLASH : RESTORE_DEFAULTS;
+  }
+  restoreMicros = (uint32_t)(esp_timer_get_time() - restoreStart);
+
+  // The journal is mounted once the path is chosen. A warm reset never
+  // formats: a mount failure there costs the journal, not its contents.
+  bool journalMounted = LittleFS.begin(restorePath != RESTORE_RTC);
+  if (!journalMounted)
+  {
+    Serial.println("Journal unavailable: LittleFS mount failed");
+  }
+  else if (restorePath == RESTORE_RTC)
+  {
+    if (!eventJournal.resume(resumed.journal, resumed.journalSequence, resumed.journalBytes))
+    {
+      eventJournal.begin();
+    }
+  }
+  else if (eventJournal.begin())
+  {
+    restorePath = RESTORE_FLASH;
+  }
+  lastRollupCheckpoint = millis();
+
+  const char *restoreNames[] = {"defaults", "NVS + journal", "RTC snapshot"};
+  Serial.printf("State restored from %s in %u us (reset reason %d)\n", restoreNames[restorePath], restoreMicros,
+                (int)resetReason);
+  const JournalState &history = eventJournal.getState();
+  Serial.printf("Journal: segment %u, %u records replayed, %u boots, %u draws since reset\n",
+                eventJournal.getSegmentSequence(), eventJournal.getReplayedRecords(),
+                history.bootCount, history.drawCount);
+  if (journalMounted)
+  {
+    eventJournal.logBoot(currentTimestamp());
+  }
+
+  // Power-fail path, armed once there is state worth saving
+  powerFailRecord.prepare(persistentCounters, currentTimestamp());
+  if (deviceConfig.powerFailPin != PIN_NOT_FITTED)
+  {
+    xTaskCreatePinnedToCore(powerFailTask, "pwrfail", 3072, nullptr, configMAX_PRIORITIES - 1, &powerFailTaskHandle, 1);
+    pinMode(deviceConfig.powerFailPin, INPUT);
+    if (digitalRead(deviceConfig.powerFailPin) == LOW)
+    {
+      Serial.printf("Power-fail input GPIO %u is LOW at boot - supply low or comparator missing\n",
+                    deviceConfig.powerFailPin);
+    }
+    attachInterrupt(digitalPinToInterrupt(deviceConfig.powerFailPin), handlePowerFail, FALLING);
+  }
+  bootProfiler.mark("restore", (uint32_t)esp_timer_get_time());
+
+  // TDS acquisition task
+  TdsAcquisitionConfig tdsConfig;
+  tdsConfig.inletAdcChannel = deviceConfig.tdsInletAdcChannel;
+  tdsConfig.outletAdcChannel = deviceConfig.tdsOutletAdcChannel;
+  tdsConfig.outputIntervalMs = deviceConfig.tdsOutputIntervalMs;
+  tdsSensor.begin(tdsConfig);
+
+  // Leak detection timer
+  LeakDetectorConfig leakConfig;
+  leakConfig.maxContinuousFlowMs = deviceConfig.leakMaxContinuousFlowMin * 60000UL;
+  leakConfig.maxFlowRateMlPerMin = deviceConfig.leakMaxRateMlPerMin;
+  if (deviceConfig.quietStartHour >= 0 && deviceConfig.quietEndHour >= 0)
+  {
+    leakConfig.quietStartHour = deviceConfig.quietStartHour;
+    leakConfig.quietEndHour = deviceConfig.quietEndHour;
+  }
+  else
+  {
+    leakConfig.quietStartHour = leakConfig.quietEndHour = 0; // No quiet hours
+  }
+  leakDetector.setConfig(leakConfig);
+  loopTaskHandle = xTaskGetCurrentTaskHandle();
+  esp_timer_create_args_t leakTimerArgs = {};
+  leakTimerArgs.callback = sampleLeakDetector;
+  leakTimerArgs.name = "leak";
+  esp_timer_create(&leakTimerArgs, &leakTimer);
+  esp_timer_start_periodic(leakTimer, deviceConfig.leakSampleMs * 1000ULL);
+  bootProfiler.mark("sensors", (uint32_t)esp_timer_get_time());
+
   lastScreenChange = millis();
 
   // Initialize HomeKit (HomeSpan will handle WiFi configuration)
@@ -312,9 +1368,19 @@ void setup()
   display.display();
 
   // HomeSpan will handle WiFi and display instructions in serial monitor
-  homeKitController.begin(filters, &totalWaterUsed);
+  homeKitController.setSetupCode(deviceConfig.setupCode);
+  homeKitController.setFilterStages(filters.getInfoTable(), FilterModel::COUNT);
+  homeKitController.setTrail(&homeKitTrail);
+  if (journalMounted)
+  {
+    homeKitController.setHistoryStorage(&journalStorage); // Eve history checkpoints beside the journal
+  }
+  homeKitController.begin(buildHomeKitState());
+  bootProfiler.mark("homespan", (uint32_t)esp_timer_get_time());
+  AllocationCounter::track(); // loop() runs on this task
+  startStallWatchdog();
 
-  delay(1000);
+  // No settle delay: loop() draws the dashboard right away
 }
 
 void drawDashboard()
@@ -324,22 +1390,23 @@ void drawDashboard()
   // System title at top
   drawCenteredText("RO SYSTEM", 0, 2);
 
-  // Draw filter cards in a grid layout
-  int cardWidth = 40;
+  // Filter cards in two rows, the first row taking the odd card; each row centered
+  const int topRow = (FilterModel::COUNT + 1) / 2;
+  int spacingX = SCREEN_WIDTH / topRow < 44 ? SCREEN_WIDTH / topRow : 44;
+  int cardWidth = spacingX - 4;
   int cardHeight = 30;
-  int startX = 4;
   int startY = 18;
-  int spacingX = 44;
   int spacingY = 32;
 
-  // Row 1: PP1, PP2, Carbon
-  drawFilterCard(startX, startY, cardWidth, cardHeight, "PP1", filters[0].status, filters[0].percentage);
-  drawFilterCard(startX + spacingX, startY, cardWidth, cardHeight, "PP2", filters[1].status, filters[1].percentage);
-  drawFilterCard(startX + spacingX * 2, startY, cardWidth, cardHeight, "CAR", filters[2].status, filters[2].percentage);
-
-  // Row 2: Membrane, Mineralizer
-  drawFilterCard(startX + spacingX / 2, startY + spacingY, cardWidth, cardHeight, "MEM", filters[3].status, filters[3].percentage);
-  drawFilterCard(startX + spacingX / 2 + spacingX, startY + spacingY, cardWidth, cardHeight, "MIN", filters[4].status, filters[4].percentage);
+  for (int i = 0; i < FilterModel::COUNT; i++)
+  {
+    int row = i < topRow ? 0 : 1;
+    int column = row == 0 ? i : i - topRow;
+    int rowCards = row == 0 ? topRow : FilterModel::COUNT - topRow;
+    int rowX = (SCREEN_WIDTH - (rowCards * spacingX - 4)) / 2;
+    drawFilterCard(rowX + column * spacingX, startY + row * spacingY, cardWidth, cardHeight,
+                   filters.getInfo(i).shortName, filters.getStatus(i), filters.getPercent(i));
+  }
 
   display.display();
 }
@@ -348,30 +1415,15 @@ void drawFilterScreen(int filterIndex)
 {
   display.clearDisplay();
 
-  FilterInfo filter = filters[filterIndex];
-
   // Filter name at top (large text)
-  drawCenteredText(filter.name, 0, 2);
+  drawCenteredText(filters.getInfo(filterIndex).name, 0, 2);
 
   // Large progress bar with percentage inside
-  drawProgressBar(5, 25, 118, 20, filter.percentage);
+  drawProgressBar(5, 25, 118, 20, filters.getPercent(filterIndex));
 
   // Status text (large)
   display.setTextSize(2);
-  String statusText;
-  switch (filter.status)
-  {
-  case STATUS_OK:
-    statusText = "OK";
-    break;
-  case STATUS_WARNING:
-    statusText = "LOW";
-    break;
-  case STATUS_REPLACE:
-    statusText = "REPLACE";
-    break;
-  }
-  drawCenteredText(statusText, 50, 2);
+  drawCenteredText(filterStatusLabel(filters.getStatus(filterIndex)), 50, 2);
 
   display.display();
 }
@@ -385,20 +1437,90 @@ void drawUsageScreen()
 
   // Large number display
   display.setTextSize(3);
-  String waterText = String(totalWaterUsed);
+  char waterText[12];
+  snprintf(waterText, sizeof(waterText), "%lu", (unsigned long)usageRollup.getLifetimeLiters());
   int16_t x1, y1;
   uint16_t w, h;
   display.getTextBounds(waterText, 0, 0, &x1, &y1, &w, &h);
   int x = (SCREEN_WIDTH - w) / 2;
-  display.setCursor(x, 20);
+  display.setCursor(x, 18);
   display.print(waterText);
 
-  // Units (large)
-  display.setTextSize(2);
-  display.getTextBounds("LITERS", 0, 0, &x1, &y1, &w, &h);
-  x = (SCREEN_WIDTH - w) / 2;
-  display.setCursor(x, 45);
-  display.print("LITERS");
+  // Units and recent history from the rollup tiers
+  uint32_t now = currentTimestamp();
+  uint32_t todayLiters = usageRollup.getRange(RollupTier::DAY, 1, now) / 1000;
+  uint32_t monthLiters = usageRollup.getRange(RollupTier::MONTH, 1, now) / 1000;
+  drawCenteredText("LITERS", 42, 1);
+  char history[24];
+  snprintf(history, sizeof(history), "Day:%lu Mon:%lu", (unsigned long)todayLiters, (unsigned long)monthLiters);
+  drawCenteredText(history, 54, 1);
+
+  display.display();
+}
+
+void drawRecoveryScreen()
+{
+  display.clearDisplay();
+
+  drawCenteredText("RECOVERY", 0, 2);
+
+  // Live ratio over the last hour, falling back to the lifetime ratio when idle
+  float recovery = flowMeter.getRecoveryRatio(currentTimestamp());
+  if (recovery < 0)
+  {
+    recovery = flowMeter.getRecoveryRatio();
+  }
+  char recoveryText[8] = "--";
+  if (recovery >= 0)
+  {
+    snprintf(recoveryText, sizeof(recoveryText), "%d%%", (int)(recovery + 0.5f));
+  }
+  drawCenteredText(recoveryText, 20, 3);
+
+  display.setTextSize(1);
+  display.setCursor(0, 46);
+  display.printf("Reject: %lu L", (unsigned long)(flowMeter.getRejectMilliliters() / 1000));
+  display.setCursor(0, 56);
+  display.printf("In:%lu Out:%lu L", (unsigned long)flowMeter.getRollup(FLOW_INLET).getLifetimeLiters(),
+                 (unsigned long)usageRollup.getLifetimeLiters());
+
+  display.display();
+}
+
+void drawWaterQualityScreen()
+{
+  display.clearDisplay();
+
+  drawCenteredText("QUALITY", 0, 2);
+
+  TdsReading tds = tdsSensor.getReading();
+  if (!tds.valid)
+  {
+    drawCenteredText(tdsSensor.isRunning() ? "Sampling..." : "No TDS probes", 30, 1);
+    display.display();
+    return;
+  }
+
+  display.setTextSize(1);
+  display.setCursor(0, 20);
+  display.printf("TDS in:  %4d ppm", (int)(tds.inletPpm + 0.5f));
+  display.setCursor(0, 32);
+  display.printf("TDS out: %4d ppm", (int)(tds.outletPpm + 0.5f));
+
+  // Salt rejection of the membrane
+  display.setCursor(0, 46);
+  if (tds.inletPpm > 1.0f)
+  {
+    display.printf("Rejection: %d%%", (int)(100.0f * (1.0f - tds.outletPpm / tds.inletPpm) + 0.5f));
+  }
+  else
+  {
+    display.print("Rejection: --");
+  }
+  display.setCursor(0, 56);
+  char temperature[12];
+  formatTenths(temperature, sizeof(temperature), tds.temperatureC);
+  display.printf("Temp: %s C", temperature);
 
   display.display();
 }
@@ -456,6 +1578,37 @@ void drawCounterResetScreen()
   display.display();
 }
 
+void drawLeakAlertScreen()
+{
+  display.clearDisplay();
+
+  uint8_t alerts = leakAlerts;
+  if (alerts == LEAK_NONE)
+  {
+    drawCenteredText("LEAK", 0, 2);
+    drawCenteredText("Flow stopped", 28, 1);
+    drawCenteredText("Alert cleared", 40, 1);
+    display.display();
+    return;
+  }
+
+  // Inverted banner so the alert stands out from normal screens
+  display.fillRect(0, 0, SCREEN_WIDTH, 18, WHITE);
+  display.setTextColor(BLACK);
+  drawCenteredText("! LEAK !", 1, 2);
+  display.setTextColor(WHITE);
+
+  drawCenteredText(LeakDetector::alertName(alerts), 24, 2);
+
+  display.setTextSize(1);
+  display.setCursor(0, 46);
+  display.printf("Rate: %lu mL/min", (unsigned long)leakDetector.getFlowRate());
+  display.setCursor(0, 56);
+  display.printf("Flow: %lu s", leakDetector.getFlowDuration(millis()) / 1000);
+
+  display.display();
+}
+
 void drawHomeKitStatusScreen()
 {
   display.clearDisplay();
@@ -480,8 +1633,7 @@ void drawHomeKitStatusScreen()
 
     // Setup code (large and prominent)
     display.setTextSize(2);
-    String setupCode = homeKitController.getSetupCode();
-    drawCenteredText(setupCode, 28, 2);
+    drawCenteredText(homeKitController.getSetupCode(), 28, 2);
 
     // Instructions
     display.setTextSize(1);
@@ -490,14 +1642,14 @@ void drawHomeKitStatusScreen()
   }
   else if (hkStatus == HOMEKIT_PAIRED)
   {
-    // Paired but not connected
+    // Paired, no controller session open
     display.setTextSize(1);
     drawCenteredText("HomeKit Paired", 20, 1);
-    drawCenteredText("Connecting...", 30, 1);
+    drawCenteredText(homeKitController.isWifiConnected() ? "No hub connected" : "WiFi down", 30, 1);
 
     // Show device count
     display.setCursor(0, 42);
-    display.print("Devices: 6"); // 5 filters + 1 usage sensor
+    display.printf("Devices: %d", FilterModel::COUNT + 3); // Filters + usage + leak + recovery
 
     // Show status
     display.setCursor(0, 52);
@@ -513,17 +1665,18 @@ void drawHomeKitStatusScreen()
     if (WiFi.status() == WL_CONNECTED)
     {
       display.setCursor(0, 26);
-      display.print("WiFi: ");
-      String ssid = WiFi.SSID();
-      if (ssid.length() > 10)
+      if (strlen(wifiSsid) > 10)
+      {
+        display.printf("WiFi: %.7s...", wifiSsid);
+      }
+      else
       {
-        ssid = ssid.substring(0, 7) + "...";
+        display.printf("WiFi: %s", wifiSsid);
       }
-      display.print(ssid);
 
       display.setCursor(0, 36);
       display.print("IP: ");
-      display.print(WiFi.localIP().toString());
+      display.print(wifiAddress);
     }
     else
     {
@@ -533,7 +1686,7 @@ void drawHomeKitStatusScreen()
 
     // HomeKit status
     display.setCursor(0, 46);
-    display.print("Filters: 5 active");
+    display.printf("Connections: %u", homeKitController.getConnectionCount());
 
     display.setCursor(0, 56);
     display.print("Setup: ");
@@ -550,6 +1703,33 @@ void drawHomeKitStatusScreen()
   display.display();
 }
 
+void drawDiagnosticsScreen()
+{
+  display.clearDisplay();
+  drawCenteredText("SYSTEM", 0, 2);
+  display.setTextSize(1);
+
+  char load0[8], load1[8];
+  formatLoad(load0, sizeof(load0), systemMonitor.getCoreLoad(0, false));
+  formatLoad(load1, sizeof(load1), systemMonitor.getCoreLoad(1, false));
+  display.setCursor(0, 18);
+  display.printf("CPU0 %-4s  CPU1 %s", load0, load1);
+
+  // Tasks closest to overflowing their stack
+  uint8_t order[4];
+  int count = systemMonitor.sortByStack(order, 4);
+  for (int i = 0; i < count; i++)
+  {
+    const TaskLoad &task = systemMonitor.getTask(order[i]);
+    char cpu[8];
+    formatLoad(cpu, sizeof(cpu), systemMonitor.hasCpuData() ? task.recentPermille : SystemMonitor::UNKNOWN);
+    display.setCursor(0, 28 + i * 9);
+    display.printf("%-9.9s %4s %5u", task.name, cpu, task.stackFree);
+  }
+
+  display.display();
+}
+
 void processButtons()
 {
   // Create button state from hardware interrupts
@@ -559,6 +1739,11 @@ void processButtons()
   buttons.leftJustReleased = leftButtonJustReleased;
   buttons.rightJustReleased = rightButtonJustReleased;
 
+  if (buttons.leftPressed || buttons.rightPressed || buttons.leftJustReleased || buttons.rightJustReleased)
+  {
+    powerPolicy.noteButton(millis());
+  }
+
   // Process buttons through the ButtonLogic class
   ButtonEvent event = buttonLogic.processButtons(buttons, millis());
 
@@ -574,7 +1759,7 @@ void processButtons()
     currentScreen = (currentScreen - 1 + NUM_SCREENS) % NUM_SCREENS;
     lastScreenChange = millis();
     // Reduced logging - only show navigation every minute
-    if (millis() - lastStatusMessageTime > statusMessageInterval)
+    if (millis() - lastStatusMessageTime > deviceConfig.statusIntervalMs)
     {
       Serial.println("Left button released - previous screen");
     }
@@ -585,7 +1770,7 @@ void processButtons()
     currentScreen = (currentScreen + 1) % NUM_SCREENS;
     lastScreenChange = millis();
     // Reduced logging - only show navigation every minute
-    if (millis() - lastStatusMessageTime > statusMessageInterval)
+    if (millis() - lastStatusMessageTime > deviceConfig.statusIntervalMs)
     {
       Serial.println("Right button released - next screen");
     }
@@ -611,15 +1796,16 @@ void processButtons()
 
   case ButtonEvent::RESET_CONFIRMED:
     Serial.println("Resetting counter!");
-    // Reset counter
+    // Reset counter and usage history
+    flowMeter.clear();
     totalWaterUsed = 0;
+    saveUsageCheckpoint();
     // Reset all filter percentages to 100%
-    for (int i = 0; i < 5; i++)
-    {
-      filters[i].percentage = 100;
-      filters[i].status = STATUS_OK;
-      filters[i].timeLeft = "12 months";
-    }
+    filters.replaceAll();
+    // Explicit user action - persist now, even over the daily budget
+    eventJournal.logCounterReset(currentTimestamp());
+    syncPersistentCounters();
+    persistentCounters.flush(millis(), true);
 
     // Note: WiFi reset removed since HomeSpan manages WiFi
     // To reset WiFi, use HomeSpan serial commands or reset device
@@ -634,13 +1820,97 @@ void processButtons()
   }
 }
 
+// Act on leak alert changes published by the leak timer
+void processLeakAlerts()
+{
+  uint8_t alerts = leakAlerts;
+  if (alerts == handledLeakAlerts)
+  {
+    return;
+  }
+
+  // Pin the alert screen for any newly raised alert bit
+  if (alerts & ~handledLeakAlerts)
+  {
+    Serial.printf("LEAK ALERT: %s (0x%02X)\n", LeakDetector::alertName(alerts), alerts);
+    if (!buttonLogic.isInResetMode())
+    {
+      currentScreen = SCREEN_LEAK_ALERT;
+    }
+  }
+  else if (alerts == LEAK_NONE)
+  {
+    Serial.println("Leak alert cleared");
+  }
+
+  eventJournal.logLeakAlert(currentTimestamp(), alerts);
+  handledLeakAlerts = alerts;
+  homeKitController.publishState(buildHomeKitState()); // Don't wait for the end of the pass
+}
+
+// Carry out requests from the Home app; the filter data belongs to this task
+void processHomeKitCommands()
+{
+  HomeKitCommand command;
+  while (homeKitController.nextCommand(command))
+  {
+    if (command.type == HomeKitCommandType::FILTER_RESET && command.index < FilterModel::COUNT)
+    {
+      filters.replace(command.index);
+      Serial.printf("Filter %s reset to 100%% from HomeKit\n", filters.getInfo(command.index).name);
+    }
+  }
+}
+
+// Pairing, WiFi and controller sessions change on HomeKit callbacks; show the
+// HomeKit screen the pass after it happens
+void followHomeKitLink()
+{
+  uint32_t changes = homeKitController.getLinkChanges();
+  if (changes == seenLinkChanges)
+  {
+    return;
+  }
+  seenLinkChanges = changes;
+  wifiSsid[0] = '\0';
+  wifiAddress[0] = '\0';
+  if (WiFi.status() == WL_CONNECTED)
+  {
+    // Straight from the driver; WiFi.SSID() builds a String on the heap
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK)
+    {
+      snprintf(wifiSsid, sizeof(wifiSsid), "%s", (const char *)ap.ssid);
+    }
+    IPAddress address = WiFi.localIP();
+    snprintf(wifiAddress, sizeof(wifiAddress), "%u.%u.%u.%u", address[0], address[1], address[2], address[3]);
+  }
+  logPrintf("HomeKit: %s | WiFi: %s | %u controller connection(s)\n", homeKitController.getStatusString(),
+            homeKitController.isWifiConnected() ? "up" : "down", homeKitController.getConnectionCount());
+
+  bool leakScreenPinned = currentScreen == SCREEN_LEAK_ALERT && leakAlerts != LEAK_NONE;
+  if (!buttonLogic.isInResetMode() && !leakScreenPinned)
+  {
+    currentScreen = SCREEN_HOMEKIT_STATUS;
+    lastScreenChange = millis();
+  }
+}
+
 void loop()
 {
+  uint32_t allocationsBefore = AllocationCounter::getCount();
+  uint32_t freesBefore = AllocationCounter::getFrees();
+
+  // Leak alerts first - they pre-empt everything else this pass
+  enterPhase(PHASE_INPUT);
+  processLeakAlerts();
+
   // Check for serial commands for testing (remove in production)
-  if (Serial.available())
+  enterPhase(PHASE_SERIAL);
+  if (!homeKitController.isSerialHandedOver() && Serial.available())
   {
     char cmd = Serial.read();
-    switch (cmd)
+    switch (collectHomeSpanCommand(cmd) ? '\0' : cmd)
     {
     case 'L':
     case 'l':
@@ -683,11 +1953,17 @@ void loop()
       Serial.println("R/r = Right button press/release");
       Serial.println("B/b = Both buttons press");
       Serial.println("U/u = Both buttons release");
-      Serial.println("W/w = WiFi configuration (HomeSpan)");
+      Serial.println("W/w = WiFi status");
+      Serial.println("!<cmd> = HomeSpan command, e.g. !W WiFi setup, !? HomeSpan help");
       Serial.println("K/k = HomeKit status");
       Serial.println("D/d = HomeKit diagnostics");
       Serial.println("P/p = Reset HomeKit pairing");
-      Serial.println("S/s = Set HomeKit as paired (for testing)");
+      Serial.println("X/x = Export usage history (encoded blocks)");
+      Serial.println("T/t = Boot timing profile");
+      Serial.println("M/m = Heap history");
+      Serial.println("S/s = Task stacks and CPU load");
+      Serial.println("C/c = Last reset cause and breadcrumbs");
+      Serial.println("E/e = WiFi power modes and HomeKit latency");
       Serial.println("H/h = This help");
       break;
     case 'W':
@@ -695,23 +1971,24 @@ void loop()
       Serial.println("WiFi Status (HomeSpan managed):");
       if (WiFi.status() == WL_CONNECTED)
       {
-        Serial.printf("Connected to: %s\n", WiFi.SSID().c_str());
-        Serial.printf("IP Address: %s\n", WiFi.localIP().toString().c_str());
+        Serial.printf("Connected to: %s\n", wifiSsid);
+        Serial.printf("IP Address: %s\n", wifiAddress);
         Serial.printf("RSSI: %d dBm\n", WiFi.RSSI());
         Serial.printf("Hostname: %s\n", WiFi.getHostname());
       }
       else
       {
         Serial.println("Not connected - use HomeSpan serial commands");
-        Serial.println("Type 'W' (capital) in HomeSpan to configure WiFi");
+        Serial.println("Type '!W' to configure WiFi through HomeSpan");
       }
       break;
     case 'K':
     case 'k':
       Serial.println("HomeKit Status:");
-      Serial.printf("Status: %s\n", homeKitController.getStatusString().c_str());
-      Serial.printf("Setup Code: %s\n", homeKitController.getSetupCode().c_str());
+      Serial.printf("Status: %s\n", homeKitController.getStatusString());
+      Serial.printf("Setup Code: %s\n", homeKitController.getSetupCode());
       Serial.printf("Paired: %s\n", homeKitController.isPaired() ? "Yes" : "No");
+      Serial.printf("Controller connections: %u\n", homeKitController.getConnectionCount());
       break;
     case 'D':
     case 'd':
@@ -722,48 +1999,136 @@ void loop()
       Serial.println("Resetting HomeKit pairing...");
       homeKitController.resetPairing();
       break;
+    case 'X':
+    case 'x':
+      exportUsageHistory();
+      break;
+    case 'T':
+    case 't':
+      reportBootProfile();
+      break;
+    case 'M':
+    case 'm':
+      reportHeapHistory(HeapMonitor::SAMPLE_COUNT);
+      break;
     case 'S':
     case 's':
-      Serial.println("Setting HomeKit status to paired (for testing)...");
-      homeKitController.setPairingStatus(true);
+      reportSystemMonitor();
+      break;
+    case 'C':
+    case 'c':
+      Serial.print(resetReport);
+      break;
+    case 'E':
+    case 'e':
+      reportPowerPolicy();
       break;
     }
   }
 
   // Process button inputs
+  enterPhase(PHASE_INPUT);
   processButtons();
 
-  // Update HomeKit controller (HomeSpan manages WiFi internally)
-  homeKitController.update();
-  homeKitController.updateSensors(filters, totalWaterUsed);
+  // Drain flow pulses into the usage history
+  processFlow();
+  enterPhase(PHASE_STORAGE);
+  if (millis() - lastRollupCheckpoint >= deviceConfig.rollupCheckpointMs && !powerFailing)
+  {
+    if (totalFlowMilliliters() != checkpointedUsageMl)
+    {
+      saveUsageCheckpoint();
+    }
+    lastRollupCheckpoint = millis();
+  }
+  journalDraws();
+  recordHistory();
+  syncPersistentCounters();
+  refreshResumeSnapshot();
+
+  // Clock sync starts once HomeSpan has brought WiFi up
+  enterPhase(PHASE_HOMEKIT);
+  if (!clockSyncStarted && WiFi.status() == WL_CONNECTED)
+  {
+    configTzTime(deviceConfig.timezone, deviceConfig.ntpServer);
+    clockSyncStarted = true;
+  }
+
+  // HomeSpan runs on its own task; exchange state and requests with it
+  processHomeKitCommands();
+  followHomeKitLink();
+  updatePowerPolicy();
 
-  // Update filter status
-  updateFilterStatus();
+  // Hand the pass's results to HomeKit
+  homeKitController.publishState(buildHomeKitState());
 
   // Print comprehensive status once per minute instead of frequent small messages
-  if (millis() - lastStatusMessageTime >= statusMessageInterval)
+  enterPhase(PHASE_STATUS);
+  if (millis() - lastStatusMessageTime >= deviceConfig.statusIntervalMs)
   {
     lastStatusMessageTime = millis();
 
     Serial.println("========== RO MONITOR STATUS ==========");
-    Serial.printf("Uptime: %lu min | Screen: %d | Filters: PP1:%d%% PP2:%d%% CAR:%d%% MEM:%d%% MIN:%d%%\n",
-                  millis() / 60000, currentScreen,
-                  filters[0].percentage, filters[1].percentage, filters[2].percentage,
-                  filters[3].percentage, filters[4].percentage);
-    Serial.printf("HomeKit: %s | WiFi: %s",
-                  homeKitController.getStatusString().c_str(),
-                  (WiFi.status() == WL_CONNECTED) ? WiFi.SSID().c_str() : "Disconnected");
+    logPrintf("Uptime: %lu min | Screen: %d | Filters:", millis() / 60000, currentScreen);
+    for (int i = 0; i < FilterModel::COUNT; i++)
+    {
+      logPrintf(" %s:%d%%", filters.getInfo(i).shortName, filters.getPercent(i));
+    }
+    logPrintf("\n");
+    const UpdateStats &homeKitUpdates = homeKitController.getUpdateStats();
+    logPrintf("HomeKit: %s (%u updates sent, %u suppressed) | WiFi: %s", homeKitController.getStatusString(),
+              homeKitUpdates.sent, homeKitUpdates.suppressed,
+              (WiFi.status() == WL_CONNECTED) ? wifiSsid : "Disconnected");
     if (WiFi.status() == WL_CONNECTED)
     {
-      Serial.printf(" (%s)", WiFi.localIP().toString().c_str());
+      logPrintf(" (%s)", wifiAddress);
     }
-    Serial.println();
-    Serial.printf("Water Usage: %d L | Free Heap: %d bytes\n", totalWaterUsed, ESP.getFreeHeap());
+    logPrintf("\n");
+    logPrintf("Water Usage: %d L (hour: %u mL, today: %u mL)\n", totalWaterUsed,
+              usageRollup.getRange(RollupTier::HOUR, 1, currentTimestamp()),
+              usageRollup.getRange(RollupTier::DAY, 1, currentTimestamp()));
+    HeapStats heap = readHeapStats();
+    logPrintf("Heap: %u free | largest block %u (%u%% fragmented) | minimum ever %u%s\n", heap.freeBytes,
+              heap.largestFreeBlock, HeapMonitor::fragmentation(heap.freeBytes, heap.largestFreeBlock),
+              heap.minimumFreeBytes, heapMonitor.isWarning() ? " | WARNING" : "");
+    char recent[12], lifetime[12];
+    formatTenths(recent, sizeof(recent), flowMeter.getRecoveryRatio(currentTimestamp()));
+    formatTenths(lifetime, sizeof(lifetime), flowMeter.getRecoveryRatio());
+    logPrintf("Recovery: %s%% (lifetime %s%%) | Reject: %lu L\n", recent, lifetime,
+              (unsigned long)(flowMeter.getRejectMilliliters() / 1000));
+    TdsReading tds = tdsSensor.getReading();
+    if (tds.valid)
+    {
+      char temperature[12];
+      formatTenths(temperature, sizeof(temperature), tds.temperatureC);
+      logPrintf("TDS: in %ld ppm | out %ld ppm | %s C\n", lroundf(tds.inletPpm), lroundf(tds.outletPpm), temperature);
+    }
+    logPrintf("Counters: %u writes (%u today)%s\n", persistentCounters.getWriteCount(),
+              persistentCounters.getWritesToday(), persistentCounters.isDirty() ? " | pending" : "");
+    logPrintf("Journal: segment %u (%u bytes) | %u draws, %u alerts since reset\n",
+              eventJournal.getSegmentSequence(), eventJournal.getSegmentBytes(),
+              eventJournal.getState().drawCount, eventJournal.getState().alertCount);
+    logPrintf("Loop heap: %u of the passes since the last report allocated (%u allocations since boot)\n",
+              allocatingPasses, AllocationCounter::getCount());
+    allocatingPasses = 0;
+    char load0[8], load1[8];
+    formatLoad(load0, sizeof(load0), systemMonitor.getCoreLoad(0, true));
+    formatLoad(load1, sizeof(load1), systemMonitor.getCoreLoad(1, true));
+    int tightest = systemMonitor.findLowestStack();
+    logPrintf("CPU (1 min): core 0 %s, core 1 %s | Tightest stack: %s, %u bytes free\n", load0, load1,
+              tightest >= 0 ? systemMonitor.getTask(tightest).name : "-",
+              tightest >= 0 ? systemMonitor.getTask(tightest).stackFree : 0);
+    logPrintf("WiFi sleep: %s | radio on ~%u%% | HomeKit p90: %u ms awake, %u ms min modem\n",
+              radioPowerModeName(powerPolicy.getMode()), (powerPolicy.getRadioOnPermille() + 5) / 10,
+              powerPolicy.getStats(RadioPowerMode::NO_SLEEP).latency.getPercentile(90),
+              powerPolicy.getStats(RadioPowerMode::MIN_MODEM).latency.getPercentile(90));
     Serial.println("=======================================");
   }
 
-  // Auto-rotate screens (only if not showing counter reset)
-  if (!buttonLogic.isInResetMode() && millis() - lastScreenChange > screenInterval)
+  // Auto-rotate screens (not while showing counter reset or an active leak alert)
+  enterPhase(PHASE_DISPLAY);
+  bool leakScreenPinned = currentScreen == SCREEN_LEAK_ALERT && leakAlerts != LEAK_NONE;
+  if (!buttonLogic.isInResetMode() && !leakScreenPinned && millis() - lastScreenChange > deviceConfig.screenIntervalMs)
   {
     currentScreen = (currentScreen + 1) % NUM_SCREENS;
     lastScreenChange = millis();
@@ -775,31 +2140,51 @@ void loop()
   case SCREEN_DASHBOARD:
     drawDashboard();
     break;
-  case SCREEN_PP1:
-    drawFilterScreen(0); // PP1
-    break;
-  case SCREEN_PP2:
-    drawFilterScreen(1); // PP2
-    break;
-  case SCREEN_CARBON:
-    drawFilterScreen(2); // Carbon
-    break;
-  case SCREEN_MEMBRANE:
-    drawFilterScreen(3); // Membrane
-    break;
-  case SCREEN_MINERALIZER:
-    drawFilterScreen(4); // Mineralizer
-    break;
   case SCREEN_USAGE:
     drawUsageScreen();
     break;
+  case SCREEN_RECOVERY:
+    drawRecoveryScreen();
+    break;
+  case SCREEN_WATER_QUALITY:
+    drawWaterQualityScreen();
+    break;
   case SCREEN_HOMEKIT_STATUS:
     drawHomeKitStatusScreen();
     break;
+  case SCREEN_DIAGNOSTICS:
+    drawDiagnosticsScreen();
+    break;
   case SCREEN_COUNTER_RESET:
     drawCounterResetScreen();
     break;
+  case SCREEN_LEAK_ALERT:
+    drawLeakAlertScreen();
+    break;
+  default:
+    drawFilterScreen(currentScreen - SCREEN_FIRST_FILTER); // The per-stage screens
+    break;
+  }
+
+  enterPhase(PHASE_MONITORS);
+  if (!bootReported)
+  {
+    bootProfiler.mark("first_frame", (uint32_t)esp_timer_get_time());
+    reportBootProfile();
+    bootReported = true;
+  }
+
+  passAllocations = AllocationCounter::getCount() - allocationsBefore;
+  passFrees = AllocationCounter::getFrees() - freesBefore;
+  if (passAllocations > 0)
+  {
+    allocatingPasses++;
   }
+  sampleHeap();
+  sampleSystem();
+  reportStalls();
 
-  delay(100);
+  // Frame delay - the leak timer cuts it short when an alert changes
+  enterPhase(PHASE_WAIT);
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
 }
@@ -0,0 +1,93 @@
+#include <unity.h>
+#include <string.h>
+#include "BootProfiler.h"
+
+BootProfiler *profiler;
+
+void setUp(void)
+{
+    profiler = new BootProfiler();
+}
+
+void tearDown(void)
+{
+    delete profiler;
+}
+
+// Each phase runs from the previous mark
+void test_phase_durations()
+{
+    profiler->mark("serial", 5000);
+    profiler->mark("oled", 85000);
+    profiler->mark("gpio", 86000);
+
+    TEST_ASSERT_EQUAL(3, profiler->getPhaseCount());
+    TEST_ASSERT_EQUAL_UINT32(5000, profiler->getPhaseDuration(0));
+    TEST_ASSERT_EQUAL_UINT32(80000, profiler->getPhaseDuration(1));
+    TEST_ASSERT_EQUAL_UINT32(1000, profiler->getPhaseDuration(2));
+    TEST_ASSERT_EQUAL_UINT32(86000, profiler->getTotalMicros());
+    TEST_ASSERT_EQUAL(1, profiler->findPhase("oled"));
+    TEST_ASSERT_EQUAL(-1, profiler->findPhase("wifi"));
+}
+
+// Recording stops at MAX_PHASES instead of overflowing
+void test_phase_limit()
+{
+    for (int i = 0; i < BootProfiler::MAX_PHASES; i++)
+    {
+        TEST_ASSERT_TRUE(profiler->mark("phase", i * 100));
+    }
+    TEST_ASSERT_FALSE(profiler->mark("extra", 99999));
+    TEST_ASSERT_EQUAL(BootProfiler::MAX_PHASES, profiler->getPhaseCount());
+}
+
+// Phases over budget are counted and flagged in the report
+void test_budget_check()
+{
+    const BootPhaseBudget budgets[] = {{"oled", 100}, {"homespan", 500}};
+    profiler->mark("oled", 50000);
+    profiler->mark("homespan", 650000);
+    profiler->mark("unbudgeted", 5650000);
+
+    TEST_ASSERT_EQUAL(1, profiler->countOverBudget(budgets, 2));
+
+    char report[256];
+    profiler->format(report, sizeof(report), budgets, 2);
+    TEST_ASSERT_NOT_NULL(strstr(report, "homespan"));
+    TEST_ASSERT_NOT_NULL(strstr(report, "OVER"));
+    TEST_ASSERT_NULL(strstr(strstr(report, "unbudgeted") + strlen("unbudgeted"), "budget"));
+}
+
+// A small buffer truncates the report but stays terminated
+void test_format_truncates()
+{
+    profiler->mark("serial", 1000);
+    profiler->mark("oled", 2000);
+    char report[20];
+    size_t length = profiler->format(report, sizeof(report));
+    TEST_ASSERT_EQUAL(19, length);
+    TEST_ASSERT_EQUAL(19, strlen(report));
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_phase_durations);
+    RUN_TEST(test_phase_limit);
+    RUN_TEST(test_budget_check);
+    RUN_TEST(test_format_truncates);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
@@ -0,0 +1,254 @@
+#include <unity.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <string.h>
+#include "DeviceConfig.h"
+
+// In-memory store that counts reads
+class CountingStore : public KeyValueStore
+{
+public:
+    std::map<std::string, std::vector<uint8_t>> values;
+    int reads = 0;
+
+    size_t read(const char *key, void *data, size_t length) override
+    {
+        reads++;
+        std::map<std::string, std::vector<uint8_t>>::iterator it = values.find(key);
+        if (it == values.end() || it->second.size() > length)
+        {
+            return 0;
+        }
+        memcpy(data, it->second.data(), it->second.size());
+        return it->second.size();
+    }
+
+    bool write(const char *key, const void *data, size_t length) override
+    {
+        values[key].assign((const uint8_t *)data, (const uint8_t *)data + length);
+        return true;
+    }
+};
+
+CountingStore *store;
+DeviceConfig config;
+uint8_t record[DEVICE_CONFIG_MAX_RECORD];
+
+void setUp(void)
+{
+    store = new CountingStore();
+    memset(&config, 0xAA, sizeof(config));
+}
+
+void tearDown(void)
+{
+    delete store;
+}
+
+DeviceConfigV1 makeV1(int8_t timezoneHours)
+{
+    DeviceConfigV1 old;
+    memset(&old, 0, sizeof(old));
+    strcpy(old.deviceName, "Kitchen RO");
+    strcpy(old.setupCode, "11122333");
+    strcpy(old.ntpServer, "time.google.com");
+    old.timezoneHours = timezoneHours;
+    old.flowPulsesPerLiter = 660;
+    old.screenIntervalMs = 5000;
+    return old;
+}
+
+// Nothing stored: defaults, from a single read
+void test_missing_uses_defaults()
+{
+    TEST_ASSERT_EQUAL(CONFIG_MISSING, loadDeviceConfig(*store, config));
+    TEST_ASSERT_EQUAL(1, store->reads);
+    TEST_ASSERT_EQUAL_STRING("RO Monitor", config.deviceName);
+    TEST_ASSERT_EQUAL_STRING("46637726", config.setupCode);
+    TEST_ASSERT_EQUAL(27, config.flowPins[1]);
+    TEST_ASSERT_EQUAL(450, config.flowPulsesPerLiter[2]);
+}
+
+// The current version round-trips exactly, loaded with one read
+void test_save_and_load_current()
+{
+    setDeviceConfigDefaults(config);
+    strcpy(config.deviceName, "Garage");
+    config.flowPulsesPerLiter[0] = 0;
+    config.quietStartHour = 23;
+    TEST_ASSERT_TRUE(saveDeviceConfig(*store, config));
+
+    DeviceConfig loaded;
+    TEST_ASSERT_EQUAL(CONFIG_LOADED, loadDeviceConfig(*store, loaded));
+    TEST_ASSERT_EQUAL(1, store->reads);
+    TEST_ASSERT_EQUAL_MEMORY(&config, &loaded, sizeof(config));
+}
+
+// Any corrupted byte is rejected and defaults are used
+void test_corruption_falls_back_to_defaults()
+{
+    setDeviceConfigDefaults(config);
+    strcpy(config.deviceName, "Garage");
+    saveDeviceConfig(*store, config);
+    std::vector<uint8_t> &stored = store->values["config"];
+
+    for (size_t i = 0; i < stored.size(); i++)
+    {
+        stored[i] ^= 0x20;
+        DeviceConfig loaded;
+        TEST_ASSERT_EQUAL(CONFIG_INVALID, decodeDeviceConfig(stored.data(), stored.size(), loaded));
+        TEST_ASSERT_EQUAL_STRING("RO Monitor", loaded.deviceName);
+        stored[i] ^= 0x20;
+    }
+}
+
+// Versions 2 and 3 never shipped; their records are not read
+void test_unreleased_versions_rejected()
+{
+    setDeviceConfigDefaults(config);
+    strcpy(config.deviceName, "Garage");
+    size_t length = encodeConfigRecord(2, 2, &config, (uint16_t)offsetof(DeviceConfig, heapSampleMs), record,
+                                       sizeof(record));
+    DeviceConfig loaded;
+    TEST_ASSERT_EQUAL(CONFIG_INVALID, decodeDeviceConfig(record, length, loaded));
+    TEST_ASSERT_EQUAL_STRING("RO Monitor", loaded.deviceName);
+
+    length = encodeConfigRecord(3, 3, &config, (uint16_t)offsetof(DeviceConfig, powerFailMaxPauseMs), record,
+                                sizeof(record));
+    TEST_ASSERT_EQUAL(CONFIG_INVALID, decodeDeviceConfig(record, length, loaded));
+}
+
+// A comparator configured on GPIO 34 stays there
+void test_power_fail_pin_kept()
+{
+    setDeviceConfigDefaults(config);
+    config.powerFailPin = 34;
+    TEST_ASSERT_TRUE(saveDeviceConfig(*store, config));
+
+    DeviceConfig loaded;
+    TEST_ASSERT_EQUAL(CONFIG_LOADED, loadDeviceConfig(*store, loaded));
+    TEST_ASSERT_EQUAL(34, loaded.powerFailPin);
+    TEST_ASSERT_EQUAL_UINT32(10000, loaded.powerFailMaxPauseMs);
+}
+
+// Version 1 migrates forward: per-channel calibration, POSIX timezone
+void test_migrate_v1_to_current()
+{
+    DeviceConfigV1 old = makeV1(3);
+    size_t length = encodeConfigRecord(1, 1, &old, sizeof(old), record, sizeof(record));
+
+    TEST_ASSERT_EQUAL(CONFIG_MIGRATED, decodeDeviceConfig(record, length, config));
+    TEST_ASSERT_EQUAL_STRING("Kitchen RO", config.deviceName);
+    TEST_ASSERT_EQUAL_STRING("11122333", config.setupCode);
+    TEST_ASSERT_EQUAL_STRING("time.google.com", config.ntpServer);
+    TEST_ASSERT_EQUAL_STRING("<+03>-3", config.timezone);
+    TEST_ASSERT_EQUAL(660, config.flowPulsesPerLiter[0]);
+    TEST_ASSERT_EQUAL(660, config.flowPulsesPerLiter[2]);
+    TEST_ASSERT_EQUAL_UINT32(5000, config.screenIntervalMs);
+    // Fields v1 did not have come from the defaults
+    TEST_ASSERT_EQUAL(PIN_NOT_FITTED, config.powerFailPin);
+    TEST_ASSERT_EQUAL_UINT32(3600000, config.rollupCheckpointMs);
+}
+
+// Negative and zero offsets
+void test_migrate_v1_timezones()
+{
+    DeviceConfigV1 old = makeV1(-5);
+    size_t length = encodeConfigRecord(1, 1, &old, sizeof(old), record, sizeof(record));
+    decodeDeviceConfig(record, length, config);
+    TEST_ASSERT_EQUAL_STRING("<-05>5", config.timezone);
+
+    old = makeV1(0);
+    length = encodeConfigRecord(1, 1, &old, sizeof(old), record, sizeof(record));
+    decodeDeviceConfig(record, length, config);
+    TEST_ASSERT_EQUAL_STRING("UTC0", config.timezone);
+}
+
+// A newer firmware's record that declares itself compatible is read by prefix
+void test_newer_compatible_record()
+{
+    uint8_t body[sizeof(DeviceConfig) + 12];
+    DeviceConfig newer;
+    setDeviceConfigDefaults(newer);
+    strcpy(newer.deviceName, "From newer");
+    memcpy(body, &newer, sizeof(newer));
+    memset(body + sizeof(newer), 0x5A, 12); // Fields this firmware does not know
+
+    size_t length = encodeConfigRecord(DEVICE_CONFIG_VERSION + 1, DEVICE_CONFIG_VERSION, body, sizeof(body), record,
+                                       sizeof(record));
+    TEST_ASSERT_EQUAL(CONFIG_NEWER, decodeDeviceConfig(record, length, config));
+    TEST_ASSERT_EQUAL_STRING("From newer", config.deviceName);
+}
+
+// A newer record that is not backward compatible is refused
+void test_newer_incompatible_record()
+{
+    uint8_t body[sizeof(DeviceConfig) + 12] = {0};
+    size_t length = encodeConfigRecord(DEVICE_CONFIG_VERSION + 1, DEVICE_CONFIG_VERSION + 1, body, sizeof(body), record,
+                                       sizeof(record));
+    TEST_ASSERT_EQUAL(CONFIG_INVALID, decodeDeviceConfig(record, length, config));
+    TEST_ASSERT_EQUAL_STRING("RO Monitor", config.deviceName);
+}
+
+// Unterminated strings and bad setup codes are repaired on load
+void test_sanitized_on_load()
+{
+    DeviceConfig raw;
+    setDeviceConfigDefaults(raw);
+    memset(raw.deviceName, 'x', sizeof(raw.deviceName));
+    strcpy(raw.setupCode, "12ab5678");
+    raw.screenIntervalMs = 0;
+    size_t length = encodeConfigRecord(DEVICE_CONFIG_VERSION, DEVICE_CONFIG_VERSION, &raw, sizeof(raw), record,
+                                       sizeof(record));
+
+    TEST_ASSERT_EQUAL(CONFIG_LOADED, decodeDeviceConfig(record, length, config));
+    TEST_ASSERT_EQUAL(sizeof(config.deviceName) - 1, strlen(config.deviceName));
+    TEST_ASSERT_EQUAL_STRING("46637726", config.setupCode);
+    TEST_ASSERT_EQUAL_UINT32(8000, config.screenIntervalMs);
+}
+
+// The old WiFiController string settings import into the record
+void test_legacy_settings_import()
+{
+    setDeviceConfigDefaults(config);
+    applyLegacySettings(config, "Utility RO", "ntp.example.org", "-8");
+    TEST_ASSERT_EQUAL_STRING("Utility RO", config.deviceName);
+    TEST_ASSERT_EQUAL_STRING("ntp.example.org", config.ntpServer);
+    TEST_ASSERT_EQUAL_STRING("<-08>8", config.timezone);
+
+    // Empty or nonsense values keep what is there
+    applyLegacySettings(config, "", nullptr, "99");
+    TEST_ASSERT_EQUAL_STRING("Utility RO", config.deviceName);
+    TEST_ASSERT_EQUAL_STRING("<-08>8", config.timezone);
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_missing_uses_defaults);
+    RUN_TEST(test_save_and_load_current);
+    RUN_TEST(test_corruption_falls_back_to_defaults);
+    RUN_TEST(test_migrate_v1_to_current);
+    RUN_TEST(test_unreleased_versions_rejected);
+    RUN_TEST(test_power_fail_pin_kept);
+    RUN_TEST(test_migrate_v1_timezones);
+    RUN_TEST(test_newer_compatible_record);
+    RUN_TEST(test_newer_incompatible_record);
+    RUN_TEST(test_sanitized_on_load);
+    RUN_TEST(test_legacy_settings_import);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
@@ -0,0 +1,217 @@
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include "EveHistory.h"
+
+HistoryRing *ring;
+EveHistoryServer *server;
+
+const uint32_t BASE_TIME = 1710072000;
+const uint32_t INTERVAL = 600;
+
+void setUp(void)
+{
+    ring = new HistoryRing();
+    server = new EveHistoryServer(*ring);
+}
+
+void tearDown(void)
+{
+    delete server;
+    delete ring;
+}
+
+uint32_t readLE32(const uint8_t *in)
+{
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+// Ten minute samples: a draw every sixth interval, filter life slowly falling
+void fillHistory(uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        HistoryEntry entry;
+        entry.timestamp = BASE_TIME + i * INTERVAL;
+        entry.usageDeciliters = (i % 6 == 0) ? 45 : 0;
+        entry.filterPercent = (uint8_t)(90 - i / 200);
+        TEST_ASSERT_TRUE(ring->append(entry));
+    }
+}
+
+// Samples read back exactly, numbered from 1
+void test_append_and_read()
+{
+    fillHistory(100);
+    TEST_ASSERT_EQUAL_UINT32(1, ring->getFirstIndex());
+    TEST_ASSERT_EQUAL_UINT32(100, ring->getLastIndex());
+
+    HistoryEntry entries[10];
+    TEST_ASSERT_EQUAL(10, ring->read(61, entries, 10));
+    TEST_ASSERT_EQUAL_UINT32(BASE_TIME + 60 * INTERVAL, entries[0].timestamp);
+    TEST_ASSERT_EQUAL_UINT32(45, entries[0].usageDeciliters);
+    TEST_ASSERT_EQUAL_UINT32(0, entries[1].usageDeciliters);
+    TEST_ASSERT_EQUAL_UINT8(90, entries[0].filterPercent);
+
+    TEST_ASSERT_EQUAL(5, ring->read(96, entries, 10)); // Stops at the newest
+    TEST_ASSERT_EQUAL(0, ring->read(101, entries, 10));
+}
+
+// Timestamps may not go backwards
+void test_rejects_backwards_time()
+{
+    fillHistory(3);
+    HistoryEntry entry = {BASE_TIME, 1, 90};
+    TEST_ASSERT_FALSE(ring->append(entry));
+    TEST_ASSERT_EQUAL_UINT32(3, ring->getCount());
+}
+
+// When full the oldest block goes; numbers of the rest do not change
+void test_ring_drops_oldest_block()
+{
+    fillHistory(5000);
+    uint32_t first = ring->getFirstIndex();
+    TEST_ASSERT_TRUE(first > 1);
+    TEST_ASSERT_EQUAL_UINT32(5000, ring->getLastIndex());
+    TEST_ASSERT_TRUE(ring->getCount() > 900);
+
+    HistoryEntry entry;
+    TEST_ASSERT_EQUAL(1, ring->read(first, &entry, 1));
+    TEST_ASSERT_EQUAL_UINT32(BASE_TIME + (first - 1) * INTERVAL, entry.timestamp);
+    TEST_ASSERT_EQUAL(0, ring->read(first - 1, &entry, 1));
+    TEST_ASSERT_EQUAL_UINT32(BASE_TIME, ring->getFirstTimestamp()); // Reference time is kept
+}
+
+// Checkpoint round trip, and appends continue in the restored open block
+void test_checkpoint_round_trip()
+{
+    fillHistory(150);
+    static uint8_t image[5000];
+    size_t length = ring->saveCheckpoint(image, sizeof(image));
+    TEST_ASSERT_EQUAL(HistoryRing::getCheckpointSize(), length);
+
+    HistoryRing restored;
+    TEST_ASSERT_TRUE(restored.restoreCheckpoint(image, length));
+    TEST_ASSERT_EQUAL_UINT32(150, restored.getLastIndex());
+
+    HistoryEntry entry = {BASE_TIME + 150 * INTERVAL, 12, 89};
+    TEST_ASSERT_TRUE(restored.append(entry));
+    HistoryEntry back[2];
+    TEST_ASSERT_EQUAL(2, restored.read(150, back, 2));
+    TEST_ASSERT_EQUAL_UINT32(12, back[1].usageDeciliters);
+
+    image[0] ^= 0xFF;
+    TEST_ASSERT_FALSE(restored.restoreCheckpoint(image, length));
+}
+
+// Status carries the reference time, signature and entry range
+void test_status_layout()
+{
+    fillHistory(20);
+    uint8_t status[EveHistoryServer::STATUS_SIZE];
+    TEST_ASSERT_EQUAL(EveHistoryServer::STATUS_SIZE, server->buildStatus(status, sizeof(status)));
+
+    TEST_ASSERT_EQUAL_UINT32(19 * INTERVAL, readLE32(status));
+    TEST_ASSERT_EQUAL_UINT32(BASE_TIME - EveHistoryServer::EVE_EPOCH_OFFSET, readLE32(status + 8));
+    TEST_ASSERT_EQUAL_UINT8(2, status[12]);
+    TEST_ASSERT_EQUAL_UINT8(EveHistoryServer::FIELD_USAGE, status[13]);
+    TEST_ASSERT_EQUAL_UINT8(20, status[17]);   // Last entry
+    TEST_ASSERT_EQUAL_UINT32(1, readLE32(status + 21)); // First entry
+}
+
+// A full transfer from the start: reference entry, then bounded batches
+void test_transfer_from_start()
+{
+    fillHistory(40);
+    uint8_t requestData[] = {0x01, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    TEST_ASSERT_TRUE(server->request(requestData, sizeof(requestData)));
+
+    uint8_t batch[EveHistoryServer::MAX_BATCH_SIZE];
+    size_t length = server->nextBatch(batch, sizeof(batch));
+    TEST_ASSERT_EQUAL(EveHistoryServer::MAX_BATCH_SIZE, length);
+    TEST_ASSERT_EQUAL_UINT8(EveHistoryServer::REFERENCE_SIZE, batch[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x81, batch[9]);
+
+    // First data entry: index 1, time 0, usage 4.5 L
+    const uint8_t *entry = batch + EveHistoryServer::REFERENCE_SIZE;
+    TEST_ASSERT_EQUAL_UINT8(EveHistoryServer::ENTRY_SIZE, entry[0]);
+    TEST_ASSERT_EQUAL_UINT32(1, readLE32(entry + 1));
+    TEST_ASSERT_EQUAL_UINT32(0, readLE32(entry + 5));
+    TEST_ASSERT_EQUAL_UINT8(45, entry[10]);
+
+    int entries = EveHistoryServer::BATCH_ENTRIES;
+    while ((length = server->nextBatch(batch, sizeof(batch))) > 1)
+    {
+        TEST_ASSERT_EQUAL(0, length % EveHistoryServer::ENTRY_SIZE);
+        entries += length / EveHistoryServer::ENTRY_SIZE;
+    }
+    TEST_ASSERT_EQUAL(40, entries);
+    TEST_ASSERT_FALSE(server->isTransferring());
+}
+
+// A client that already has entries resumes from its offset, no reference
+void test_transfer_resumes_from_offset()
+{
+    fillHistory(40);
+    uint8_t requestData[] = {0x01, 0x14, 35, 0x00, 0x00, 0x00, 0x00, 0x00};
+    server->request(requestData, sizeof(requestData));
+
+    uint8_t batch[EveHistoryServer::MAX_BATCH_SIZE];
+    size_t length = server->nextBatch(batch, sizeof(batch));
+    TEST_ASSERT_EQUAL(6 * EveHistoryServer::ENTRY_SIZE, length);
+    TEST_ASSERT_EQUAL_UINT32(35, readLE32(batch + 1));
+    TEST_ASSERT_EQUAL_UINT32(34 * INTERVAL, readLE32(batch + 5));
+}
+
+// Benchmark: worst-case batch build from a full ring
+void test_benchmark_batch_cost()
+{
+    fillHistory(5000);
+    uint8_t requestData[] = {0x01, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    uint8_t batch[EveHistoryServer::MAX_BATCH_SIZE];
+
+    const int rounds = 20000;
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+    {
+        server->request(requestData, sizeof(requestData));
+        bytes += server->nextBatch(batch, sizeof(batch));
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double micros = std::chrono::duration<double, std::micro>(elapsed).count() / rounds;
+
+    char message[128];
+    snprintf(message, sizeof(message), "%u entries in %u bytes of RAM; %.2f us per batch on the host",
+             (unsigned)ring->getCount(), (unsigned)sizeof(HistoryRing), micros);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(bytes > 0);
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_append_and_read);
+    RUN_TEST(test_rejects_backwards_time);
+    RUN_TEST(test_ring_drops_oldest_block);
+    RUN_TEST(test_checkpoint_round_trip);
+    RUN_TEST(test_status_layout);
+    RUN_TEST(test_transfer_from_start);
+    RUN_TEST(test_transfer_resumes_from_offset);
+    RUN_TEST(test_benchmark_batch_cost);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
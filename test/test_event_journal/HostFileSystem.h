@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include "JournalStorage.h"
+
+// Journal storage backed by real files in the working directory. Paths are
+// flattened onto a name prefix so no directories are needed.
+class HostFileSystem : public JournalStorage
+{
+public:
+    explicit HostFileSystem(const char *namePrefix) : bytesRead(0), bytesWritten(0), prefix(namePrefix) {}
+
+    bool append(const char *path, const void *data, size_t length) override
+    {
+        FILE *file = fopen(hostPath(path).c_str(), "ab");
+        if (!file)
+        {
+            return false;
+        }
+        size_t written = fwrite(data, 1, length, file);
+        fclose(file);
+        bytesWritten += written;
+        return written == length;
+    }
+
+    size_t read(const char *path, size_t offset, void *data, size_t length) override
+    {
+        FILE *file = fopen(hostPath(path).c_str(), "rb");
+        if (!file)
+        {
+            return 0;
+        }
+        size_t count = 0;
+        if (fseek(file, (long)offset, SEEK_SET) == 0)
+        {
+            count = fread(data, 1, length, file);
+        }
+        fclose(file);
+        bytesRead += count;
+        return count;
+    }
+
+    size_t size(const char *path) override
+    {
+        FILE *file = fopen(hostPath(path).c_str(), "rb");
+        if (!file)
+        {
+            return 0;
+        }
+        fseek(file, 0, SEEK_END);
+        long length = ftell(file);
+        fclose(file);
+        return length > 0 ? (size_t)length : 0;
+    }
+
+    bool remove(const char *path) override
+    {
+        ::remove(hostPath(path).c_str());
+        return true;
+    }
+
+    bool rename(const char *from, const char *to) override
+    {
+        return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+    }
+
+    // Chop bytes off the end of a file, as a power cut mid-append would
+    void truncate(const char *path, size_t removeBytes)
+    {
+        size_t length = size(path);
+        std::string content(length, '\0');
+        read(path, 0, &content[0], length);
+        ::remove(hostPath(path).c_str());
+        append(path, content.data(), length - removeBytes);
+    }
+
+    size_t bytesRead;
+    size_t bytesWritten;
+
+private:
+    std::string prefix;
+
+    std::string hostPath(const char *path) const
+    {
+        std::string flat = prefix;
+        for (const char *c = path; *c; c++)
+        {
+            flat += (*c == '/') ? '_' : *c;
+        }
+        return flat;
+    }
+};
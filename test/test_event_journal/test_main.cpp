@@ -0,0 +1,228 @@
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include "HostFileSystem.h"
+#include "EventJournal.h"
+
+HostFileSystem *fs;
+EventJournal *journal;
+
+const uint32_t BASE_TIME = 1710072000;
+
+void removeSegments()
+{
+    char path[32];
+    for (int i = 0; i < EventJournal::SEGMENT_COUNT; i++)
+    {
+        snprintf(path, sizeof(path), "/journal%d.log", i);
+        fs->remove(path);
+    }
+}
+
+void setUp(void)
+{
+    fs = new HostFileSystem("test_fs");
+    removeSegments();
+    journal = new EventJournal(*fs);
+    journal->begin();
+}
+
+void tearDown(void)
+{
+    delete journal;
+    removeSegments();
+    delete fs;
+}
+
+// Path of the segment currently being appended to
+const char *currentSegment()
+{
+    static char path[32];
+    snprintf(path, sizeof(path), "/journal%u.log", (unsigned)(journal->getSegmentSequence() % EventJournal::SEGMENT_COUNT));
+    return path;
+}
+
+// An empty journal starts its first segment on the first append
+void test_empty_journal()
+{
+    TEST_ASSERT_EQUAL(0, journal->getSegmentSequence());
+    TEST_ASSERT_TRUE(journal->logBoot(BASE_TIME));
+    TEST_ASSERT_EQUAL(1, journal->getSegmentSequence());
+
+    EventJournal reopened(*fs);
+    TEST_ASSERT_TRUE(reopened.begin());
+    TEST_ASSERT_EQUAL(1, reopened.getState().bootCount);
+}
+
+// Every event type survives a reboot
+void test_state_rebuilt_on_boot()
+{
+    journal->logBoot(BASE_TIME);
+    journal->logDraw(BASE_TIME + 10, 1500, 45000);
+    journal->logDraw(BASE_TIME + 20, 250, 8000);
+    journal->logFilterReplaced(BASE_TIME + 30, 3);
+    journal->logLeakAlert(BASE_TIME + 40, 0x02);
+    journal->logLeakAlert(BASE_TIME + 50, 0x00);
+
+    EventJournal reopened(*fs);
+    TEST_ASSERT_TRUE(reopened.begin());
+    const JournalState &state = reopened.getState();
+    TEST_ASSERT_TRUE(state.drawnMl == 1750);
+    TEST_ASSERT_EQUAL(2, state.drawCount);
+    TEST_ASSERT_EQUAL_UINT32(BASE_TIME + 30, state.filterReplacedTime[3]);
+    TEST_ASSERT_EQUAL(1, state.alertCount);
+    TEST_ASSERT_EQUAL_UINT32(BASE_TIME + 40, state.lastAlertTime);
+    TEST_ASSERT_EQUAL(0, state.lastAlerts);
+    TEST_ASSERT_FALSE(reopened.hadTornTail());
+}
+
+// A counter reset clears usage and stamps every filter
+void test_counter_reset()
+{
+    journal->logDraw(BASE_TIME, 1000, 1000);
+    journal->logCounterReset(BASE_TIME + 60);
+    journal->logDraw(BASE_TIME + 120, 300, 1000);
+
+    EventJournal reopened(*fs);
+    reopened.begin();
+    TEST_ASSERT_TRUE(reopened.getState().drawnMl == 300);
+    TEST_ASSERT_EQUAL(1, reopened.getState().resetCount);
+    TEST_ASSERT_EQUAL_UINT32(BASE_TIME + 60, reopened.getState().filterReplacedTime[0]);
+}
+
+// Only records after the last checkpoint are replayed
+void test_replay_starts_at_checkpoint()
+{
+    for (int i = 0; i < 500; i++)
+    {
+        journal->logDraw(BASE_TIME + i * 60, 100, 2000);
+    }
+
+    EventJournal reopened(*fs);
+    reopened.begin();
+    TEST_ASSERT_TRUE(reopened.getState().drawnMl == 50000);
+    TEST_ASSERT_LESS_OR_EQUAL(EventJournal::CHECKPOINT_INTERVAL, reopened.getReplayedRecords());
+}
+
+// Segments are reused as a ring; files never exceed the segment size
+void test_segment_ring()
+{
+    uint32_t events = 0;
+    while (journal->getSegmentSequence() < EventJournal::SEGMENT_COUNT * 2 + 1)
+    {
+        journal->logDraw(BASE_TIME + events, 10, 500);
+        events++;
+    }
+
+    char path[32];
+    for (int i = 0; i < EventJournal::SEGMENT_COUNT; i++)
+    {
+        snprintf(path, sizeof(path), "/journal%d.log", i);
+        TEST_ASSERT_GREATER_THAN(0, fs->size(path));
+        TEST_ASSERT_LESS_OR_EQUAL(EventJournal::SEGMENT_SIZE, fs->size(path));
+    }
+
+    EventJournal reopened(*fs);
+    reopened.begin();
+    TEST_ASSERT_EQUAL(journal->getSegmentSequence(), reopened.getSegmentSequence());
+    TEST_ASSERT_TRUE(reopened.getState().drawnMl == (uint64_t)events * 10);
+    TEST_ASSERT_EQUAL(events, reopened.getState().drawCount);
+}
+
+// A record cut short by power loss is dropped and the journal moves on
+void test_torn_tail_recovery()
+{
+    journal->logDraw(BASE_TIME, 1000, 1000);
+    journal->logDraw(BASE_TIME + 60, 2000, 1000);
+    uint32_t tornSequence = journal->getSegmentSequence();
+    fs->truncate(currentSegment(), 3);
+
+    EventJournal reopened(*fs);
+    reopened.begin();
+    TEST_ASSERT_TRUE(reopened.hadTornTail());
+    TEST_ASSERT_TRUE(reopened.getState().drawnMl == 1000);
+
+    // The next event goes to a fresh segment so nothing hides behind the tear
+    reopened.logDraw(BASE_TIME + 120, 500, 1000);
+    TEST_ASSERT_EQUAL(tornSequence + 1, reopened.getSegmentSequence());
+
+    EventJournal again(*fs);
+    again.begin();
+    TEST_ASSERT_FALSE(again.hadTornTail());
+    TEST_ASSERT_TRUE(again.getState().drawnMl == 1500);
+}
+
+// Resuming from saved state skips replay but is refused if the segment moved on
+void test_resume_without_replay()
+{
+    journal->logDraw(BASE_TIME, 1000, 1000);
+    JournalState saved = journal->getState();
+    uint32_t sequence = journal->getSegmentSequence();
+    uint32_t length = journal->getSegmentBytes();
+
+    EventJournal resumed(*fs);
+    TEST_ASSERT_TRUE(resumed.resume(saved, sequence, length));
+    resumed.logDraw(BASE_TIME + 60, 500, 1000);
+    TEST_ASSERT_TRUE(resumed.getState().drawnMl == 1500);
+
+    // The saved state is now stale against the file
+    EventJournal stale(*fs);
+    TEST_ASSERT_FALSE(stale.resume(saved, sequence, length));
+
+    EventJournal replayed(*fs);
+    replayed.begin();
+    TEST_ASSERT_TRUE(replayed.getState().drawnMl == 1500);
+}
+
+// Benchmark: boot replay cost stays bounded however long the history is
+void test_benchmark_bounded_boot_replay()
+{
+    const int events = 100000;
+    for (int i = 0; i < events; i++)
+    {
+        journal->logDraw(BASE_TIME + i * 60, 100 + i % 900, 2000);
+    }
+
+    fs->bytesRead = 0;
+    EventJournal reopened(*fs);
+    auto start = std::chrono::steady_clock::now();
+    reopened.begin();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double milliseconds = std::chrono::duration<double>(elapsed).count() * 1000;
+
+    char message[160];
+    snprintf(message, sizeof(message), "%d events, %u bytes written: boot read %u bytes, replayed %u records in %.2f ms",
+             events, (unsigned)fs->bytesWritten, (unsigned)fs->bytesRead, reopened.getReplayedRecords(), milliseconds);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_EQUAL(events, reopened.getState().drawCount);
+    TEST_ASSERT_LESS_OR_EQUAL(EventJournal::SEGMENT_SIZE + EventJournal::SEGMENT_COUNT * 100, fs->bytesRead);
+    TEST_ASSERT_LESS_OR_EQUAL(EventJournal::CHECKPOINT_INTERVAL, reopened.getReplayedRecords());
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_empty_journal);
+    RUN_TEST(test_state_rebuilt_on_boot);
+    RUN_TEST(test_counter_reset);
+    RUN_TEST(test_replay_starts_at_checkpoint);
+    RUN_TEST(test_segment_ring);
+    RUN_TEST(test_torn_tail_recovery);
+    RUN_TEST(test_resume_without_replay);
+    RUN_TEST(test_benchmark_bounded_boot_replay);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
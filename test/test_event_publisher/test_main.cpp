@@ -0,0 +1,236 @@
+#include <unity.h>
+#include "EventPublisher.h"
+
+// Stands in for a HomeSpan characteristic: counts setVal() calls, and the
+// poll cycles that had any, which is what becomes HAP event messages
+struct MockCharacteristic : public CharacteristicSink
+{
+    float value = 0;
+    int events = 0;
+
+    void publish(float newValue) override
+    {
+        value = newValue;
+        events++;
+    }
+};
+
+EventPublisher *publisher;
+MockCharacteristic life[5];
+MockCharacteristic change[5];
+MockCharacteristic usage;
+MockCharacteristic leak;
+int lifeHandle[5];
+int changeHandle[5];
+int usageHandle;
+int leakHandle;
+
+int totalEvents()
+{
+    int total = usage.events + leak.events;
+    for (int i = 0; i < 5; i++)
+    {
+        total += life[i].events + change[i].events;
+    }
+    return total;
+}
+
+void setUp(void)
+{
+    publisher = new EventPublisher(250);
+    for (int i = 0; i < 5; i++)
+    {
+        life[i] = MockCharacteristic();
+        change[i] = MockCharacteristic();
+        lifeHandle[i] = publisher->add(life[i], 40);
+        changeHandle[i] = publisher->add(change[i], 0);
+    }
+    usage = MockCharacteristic();
+    leak = MockCharacteristic();
+
+    PublishPolicy usagePolicy;
+    usagePolicy.hysteresis = 0.5f;
+    usagePolicy.minIntervalMs = 30000;
+    usageHandle = publisher->add(usage, 120, usagePolicy);
+
+    PublishPolicy leakPolicy;
+    leakPolicy.urgent = true;
+    leakHandle = publisher->add(leak, 0, leakPolicy);
+}
+
+void tearDown(void)
+{
+    delete publisher;
+}
+
+// A full counter reset: eleven changes, one batch, one event each
+void test_reset_burst_single_batch()
+{
+    for (int i = 0; i < 5; i++)
+    {
+        publisher->set(lifeHandle[i], 100, 1000);
+        publisher->set(changeHandle[i], 1, 1000);
+    }
+    publisher->set(usageHandle, 0, 1000);
+
+    TEST_ASSERT_EQUAL(0, publisher->flush(1100)); // Still in the window
+    TEST_ASSERT_EQUAL(11, publisher->flush(1250));
+    TEST_ASSERT_EQUAL(11, totalEvents());
+    TEST_ASSERT_EQUAL_UINT32(1, publisher->getBatches());
+    TEST_ASSERT_EQUAL_FLOAT(100, life[3].value);
+    TEST_ASSERT_FALSE(publisher->hasPending());
+}
+
+// Repeated updates from a 100 ms loop coalesce to the latest value
+void test_changes_within_window_coalesce()
+{
+    uint32_t now = 0;
+    for (int tick = 0; tick < 3; tick++, now += 100)
+    {
+        publisher->set(lifeHandle[0], 50 + tick, now);
+        publisher->flush(now);
+    }
+    publisher->flush(now);
+
+    TEST_ASSERT_EQUAL(1, life[0].events);
+    TEST_ASSERT_EQUAL_FLOAT(52, life[0].value);
+    TEST_ASSERT_EQUAL_UINT32(2, publisher->getCoalesced());
+}
+
+// Unchanged values never produce events or open a window
+void test_unchanged_values_suppressed()
+{
+    for (uint32_t now = 0; now < 60000; now += 100)
+    {
+        for (int i = 0; i < 5; i++)
+        {
+            publisher->set(lifeHandle[i], 40, now);
+            publisher->set(changeHandle[i], 0, now);
+        }
+        publisher->set(usageHandle, 120.2f, now); // Inside the hysteresis step
+        publisher->flush(now);
+    }
+    TEST_ASSERT_EQUAL(0, totalEvents());
+    TEST_ASSERT_EQUAL_UINT32(600 * 11, publisher->getStats().suppressed);
+}
+
+// A value that returns to the published one before the flush is dropped
+void test_change_reverted_in_window()
+{
+    publisher->set(changeHandle[2], 1, 0);
+    publisher->set(changeHandle[2], 0, 100);
+    publisher->flush(300);
+    TEST_ASSERT_EQUAL(0, change[2].events);
+    TEST_ASSERT_FALSE(publisher->hasPending());
+}
+
+// A steadily rising usage sensor is limited to one event per interval
+void test_rate_limit_per_characteristic()
+{
+    float liters = 120;
+    for (uint32_t now = 0; now < 5UL * 60 * 1000; now += 100)
+    {
+        liters += 0.05f; // Fast draw, a step every 10 loops
+        publisher->set(usageHandle, liters, now);
+        publisher->flush(now);
+    }
+
+    // First change right away, then one per 30 s over five minutes
+    TEST_ASSERT_LESS_OR_EQUAL(11, usage.events);
+    TEST_ASSERT_GREATER_OR_EQUAL(10, usage.events);
+    TEST_ASSERT_TRUE(publisher->hasPending());
+
+    // The latest value still goes out once the interval allows
+    publisher->flush(5UL * 60 * 1000 + 30000);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, liters, usage.value);
+}
+
+// The leak sensor skips the window and carries pending changes with it
+void test_urgent_flushes_everything_now()
+{
+    publisher->set(lifeHandle[1], 39, 1000);
+    publisher->set(leakHandle, 1, 1010);
+    TEST_ASSERT_EQUAL(2, publisher->flush(1010));
+    TEST_ASSERT_EQUAL(1, leak.events);
+    TEST_ASSERT_EQUAL(1, life[1].events);
+}
+
+// Leak alerts are never rate limited
+void test_urgent_not_rate_limited()
+{
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        publisher->set(leakHandle, (i % 2) ? 0 : 1, i * 10);
+        publisher->flush(i * 10);
+    }
+    TEST_ASSERT_EQUAL(10, leak.events);
+}
+
+// An expedited value goes out on the next flush despite the interval
+void test_expedite_skips_rate_limit()
+{
+    publisher->set(usageHandle, 121, 0);
+    publisher->flush(300);
+    TEST_ASSERT_EQUAL(1, usage.events);
+
+    publisher->set(usageHandle, 122, 5000);
+    publisher->flush(5300);
+    TEST_ASSERT_EQUAL(1, usage.events); // Still inside the 30 s interval
+
+    publisher->expedite(usageHandle);
+    TEST_ASSERT_EQUAL(1, publisher->flush(5310));
+    TEST_ASSERT_EQUAL(2, usage.events);
+    TEST_ASSERT_EQUAL_FLOAT(122, usage.value);
+
+    // Only that one value; the interval applies again afterwards
+    publisher->set(usageHandle, 123, 6000);
+    publisher->flush(6300);
+    TEST_ASSERT_EQUAL(2, usage.events);
+
+    // Nothing pending, nothing to expedite
+    publisher->expedite(leakHandle);
+    TEST_ASSERT_EQUAL(0, publisher->flush(6310));
+}
+
+// Handles beyond the capacity are refused and ignored
+void test_capacity()
+{
+    MockCharacteristic extra;
+    int handle = 0;
+    for (int i = 0; i < EventPublisher::MAX_CHARACTERISTICS; i++)
+    {
+        handle = publisher->add(extra, 0);
+    }
+    TEST_ASSERT_EQUAL(-1, handle);
+    publisher->set(handle, 1, 0);
+    publisher->flush(1000);
+    TEST_ASSERT_EQUAL(0, extra.events);
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_reset_burst_single_batch);
+    RUN_TEST(test_changes_within_window_coalesce);
+    RUN_TEST(test_unchanged_values_suppressed);
+    RUN_TEST(test_change_reverted_in_window);
+    RUN_TEST(test_rate_limit_per_characteristic);
+    RUN_TEST(test_urgent_flushes_everything_now);
+    RUN_TEST(test_urgent_not_rate_limited);
+    RUN_TEST(test_expedite_skips_rate_limit);
+    RUN_TEST(test_capacity);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
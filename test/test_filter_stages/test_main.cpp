@@ -0,0 +1,108 @@
+#include <unity.h>
+#include <string.h>
+#include "FilterStages.h"
+
+const FilterStageInfo threeStages[] = {
+    {"SEDIMENT", "SED", "Sediment Filter"},
+    {"CARBON", "CAR", "Carbon Filter"},
+    {"MEMBRANE", "MEM", "RO Membrane"}};
+
+const FilterStageInfo eightStages[] = {
+    {"PP1 FILTER", "PP1", "PP1 Filter"},
+    {"PP2 FILTER", "PP2", "PP2 Filter"},
+    {"CARBON", "CAR", "Carbon Filter"},
+    {"MEMBRANE", "MEM", "RO Membrane"},
+    {"POST CARB", "PCB", "Post Carbon"},
+    {"MINERALIZR", "MIN", "Mineralizer"},
+    {"ALKALINE", "ALK", "Alkaline Filter"},
+    {"UV LAMP", "UV", "UV Lamp"}};
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// New models start with every stage full and OK
+void test_starts_full()
+{
+    FilterStageModel<3> model(threeStages);
+    TEST_ASSERT_EQUAL(3, FilterStageModel<3>::COUNT);
+    for (int i = 0; i < 3; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(100, model.getPercent(i));
+        TEST_ASSERT_EQUAL(STATUS_OK, model.getStatus(i));
+    }
+    TEST_ASSERT_EQUAL_STRING("MEM", model.getInfo(2).shortName);
+}
+
+// Status follows the level at the 20% and 10% thresholds
+void test_status_thresholds()
+{
+    FilterStageModel<8> model(eightStages);
+    model.setPercent(0, 20);
+    model.setPercent(1, 19);
+    model.setPercent(2, 10);
+    model.setPercent(3, 9);
+    model.setPercent(4, 0);
+
+    TEST_ASSERT_EQUAL(STATUS_OK, model.getStatus(0));
+    TEST_ASSERT_EQUAL(STATUS_WARNING, model.getStatus(1));
+    TEST_ASSERT_EQUAL(STATUS_WARNING, model.getStatus(2));
+    TEST_ASSERT_EQUAL(STATUS_REPLACE, model.getStatus(3));
+    TEST_ASSERT_EQUAL(STATUS_REPLACE, model.getStatus(4));
+    TEST_ASSERT_EQUAL_STRING("LOW", filterStatusLabel(model.getStatus(1)));
+    TEST_ASSERT_EQUAL_STRING("REPLACE", filterStatusLabel(model.getStatus(3)));
+}
+
+// Levels are clamped, and replacing a stage brings it back to full
+void test_clamp_and_replace()
+{
+    FilterStageModel<8> model(eightStages);
+    model.setPercent(7, 250);
+    TEST_ASSERT_EQUAL_UINT8(100, model.getPercent(7));
+
+    model.setPercent(5, 4);
+    TEST_ASSERT_EQUAL_UINT8(4, model.getLowestPercent());
+    model.replace(5);
+    TEST_ASSERT_EQUAL_UINT8(100, model.getPercent(5));
+    TEST_ASSERT_EQUAL(STATUS_OK, model.getStatus(5));
+
+    model.setPercent(0, 30);
+    model.setPercent(1, 40);
+    model.replaceAll();
+    TEST_ASSERT_EQUAL_UINT8(100, model.getLowestPercent());
+}
+
+// The metadata table is shared, not copied; the model itself stays small
+void test_metadata_not_copied()
+{
+    FilterStageModel<8> model(eightStages);
+    TEST_ASSERT_EQUAL_PTR(eightStages, model.getInfoTable());
+    TEST_ASSERT_TRUE(sizeof(model) <= sizeof(void *) + 2 * FILTER_STAGE_MAX);
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_starts_full);
+    RUN_TEST(test_status_thresholds);
+    RUN_TEST(test_clamp_and_replace);
+    RUN_TEST(test_metadata_not_copied);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
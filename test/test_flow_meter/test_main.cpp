@@ -0,0 +1,159 @@
+#include <unity.h>
+#include "FlowMeter.h"
+
+FlowMeter *meter;
+uint32_t pulses[FLOW_CHANNEL_COUNT];
+
+const uint32_t BASE_TIME = 1710072000;
+
+void setUp(void)
+{
+    meter = new FlowMeter();
+    for (int i = 0; i < FLOW_CHANNEL_COUNT; i++)
+    {
+        pulses[i] = 0;
+    }
+}
+
+void tearDown(void)
+{
+    delete meter;
+}
+
+// Each channel converts pulses with its own calibration
+void test_per_channel_calibration()
+{
+    meter->configure(FLOW_INLET, 450);
+    meter->configure(FLOW_PERMEATE, 1000);
+
+    pulses[FLOW_INLET] = 900;
+    pulses[FLOW_PERMEATE] = 500;
+    meter->update(pulses, BASE_TIME);
+
+    TEST_ASSERT_EQUAL_UINT32(2000, meter->getLastMilliliters(FLOW_INLET));
+    TEST_ASSERT_EQUAL_UINT32(500, meter->getLastMilliliters(FLOW_PERMEATE));
+    TEST_ASSERT_EQUAL(2, meter->getRollup(FLOW_INLET).getLifetimeLiters());
+}
+
+// Sub-milliliter remainders carry over between updates
+void test_remainder_carry()
+{
+    meter->configure(FLOW_PERMEATE, 450);
+    for (int i = 0; i < 450; i++)
+    {
+        pulses[FLOW_PERMEATE]++;
+        meter->update(pulses, BASE_TIME + i);
+    }
+    TEST_ASSERT_EQUAL(1000, (int)meter->getRollup(FLOW_PERMEATE).getLifetimeMilliliters());
+}
+
+// Pulse totals wrapping past 32 bits still produce the right delta
+void test_pulse_counter_wrap()
+{
+    meter->configure(FLOW_PERMEATE, 1000);
+    pulses[FLOW_PERMEATE] = 0xFFFFFF00;
+    meter->update(pulses, BASE_TIME);
+    meter->clear();
+
+    pulses[FLOW_PERMEATE] = 0x00000100;
+    meter->update(pulses, BASE_TIME);
+    TEST_ASSERT_EQUAL_UINT32(512, meter->getLastMilliliters(FLOW_PERMEATE));
+}
+
+// Recovery from inlet and permeate; reject derived as the difference
+void test_recovery_with_inlet_sensor()
+{
+    meter->configure(FLOW_INLET, 1000);
+    meter->configure(FLOW_PERMEATE, 1000);
+
+    pulses[FLOW_INLET] = 4000;
+    pulses[FLOW_PERMEATE] = 1000;
+    meter->update(pulses, BASE_TIME);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 25.0, meter->getRecoveryRatio());
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 25.0, meter->getRecoveryRatio(BASE_TIME));
+    TEST_ASSERT_TRUE(meter->getRejectMilliliters() == 3000);
+}
+
+// Recovery from permeate and brine when no inlet sensor is fitted
+void test_recovery_with_brine_sensor()
+{
+    meter->configure(FLOW_PERMEATE, 1000);
+    meter->configure(FLOW_BRINE, 1000);
+
+    pulses[FLOW_PERMEATE] = 1000;
+    pulses[FLOW_BRINE] = 2000;
+    meter->update(pulses, BASE_TIME);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 33.33, meter->getRecoveryRatio());
+    TEST_ASSERT_TRUE(meter->getRejectMilliliters() == 2000);
+}
+
+// Without a feed-side sensor, or before any flow, recovery is unknown
+void test_recovery_unknown()
+{
+    meter->configure(FLOW_PERMEATE, 450);
+    pulses[FLOW_PERMEATE] = 450;
+    meter->update(pulses, BASE_TIME);
+    TEST_ASSERT_TRUE(meter->getRecoveryRatio() < 0);
+
+    FlowMeter idle;
+    idle.configure(FLOW_INLET, 450);
+    idle.configure(FLOW_PERMEATE, 450);
+    TEST_ASSERT_TRUE(idle.getRecoveryRatio() < 0);
+}
+
+// The live ratio follows the last hour while the lifetime one is stable
+void test_live_recovery_window()
+{
+    meter->configure(FLOW_INLET, 1000);
+    meter->configure(FLOW_PERMEATE, 1000);
+
+    pulses[FLOW_INLET] = 4000;
+    pulses[FLOW_PERMEATE] = 1000;
+    meter->update(pulses, BASE_TIME);
+
+    // Two hours later the membrane recovers 50%
+    pulses[FLOW_INLET] += 2000;
+    pulses[FLOW_PERMEATE] += 1000;
+    meter->update(pulses, BASE_TIME + 7200);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 50.0, meter->getRecoveryRatio(BASE_TIME + 7200));
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 33.33, meter->getRecoveryRatio());
+}
+
+// Channels that are not fitted ignore stray pulses
+void test_unfitted_channel_ignored()
+{
+    pulses[FLOW_BRINE] = 1234;
+    meter->update(pulses, BASE_TIME);
+    TEST_ASSERT_EQUAL_UINT32(0, meter->getLastMilliliters(FLOW_BRINE));
+    TEST_ASSERT_FALSE(meter->isFitted(FLOW_BRINE));
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_per_channel_calibration);
+    RUN_TEST(test_remainder_carry);
+    RUN_TEST(test_pulse_counter_wrap);
+    RUN_TEST(test_recovery_with_inlet_sensor);
+    RUN_TEST(test_recovery_with_brine_sensor);
+    RUN_TEST(test_recovery_unknown);
+    RUN_TEST(test_live_recovery_window);
+    RUN_TEST(test_unfitted_channel_ignored);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <unity.h>
+#include "HeapMonitor.h"
+
+HeapMonitor *monitor;
+
+HeapStats stats(uint32_t freeBytes, uint32_t largest, uint32_t minimum)
+{
+    HeapStats result;
+    result.freeBytes = freeBytes;
+    result.largestFreeBlock = largest;
+    result.minimumFreeBytes = minimum;
+    return result;
+}
+
+void setUp(void)
+{
+    monitor = new HeapMonitor();
+}
+
+void tearDown(void)
+{
+    delete monitor;
+}
+
+// Fragmentation is the share of free memory outside the largest block
+void test_fragmentation_ratio()
+{
+    TEST_ASSERT_EQUAL_UINT8(0, HeapMonitor::fragmentation(100000, 100000));
+    TEST_ASSERT_EQUAL_UINT8(75, HeapMonitor::fragmentation(100000, 25000));
+    TEST_ASSERT_EQUAL_UINT8(0, HeapMonitor::fragmentation(0, 0));
+}
+
+// Pass counts add up into the interval and reset once it is sampled
+void test_interval_counts()
+{
+    TEST_ASSERT_TRUE(monitor->isDue(0)); // First sample is taken straight away
+    monitor->addPass(0, 0);
+    monitor->addPass(3, 2);
+    monitor->addPass(1, 2);
+    monitor->sample(1000, stats(150000, 110000, 140000));
+
+    const HeapSample &first = monitor->getSample(0);
+    TEST_ASSERT_EQUAL_UINT32(4, first.allocations);
+    TEST_ASSERT_EQUAL_UINT32(4, first.frees);
+    TEST_ASSERT_EQUAL_UINT16(3, first.passes);
+    TEST_ASSERT_EQUAL_UINT16(3, first.maxPassAllocations);
+    TEST_ASSERT_EQUAL_UINT8(27, first.fragmentationPercent);
+    TEST_ASSERT_FALSE(first.warning);
+
+    TEST_ASSERT_FALSE(monitor->isDue(5999));
+    TEST_ASSERT_TRUE(monitor->isDue(6000));
+    monitor->sample(6000, stats(150000, 110000, 140000));
+    TEST_ASSERT_EQUAL_UINT32(0, monitor->getSample(0).allocations);
+    TEST_ASSERT_EQUAL_UINT32(1000, monitor->getSample(1).timestampMs);
+}
+
+// The ring keeps the newest SAMPLE_COUNT samples
+void test_ring_wraps()
+{
+    for (int i = 0; i < HeapMonitor::SAMPLE_COUNT + 10; i++)
+    {
+        monitor->sample(i * 5000, stats(100000 - i, 90000, 90000));
+    }
+    TEST_ASSERT_EQUAL(HeapMonitor::SAMPLE_COUNT, monitor->getCount());
+    TEST_ASSERT_EQUAL_UINT32((HeapMonitor::SAMPLE_COUNT + 9) * 5000, monitor->getSample(0).timestampMs);
+    TEST_ASSERT_EQUAL_UINT32(10 * 5000, monitor->getSample(HeapMonitor::SAMPLE_COUNT - 1).timestampMs);
+}
+
+// A warning fires once when either threshold is crossed and re-arms on recovery
+void test_warning_edges()
+{
+    HeapMonitorConfig config;
+    config.warnLargestBlock = 16384;
+    config.warnFragmentationPercent = 60;
+    monitor->setConfig(config);
+
+    TEST_ASSERT_FALSE(monitor->sample(0, stats(120000, 80000, 100000)));
+    TEST_ASSERT_TRUE(monitor->sample(5000, stats(120000, 12000, 100000))); // Largest block too small
+    TEST_ASSERT_TRUE(monitor->isWarning());
+    TEST_ASSERT_FALSE(monitor->sample(10000, stats(120000, 12000, 100000))); // Still low, no repeat
+    TEST_ASSERT_FALSE(monitor->sample(15000, stats(120000, 80000, 100000))); // Recovered
+    TEST_ASSERT_FALSE(monitor->isWarning());
+    TEST_ASSERT_TRUE(monitor->sample(20000, stats(120000, 40000, 100000))); // 67% fragmented
+    TEST_ASSERT_EQUAL_UINT32(2, monitor->getWarningCount());
+    TEST_ASSERT_EQUAL_UINT32(12000, monitor->getLowestLargestBlock());
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_fragmentation_ratio);
+    RUN_TEST(test_interval_counts);
+    RUN_TEST(test_ring_wraps);
+    RUN_TEST(test_warning_edges);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
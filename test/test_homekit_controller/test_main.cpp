@@ -0,0 +1,625 @@
+#include <unity.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include "AllocationCounter.h"
+#include "HomeKitController.h"
+
+const FilterStageInfo stages[] = {
+    {"PP1 FILTER", "PP1", "PP1 Filter"},
+    {"PP2 FILTER", "PP2", "PP2 Filter"},
+    {"CARBON", "CAR", "Carbon Filter"},
+    {"MEMBRANE", "MEM", "RO Membrane"},
+    {"MINERALIZR", "MIN", "Mineralizer"}};
+const int STAGE_COUNT = sizeof(stages) / sizeof(stages[0]);
+
+// In-memory files for the Eve history checkpoint
+class MemoryStorage : public JournalStorage
+{
+public:
+    std::map<std::string, std::string> files;
+
+    bool append(const char *path, const void *data, size_t length) override
+    {
+        files[path].append((const char *)data, length);
+        return true;
+    }
+    size_t read(const char *path, size_t offset, void *data, size_t length) override
+    {
+        std::map<std::string, std::string>::iterator it = files.find(path);
+        if (it == files.end() || offset >= it->second.size())
+        {
+            return 0;
+        }
+        size_t count = it->second.size() - offset < length ? it->second.size() - offset : length;
+        memcpy(data, it->second.data() + offset, count);
+        return count;
+    }
+    size_t size(const char *path) override
+    {
+        return files.count(path) ? files[path].size() : 0;
+    }
+    bool remove(const char *path) override
+    {
+        files.erase(path);
+        return true;
+    }
+    bool rename(const char *from, const char *to) override
+    {
+        files[to] = files[from];
+        files.erase(from);
+        return true;
+    }
+};
+
+HomeKitController *controller;
+HomeKitState state;
+std::vector<DEV_FilterMaintenance *> filterServices;
+DEV_WaterUsage *usageService;
+DEV_LeakSensor *leakService;
+DEV_EveHistory *historyService;
+
+void setUp(void)
+{
+    homeSpan.reset();
+    hostSetMillis(0);
+
+    memset(&state, 0, sizeof(state));
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        state.filterPercent[i] = 80 - 10 * i;
+    }
+    state.waterUsageLiters = 1200;
+    state.recoveryPercent = -1;
+
+    controller = new HomeKitController();
+    controller->setFilterStages(stages, STAGE_COUNT);
+    controller->setEveHistoryService(true);
+    controller->begin(state);
+
+    filterServices.clear();
+    for (size_t i = 0; i < homeSpan.services.size(); i++)
+    {
+        SpanService *service = homeSpan.services[i];
+        if (DEV_FilterMaintenance *filter = dynamic_cast<DEV_FilterMaintenance *>(service))
+            filterServices.push_back(filter);
+        else if (DEV_WaterUsage *usage = dynamic_cast<DEV_WaterUsage *>(service))
+            usageService = usage;
+        else if (DEV_LeakSensor *leak = dynamic_cast<DEV_LeakSensor *>(service))
+            leakService = leak;
+        else if (DEV_EveHistory *history = dynamic_cast<DEV_EveHistory *>(service))
+            historyService = history;
+    }
+}
+
+void tearDown(void)
+{
+    delete controller; // HomeSpan objects are never freed on the device either
+}
+
+// One HomeKit task pass after some time has gone by
+void pollAfter(unsigned long ms)
+{
+    hostAdvanceMillis(ms);
+    controller->poll();
+}
+
+// Services are built from the initial state and HomeSpan gets its own task
+void test_begin_builds_services()
+{
+    TEST_ASSERT_EQUAL(STAGE_COUNT, filterServices.size());
+    TEST_ASSERT_NOT_NULL(usageService);
+    TEST_ASSERT_NOT_NULL(leakService);
+    TEST_ASSERT_EQUAL(1, hostTasksCreated() > 0);
+    TEST_ASSERT_EQUAL(60, filterServices[2]->filterLifeLevel->getVal());
+    TEST_ASSERT_EQUAL_STRING("466-37-726", controller->getSetupCode());
+    TEST_ASSERT_EQUAL(HOMEKIT_WAITING_FOR_PAIRING, controller->getStatus());
+}
+
+// Other RO models get one filter service per stage from the same firmware
+void test_three_stage_system()
+{
+    delete controller;
+    homeSpan.reset();
+    controller = new HomeKitController();
+    controller->setFilterStages(stages + 2, 3);
+    controller->begin(state);
+
+    int filters = 0;
+    for (size_t i = 0; i < homeSpan.services.size(); i++)
+    {
+        if (DEV_FilterMaintenance *filter = dynamic_cast<DEV_FilterMaintenance *>(homeSpan.services[i]))
+        {
+            TEST_ASSERT_EQUAL_STRING(stages[2 + filters].homeKitName, filter->filterName);
+            filters++;
+        }
+    }
+    TEST_ASSERT_EQUAL(3, filters);
+
+    state.filterPercent[2] = 7;
+    state.filterChangeNeeded[2] = 1;
+    controller->publishState(state);
+    pollAfter(20000);
+    pollAfter(300);
+    TEST_ASSERT_EQUAL_UINT32(2, controller->getUpdateStats().sent);
+}
+
+// Passes without a new state, or with the same state, set nothing
+void test_unchanged_state_sets_nothing()
+{
+    uint32_t before = homeSpan.totalSetCount();
+    for (int i = 0; i < 1000; i++)
+    {
+        controller->publishState(state);
+        pollAfter(100);
+    }
+    TEST_ASSERT_EQUAL_UINT32(before, homeSpan.totalSetCount());
+    TEST_ASSERT_EQUAL(1000, homeSpan.pollCount);
+}
+
+// A simulated hour of the 100 ms UI loop: only real changes become events
+void test_set_calls_per_simulated_hour()
+{
+    uint32_t before = homeSpan.totalSetCount();
+    for (int tick = 0; tick < 36000; tick++)
+    {
+        state.waterUsageLiters = 1200 + tick / 1800; // 20 L over the hour
+        state.filterPercent[0] = tick < 18000 ? 80 : 79;
+        state.recoveryPercent = 30.0f + (tick % 7) * 0.1f; // Jitter inside one percent
+        controller->publishState(state);
+        pollAfter(100);
+    }
+    uint32_t sets = homeSpan.totalSetCount() - before;
+
+    char message[96];
+    snprintf(message, sizeof(message), "%u setVal() calls per simulated hour (unfiltered: %u)", sets,
+             36000u * 17);
+    TEST_MESSAGE(message);
+
+    // First recovery, one filter step, 19 one-liter usage steps
+    TEST_ASSERT_EQUAL_UINT32(21, sets);
+    TEST_ASSERT_EQUAL(79, filterServices[0]->filterLifeLevel->getVal());
+    TEST_ASSERT_EQUAL(1219, usageService->totalVolume->getVal());
+}
+
+// A reset from the Home app becomes a request for the UI task; the new level
+// reaches HomeKit once the UI publishes it
+void test_reset_from_home_app()
+{
+    homeSpan.write(filterServices[2]->resetFilterIndication, 1);
+
+    HomeKitCommand command;
+    TEST_ASSERT_TRUE(controller->nextCommand(command));
+    TEST_ASSERT_TRUE(command.type == HomeKitCommandType::FILTER_RESET);
+    TEST_ASSERT_EQUAL(2, command.index);
+    TEST_ASSERT_FALSE(controller->nextCommand(command));
+    TEST_ASSERT_EQUAL(60, filterServices[2]->filterLifeLevel->getVal()); // Unchanged until the UI acts
+
+    state.filterPercent[2] = 100;
+    controller->publishState(state);
+    pollAfter(10);
+    pollAfter(300); // Coalescing window
+    TEST_ASSERT_EQUAL(100, filterServices[2]->filterLifeLevel->getVal());
+    TEST_ASSERT_EQUAL_UINT32(1, filterServices[2]->filterLifeLevel->setCount);
+}
+
+// If the UI falls behind, further resets are refused instead of lost silently
+void test_reset_requests_bounded()
+{
+    int accepted = 0;
+    for (int i = 0; i < 10; i++)
+    {
+        homeSpan.write(filterServices[i % STAGE_COUNT]->resetFilterIndication, 1);
+    }
+    HomeKitCommand command;
+    while (controller->nextCommand(command))
+    {
+        accepted++;
+    }
+    TEST_ASSERT_EQUAL(7, accepted);
+}
+
+// Leak alerts go out on the very next pass
+void test_leak_is_immediate()
+{
+    state.leakDetected = 1;
+    controller->publishState(state);
+    controller->poll();
+    TEST_ASSERT_EQUAL(1, leakService->leakDetected->getVal());
+}
+
+// Draw start and stop reach HomeKit on the next pass; the volume and rate
+// stay rate limited while water runs and settle as soon as it stops
+void test_draw_events_immediate()
+{
+    state.waterInUse = 1;
+    state.flowLitersPerMinute = 1.8f;
+    controller->publishState(state);
+    controller->poll();
+    TEST_ASSERT_EQUAL(1, usageService->inUse->getVal());
+    TEST_ASSERT_EQUAL(1, usageService->active->getVal());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 1.8f, usageService->flowRate->getVal<float>());
+
+    for (int tick = 0; tick < 100; tick++)
+    {
+        state.waterUsageLiters = 1200 + tick / 33; // 3 L over 10 s
+        controller->publishState(state);
+        pollAfter(100);
+    }
+    uint32_t totalSets = usageService->totalVolume->setCount;
+    TEST_ASSERT_LESS_OR_EQUAL(1, totalSets);
+
+    state.waterInUse = 0;
+    state.flowLitersPerMinute = 0;
+    state.waterUsageLiters = 1204;
+    controller->publishState(state);
+    pollAfter(100);
+    TEST_ASSERT_EQUAL(0, usageService->inUse->getVal());
+    TEST_ASSERT_EQUAL(1204, usageService->totalVolume->getVal());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, usageService->flowRate->getVal<float>());
+}
+
+// There is no valve to drive, so Home app writes are refused
+void test_valve_write_refused()
+{
+    homeSpan.write(usageService->active, 1);
+    TEST_ASSERT_EQUAL(0, usageService->active->getVal());
+}
+
+// Samples from the UI reach the Eve service; a request gets one batch
+void test_eve_history_request()
+{
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        HistoryEntry entry = {1710072000 + i * 600, 10 * i, 80};
+        TEST_ASSERT_TRUE(controller->addHistory(entry));
+    }
+    controller->poll();
+    TEST_ASSERT_EQUAL(EveHistoryServer::STATUS_SIZE, historyService->status->data.size());
+    TEST_ASSERT_EQUAL_UINT8(3, historyService->status->data[17]); // Last entry
+
+    uint8_t request[] = {0x01, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    homeSpan.writeData(historyService->request, request, sizeof(request));
+    TEST_ASSERT_EQUAL(EveHistoryServer::REFERENCE_SIZE + 3 * EveHistoryServer::ENTRY_SIZE,
+                      historyService->entries->data.size());
+}
+
+// Without the Eve service the history is still recorded, and nothing is registered
+void test_eve_history_off_by_default()
+{
+    delete controller;
+    homeSpan.reset();
+    controller = new HomeKitController();
+    controller->setFilterStages(stages, STAGE_COUNT);
+    controller->begin(state);
+    for (size_t i = 0; i < homeSpan.services.size(); i++)
+    {
+        TEST_ASSERT_NULL(dynamic_cast<DEV_EveHistory *>(homeSpan.services[i]));
+    }
+
+    HistoryEntry entry = {1710072000, 10, 80};
+    TEST_ASSERT_TRUE(controller->addHistory(entry));
+    controller->poll();
+    TEST_ASSERT_EQUAL(1, homeSpan.pollCount);
+}
+
+// Rebuild the controller as after a restart, on the given history storage
+void restartController(JournalStorage *storage)
+{
+    delete controller;
+    homeSpan.reset();
+    controller = new HomeKitController();
+    controller->setFilterStages(stages, STAGE_COUNT);
+    controller->setHistoryStorage(storage);
+    controller->setEveHistoryService(true);
+    controller->begin(state);
+    for (size_t i = 0; i < homeSpan.services.size(); i++)
+    {
+        if (DEV_EveHistory *history = dynamic_cast<DEV_EveHistory *>(homeSpan.services[i]))
+            historyService = history;
+    }
+}
+
+// History checkpoints go to the filesystem, replacing the old file whole
+void test_history_checkpoint_on_storage()
+{
+    MemoryStorage storage;
+    restartController(&storage);
+    for (uint32_t i = 0; i < 36; i++) // Six hours of samples
+    {
+        HistoryEntry entry = {1710072000 + i * 600, i, 80};
+        TEST_ASSERT_TRUE(controller->addHistory(entry));
+        controller->poll();
+    }
+    TEST_ASSERT_TRUE(storage.size("/history.bin") > 0);
+    TEST_ASSERT_EQUAL(0, storage.size("/history.tmp"));
+
+    restartController(&storage);
+    TEST_ASSERT_EQUAL_UINT8(36, historyService->status->data[17]); // Last entry
+}
+
+// A full counter reset leaves in one batch
+void test_counter_reset_single_batch()
+{
+    uint32_t before = homeSpan.totalSetCount();
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        state.filterPercent[i] = 100;
+    }
+    state.waterUsageLiters = 0;
+    controller->publishState(state);
+    pollAfter(100);
+    uint32_t afterFirst = homeSpan.totalSetCount() - before;
+    pollAfter(300);
+
+    TEST_ASSERT_EQUAL_UINT32(0, afterFirst);
+    TEST_ASSERT_EQUAL_UINT32(6, homeSpan.totalSetCount() - before);
+    TEST_ASSERT_EQUAL_UINT32(6, controller->getUpdateStats().sent);
+}
+
+// Pairing, WiFi and session changes come from HomeSpan's callbacks, not polling
+void test_link_follows_callbacks()
+{
+    TEST_ASSERT_NOT_NULL(homeSpan.statusCallback);
+    TEST_ASSERT_NOT_NULL(homeSpan.pairCallback);
+    TEST_ASSERT_NOT_NULL(homeSpan.connectionCallback);
+    TEST_ASSERT_FALSE(controller->isWifiConnected());
+
+    uint32_t changes = controller->getLinkChanges();
+    for (int i = 0; i < 1000; i++)
+    {
+        pollAfter(1000);
+    }
+    TEST_ASSERT_EQUAL_UINT32(changes, controller->getLinkChanges());
+
+    homeSpan.connectionCallback(1);
+    homeSpan.statusCallback(HS_PAIRING_NEEDED);
+    TEST_ASSERT_TRUE(controller->isWifiConnected());
+    TEST_ASSERT_EQUAL(HOMEKIT_WAITING_FOR_PAIRING, controller->getStatus());
+
+    homeSpan.pairCallback(true);
+    TEST_ASSERT_TRUE(controller->isPaired());
+    TEST_ASSERT_EQUAL(HOMEKIT_PAIRED, controller->getStatus());
+
+    homeSpan.setOpenSessions(2);
+    controller->poll();
+    TEST_ASSERT_EQUAL(2, controller->getConnectionCount());
+    TEST_ASSERT_EQUAL(HOMEKIT_RUNNING, controller->getStatus());
+
+    homeSpan.setOpenSessions(0);
+    homeSpan.statusCallback(HS_WIFI_CONNECTING);
+    controller->poll();
+    TEST_ASSERT_FALSE(controller->isWifiConnected());
+    TEST_ASSERT_EQUAL(HOMEKIT_PAIRED, controller->getStatus());
+    TEST_ASSERT_EQUAL_UINT32(changes + 6, controller->getLinkChanges());
+}
+
+// Pairing resets run HomeSpan's unpair on the HomeKit task; the pair
+// callback, not the command, clears the paired state
+void test_reset_pairing_on_homekit_task()
+{
+    homeSpan.statusCallback(HS_PAIRED);
+    TEST_ASSERT_TRUE(controller->isPaired());
+
+    controller->resetPairing();
+    TEST_ASSERT_EQUAL(0, (int)homeSpan.serialCommands.size());
+    TEST_ASSERT_TRUE(controller->isPaired());
+    uint32_t changes = controller->getLinkChanges();
+    controller->poll();
+    TEST_ASSERT_EQUAL(1, (int)homeSpan.serialCommands.size());
+    TEST_ASSERT_EQUAL_STRING("U", homeSpan.serialCommands[0].c_str());
+    TEST_ASSERT_EQUAL(0, homeSpan.deleteCount); // Characteristic values are kept
+    TEST_ASSERT_FALSE(controller->isPaired());
+    TEST_ASSERT_EQUAL(HOMEKIT_WAITING_FOR_PAIRING, controller->getStatus());
+    TEST_ASSERT_EQUAL_UINT32(changes + 1, controller->getLinkChanges());
+}
+
+// HomeSpan's CLI runs on the HomeKit task; the UART is handed over until it returns
+void test_serial_commands_forwarded()
+{
+    TEST_ASSERT_TRUE(homeSpan.serialInputDisabled);
+    TEST_ASSERT_TRUE(controller->sendSerialCommand("W"));
+    TEST_ASSERT_TRUE(controller->isSerialHandedOver());
+    TEST_ASSERT_FALSE(controller->sendSerialCommand("?")); // One at a time
+    TEST_ASSERT_EQUAL(0, (int)homeSpan.serialCommands.size());
+
+    controller->poll();
+    TEST_ASSERT_FALSE(controller->isSerialHandedOver());
+    TEST_ASSERT_EQUAL(1, (int)homeSpan.serialCommands.size());
+    TEST_ASSERT_EQUAL_STRING("W", homeSpan.serialCommands[0].c_str());
+}
+
+// HomeSpan's own S command cannot leave a code the display does not show
+void test_serial_setup_code_kept()
+{
+    TEST_ASSERT_EQUAL(1, homeSpan.pairingCodeCount);
+    TEST_ASSERT_TRUE(controller->sendSerialCommand("S 11122333"));
+    controller->poll();
+    TEST_ASSERT_EQUAL(2, homeSpan.pairingCodeCount);
+    TEST_ASSERT_EQUAL_STRING("466-37-726", controller->getSetupCode());
+}
+
+// Each pass leaves breadcrumbs; the last one names homeSpan.poll()
+void test_pass_breadcrumbs()
+{
+    BreadcrumbTrail trail;
+    beginTrail(trail);
+    controller->setTrail(&trail);
+    controller->poll();
+    TEST_ASSERT_EQUAL_UINT32(HOMEKIT_PHASE_IDLE, trail.sequence); // Apply through poll
+    TEST_ASSERT_EQUAL(HOMEKIT_PHASE_POLL, trail.phase);
+    TEST_ASSERT_TRUE(isTrailValid(trail, HOMEKIT_PHASE_COUNT));
+    controller->setTrail(nullptr);
+}
+
+// Stands in for a poll() that blocks far past the hk_poll limit
+StallWatchdog watchdog;
+bool reportSetup;
+StallAction blockedAction;
+
+void blockInsidePoll()
+{
+    if (reportSetup)
+    {
+        homeSpan.statusCallback(HS_AP_STARTED);
+    }
+    watchdog.check(millis());
+    hostAdvanceMillis(HOMEKIT_STALL_PHASES[HOMEKIT_PHASE_POLL].limitMs + 60000);
+    blockedAction = watchdog.check(millis());
+}
+
+// HomeSpan's access point waits for the user inside poll(); that is no stall
+void test_setup_mode_not_a_stall()
+{
+    BreadcrumbTrail trail;
+    beginTrail(trail);
+    controller->setTrail(&trail);
+    watchdog = StallWatchdog();
+    watchdog.watch(trail, "HomeKit", HOMEKIT_STALL_PHASES, HOMEKIT_PHASE_COUNT, millis());
+    watchdog.setRestartAfterMs(30000);
+    homeSpan.pollHook = blockInsidePoll;
+
+    reportSetup = true;
+    controller->poll();
+    TEST_ASSERT_EQUAL(STALL_NONE, blockedAction);
+    TEST_ASSERT_EQUAL(HOMEKIT_PHASE_SETUP, trail.phase);
+    TEST_ASSERT_EQUAL_UINT32(0, watchdog.getStallCount());
+
+    // The same wait outside setup restarts the device
+    reportSetup = false;
+    controller->poll();
+    TEST_ASSERT_EQUAL(STALL_RESTART, blockedAction);
+    TEST_ASSERT_EQUAL(HOMEKIT_PHASE_POLL, trail.phase);
+    controller->setTrail(nullptr);
+}
+
+// A request is timed from the pass that sees it to the poll that answers it
+void test_request_latency()
+{
+    uint16_t latency;
+    homeSpan.setOpenSessions(2);
+    pollAfter(10);
+    TEST_ASSERT_FALSE(controller->nextLatency(latency));
+
+    homeSpan.pollMs = 35;
+    homeSpan.sendRequest(1);
+    pollAfter(10);
+    TEST_ASSERT_TRUE(controller->nextLatency(latency));
+    TEST_ASSERT_EQUAL_UINT16(35, latency);
+    TEST_ASSERT_FALSE(controller->nextLatency(latency));
+
+    // Requests on two sessions in the same pass are timed separately
+    homeSpan.sendRequest(0);
+    homeSpan.sendRequest(1);
+    pollAfter(10);
+    TEST_ASSERT_TRUE(controller->nextLatency(latency));
+    TEST_ASSERT_TRUE(controller->nextLatency(latency));
+    TEST_ASSERT_FALSE(controller->nextLatency(latency));
+}
+
+// A session table longer than the timing slots turns timing off instead of reading past them
+void test_request_timing_guard()
+{
+    delete controller;
+    homeSpan.reset();
+    homeSpan.maxConnections = Span::HOST_MAX_CONNECTIONS;
+    controller = new HomeKitController();
+    controller->setFilterStages(stages, STAGE_COUNT);
+    controller->begin(state);
+
+    uint16_t latency;
+    homeSpan.setOpenSessions(18);
+    homeSpan.sendRequest(17);
+    pollAfter(10);
+    TEST_ASSERT_FALSE(controller->nextLatency(latency));
+    TEST_ASSERT_EQUAL(18, controller->getConnectionCount());
+}
+
+// Steady state takes nothing from the heap: publish, HomeKit pass and the
+// status the UI draws every frame
+void test_steady_state_allocation_free()
+{
+    pollAfter(1000); // Let the first pass settle
+    AllocationCounter::track();
+    size_t characters = 0;
+    for (int i = 0; i < 10000; i++)
+    {
+        state.waterUsageLiters = 1200 + i / 100;
+        state.flowLitersPerMinute = (i % 200) < 20 ? 1.5f : 0.0f;
+        state.waterInUse = state.flowLitersPerMinute > 0 ? 1 : 0;
+        state.recoveryPercent = 30.0f + (i % 50) * 0.1f;
+        controller->publishState(state);
+        pollAfter(100);
+        characters += strlen(controller->getStatusString()) + strlen(controller->getSetupCode());
+    }
+    TEST_ASSERT_TRUE(characters > 0);
+    TEST_ASSERT_EQUAL_UINT32(0, AllocationCounter::getCount());
+
+    // The counter does see allocations
+    String built = String("Waiting for pairing, code ") + controller->getSetupCode();
+    TEST_ASSERT_TRUE(AllocationCounter::getCount() > 0);
+}
+
+// Benchmark: UI publish plus one HomeKit pass with changing values
+void test_benchmark_update_cost()
+{
+    const int passes = 200000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < passes; i++)
+    {
+        state.waterUsageLiters = 1200 + i / 100;
+        state.recoveryPercent = 30.0f + (i % 50) * 0.1f;
+        controller->publishState(state);
+        pollAfter(5);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double micros = std::chrono::duration<double, std::micro>(elapsed).count() / passes;
+
+    char message[96];
+    snprintf(message, sizeof(message), "%.3f us per publish + poll pass on the host", micros);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(micros < 50.0);
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_begin_builds_services);
+    RUN_TEST(test_three_stage_system);
+    RUN_TEST(test_unchanged_state_sets_nothing);
+    RUN_TEST(test_set_calls_per_simulated_hour);
+    RUN_TEST(test_reset_from_home_app);
+    RUN_TEST(test_reset_requests_bounded);
+    RUN_TEST(test_leak_is_immediate);
+    RUN_TEST(test_draw_events_immediate);
+    RUN_TEST(test_valve_write_refused);
+    RUN_TEST(test_eve_history_request);
+    RUN_TEST(test_eve_history_off_by_default);
+    RUN_TEST(test_history_checkpoint_on_storage);
+    RUN_TEST(test_counter_reset_single_batch);
+    RUN_TEST(test_link_follows_callbacks);
+    RUN_TEST(test_reset_pairing_on_homekit_task);
+    RUN_TEST(test_serial_commands_forwarded);
+    RUN_TEST(test_serial_setup_code_kept);
+    RUN_TEST(test_pass_breadcrumbs);
+    RUN_TEST(test_setup_mode_not_a_stall);
+    RUN_TEST(test_request_latency);
+    RUN_TEST(test_request_timing_guard);
+    RUN_TEST(test_steady_state_allocation_free);
+    RUN_TEST(test_benchmark_update_cost);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include <unity.h>
+#include "LeakDetector.h"
+
+LeakDetector *detector;
+
+const unsigned long SAMPLE_MS = 200;
+const uint32_t PULSES_PER_LITER = 450;
+
+// Scenario replay state: simulated clock and pulse quantization
+unsigned long now;
+uint64_t pulseAccumulator; // Pulses * 1000 * 60000 fractional accumulator
+uint32_t pulseRemainder;
+
+void setUp(void)
+{
+    detector = new LeakDetector();
+    now = 0;
+    pulseAccumulator = 0;
+    pulseRemainder = 0;
+}
+
+void tearDown(void)
+{
+    delete detector;
+}
+
+// Feed a constant flow for durationMs, quantized to whole sensor pulses like
+// the real flow meter. Returns the elapsed time when `alert` first fired, or 0.
+unsigned long replayFlow(uint32_t rateMlPerMin, unsigned long durationMs, int hour, uint8_t alert)
+{
+    unsigned long start = now;
+    unsigned long firedAt = 0;
+    for (unsigned long t = 0; t < durationMs; t += SAMPLE_MS)
+    {
+        now += SAMPLE_MS;
+        pulseAccumulator += (uint64_t)rateMlPerMin * PULSES_PER_LITER * SAMPLE_MS;
+        uint32_t pulses = (uint32_t)(pulseAccumulator / (1000ULL * 60000));
+        pulseAccumulator %= 1000ULL * 60000;
+
+        uint32_t scaled = pulses * 1000 + pulseRemainder;
+        uint32_t milliliters = scaled / PULSES_PER_LITER;
+        pulseRemainder = scaled % PULSES_PER_LITER;
+
+        uint8_t alerts = detector->update(milliliters, SAMPLE_MS, now, hour);
+        if (firedAt == 0 && (alerts & alert))
+        {
+            firedAt = now - start;
+        }
+    }
+    return firedAt;
+}
+
+// Single drip pulses spaced intervalMs apart
+unsigned long replayDrips(unsigned long intervalMs, unsigned long durationMs, int hour)
+{
+    unsigned long start = now;
+    unsigned long firedAt = 0;
+    unsigned long sinceDrip = 0;
+    for (unsigned long t = 0; t < durationMs; t += SAMPLE_MS)
+    {
+        now += SAMPLE_MS;
+        sinceDrip += SAMPLE_MS;
+        uint32_t milliliters = 0;
+        if (sinceDrip >= intervalMs)
+        {
+            milliliters = 2; // One pulse ~2.2 mL
+            sinceDrip = 0;
+        }
+        uint8_t alerts = detector->update(milliliters, SAMPLE_MS, now, hour);
+        if (firedAt == 0 && (alerts & LEAK_QUIET_TRICKLE))
+        {
+            firedAt = now - start;
+        }
+    }
+    return firedAt;
+}
+
+// Filling a 2 L jug at a normal rate raises nothing
+void test_normal_draw_no_alert()
+{
+    replayFlow(2000, 60000, 12, 0xFF);
+    TEST_ASSERT_EQUAL(LEAK_NONE, detector->getAlerts());
+    TEST_ASSERT_TRUE(detector->isFlowing());
+
+    replayFlow(0, 5000, 12, 0xFF);
+    TEST_ASSERT_FALSE(detector->isFlowing());
+}
+
+// A stuck faucet trips the continuous flow limit right at the limit
+void test_stuck_faucet_continuous_flow()
+{
+    unsigned long firedAt = replayFlow(1500, 15UL * 60 * 1000, 14, LEAK_CONTINUOUS_FLOW);
+    TEST_ASSERT_GREATER_OR_EQUAL(10UL * 60 * 1000, firedAt);
+    TEST_ASSERT_LESS_OR_EQUAL(10UL * 60 * 1000 + SAMPLE_MS, firedAt);
+    TEST_ASSERT_TRUE(detector->getAlerts() & LEAK_CONTINUOUS_FLOW);
+}
+
+// Alerts latch until the flow stops, then clear
+void test_alert_clears_after_flow_stops()
+{
+    replayFlow(1500, 11UL * 60 * 1000, 14, LEAK_CONTINUOUS_FLOW);
+    TEST_ASSERT_TRUE(detector->getAlerts() & LEAK_CONTINUOUS_FLOW);
+
+    replayFlow(0, 2000, 14, 0);
+    TEST_ASSERT_TRUE(detector->getAlerts() & LEAK_CONTINUOUS_FLOW);
+
+    replayFlow(0, 2000, 14, 0);
+    TEST_ASSERT_EQUAL(LEAK_NONE, detector->getAlerts());
+}
+
+// A burst fitting is flagged in well under a second
+void test_burst_rate_ceiling_sub_second()
+{
+    unsigned long firedAt = replayFlow(12000, 3000, 14, LEAK_RATE_CEILING);
+    TEST_ASSERT_GREATER_THAN(0, firedAt);
+    TEST_ASSERT_LESS_THAN(1000, firedAt);
+}
+
+// A short spike above the ceiling does not trip the alarm
+void test_short_spike_ignored()
+{
+    replayFlow(2000, 5000, 14, 0);
+    replayFlow(6000, 200, 14, 0);
+    replayFlow(2000, 5000, 14, 0);
+    TEST_ASSERT_EQUAL(LEAK_NONE, detector->getAlerts());
+}
+
+// Night-time drips raise the trickle alert after the trickle duration
+void test_quiet_hour_trickle()
+{
+    unsigned long firedAt = replayDrips(20000, 20UL * 60 * 1000, 2);
+    TEST_ASSERT_GREATER_OR_EQUAL(15UL * 60 * 1000, firedAt);
+    TEST_ASSERT_LESS_THAN(16UL * 60 * 1000, firedAt);
+}
+
+// The same drips during the day, or without a clock, are not a trickle alert
+void test_trickle_outside_quiet_hours_ignored()
+{
+    TEST_ASSERT_EQUAL(0, replayDrips(20000, 20UL * 60 * 1000, 15));
+    TEST_ASSERT_EQUAL(0, replayDrips(20000, 20UL * 60 * 1000, -1));
+}
+
+// A real draw at night is not mistaken for a trickle
+void test_night_draw_not_trickle()
+{
+    replayFlow(2000, 30000, 3, 0);
+    replayFlow(0, 20UL * 60 * 1000, 3, 0);
+    TEST_ASSERT_EQUAL(LEAK_NONE, detector->getAlerts());
+}
+
+// Quiet hours may wrap past midnight
+void test_quiet_hours_wrap_midnight()
+{
+    LeakDetectorConfig config;
+    config.quietStartHour = 23;
+    config.quietEndHour = 6;
+    detector->setConfig(config);
+
+    TEST_ASSERT_GREATER_THAN(0, replayDrips(20000, 20UL * 60 * 1000, 0));
+}
+
+// Detection state does not grow with history
+void test_constant_state_size()
+{
+    TEST_ASSERT_LESS_OR_EQUAL(160, sizeof(LeakDetector));
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_normal_draw_no_alert);
+    RUN_TEST(test_stuck_faucet_continuous_flow);
+    RUN_TEST(test_alert_clears_after_flow_stops);
+    RUN_TEST(test_burst_rate_ceiling_sub_second);
+    RUN_TEST(test_short_spike_ignored);
+    RUN_TEST(test_quiet_hour_trickle);
+    RUN_TEST(test_trickle_outside_quiet_hours_ignored);
+    RUN_TEST(test_night_draw_not_trickle);
+    RUN_TEST(test_quiet_hours_wrap_midnight);
+    RUN_TEST(test_constant_state_size);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
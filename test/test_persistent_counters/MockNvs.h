@@ -0,0 +1,133 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <string.h>
+#include "KeyValueStore.h"
+
+// Host model of the ESP-IDF NVS partition, just detailed enough to count
+// flash wear. Entries are 32 bytes, a 4 KB page holds 126 of them and pages
+// fill as a ring. One page is always kept erased; when the active page
+// fills, the oldest page's live entries move forward and it is erased.
+class MockNvs : public KeyValueStore
+{
+public:
+    static const int PAGE_COUNT = 6; // 0x6000 nvs partition
+    static const int ENTRIES_PER_PAGE = 126;
+    static const int ENTRY_SIZE = 32;
+
+    MockNvs() : failWrites(false), activePage(0), entryWrites(0)
+    {
+        for (int i = 0; i < PAGE_COUNT; i++)
+        {
+            used[i] = 0;
+            live[i] = 0;
+            erases[i] = 0;
+        }
+    }
+
+    size_t read(const char *key, void *data, size_t length) override
+    {
+        std::map<std::string, Item>::const_iterator it = items.find(key);
+        if (it == items.end() || it->second.value.size() > length)
+        {
+            return 0;
+        }
+        memcpy(data, it->second.value.data(), it->second.value.size());
+        return it->second.value.size();
+    }
+
+    bool write(const char *key, const void *data, size_t length) override
+    {
+        if (failWrites)
+        {
+            return false;
+        }
+
+        Item &item = items[key];
+        if (item.entries > 0)
+        {
+            live[item.page] -= item.entries;
+        }
+        item.value.assign((const uint8_t *)data, (const uint8_t *)data + length);
+        item.entries = entriesFor(length);
+        item.page = append(item.entries);
+        live[item.page] += item.entries;
+        return true;
+    }
+
+    uint32_t getMaxEraseCount() const
+    {
+        uint32_t highest = 0;
+        for (int i = 0; i < PAGE_COUNT; i++)
+        {
+            highest = erases[i] > highest ? erases[i] : highest;
+        }
+        return highest;
+    }
+
+    uint64_t getEntryWrites() const { return entryWrites; }
+
+    bool hasKey(const char *key) const { return items.count(key) > 0; }
+
+    // Simulate a torn or decayed value
+    void corrupt(const char *key, size_t offset)
+    {
+        items[key].value[offset] ^= 0x01;
+    }
+
+    // Blob header, blob index and the data itself
+    static int entriesFor(size_t length) { return 2 + (int)((length + ENTRY_SIZE - 1) / ENTRY_SIZE); }
+
+    bool failWrites;
+
+private:
+    struct Item
+    {
+        std::vector<uint8_t> value;
+        int page = 0;
+        int entries = 0;
+    };
+
+    std::map<std::string, Item> items;
+    int used[PAGE_COUNT];
+    int live[PAGE_COUNT];
+    uint32_t erases[PAGE_COUNT];
+    int activePage;
+    uint64_t entryWrites;
+
+    int append(int entries)
+    {
+        if (used[activePage] + entries > ENTRIES_PER_PAGE)
+        {
+            activePage = (activePage + 1) % PAGE_COUNT;
+            reclaim((activePage + 1) % PAGE_COUNT);
+        }
+        used[activePage] += entries;
+        entryWrites += entries;
+        return activePage;
+    }
+
+    // Move the oldest page's live items into the active page, then erase it
+    void reclaim(int page)
+    {
+        if (used[page] == 0)
+        {
+            return;
+        }
+        for (std::map<std::string, Item>::iterator it = items.begin(); it != items.end(); ++it)
+        {
+            if (it->second.page == page && it->second.entries > 0)
+            {
+                used[activePage] += it->second.entries;
+                live[activePage] += it->second.entries;
+                entryWrites += it->second.entries;
+                it->second.page = activePage;
+            }
+        }
+        used[page] = 0;
+        live[page] = 0;
+        erases[page]++;
+    }
+};
@@ -0,0 +1,312 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include "MockNvs.h"
+#include "PersistentCounters.h"
+#include "PowerFailRecord.h"
+
+MockNvs *nvs;
+PersistentCounters *counters;
+
+const unsigned long MINUTE_MS = 60000UL;
+const unsigned long HOUR_MS = 60 * MINUTE_MS;
+const unsigned long DAY_MS = 24 * HOUR_MS;
+const uint32_t FLASH_ENDURANCE_CYCLES = 100000; // Typical NOR flash sector rating
+
+void setUp(void)
+{
+    nvs = new MockNvs();
+    counters = new PersistentCounters(*nvs);
+}
+
+void tearDown(void)
+{
+    delete counters;
+    delete nvs;
+}
+
+// Nothing is written while nothing changes
+void test_idle_never_writes()
+{
+    for (unsigned long t = 0; t < 3 * DAY_MS; t += MINUTE_MS)
+    {
+        counters->update(t);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, counters->getWriteCount());
+    TEST_ASSERT_FALSE(counters->load());
+}
+
+// Small draws coalesce into one write after the max interval
+void test_small_draws_coalesce()
+{
+    uint64_t used = 0;
+    for (int draw = 0; draw < 5; draw++)
+    {
+        used += 250;
+        counters->setWaterUsed(used);
+        counters->update(draw * MINUTE_MS);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, counters->getWriteCount());
+    TEST_ASSERT_TRUE(counters->isDirty());
+
+    counters->update(15 * MINUTE_MS);
+    TEST_ASSERT_EQUAL_UINT32(1, counters->getWriteCount());
+    TEST_ASSERT_FALSE(counters->isDirty());
+}
+
+// Enough new usage is written without waiting for the interval
+void test_volume_threshold_writes()
+{
+    counters->setWaterUsed(4999);
+    TEST_ASSERT_FALSE(counters->update(1000));
+    counters->setWaterUsed(5000);
+    TEST_ASSERT_TRUE(counters->update(2000));
+
+    PersistentCounters restored(*nvs);
+    TEST_ASSERT_TRUE(restored.load());
+    TEST_ASSERT_TRUE(restored.getWaterUsed() == 5000);
+}
+
+// A filter reset is persisted once it has settled for a few seconds
+void test_filter_change_written_after_settle()
+{
+    counters->setFilterPercent(2, 100);
+    TEST_ASSERT_FALSE(counters->update(0));
+    TEST_ASSERT_FALSE(counters->update(4000));
+    TEST_ASSERT_TRUE(counters->update(5000));
+
+    PersistentCounters restored(*nvs);
+    restored.load();
+    TEST_ASSERT_EQUAL_UINT8(100, restored.getFilterPercent(2));
+}
+
+// Continuous heavy flow cannot exceed the daily write budget; the next day resets it
+void test_daily_budget_enforced()
+{
+    uint64_t used = 0;
+    unsigned long t = 0;
+    for (; t < DAY_MS; t += 1000)
+    {
+        used += 1000;
+        counters->setWaterUsed(used);
+        counters->update(t);
+    }
+    CounterWritePolicy policy;
+    TEST_ASSERT_EQUAL_UINT32(policy.dailyWriteBudget, counters->getWriteCount());
+    TEST_ASSERT_EQUAL_UINT32(1, counters->getBudgetExhaustions());
+    TEST_ASSERT_TRUE(counters->isDirty());
+
+    TEST_ASSERT_TRUE(counters->update(t));
+    TEST_ASSERT_EQUAL_UINT16(1, counters->getWritesToday());
+
+    // A forced flush (e.g. power loss) may still go over budget
+    TEST_ASSERT_TRUE(counters->flush(t) || !counters->isDirty());
+}
+
+// Writes rotate across all slots; a corrupt newest slot falls back to the previous one
+void test_slot_rotation_and_fallback()
+{
+    for (int i = 1; i <= PersistentCounters::SLOT_COUNT; i++)
+    {
+        counters->setWaterUsed(i * 1000);
+        TEST_ASSERT_TRUE(counters->flush(i * 1000));
+    }
+    TEST_ASSERT_TRUE(nvs->hasKey("ctr0"));
+    TEST_ASSERT_TRUE(nvs->hasKey("ctr1"));
+    TEST_ASSERT_TRUE(nvs->hasKey("ctr2"));
+    TEST_ASSERT_TRUE(nvs->hasKey("ctr3"));
+
+    PersistentCounters restored(*nvs);
+    TEST_ASSERT_TRUE(restored.load());
+    TEST_ASSERT_TRUE(restored.getWaterUsed() == 4000);
+
+    // Sequence 4 lives in slot 0
+    nvs->corrupt("ctr0", 10);
+    PersistentCounters fallback(*nvs);
+    TEST_ASSERT_TRUE(fallback.load());
+    TEST_ASSERT_TRUE(fallback.getWaterUsed() == 3000);
+    TEST_ASSERT_EQUAL_UINT32(3, fallback.getSequence());
+}
+
+// A failed write keeps the data dirty and retries after the interval
+void test_failed_write_retries()
+{
+    counters->setWaterUsed(6000);
+    nvs->failWrites = true;
+    TEST_ASSERT_FALSE(counters->update(0));
+    TEST_ASSERT_TRUE(counters->isDirty());
+
+    nvs->failWrites = false;
+    TEST_ASSERT_FALSE(counters->update(MINUTE_MS));
+    TEST_ASSERT_TRUE(counters->update(15 * MINUTE_MS));
+    TEST_ASSERT_FALSE(counters->isDirty());
+}
+
+// Usage below the write threshold survives power loss through the emergency record
+void test_power_fail_record_merged_on_boot()
+{
+    counters->setWaterUsed(5000);
+    counters->flush(0);
+    counters->setWaterUsed(5800);
+    counters->setFilterPercent(1, 100);
+    TEST_ASSERT_FALSE(counters->update(1000));
+
+    PowerFailRecord record;
+    record.prepare(*counters, 1234);
+    TEST_ASSERT_TRUE(record.hasPendingDelta());
+    uint8_t saved[PowerFailRecord::RECORD_SIZE];
+    memcpy(saved, record.data(), sizeof(saved)); // The single emergency write
+
+    PersistentCounters booted(*nvs);
+    booted.load();
+    TEST_ASSERT_TRUE(booted.getWaterUsed() == 5000);
+    TEST_ASSERT_TRUE(PowerFailRecord::merge(saved, sizeof(saved), booted));
+    TEST_ASSERT_TRUE(booted.getWaterUsed() == 5800);
+    TEST_ASSERT_EQUAL_UINT8(100, booted.getFilterPercent(1));
+    TEST_ASSERT_TRUE(booted.isDirty());
+}
+
+// A record older than the stored counters, or damaged, is ignored
+void test_power_fail_record_stale_or_corrupt()
+{
+    counters->setWaterUsed(1000);
+    counters->flush(0);
+    counters->setWaterUsed(1500);
+    PowerFailRecord record;
+    record.prepare(*counters, 0);
+    uint8_t saved[PowerFailRecord::RECORD_SIZE];
+    memcpy(saved, record.data(), sizeof(saved));
+
+    // The normal path wrote after the record was taken
+    counters->flush(1000);
+    PersistentCounters booted(*nvs);
+    booted.load();
+    TEST_ASSERT_FALSE(PowerFailRecord::merge(saved, sizeof(saved), booted));
+    TEST_ASSERT_TRUE(booted.getWaterUsed() == 1500);
+
+    saved[9] ^= 0x01;
+    PersistentCounters older(*nvs);
+    older.load();
+    TEST_ASSERT_FALSE(PowerFailRecord::merge(saved, sizeof(saved), older));
+}
+
+// Preparing a new image never touches the one currently published
+void test_power_fail_record_double_buffered()
+{
+    counters->setWaterUsed(100);
+    PowerFailRecord record;
+    record.prepare(*counters, 0);
+    const uint8_t *published = record.data();
+    uint8_t copy[PowerFailRecord::RECORD_SIZE];
+    memcpy(copy, published, sizeof(copy));
+
+    counters->setWaterUsed(200);
+    record.prepare(*counters, 1);
+    TEST_ASSERT_TRUE(record.data() != published);
+    TEST_ASSERT_EQUAL_MEMORY(copy, published, sizeof(copy));
+
+    // Nothing pending once the counters are written
+    counters->flush(0);
+    record.prepare(*counters, 2);
+    TEST_ASSERT_FALSE(record.hasPendingDelta());
+}
+
+// Simulate ten years of minute-by-minute operation against the flash model.
+// Besides the counters, the hourly rollup checkpoints (three ~1 KB blobs,
+// skipped when nothing was drawn) share the partition.
+uint32_t simulateTenYears(bool heavyUse)
+{
+    const int years = 10;
+    const size_t rollupSize = 936;
+    static uint8_t rollupBlob[rollupSize];
+    uint8_t pairing[512] = {0};
+    nvs->write("pairing", pairing, sizeof(pairing)); // Long-lived data that must be relocated
+
+    uint64_t used = 0;
+    uint64_t checkpointedUsage = 0;
+    for (unsigned long day = 0; day < 365UL * years; day++)
+    {
+        for (int minute = 0; minute < 24 * 60; minute++)
+        {
+            // Typical household: eight 1.5 L draws a day. Heavy: flow every waking minute.
+            bool drawing = heavyUse ? (minute >= 7 * 60 && minute < 23 * 60)
+                                    : (minute % 120 == 0 && minute >= 7 * 60);
+            if (drawing)
+            {
+                used += 1500;
+                counters->setWaterUsed(used);
+            }
+            if (minute == 9 * 60 && day % 30 == 0)
+            {
+                counters->setFilterPercent(day / 30 % 5, (uint8_t)(day % 100));
+            }
+
+            // Uptime wraps every ~49.7 days like millis()
+            unsigned long now = (unsigned long)(uint32_t)(day * DAY_MS + minute * MINUTE_MS);
+            counters->update(now);
+
+            if (minute % 60 == 59 && used != checkpointedUsage)
+            {
+                rollupBlob[0] = (uint8_t)used;
+                nvs->write("rollup_in", rollupBlob, rollupSize);
+                nvs->write("rollup", rollupBlob, rollupSize);
+                nvs->write("rollup_br", rollupBlob, rollupSize);
+                checkpointedUsage = used;
+            }
+        }
+    }
+
+    char message[160];
+    snprintf(message, sizeof(message), "%s use, %d years: %u counter writes, max page erases %u (%.1f%% of rating)",
+             heavyUse ? "Heavy" : "Typical", years, counters->getWriteCount(), nvs->getMaxEraseCount(),
+             100.0 * nvs->getMaxEraseCount() / FLASH_ENDURANCE_CYCLES);
+    TEST_MESSAGE(message);
+    return nvs->getMaxEraseCount();
+}
+
+// Typical use stays far below flash endurance for ten years
+void test_ten_year_lifetime_typical()
+{
+    uint32_t erases = simulateTenYears(false);
+    TEST_ASSERT_LESS_THAN(FLASH_ENDURANCE_CYCLES / 10, erases);
+}
+
+// Even flow all day every day stays within endurance thanks to the budget
+void test_ten_year_lifetime_heavy()
+{
+    uint32_t erases = simulateTenYears(true);
+    CounterWritePolicy policy;
+    TEST_ASSERT_LESS_OR_EQUAL(365UL * 10 * policy.dailyWriteBudget, counters->getWriteCount());
+    TEST_ASSERT_LESS_THAN(FLASH_ENDURANCE_CYCLES / 2, erases);
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_idle_never_writes);
+    RUN_TEST(test_small_draws_coalesce);
+    RUN_TEST(test_volume_threshold_writes);
+    RUN_TEST(test_filter_change_written_after_settle);
+    RUN_TEST(test_daily_budget_enforced);
+    RUN_TEST(test_slot_rotation_and_fallback);
+    RUN_TEST(test_failed_write_retries);
+    RUN_TEST(test_power_fail_record_merged_on_boot);
+    RUN_TEST(test_power_fail_record_stale_or_corrupt);
+    RUN_TEST(test_power_fail_record_double_buffered);
+    RUN_TEST(test_ten_year_lifetime_typical);
+    RUN_TEST(test_ten_year_lifetime_heavy);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
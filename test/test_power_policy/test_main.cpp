@@ -0,0 +1,151 @@
+#include <unity.h>
+#include "PowerPolicy.h"
+
+PowerPolicy policy;
+
+void setUp(void)
+{
+    policy = PowerPolicy();
+}
+
+void tearDown(void)
+{
+}
+
+// The first update always applies; unpaired with nothing going on sleeps deepest
+void test_idle_sleeps_deepest()
+{
+    TEST_ASSERT_TRUE(policy.update(1000, false, 0, false));
+    TEST_ASSERT_EQUAL(RadioPowerMode::MAX_MODEM, policy.getMode());
+    TEST_ASSERT_FALSE(policy.update(2000, false, 0, false));
+    TEST_ASSERT_EQUAL_UINT32(0, policy.getModeChanges());
+
+    // An open session alone, as a home hub keeps, only wakes for beacons
+    TEST_ASSERT_TRUE(policy.update(3000, false, 1, false));
+    TEST_ASSERT_EQUAL(RadioPowerMode::MIN_MODEM, policy.getMode());
+    TEST_ASSERT_EQUAL_STRING("min", radioPowerModeName(policy.getMode()));
+}
+
+// Buttons, requests and draws keep the radio awake for their hold time
+void test_activity_holds_awake()
+{
+    PowerPolicyConfig config = policy.getConfig();
+    policy.update(0, false, 1, false);
+
+    policy.noteButton(1000);
+    TEST_ASSERT_TRUE(policy.update(1000, false, 1, false));
+    TEST_ASSERT_EQUAL(RadioPowerMode::NO_SLEEP, policy.getMode());
+    policy.update(1000 + config.buttonHoldMs - 1, false, 1, false);
+    TEST_ASSERT_EQUAL(RadioPowerMode::NO_SLEEP, policy.getMode());
+    policy.update(1000 + config.buttonHoldMs, false, 1, false);
+    TEST_ASSERT_EQUAL(RadioPowerMode::MIN_MODEM, policy.getMode());
+
+    unsigned long now = 200000;
+    policy.noteRequest(now, 20);
+    policy.update(now + config.requestHoldMs - 1, false, 0, false);
+    TEST_ASSERT_EQUAL(RadioPowerMode::NO_SLEEP, policy.getMode());
+    policy.update(now + config.requestHoldMs, false, 0, false);
+    TEST_ASSERT_EQUAL(RadioPowerMode::MAX_MODEM, policy.getMode());
+
+    // The hold starts when the draw ends
+    now = 400000;
+    policy.update(now, false, 0, true);
+    policy.update(now + 120000, false, 0, true);
+    TEST_ASSERT_EQUAL(RadioPowerMode::NO_SLEEP, policy.getMode());
+    policy.update(now + 120000 + config.drawHoldMs - 1, false, 0, false);
+    TEST_ASSERT_EQUAL(RadioPowerMode::NO_SLEEP, policy.getMode());
+    policy.update(now + 120000 + config.drawHoldMs, false, 0, false);
+    TEST_ASSERT_EQUAL(RadioPowerMode::MAX_MODEM, policy.getMode());
+    TEST_ASSERT_EQUAL_UINT32(6, policy.getModeChanges());
+}
+
+// Requests are recorded against the mode that served them
+void test_latency_per_mode()
+{
+    policy.update(0, false, 1, false);
+    policy.noteRequest(10, 40); // First of a burst, served in min modem
+    policy.update(10, false, 1, false);
+    policy.noteRequest(20, 8);
+    policy.noteRequest(30, 12);
+    policy.noteRequest(40, 600);
+
+    const LatencyStats &awake = policy.getStats(RadioPowerMode::NO_SLEEP).latency;
+    const LatencyStats &light = policy.getStats(RadioPowerMode::MIN_MODEM).latency;
+    TEST_ASSERT_EQUAL_UINT32(1, light.count);
+    TEST_ASSERT_EQUAL_UINT16(40, light.maxMs);
+    TEST_ASSERT_EQUAL_UINT32(3, awake.count);
+    TEST_ASSERT_EQUAL_UINT32(1, awake.slow);
+    TEST_ASSERT_EQUAL_UINT16(206, awake.getAverage());
+    TEST_ASSERT_EQUAL_UINT16(600, awake.maxMs);
+
+    // Percentiles report the bucket bound, capped at the worst seen
+    TEST_ASSERT_EQUAL_UINT16(10, awake.getPercentile(33));
+    TEST_ASSERT_EQUAL_UINT16(25, awake.getPercentile(50));
+    TEST_ASSERT_EQUAL_UINT16(600, awake.getPercentile(90));
+    TEST_ASSERT_EQUAL_UINT16(40, light.getPercentile(90));
+    TEST_ASSERT_EQUAL_UINT16(0, policy.getStats(RadioPowerMode::MAX_MODEM).latency.getPercentile(90));
+}
+
+// A paired accessory never sleeps through the beacons that carry mDNS
+void test_paired_stays_min_modem()
+{
+    policy.update(0, true, 0, false);
+    TEST_ASSERT_EQUAL(RadioPowerMode::MIN_MODEM, policy.getMode());
+
+    // Slow requests are only recorded; they no longer move the level
+    for (int i = 0; i < 5; i++)
+    {
+        policy.noteRequest(i * 20000, policy.getConfig().latencyTargetMs + 50);
+        policy.update(i * 20000 + policy.getConfig().requestHoldMs, true, 1, false);
+        TEST_ASSERT_EQUAL(RadioPowerMode::MIN_MODEM, policy.getMode());
+    }
+    TEST_ASSERT_EQUAL_UINT32(5, policy.getStats(RadioPowerMode::MIN_MODEM).latency.slow);
+
+    // Unpaired and idle sleeps deepest again
+    TEST_ASSERT_TRUE(policy.update(200000, false, 0, false));
+    TEST_ASSERT_EQUAL(RadioPowerMode::MAX_MODEM, policy.getMode());
+}
+
+// Time is split by mode and radio-on time estimated from the duty cycles
+void test_radio_on_estimate()
+{
+    policy.update(0, false, 0, false);
+    policy.update(600000, false, 1, false); // 10 min in max modem
+    policy.update(900000, false, 1, false); // 5 min in min modem
+    policy.noteButton(900000);
+    policy.update(900000, false, 1, false);
+    policy.update(960000, false, 1, false); // 1 min awake
+
+    TEST_ASSERT_EQUAL_UINT64(600000, policy.getStats(RadioPowerMode::MAX_MODEM).timeMs);
+    TEST_ASSERT_EQUAL_UINT64(300000, policy.getStats(RadioPowerMode::MIN_MODEM).timeMs);
+    TEST_ASSERT_EQUAL_UINT64(60000, policy.getStats(RadioPowerMode::NO_SLEEP).timeMs);
+    TEST_ASSERT_EQUAL_UINT64(9000, policy.getRadioOnMs(RadioPowerMode::MAX_MODEM));
+    TEST_ASSERT_EQUAL_UINT64(12000, policy.getRadioOnMs(RadioPowerMode::MIN_MODEM));
+    TEST_ASSERT_EQUAL_UINT64(60000, policy.getRadioOnMs(RadioPowerMode::NO_SLEEP));
+    TEST_ASSERT_EQUAL_UINT16(84, policy.getRadioOnPermille()); // 81 s of 960 s
+    TEST_ASSERT_EQUAL_UINT32(1, policy.getStats(RadioPowerMode::NO_SLEEP).entries);
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_idle_sleeps_deepest);
+    RUN_TEST(test_activity_holds_awake);
+    RUN_TEST(test_latency_per_mode);
+    RUN_TEST(test_paired_stays_min_modem);
+    RUN_TEST(test_radio_on_estimate);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include <unity.h>
+#include "PublishedValue.h"
+
+UpdateStats stats;
+
+void setUp(void)
+{
+    stats = UpdateStats();
+}
+
+void tearDown(void)
+{
+}
+
+// The first value is always sent, repeats never are
+void test_first_sent_repeats_suppressed()
+{
+    PublishedValue value;
+    TEST_ASSERT_TRUE(value.offer(80, stats));
+    for (int i = 0; i < 99; i++)
+    {
+        TEST_ASSERT_FALSE(value.offer(80, stats));
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, stats.sent);
+    TEST_ASSERT_EQUAL_UINT32(99, stats.suppressed);
+}
+
+// Without hysteresis any real change is sent
+void test_any_change_sent()
+{
+    PublishedValue value;
+    value.offer(80, stats);
+    TEST_ASSERT_TRUE(value.offer(79, stats));
+    TEST_ASSERT_TRUE(value.offer(80, stats));
+    TEST_ASSERT_EQUAL_FLOAT(80, value.getPublished());
+}
+
+// Changes smaller than the step are held back until they add up
+void test_hysteresis_accumulates_from_last_sent()
+{
+    PublishedValue value(1.0f);
+    value.offer(50.0f, stats);
+    TEST_ASSERT_FALSE(value.offer(50.4f, stats));
+    TEST_ASSERT_FALSE(value.offer(50.8f, stats));
+    TEST_ASSERT_TRUE(value.offer(51.0f, stats));
+    TEST_ASSERT_EQUAL_FLOAT(51.0f, value.getPublished());
+    TEST_ASSERT_FALSE(value.offer(50.2f, stats));
+    TEST_ASSERT_TRUE(value.offer(49.9f, stats));
+}
+
+// Noise around a rounding boundary does not flap the published value
+void test_noise_at_boundary_suppressed()
+{
+    PublishedValue value(1.0f);
+    value.offer(49.5f, stats);
+    for (int i = 0; i < 1000; i++)
+    {
+        value.offer(i % 2 ? 49.4f : 49.6f, stats);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, stats.sent);
+    TEST_ASSERT_EQUAL_UINT32(1000, stats.suppressed);
+}
+
+// forget() makes the next value go out, e.g. after a reconnect
+void test_forget_resends()
+{
+    PublishedValue value;
+    value.offer(10, stats);
+    value.forget();
+    TEST_ASSERT_FALSE(value.hasPublished());
+    TEST_ASSERT_TRUE(value.offer(10, stats));
+}
+
+// A 100 ms loop with five filters and a usage sensor: only changes go out
+void test_loop_traffic()
+{
+    PublishedValue life[5];
+    PublishedValue change[5];
+    PublishedValue usage(0.5f);
+
+    float liters = 1200;
+    for (int tick = 0; tick < 36000; tick++) // One hour
+    {
+        liters += 0.001f; // Slow draw, about 3.6 L an hour
+        for (int i = 0; i < 5; i++)
+        {
+            life[i].offer(80 - i, stats);
+            change[i].offer(0, stats);
+        }
+        usage.offer(liters / 10.0f, stats);
+    }
+
+    // 11 initial values and a handful of usage steps, out of 396000 offers
+    TEST_ASSERT_LESS_THAN(20, stats.sent);
+    TEST_ASSERT_EQUAL_UINT32(36000 * 11, stats.sent + stats.suppressed);
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_first_sent_repeats_suppressed);
+    RUN_TEST(test_any_change_sent);
+    RUN_TEST(test_hysteresis_accumulates_from_last_sent);
+    RUN_TEST(test_noise_at_boundary_suppressed);
+    RUN_TEST(test_forget_resends);
+    RUN_TEST(test_loop_traffic);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ResumeSnapshot.h"
+
+uint8_t region[3072];
+
+void setUp(void)
+{
+    memset(region, 0, sizeof(region));
+}
+
+void tearDown(void)
+{
+}
+
+// Fill and commit a payload of the given length
+void writePayload(ResumeSnapshot &snapshot, size_t length, uint8_t seed)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        snapshot.payload()[i] = (uint8_t)(seed + i * 7);
+    }
+    TEST_ASSERT_TRUE(snapshot.commit(length));
+}
+
+// A committed payload reads back intact
+void test_round_trip()
+{
+    ResumeSnapshot snapshot(region, sizeof(region), 1);
+    writePayload(snapshot, 1000, 3);
+
+    ResumeSnapshot afterReset(region, sizeof(region), 1);
+    size_t length;
+    const uint8_t *payload = afterReset.getPayload(length);
+    TEST_ASSERT_NOT_NULL(payload);
+    TEST_ASSERT_EQUAL(1000, length);
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)(3 + 999 * 7), payload[999]);
+}
+
+// Power-on contents are random and must never pass as a snapshot
+void test_power_on_garbage_rejected()
+{
+    srand(11);
+    for (int round = 0; round < 1000; round++)
+    {
+        for (size_t i = 0; i < sizeof(region); i++)
+        {
+            region[i] = (uint8_t)rand();
+        }
+        ResumeSnapshot snapshot(region, sizeof(region), 1);
+        TEST_ASSERT_FALSE(snapshot.isValid());
+    }
+}
+
+// Any flipped bit in header or payload invalidates the snapshot
+void test_corruption_detected()
+{
+    ResumeSnapshot snapshot(region, sizeof(region), 1);
+    writePayload(snapshot, 200, 9);
+
+    for (size_t i = 0; i < ResumeSnapshot::HEADER_SIZE + 200; i++)
+    {
+        region[i] ^= 0x04;
+        TEST_ASSERT_FALSE(snapshot.isValid());
+        region[i] ^= 0x04;
+    }
+    TEST_ASSERT_TRUE(snapshot.isValid());
+}
+
+// A reset halfway through a refresh leaves an invalid snapshot, not a mixed one
+void test_torn_refresh_rejected()
+{
+    ResumeSnapshot snapshot(region, sizeof(region), 1);
+    writePayload(snapshot, 100, 1);
+    snapshot.payload()[50] ^= 0xFF; // Payload updated, commit() never ran
+    TEST_ASSERT_FALSE(snapshot.isValid());
+}
+
+// Firmware with a different payload layout ignores the old snapshot
+void test_layout_version_mismatch()
+{
+    ResumeSnapshot oldFirmware(region, sizeof(region), 1);
+    writePayload(oldFirmware, 100, 1);
+
+    ResumeSnapshot newFirmware(region, sizeof(region), 2);
+    TEST_ASSERT_FALSE(newFirmware.isValid());
+}
+
+// Payloads larger than the region are refused; invalidate() clears it
+void test_capacity_and_invalidate()
+{
+    ResumeSnapshot snapshot(region, sizeof(region), 1);
+    TEST_ASSERT_FALSE(snapshot.commit(snapshot.getCapacity() + 1));
+    writePayload(snapshot, snapshot.getCapacity(), 5);
+    TEST_ASSERT_TRUE(snapshot.isValid());
+
+    snapshot.invalidate();
+    TEST_ASSERT_FALSE(snapshot.isValid());
+}
+
+// Refresh count grows across commits of the same snapshot
+void test_refresh_count()
+{
+    ResumeSnapshot snapshot(region, sizeof(region), 1);
+    writePayload(snapshot, 10, 0);
+    writePayload(snapshot, 10, 1);
+    writePayload(snapshot, 10, 2);
+    TEST_ASSERT_EQUAL_UINT32(3, snapshot.getRefreshCount());
+}
+
+// Benchmark: refresh cost for a full-size snapshot
+void test_benchmark_refresh()
+{
+    ResumeSnapshot snapshot(region, sizeof(region), 1);
+    const int iterations = 20000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        snapshot.payload()[i % 100] = (uint8_t)i;
+        snapshot.commit(snapshot.getCapacity());
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double microseconds = std::chrono::duration<double>(elapsed).count() * 1e6 / iterations;
+
+    char message[96];
+    snprintf(message, sizeof(message), "Commit of %u bytes: %.2f us on host", (unsigned)snapshot.getCapacity(),
+             microseconds);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(snapshot.isValid());
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_power_on_garbage_rejected);
+    RUN_TEST(test_corruption_detected);
+    RUN_TEST(test_torn_refresh_rejected);
+    RUN_TEST(test_layout_version_mismatch);
+    RUN_TEST(test_capacity_and_invalidate);
+    RUN_TEST(test_refresh_count);
+    RUN_TEST(test_benchmark_refresh);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include "SharedState.h"
+
+// Every field carries the same stamp, so a torn copy shows up as a mismatch
+struct Stamped
+{
+    uint32_t stamp[24];
+};
+
+Seqlock<Stamped> *lock;
+
+void setUp(void)
+{
+    lock = new Seqlock<Stamped>();
+}
+
+void tearDown(void)
+{
+    delete lock;
+}
+
+Stamped makeStamped(uint32_t stamp)
+{
+    Stamped value;
+    for (int i = 0; i < 24; i++)
+    {
+        value.stamp[i] = stamp;
+    }
+    return value;
+}
+
+// Single-threaded: what is written is what is read
+void test_write_then_read()
+{
+    Stamped out;
+    lock->read(out);
+    TEST_ASSERT_EQUAL_UINT32(0, out.stamp[0]);
+
+    lock->write(makeStamped(7));
+    uint32_t sequence = lock->read(out);
+    TEST_ASSERT_EQUAL_UINT32(7, out.stamp[23]);
+    TEST_ASSERT_EQUAL_UINT32(2, sequence);
+}
+
+// A writer hammering the snapshot never lets readers see a torn copy
+void test_concurrent_readers_never_torn()
+{
+    std::atomic<bool> done(false);
+    std::atomic<uint32_t> torn(0);
+    std::atomic<uint32_t> reads(0);
+
+    auto reader = [&]() {
+        uint32_t lastStamp = 0;
+        while (!done.load())
+        {
+            Stamped out;
+            lock->read(out);
+            for (int i = 1; i < 24; i++)
+            {
+                if (out.stamp[i] != out.stamp[0])
+                {
+                    torn++;
+                    break;
+                }
+            }
+            if (out.stamp[0] < lastStamp)
+            {
+                torn++; // Went backwards
+            }
+            lastStamp = out.stamp[0];
+            reads++;
+        }
+    };
+
+    std::thread first(reader);
+    std::thread second(reader);
+    while (reads.load() == 0)
+    {
+        std::this_thread::yield(); // On a single core the writer could otherwise finish first
+    }
+    for (uint32_t stamp = 1; stamp <= 20000; stamp++)
+    {
+        lock->write(makeStamped(stamp));
+    }
+    done = true;
+    first.join();
+    second.join();
+
+    TEST_ASSERT_EQUAL_UINT32(0, torn.load());
+    TEST_ASSERT_GREATER_THAN(0, reads.load());
+    TEST_ASSERT_EQUAL_UINT32(40000, lock->getSequence());
+}
+
+// Queue keeps order and refuses to overfill
+void test_queue_order_and_capacity()
+{
+    SpscQueue<int, 4> queue;
+    TEST_ASSERT_TRUE(queue.push(1));
+    TEST_ASSERT_TRUE(queue.push(2));
+    TEST_ASSERT_TRUE(queue.push(3));
+    TEST_ASSERT_FALSE(queue.push(4));
+
+    int item;
+    TEST_ASSERT_TRUE(queue.pop(item));
+    TEST_ASSERT_EQUAL(1, item);
+    TEST_ASSERT_TRUE(queue.push(4));
+    TEST_ASSERT_TRUE(queue.pop(item));
+    TEST_ASSERT_TRUE(queue.pop(item));
+    TEST_ASSERT_TRUE(queue.pop(item));
+    TEST_ASSERT_EQUAL(4, item);
+    TEST_ASSERT_FALSE(queue.pop(item));
+}
+
+// Producer and consumer threads: nothing lost, nothing reordered
+void test_queue_across_threads()
+{
+    SpscQueue<uint32_t, 8> queue;
+    const uint32_t count = 20000;
+
+    std::thread producer([&]() {
+        for (uint32_t i = 1; i <= count; i++)
+        {
+            while (!queue.push(i))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t expected = 1;
+    uint32_t outOfOrder = 0;
+    while (expected <= count)
+    {
+        uint32_t item;
+        if (queue.pop(item))
+        {
+            if (item != expected)
+            {
+                outOfOrder++;
+            }
+            expected++;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    TEST_ASSERT_EQUAL_UINT32(0, outOfOrder);
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_write_then_read);
+    RUN_TEST(test_concurrent_readers_never_torn);
+    RUN_TEST(test_queue_order_and_capacity);
+    RUN_TEST(test_queue_across_threads);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
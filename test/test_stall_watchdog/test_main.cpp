@@ -0,0 +1,167 @@
+#include <unity.h>
+#include <string.h>
+#include "StallWatchdog.h"
+
+enum TestPhase : uint8_t
+{
+    PHASE_INPUT,
+    PHASE_DISPLAY,
+    PHASE_IDLE,
+    PHASE_COUNT
+};
+
+const StallPhase phases[PHASE_COUNT] = {
+    {"input", 200},
+    {"display", 500},
+    {"idle", 0}}; // Never a stall
+
+BreadcrumbTrail trail;
+StallWatchdog *watchdog;
+
+void setUp(void)
+{
+    beginTrail(trail);
+    watchdog = new StallWatchdog();
+}
+
+void tearDown(void)
+{
+    delete watchdog;
+}
+
+// Markers fill the ring in order and bump the sequence
+void test_markers_fill_ring()
+{
+    TEST_ASSERT_FALSE(isTrailValid(trail, PHASE_COUNT)); // No marker yet
+    for (uint32_t i = 0; i < BREADCRUMB_COUNT + 3; i++)
+    {
+        markPhase(trail, i % 2 ? PHASE_DISPLAY : PHASE_INPUT, i * 1000);
+    }
+    TEST_ASSERT_EQUAL_UINT32(BREADCRUMB_COUNT + 3, trail.sequence);
+    TEST_ASSERT_EQUAL(PHASE_INPUT, trail.phase);
+    TEST_ASSERT_EQUAL_UINT32((BREADCRUMB_COUNT + 2) * 1000, trail.crumbs[(trail.head - 1) & (BREADCRUMB_COUNT - 1)].stamp);
+    TEST_ASSERT_TRUE(isTrailValid(trail, PHASE_COUNT));
+}
+
+// A phase past its limit is flagged once; moving on clears it
+void test_stall_detected_and_cleared()
+{
+    watchdog->watch(trail, "loop", phases, PHASE_COUNT, 0);
+    markPhase(trail, PHASE_INPUT, 0);
+    TEST_ASSERT_EQUAL(STALL_NONE, watchdog->check(100));
+    TEST_ASSERT_EQUAL(STALL_NONE, watchdog->check(300)); // Sequence moved at the first check
+
+    TEST_ASSERT_EQUAL(STALL_DETECTED, watchdog->check(400));
+    TEST_ASSERT_EQUAL(PHASE_INPUT, trail.stalledPhase);
+    TEST_ASSERT_EQUAL_UINT32(300, trail.phaseMs);
+    TEST_ASSERT_EQUAL(STALL_NONE, watchdog->check(500)); // Already reported
+    TEST_ASSERT_EQUAL_UINT32(1, watchdog->getStallCount());
+
+    markPhase(trail, PHASE_DISPLAY, 0);
+    TEST_ASSERT_EQUAL(STALL_NONE, watchdog->check(600));
+    TEST_ASSERT_EQUAL(STALL_NO_PHASE, trail.stalledPhase);
+
+    // The watchdog still holds the stall for a report once the task is back
+    TEST_ASSERT_EQUAL(0, watchdog->getLastStalledTrail());
+    TEST_ASSERT_EQUAL(PHASE_INPUT, watchdog->getLastStalledPhase());
+    TEST_ASSERT_EQUAL_UINT32(400, watchdog->getLastStallMs());
+    TEST_ASSERT_EQUAL_UINT32(600, trail.uptimeMs);
+}
+
+// Limits are per phase; a zero limit never stalls
+void test_per_phase_limits()
+{
+    int id = watchdog->watch(trail, "loop", phases, PHASE_COUNT, 0);
+    markPhase(trail, PHASE_DISPLAY, 0);
+    watchdog->check(0);
+    TEST_ASSERT_EQUAL(STALL_NONE, watchdog->check(450)); // Input's limit would have fired
+    TEST_ASSERT_EQUAL(STALL_DETECTED, watchdog->check(550));
+
+    markPhase(trail, PHASE_IDLE, 0);
+    watchdog->check(600);
+    TEST_ASSERT_EQUAL(STALL_NONE, watchdog->check(60000));
+
+    watchdog->setLimit(id, PHASE_IDLE, 1000);
+    TEST_ASSERT_EQUAL_UINT32(1000, watchdog->getLimit(id, PHASE_IDLE));
+    TEST_ASSERT_EQUAL(STALL_DETECTED, watchdog->check(60001));
+    TEST_ASSERT_EQUAL_STRING("idle", watchdog->getPhaseName(id, trail.stalledPhase));
+}
+
+// With a restart grace, a stall that outlasts it asks for a restart
+void test_restart_after_grace()
+{
+    watchdog->setRestartAfterMs(2000);
+    watchdog->watch(trail, "loop", phases, PHASE_COUNT, 0);
+    markPhase(trail, PHASE_INPUT, 0);
+    watchdog->check(0);
+    TEST_ASSERT_EQUAL(STALL_DETECTED, watchdog->check(300));
+    TEST_ASSERT_EQUAL(STALL_NONE, watchdog->check(2200));
+    TEST_ASSERT_EQUAL(STALL_RESTART, watchdog->check(2300));
+}
+
+// Two trails are watched independently
+void test_two_trails()
+{
+    BreadcrumbTrail other;
+    beginTrail(other);
+    watchdog->watch(trail, "loop", phases, PHASE_COUNT, 0);
+    TEST_ASSERT_EQUAL(1, watchdog->watch(other, "homekit", phases, PHASE_COUNT, 0));
+    TEST_ASSERT_EQUAL(-1, watchdog->watch(other, "third", phases, PHASE_COUNT, 0));
+
+    markPhase(trail, PHASE_INPUT, 0);
+    markPhase(other, PHASE_INPUT, 0);
+    watchdog->check(0);
+    for (uint32_t now = 100; now <= 1000; now += 100)
+    {
+        markPhase(trail, PHASE_INPUT, now); // The loop keeps going
+        watchdog->check(now);
+    }
+    TEST_ASSERT_EQUAL(1, watchdog->getLastStalledTrail());
+    TEST_ASSERT_EQUAL_STRING("homekit", watchdog->getTaskName(1));
+    TEST_ASSERT_EQUAL(STALL_NO_PHASE, trail.stalledPhase);
+}
+
+// The report lists crumbs oldest first with the time each phase took
+void test_format_trail()
+{
+    markPhase(trail, PHASE_INPUT, 0);
+    markPhase(trail, PHASE_DISPLAY, 2400); // 10 us at 240 cycles per us
+    markPhase(trail, PHASE_INPUT, 2400 + 4800000);
+    trail.phaseMs = 700;
+
+    char report[256];
+    formatTrail(trail, phases, PHASE_COUNT, 240000, report, sizeof(report));
+    TEST_ASSERT_NOT_NULL(strstr(report, "input             0.010 ms"));
+    TEST_ASSERT_NOT_NULL(strstr(report, "display          20.000 ms"));
+    TEST_ASSERT_NOT_NULL(strstr(report, "input           700 ms, still running"));
+    TEST_ASSERT_TRUE(strstr(report, "display") < strstr(report, "still running"));
+
+    char small[20];
+    size_t length = formatTrail(trail, phases, PHASE_COUNT, 240000, small, sizeof(small));
+    TEST_ASSERT_EQUAL(strlen(small), length);
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_markers_fill_ring);
+    RUN_TEST(test_stall_detected_and_cleared);
+    RUN_TEST(test_per_phase_limits);
+    RUN_TEST(test_restart_after_grace);
+    RUN_TEST(test_two_trails);
+    RUN_TEST(test_format_trail);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
@@ -0,0 +1,216 @@
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include "SystemMonitor.h"
+
+SystemMonitor *monitor;
+
+// A two-core system: both idle tasks, the Arduino loop and HomeSpan
+TaskSnapshot tasks[4];
+uint32_t clockNow;
+
+void setTask(int index, uint32_t id, const char *name, int8_t core, uint32_t stackFree)
+{
+    tasks[index].id = id;
+    tasks[index].name = name;
+    tasks[index].core = core;
+    tasks[index].runTime = 0;
+    tasks[index].stackFree = stackFree;
+}
+
+// Advances the clock one second, giving each task its share in permille
+void runSecond(const uint16_t *permille)
+{
+    clockNow += 1000000;
+    for (int i = 0; i < 4; i++)
+    {
+        tasks[i].runTime += permille[i] * 1000;
+    }
+    monitor->update(clockNow, tasks, 4);
+}
+
+void setUp(void)
+{
+    monitor = new SystemMonitor();
+    clockNow = 5000000;
+    setTask(0, 1, "IDLE0", 0, 900);
+    setTask(1, 2, "IDLE1", 1, 900);
+    setTask(2, 7, "loopTask", 1, 5200);
+    setTask(3, 9, "homeSpan", 0, 2100);
+}
+
+void tearDown(void)
+{
+    delete monitor;
+}
+
+// Task shares come from counter deltas; core load is what the idle task did not get
+void test_recent_shares()
+{
+    monitor->update(clockNow, tasks, 4);
+    TEST_ASSERT_FALSE(monitor->hasCpuData());
+    TEST_ASSERT_EQUAL(SystemMonitor::UNKNOWN, monitor->getCoreLoad(0, false));
+
+    const uint16_t busy[] = {750, 600, 400, 250};
+    runSecond(busy);
+    TEST_ASSERT_TRUE(monitor->hasCpuData());
+    TEST_ASSERT_EQUAL(4, monitor->getTaskCount());
+    TEST_ASSERT_EQUAL_UINT16(250, monitor->getCoreLoad(0, false));
+    TEST_ASSERT_EQUAL_UINT16(400, monitor->getCoreLoad(1, false));
+    TEST_ASSERT_EQUAL_UINT16(400, monitor->getTask(2).recentPermille);
+    TEST_ASSERT_EQUAL_STRING("homeSpan", monitor->getTask(3).name);
+    TEST_ASSERT_EQUAL_UINT16(250, monitor->getTask(3).recentPermille);
+}
+
+// The rolling window averages over the checkpoints while the recent share follows the last second
+void test_rolling_window()
+{
+    monitor->update(clockNow, tasks, 4);
+    const uint16_t quiet[] = {900, 900, 100, 100};
+    const uint16_t busy[] = {300, 900, 100, 700};
+    for (int i = 0; i < SystemMonitor::WINDOW_CHECKPOINTS * SystemMonitor::CHECKPOINT_SAMPLES; i++)
+    {
+        runSecond(quiet);
+    }
+    for (int i = 0; i < SystemMonitor::CHECKPOINT_SAMPLES; i++)
+    {
+        runSecond(busy);
+    }
+    TEST_ASSERT_EQUAL_UINT16(700, monitor->getCoreLoad(0, false));
+    TEST_ASSERT_EQUAL_UINT16(700, monitor->getTask(3).recentPermille);
+
+    // Window: the last 60 s, 10 of them busy
+    TEST_ASSERT_EQUAL_UINT16(200, monitor->getCoreLoad(0, true));
+    TEST_ASSERT_EQUAL_UINT16(200, monitor->getTask(3).windowPermille);
+    TEST_ASSERT_EQUAL_UINT16(100, monitor->getCoreLoad(1, true));
+}
+
+// Stack headroom keeps the lowest mark, and the tightest task sorts first
+void test_stack_headroom()
+{
+    monitor->update(clockNow, tasks, 4);
+    tasks[2].stackFree = 300;
+    const uint16_t busy[] = {500, 500, 500, 500};
+    runSecond(busy);
+    tasks[2].stackFree = 4000; // High-water marks never rise; ignore a bogus reading
+    runSecond(busy);
+
+    TEST_ASSERT_EQUAL_UINT32(300, monitor->getTask(2).stackFree);
+    TEST_ASSERT_EQUAL(2, monitor->findLowestStack());
+
+    uint8_t order[SystemMonitor::MAX_TASKS];
+    TEST_ASSERT_EQUAL(4, monitor->sortByStack(order, SystemMonitor::MAX_TASKS));
+    TEST_ASSERT_EQUAL(2, order[0]);
+    TEST_ASSERT_EQUAL_UINT32(900, monitor->getTask(order[1]).stackFree);
+    TEST_ASSERT_EQUAL_UINT32(2100, monitor->getTask(order[3]).stackFree);
+
+    // A short list keeps only the tightest tasks
+    TEST_ASSERT_EQUAL(2, monitor->sortByStack(order, 2));
+    TEST_ASSERT_EQUAL(2, order[0]);
+    TEST_ASSERT_EQUAL_UINT32(900, monitor->getTask(order[1]).stackFree);
+}
+
+// A deleted task frees its slot for the next new one
+void test_task_churn()
+{
+    monitor->update(clockNow, tasks, 4);
+    setTask(3, 12, "ota", -1, 1500);
+    const uint16_t busy[] = {500, 500, 100, 0};
+    runSecond(busy);
+    TEST_ASSERT_EQUAL(4, monitor->getTaskCount());
+    TEST_ASSERT_EQUAL_STRING("ota", monitor->getTask(3).name);
+    TEST_ASSERT_EQUAL(-1, monitor->getTask(3).core);
+    TEST_ASSERT_EQUAL_UINT16(500, monitor->getCoreLoad(0, false));
+}
+
+// More tasks than slots: the extras are skipped, the tracked ones stay correct
+void test_more_tasks_than_slots()
+{
+    TaskSnapshot many[SystemMonitor::MAX_TASKS + 4];
+    char names[SystemMonitor::MAX_TASKS + 4][8];
+    for (int i = 0; i < SystemMonitor::MAX_TASKS + 4; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "t%d", i);
+        many[i].id = 100 + i;
+        many[i].name = names[i];
+        many[i].core = 0;
+        many[i].runTime = 0;
+        many[i].stackFree = 1000;
+    }
+    monitor->update(0, many, SystemMonitor::MAX_TASKS + 4);
+    many[0].runTime = 500000;
+    monitor->update(1000000, many, SystemMonitor::MAX_TASKS + 4);
+    TEST_ASSERT_EQUAL(SystemMonitor::MAX_TASKS, monitor->getTaskCount());
+    TEST_ASSERT_EQUAL_UINT16(500, monitor->getTask(0).recentPermille);
+}
+
+// Sampling cost is reported against the time covered
+void test_overhead_report()
+{
+    monitor->update(clockNow, tasks, 4);
+    const uint16_t busy[] = {500, 500, 500, 500};
+    for (int i = 0; i < 10; i++)
+    {
+        runSecond(busy);
+        monitor->addSampleCost(60);
+    }
+    TEST_ASSERT_EQUAL_UINT32(60, monitor->getOverheadPpm());
+}
+
+// One update with a full task table, to keep the budget visible
+void test_benchmark_update()
+{
+    TaskSnapshot many[SystemMonitor::MAX_TASKS];
+    for (int i = 0; i < SystemMonitor::MAX_TASKS; i++)
+    {
+        many[i].id = i;
+        many[i].name = "task";
+        many[i].core = i % 2;
+        many[i].runTime = 0;
+        many[i].stackFree = 1000 + i;
+    }
+    const int rounds = 100000;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 1; round <= rounds; round++)
+    {
+        for (int i = 0; i < SystemMonitor::MAX_TASKS; i++)
+        {
+            many[i].runTime += 1000 * (i + 1);
+        }
+        monitor->update(round * 1000000u, many, SystemMonitor::MAX_TASKS);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    char message[96];
+    snprintf(message, sizeof(message), "%d tasks: %.2f us per update", SystemMonitor::MAX_TASKS,
+             seconds * 1e6 / rounds);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL_UINT16(16, monitor->getTask(15).recentPermille);
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_recent_shares);
+    RUN_TEST(test_rolling_window);
+    RUN_TEST(test_stack_headroom);
+    RUN_TEST(test_task_churn);
+    RUN_TEST(test_more_tasks_than_slots);
+    RUN_TEST(test_overhead_report);
+    RUN_TEST(test_benchmark_update);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
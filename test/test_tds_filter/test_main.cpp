@@ -0,0 +1,174 @@
+#include <unity.h>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include "TdsFilter.h"
+
+TdsCalibration calibration;
+
+void setUp(void)
+{
+    calibration = TdsCalibration();
+}
+
+void tearDown(void)
+{
+}
+
+// Quickselect median matches a full sort for random, sorted and constant blocks
+void test_block_median_matches_sort()
+{
+    srand(7);
+    uint16_t block[101];
+    uint16_t sorted[101];
+    for (int round = 0; round < 500; round++)
+    {
+        size_t count = 1 + rand() % 101;
+        int pattern = round % 4;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (pattern == 0)
+                block[i] = rand() % 4096;
+            else if (pattern == 1)
+                block[i] = (uint16_t)i;
+            else if (pattern == 2)
+                block[i] = (uint16_t)(count - i);
+            else
+                block[i] = 1234 + rand() % 3;
+            sorted[i] = block[i];
+        }
+        std::sort(sorted, sorted + count);
+        TEST_ASSERT_EQUAL_UINT16(sorted[count / 2], tdsBlockMedian(block, count));
+    }
+}
+
+// Spikes in a block do not move the median
+void test_block_median_rejects_spikes()
+{
+    uint16_t block[16];
+    for (int i = 0; i < 16; i++)
+    {
+        block[i] = 1000 + (i % 3);
+    }
+    block[3] = 4095;
+    block[9] = 0;
+    block[12] = 4095;
+
+    uint16_t median = tdsBlockMedian(block, 16);
+    TEST_ASSERT_TRUE(median >= 1000 && median <= 1002);
+}
+
+// Moving average covers the last WINDOW block medians only
+void test_channel_moving_average()
+{
+    TdsChannelFilter filter;
+    TEST_ASSERT_FALSE(filter.hasReading());
+
+    uint16_t block[8];
+    for (int b = 0; b < TdsChannelFilter::WINDOW; b++)
+    {
+        std::fill(block, block + 8, (uint16_t)100);
+        filter.addBlock(block, 8);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 100.0, filter.getAverageCounts());
+
+    // A full window of new values replaces the old ones entirely
+    for (int b = 0; b < TdsChannelFilter::WINDOW; b++)
+    {
+        std::fill(block, block + 8, (uint16_t)200);
+        filter.addBlock(block, 8);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 200.0, filter.getAverageCounts());
+}
+
+// The probe curve and calibration factor
+void test_tds_conversion()
+{
+    // 1 V at 25 C: (133.42 - 255.86 + 857.39) / 2
+    TEST_ASSERT_FLOAT_WITHIN(0.1, 367.5, tdsFromMillivolts(1000.0f, 25.0f, calibration));
+
+    calibration.kFactor = 1.1f;
+    TEST_ASSERT_FLOAT_WITHIN(0.1, 404.2, tdsFromMillivolts(1000.0f, 25.0f, calibration));
+
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, tdsFromMillivolts(0.0f, 25.0f, calibration));
+}
+
+// Warm water conducts better, so the same voltage means less TDS
+void test_temperature_compensation()
+{
+    float at25 = tdsFromMillivolts(800.0f, 25.0f, calibration);
+    float at35 = tdsFromMillivolts(800.0f, 35.0f, calibration);
+    float at15 = tdsFromMillivolts(800.0f, 15.0f, calibration);
+    TEST_ASSERT_TRUE(at35 < at25);
+    TEST_ASSERT_TRUE(at15 > at25);
+
+    // Same reading as 25 C when the voltage is scaled by the compensation factor
+    TEST_ASSERT_FLOAT_WITHIN(0.5, at25, tdsFromMillivolts(800.0f * 1.2f, 35.0f, calibration));
+}
+
+// Offset is removed before conversion
+void test_adc_offset()
+{
+    calibration.offsetMillivolts = 100.0f;
+    TdsCalibration plain;
+    TEST_ASSERT_FLOAT_WITHIN(0.01, tdsFromMillivolts(900.0f, 25.0f, plain),
+                             tdsFromMillivolts(1000.0f, 25.0f, calibration));
+}
+
+// Benchmark: block median plus averaging throughput on the host
+void test_benchmark_filter_throughput()
+{
+    const size_t blockSize = 64;
+    const int blocks = 200000;
+    uint16_t source[blockSize];
+    uint16_t block[blockSize];
+    srand(3);
+    for (size_t i = 0; i < blockSize; i++)
+    {
+        source[i] = 1500 + rand() % 64;
+    }
+
+    TdsChannelFilter filter;
+    auto start = std::chrono::steady_clock::now();
+    for (int b = 0; b < blocks; b++)
+    {
+        std::copy(source, source + blockSize, block);
+        block[b % blockSize] = (uint16_t)(b & 0xFFF); // Vary input so work is not hoisted
+        filter.addBlock(block, blockSize);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double seconds = std::chrono::duration<double>(elapsed).count();
+
+    char message[128];
+    snprintf(message, sizeof(message), "%d blocks of %u samples in %.3f s: %.1f M samples/s (avg %.1f)",
+             blocks, (unsigned)blockSize, seconds, blocks * blockSize / seconds / 1e6, filter.getAverageCounts());
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(filter.hasReading());
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_block_median_matches_sort);
+    RUN_TEST(test_block_median_rejects_spikes);
+    RUN_TEST(test_channel_moving_average);
+    RUN_TEST(test_tds_conversion);
+    RUN_TEST(test_temperature_compensation);
+    RUN_TEST(test_adc_offset);
+    RUN_TEST(test_benchmark_filter_throughput);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
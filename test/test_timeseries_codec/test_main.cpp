@@ -0,0 +1,240 @@
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include "Checksum.h"
+#include "TimeSeriesCodec.h"
+
+uint8_t buffer[4096];
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+// Known CRC-32 check value
+void test_crc32_check_value()
+{
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, crc32("123456789", 9));
+    TEST_ASSERT_EQUAL_HEX32(crc32("123456789", 9), crc32Update(crc32("1234", 4), "56789", 5));
+}
+
+// Regular per-minute records survive the round trip
+void test_round_trip_regular_series()
+{
+    TimeSeriesEncoder encoder(buffer, sizeof(buffer));
+    for (int i = 0; i < 100; i++)
+    {
+        TEST_ASSERT_TRUE(encoder.append(1700000000 + i * 60, (i % 7) * 125));
+    }
+    size_t length = encoder.finish();
+
+    TimeSeriesDecoder decoder(buffer, length);
+    TEST_ASSERT_TRUE(decoder.isValid());
+    TEST_ASSERT_EQUAL(100, decoder.getRecordCount());
+    TEST_ASSERT_EQUAL(length, decoder.getBlockLength());
+
+    uint32_t timestamp;
+    int32_t value;
+    for (int i = 0; i < 100; i++)
+    {
+        TEST_ASSERT_TRUE(decoder.next(timestamp, value));
+        TEST_ASSERT_EQUAL_UINT32(1700000000 + i * 60, timestamp);
+        TEST_ASSERT_EQUAL_INT32((i % 7) * 125, value);
+    }
+    TEST_ASSERT_FALSE(decoder.next(timestamp, value));
+}
+
+// Irregular draw events, repeated timestamps and large value jumps
+void test_round_trip_irregular_series()
+{
+    const uint32_t timestamps[] = {5, 5, 17, 4000, 4001, 90000, 4000000000u};
+    const int32_t values[] = {0, -3, 2000000, 1, -2000000000, 2000000000, 42};
+
+    TimeSeriesEncoder encoder(buffer, sizeof(buffer));
+    for (int i = 0; i < 7; i++)
+    {
+        TEST_ASSERT_TRUE(encoder.append(timestamps[i], values[i]));
+    }
+    size_t length = encoder.finish();
+
+    TimeSeriesDecoder decoder(buffer, length);
+    uint32_t timestamp;
+    int32_t value;
+    for (int i = 0; i < 7; i++)
+    {
+        TEST_ASSERT_TRUE(decoder.next(timestamp, value));
+        TEST_ASSERT_EQUAL_UINT32(timestamps[i], timestamp);
+        TEST_ASSERT_EQUAL_INT32(values[i], value);
+    }
+}
+
+// Timestamps must not go backwards
+void test_rejects_backwards_timestamp()
+{
+    TimeSeriesEncoder encoder(buffer, sizeof(buffer));
+    TEST_ASSERT_TRUE(encoder.append(100, 1));
+    TEST_ASSERT_FALSE(encoder.append(99, 1));
+    TEST_ASSERT_EQUAL(1, encoder.getRecordCount());
+}
+
+// A full block refuses records instead of splitting them
+void test_block_full()
+{
+    uint8_t small[TIMESERIES_HEADER_SIZE + 8];
+    TimeSeriesEncoder encoder(small, sizeof(small));
+    int appended = 0;
+    while (encoder.append(1000 + appended * 60, 100000 * (appended % 2)))
+    {
+        appended++;
+    }
+    TEST_ASSERT_GREATER_THAN(0, appended);
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(small), encoder.getEncodedSize());
+
+    size_t length = encoder.finish();
+    TimeSeriesDecoder decoder(small, length);
+    TEST_ASSERT_TRUE(decoder.isValid());
+    TEST_ASSERT_EQUAL(appended, decoder.getRecordCount());
+}
+
+// Any flipped bit is caught by the CRC
+void test_corruption_detected()
+{
+    TimeSeriesEncoder encoder(buffer, sizeof(buffer));
+    for (int i = 0; i < 10; i++)
+    {
+        encoder.append(i * 60, i);
+    }
+    size_t length = encoder.finish();
+
+    for (size_t i = 0; i < length; i++)
+    {
+        buffer[i] ^= 0x10;
+        TimeSeriesDecoder decoder(buffer, length);
+        TEST_ASSERT_FALSE(decoder.isValid());
+        buffer[i] ^= 0x10;
+    }
+
+    TimeSeriesDecoder truncated(buffer, length - 1);
+    TEST_ASSERT_FALSE(truncated.isValid());
+}
+
+// Concatenated blocks decode by stepping over block lengths
+void test_stream_of_blocks()
+{
+    size_t offset = 0;
+    for (int block = 0; block < 3; block++)
+    {
+        TimeSeriesEncoder encoder(buffer + offset, sizeof(buffer) - offset);
+        for (int i = 0; i < 10; i++)
+        {
+            encoder.append(block * 600 + i * 60, block * 10 + i);
+        }
+        offset += encoder.finish();
+    }
+
+    size_t position = 0;
+    int expected = 0;
+    while (position < offset)
+    {
+        TimeSeriesDecoder decoder(buffer + position, offset - position);
+        TEST_ASSERT_TRUE(decoder.isValid());
+        uint32_t timestamp;
+        int32_t value;
+        while (decoder.next(timestamp, value))
+        {
+            TEST_ASSERT_EQUAL_INT32(expected, value);
+            TEST_ASSERT_EQUAL_UINT32(expected * 60, timestamp);
+            expected++;
+        }
+        position += decoder.getBlockLength();
+    }
+    TEST_ASSERT_EQUAL(30, expected);
+}
+
+// Benchmark: bytes per record for a realistic per-minute usage series
+void test_benchmark_bytes_per_record()
+{
+    srand(1);
+    TimeSeriesEncoder encoder(buffer, sizeof(buffer));
+    int records = 0;
+    uint32_t timestamp = 1700000000;
+    while (true)
+    {
+        // Mostly idle minutes, occasional draws of 0.2 - 2 L
+        int32_t milliliters = (rand() % 10 == 0) ? 200 + rand() % 1800 : 0;
+        if (!encoder.append(timestamp, milliliters))
+        {
+            break;
+        }
+        timestamp += 60;
+        records++;
+    }
+    size_t length = encoder.finish();
+
+    double bytesPerRecord = (double)length / records;
+    char message[96];
+    snprintf(message, sizeof(message), "%d records in %u bytes: %.2f bytes/record (raw: 8)",
+             records, (unsigned)length, bytesPerRecord);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(bytesPerRecord < 2.5);
+}
+
+// Benchmark: encode throughput
+void test_benchmark_encode_throughput()
+{
+    const int iterations = 2000;
+    int records = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        TimeSeriesEncoder encoder(buffer, sizeof(buffer));
+        for (int i = 0; i < 500; i++)
+        {
+            if (encoder.append(iteration + i * 60, (i * 37) % 1500))
+            {
+                records++;
+            }
+        }
+        encoder.finish();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double seconds = std::chrono::duration<double>(elapsed).count();
+
+    char message[96];
+    snprintf(message, sizeof(message), "Encoded %d records in %.3f s: %.1f M records/s",
+             records, seconds, records / seconds / 1e6);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(iterations * 500, records);
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_crc32_check_value);
+    RUN_TEST(test_round_trip_regular_series);
+    RUN_TEST(test_round_trip_irregular_series);
+    RUN_TEST(test_rejects_backwards_timestamp);
+    RUN_TEST(test_block_full);
+    RUN_TEST(test_corruption_detected);
+    RUN_TEST(test_stream_of_blocks);
+    RUN_TEST(test_benchmark_bytes_per_record);
+    RUN_TEST(test_benchmark_encode_throughput);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
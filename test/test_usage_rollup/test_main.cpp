@@ -0,0 +1,189 @@
+#include <unity.h>
+#include <string.h>
+#include "UsageRollup.h"
+
+UsageRollup *rollup;
+
+// 2024-03-10 12:00:00 UTC
+const uint32_t BASE_TIME = 1710072000;
+
+void setUp(void)
+{
+    rollup = new UsageRollup();
+}
+
+void tearDown(void)
+{
+    delete rollup;
+}
+
+// Usage in the same minute accumulates in every tier
+void test_usage_accumulates_in_all_tiers()
+{
+    rollup->addUsage(250, BASE_TIME);
+    rollup->addUsage(750, BASE_TIME + 30);
+
+    TEST_ASSERT_EQUAL_UINT32(1000, rollup->getBucket(RollupTier::MINUTE, 0, BASE_TIME + 30));
+    TEST_ASSERT_EQUAL_UINT32(1000, rollup->getBucket(RollupTier::HOUR, 0, BASE_TIME + 30));
+    TEST_ASSERT_EQUAL_UINT32(1000, rollup->getBucket(RollupTier::DAY, 0, BASE_TIME + 30));
+    TEST_ASSERT_EQUAL_UINT32(1000, rollup->getBucket(RollupTier::MONTH, 0, BASE_TIME + 30));
+    TEST_ASSERT_EQUAL(1, rollup->getLifetimeLiters());
+}
+
+// Range queries sum the newest buckets and treat idle periods as zero
+void test_range_query_across_minutes()
+{
+    rollup->addUsage(100, BASE_TIME);
+    rollup->addUsage(200, BASE_TIME + 60);
+    rollup->addUsage(300, BASE_TIME + 180); // One idle minute in between
+
+    uint32_t now = BASE_TIME + 180;
+    TEST_ASSERT_EQUAL_UINT32(300, rollup->getRange(RollupTier::MINUTE, 1, now));
+    TEST_ASSERT_EQUAL_UINT32(300, rollup->getRange(RollupTier::MINUTE, 2, now));
+    TEST_ASSERT_EQUAL_UINT32(500, rollup->getRange(RollupTier::MINUTE, 3, now));
+    TEST_ASSERT_EQUAL_UINT32(600, rollup->getRange(RollupTier::MINUTE, 60, now));
+
+    // Ten minutes later without usage the newest minute is empty
+    TEST_ASSERT_EQUAL_UINT32(0, rollup->getRange(RollupTier::MINUTE, 5, now + 600));
+    TEST_ASSERT_EQUAL_UINT32(600, rollup->getRange(RollupTier::HOUR, 1, now + 600));
+}
+
+// Minute tier only keeps the last hour
+void test_minute_tier_wraps()
+{
+    for (uint32_t m = 0; m < 90; m++)
+    {
+        rollup->addUsage(10, BASE_TIME + m * 60);
+    }
+
+    uint32_t now = BASE_TIME + 89 * 60;
+    TEST_ASSERT_EQUAL_UINT32(600, rollup->getRange(RollupTier::MINUTE, 60, now));
+    TEST_ASSERT_EQUAL_UINT32(900, rollup->getRange(RollupTier::DAY, 1, now));
+    TEST_ASSERT_EQUAL_UINT32(0, rollup->getBucket(RollupTier::MINUTE, 60, now));
+}
+
+// A gap longer than the whole tier clears it
+void test_long_gap_clears_tier()
+{
+    rollup->addUsage(500, BASE_TIME);
+    rollup->addUsage(100, BASE_TIME + 3 * 86400);
+
+    uint32_t now = BASE_TIME + 3 * 86400;
+    TEST_ASSERT_EQUAL_UINT32(100, rollup->getRange(RollupTier::MINUTE, 60, now));
+    TEST_ASSERT_EQUAL_UINT32(100, rollup->getRange(RollupTier::HOUR, 48, now));
+    TEST_ASSERT_EQUAL_UINT32(600, rollup->getRange(RollupTier::DAY, 90, now));
+}
+
+// Months follow the calendar, not fixed 30 day blocks
+void test_calendar_months()
+{
+    // 2024-01-31 23:00 UTC and 2024-02-01 01:00 UTC
+    rollup->addUsage(1000, 1706742000);
+    rollup->addUsage(2000, 1706749200);
+
+    TEST_ASSERT_EQUAL_UINT32(2000, rollup->getBucket(RollupTier::MONTH, 0, 1706749200));
+    TEST_ASSERT_EQUAL_UINT32(1000, rollup->getBucket(RollupTier::MONTH, 1, 1706749200));
+    TEST_ASSERT_EQUAL_UINT32(2024 * 12 + 1, UsageRollup::periodOf(RollupTier::MONTH, 1706749200));
+}
+
+// Checkpoint round trip restores every tier
+void test_checkpoint_round_trip()
+{
+    rollup->addUsage(1234, BASE_TIME);
+    rollup->addUsage(4321, BASE_TIME + 7200);
+
+    uint8_t buffer[1024];
+    TEST_ASSERT_TRUE(UsageRollup::getCheckpointSize() <= sizeof(buffer));
+    size_t length = rollup->saveCheckpoint(buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(UsageRollup::getCheckpointSize(), length);
+
+    UsageRollup restored;
+    TEST_ASSERT_TRUE(restored.restoreCheckpoint(buffer, length));
+    uint32_t now = BASE_TIME + 7200;
+    TEST_ASSERT_EQUAL_UINT32(4321, restored.getRange(RollupTier::HOUR, 1, now));
+    TEST_ASSERT_EQUAL_UINT32(5555, restored.getRange(RollupTier::HOUR, 48, now));
+    TEST_ASSERT_TRUE(rollup->getLifetimeMilliliters() == restored.getLifetimeMilliliters());
+
+    // Corrupted image is rejected
+    buffer[0] ^= 0xFF;
+    TEST_ASSERT_FALSE(restored.restoreCheckpoint(buffer, length));
+    TEST_ASSERT_FALSE(restored.restoreCheckpoint(buffer, length - 1));
+}
+
+// Usage before the clock is set waits for the first real period
+void test_usage_held_until_clock_set()
+{
+    rollup->addUsage(300, UsageRollup::UNKNOWN_TIME);
+    rollup->addUsage(200, UsageRollup::UNKNOWN_TIME);
+    TEST_ASSERT_EQUAL_UINT32(500, rollup->getPendingMilliliters());
+    TEST_ASSERT_TRUE(rollup->getLifetimeMilliliters() == 500);
+    TEST_ASSERT_EQUAL_UINT32(0, rollup->getRange(RollupTier::MONTH, 24, BASE_TIME));
+
+    // The pending volume survives a checkpoint
+    uint8_t buffer[1024];
+    size_t length = rollup->saveCheckpoint(buffer, sizeof(buffer));
+    UsageRollup restored;
+    TEST_ASSERT_TRUE(restored.restoreCheckpoint(buffer, length));
+    TEST_ASSERT_EQUAL_UINT32(500, restored.getPendingMilliliters());
+
+    restored.addUsage(100, BASE_TIME);
+    TEST_ASSERT_EQUAL_UINT32(0, restored.getPendingMilliliters());
+    TEST_ASSERT_EQUAL_UINT32(600, restored.getRange(RollupTier::MINUTE, 1, BASE_TIME));
+    TEST_ASSERT_EQUAL_UINT32(600, restored.getRange(RollupTier::DAY, 1, BASE_TIME));
+    TEST_ASSERT_TRUE(restored.getLifetimeMilliliters() == 600);
+}
+
+// Checkpoints written before the pending field are still read
+void test_checkpoint_version_1()
+{
+    rollup->addUsage(1234, BASE_TIME);
+    uint8_t buffer[1024];
+    size_t length = rollup->saveCheckpoint(buffer, sizeof(buffer));
+
+    // A v1 image is the same without the 4-byte pending field after the lifetime
+    uint8_t old[1024];
+    uint16_t version = 1;
+    memcpy(old, buffer, 16);
+    memcpy(old + 4, &version, 2);
+    memcpy(old + 16, buffer + 20, length - 20);
+
+    UsageRollup restored;
+    TEST_ASSERT_TRUE(restored.restoreCheckpoint(old, length - 4));
+    TEST_ASSERT_EQUAL_UINT32(1234, restored.getRange(RollupTier::HOUR, 1, BASE_TIME));
+    TEST_ASSERT_EQUAL_UINT32(0, restored.getPendingMilliliters());
+    TEST_ASSERT_FALSE(restored.restoreCheckpoint(old, length));
+}
+
+// The documented RAM budget holds
+void test_ram_budget()
+{
+    TEST_ASSERT_TRUE(sizeof(UsageRollup) < 1024);
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_usage_accumulates_in_all_tiers);
+    RUN_TEST(test_range_query_across_minutes);
+    RUN_TEST(test_minute_tier_wraps);
+    RUN_TEST(test_long_gap_clears_tier);
+    RUN_TEST(test_calendar_months);
+    RUN_TEST(test_checkpoint_round_trip);
+    RUN_TEST(test_usage_held_until_clock_set);
+    RUN_TEST(test_checkpoint_version_1);
+    RUN_TEST(test_ram_budget);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}
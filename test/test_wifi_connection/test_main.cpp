@@ -0,0 +1,290 @@
+#include <unity.h>
+#include <string.h>
+#include "WiFiConnection.h"
+
+// Scripted radio: the test decides what each attempt leads to
+class MockWiFiDriver : public WiFiDriver
+{
+public:
+    bool credentials = true;
+    WiFiLinkStatus link = WiFiLinkStatus::DISCONNECTED;
+    bool portalRunning = false;
+    bool portalSaves = false; // Next processPortal() reports new credentials
+    int connectCalls = 0;
+    int disconnectCalls = 0;
+    int portalStarts = 0;
+    bool lastHadBssid = false;
+    int32_t lastChannel = 0;
+    uint8_t apBssid[6] = {0x24, 0x5A, 0x4C, 0x10, 0x20, 0x30};
+    int32_t apChannel = 6;
+
+    bool hasCredentials() override { return credentials; }
+    void connect(const uint8_t *bssid, int32_t channel) override
+    {
+        connectCalls++;
+        lastHadBssid = bssid != nullptr;
+        lastChannel = channel;
+        link = WiFiLinkStatus::DISCONNECTED;
+    }
+    void disconnect() override
+    {
+        disconnectCalls++;
+        link = WiFiLinkStatus::DISCONNECTED;
+    }
+    WiFiLinkStatus getLinkStatus() override { return link; }
+    bool getAccessPoint(uint8_t *bssid, int32_t &channel) override
+    {
+        memcpy(bssid, apBssid, 6);
+        channel = apChannel;
+        return link == WiFiLinkStatus::CONNECTED;
+    }
+    void startPortal() override
+    {
+        portalRunning = true;
+        portalStarts++;
+    }
+    bool processPortal() override
+    {
+        bool saved = portalSaves;
+        portalSaves = false;
+        if (saved)
+        {
+            credentials = true;
+        }
+        return saved;
+    }
+    void stopPortal() override { portalRunning = false; }
+};
+
+MockWiFiDriver *radio;
+WiFiConnection *connection;
+
+void setUp(void)
+{
+    radio = new MockWiFiDriver();
+    connection = new WiFiConnection(*radio, 12345);
+}
+
+void tearDown(void)
+{
+    delete connection;
+    delete radio;
+}
+
+// Fails the current attempt and returns the backoff it chose
+unsigned long failAttempt(unsigned long &now)
+{
+    radio->link = WiFiLinkStatus::FAILED;
+    connection->update(now);
+    TEST_ASSERT_EQUAL(WiFiConnectionState::WAITING, connection->getState());
+    unsigned long delay = connection->getNextAttempt() - now;
+    now = connection->getNextAttempt();
+    connection->update(now); // Starts the next attempt
+    return delay;
+}
+
+// Saved credentials: begin() starts an attempt and returns at once
+void test_connects_with_saved_credentials()
+{
+    connection->begin(0);
+    TEST_ASSERT_EQUAL(WiFiConnectionState::CONNECTING, connection->getState());
+    TEST_ASSERT_EQUAL(1, radio->connectCalls);
+    TEST_ASSERT_FALSE(radio->lastHadBssid); // Nothing cached: scan
+
+    radio->link = WiFiLinkStatus::CONNECTED;
+    connection->update(2000);
+    TEST_ASSERT_TRUE(connection->isConnected());
+    TEST_ASSERT_EQUAL(6, connection->getCachedChannel());
+    TEST_ASSERT_EQUAL_UINT32(1, connection->getCacheChanges());
+    TEST_ASSERT_FALSE(radio->portalRunning);
+}
+
+// Backoff doubles up to the cap, with jitter inside [delay / 2, delay]
+void test_exponential_backoff_with_jitter()
+{
+    WiFiConnectionConfig config;
+    config.portalAfterFailures = 100;
+    connection->setConfig(config);
+    unsigned long now = 0;
+    connection->begin(now);
+
+    unsigned long expected = 1000;
+    bool jittered = false;
+    for (int i = 0; i < 12; i++)
+    {
+        unsigned long delay = failAttempt(now);
+        TEST_ASSERT_TRUE(delay >= expected / 2);
+        TEST_ASSERT_TRUE(delay <= expected);
+        if (delay != expected && delay != expected / 2)
+        {
+            jittered = true;
+        }
+        expected = expected * 2 > config.backoffMaxMs ? config.backoffMaxMs : expected * 2;
+    }
+    TEST_ASSERT_TRUE(jittered);
+    TEST_ASSERT_EQUAL(12, connection->getFailures());
+    TEST_ASSERT_EQUAL(13, radio->connectCalls);
+}
+
+// Two devices with different seeds do not retry in step
+void test_jitter_differs_between_devices()
+{
+    MockWiFiDriver otherRadio;
+    WiFiConnection other(otherRadio, 987654);
+    unsigned long now = 0, otherNow = 0;
+    connection->begin(0);
+    other.begin(0);
+
+    int differences = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        unsigned long delay = failAttempt(now);
+        otherRadio.link = WiFiLinkStatus::FAILED;
+        other.update(otherNow);
+        unsigned long otherDelay = other.getNextAttempt() - otherNow;
+        otherNow = other.getNextAttempt();
+        other.update(otherNow);
+        if (delay != otherDelay)
+        {
+            differences++;
+        }
+    }
+    TEST_ASSERT_TRUE(differences > 0);
+}
+
+// An attempt that never completes times out instead of waiting forever
+void test_attempt_timeout()
+{
+    connection->begin(0);
+    connection->update(14999);
+    TEST_ASSERT_EQUAL(WiFiConnectionState::CONNECTING, connection->getState());
+    connection->update(15000);
+    TEST_ASSERT_EQUAL(WiFiConnectionState::WAITING, connection->getState());
+    TEST_ASSERT_EQUAL(1, radio->disconnectCalls);
+}
+
+// A drop reconnects at once on the cached access point; if that fails, scan
+void test_fast_reconnect_then_scan()
+{
+    connection->begin(0);
+    radio->link = WiFiLinkStatus::CONNECTED;
+    connection->update(1000);
+
+    radio->link = WiFiLinkStatus::DISCONNECTED;
+    connection->update(60000);
+    TEST_ASSERT_EQUAL(WiFiConnectionState::CONNECTING, connection->getState());
+    TEST_ASSERT_TRUE(radio->lastHadBssid);
+    TEST_ASSERT_EQUAL(6, radio->lastChannel);
+
+    unsigned long now = 60000;
+    failAttempt(now); // The router moved channel
+    TEST_ASSERT_FALSE(radio->lastHadBssid);
+
+    radio->apChannel = 11;
+    radio->link = WiFiLinkStatus::CONNECTED;
+    connection->update(now + 100);
+    TEST_ASSERT_EQUAL(11, connection->getCachedChannel());
+    TEST_ASSERT_EQUAL_UINT32(2, connection->getCacheChanges());
+}
+
+// A cache restored at boot is used for the first attempt
+void test_boot_uses_restored_cache()
+{
+    const uint8_t bssid[6] = {1, 2, 3, 4, 5, 6};
+    connection->setCachedAccessPoint(bssid, 3);
+    connection->begin(0);
+    TEST_ASSERT_TRUE(radio->lastHadBssid);
+    TEST_ASSERT_EQUAL(3, radio->lastChannel);
+}
+
+// Repeated failures open the portal without stopping the retries
+void test_portal_after_failures()
+{
+    unsigned long now = 0;
+    connection->begin(now);
+    failAttempt(now);
+    failAttempt(now);
+    TEST_ASSERT_FALSE(radio->portalRunning);
+    failAttempt(now);
+    TEST_ASSERT_TRUE(connection->isPortalOpen());
+    TEST_ASSERT_EQUAL(WiFiConnectionState::CONNECTING, connection->getState()); // Still retrying
+
+    radio->link = WiFiLinkStatus::CONNECTED;
+    connection->update(now + 10);
+    TEST_ASSERT_FALSE(radio->portalRunning); // Closed on connect
+}
+
+// With credentials the portal closes after its timeout, and reopens after
+// another run of failures
+void test_portal_timeout()
+{
+    WiFiConnectionConfig config;
+    config.attemptTimeoutMs = 1000000; // Keep the attempt pending through the window
+    config.portalAfterFailures = 1;
+    config.portalTimeoutMs = 60000;
+    connection->setConfig(config);
+    unsigned long now = 0;
+    connection->begin(now);
+    failAttempt(now); // Portal opens at 0
+    for (unsigned long t = now; t < 60000; t += 500)
+    {
+        connection->update(t);
+        TEST_ASSERT_TRUE(radio->portalRunning);
+    }
+    connection->update(60000);
+    TEST_ASSERT_FALSE(radio->portalRunning);
+
+    radio->link = WiFiLinkStatus::FAILED;
+    connection->update(60500);
+    TEST_ASSERT_TRUE(radio->portalRunning);
+    TEST_ASSERT_EQUAL(2, radio->portalStarts);
+}
+
+// No credentials: the portal stays up until it saves some, then we connect
+void test_setup_portal_without_credentials()
+{
+    radio->credentials = false;
+    connection->begin(0);
+    TEST_ASSERT_EQUAL(WiFiConnectionState::NO_CREDENTIALS, connection->getState());
+    TEST_ASSERT_TRUE(radio->portalRunning);
+    connection->update(3600000);
+    TEST_ASSERT_TRUE(radio->portalRunning);
+    TEST_ASSERT_EQUAL(0, radio->connectCalls);
+
+    radio->portalSaves = true;
+    connection->update(3600100);
+    TEST_ASSERT_EQUAL(WiFiConnectionState::CONNECTING, connection->getState());
+    TEST_ASSERT_EQUAL(1, radio->connectCalls);
+    radio->link = WiFiLinkStatus::CONNECTED;
+    connection->update(3601000);
+    TEST_ASSERT_TRUE(connection->isConnected());
+    TEST_ASSERT_FALSE(radio->portalRunning);
+}
+
+void setup()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(test_connects_with_saved_credentials);
+    RUN_TEST(test_exponential_backoff_with_jitter);
+    RUN_TEST(test_jitter_differs_between_devices);
+    RUN_TEST(test_attempt_timeout);
+    RUN_TEST(test_fast_reconnect_then_scan);
+    RUN_TEST(test_boot_uses_restored_cache);
+    RUN_TEST(test_portal_after_failures);
+    RUN_TEST(test_portal_timeout);
+    RUN_TEST(test_setup_portal_without_credentials);
+
+    UNITY_END();
+}
+
+void loop()
+{
+    // Empty
+}
+
+int main()
+{
+    setup();
+    return 0;
+}